@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+// The device side of BLE OTA for ble_ota_upload.py --stub, so the uploader can be run without hardware.
+//
+// Runs OtaReceiver natively. Each write the uploader makes comes in on stdin as a little endian 16 bit length and the
+// bytes, and each notification goes out on stdout the same way. The writer task is emulated by flushing every full
+// buffer after each write. ble_ota_upload.py builds and starts it; by hand:
+//
+//   c++ -std=c++11 -Ilib/SS2K/include ble_ota_stub.cpp lib/SS2K/src/OtaReceiver.cpp -o ble_ota_stub
+//   ble_ota_stub flash.bin [dropEvery]
+//
+// What reaches flash is written to flash.bin. dropEvery loses every Nth DATA packet, except the one that completes the
+// image, to exercise the NAK and resend path. Exits 0 once an image is verified.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "OtaReceiver.h"
+
+static OtaReceiver receiver;
+
+static bool readWrite(std::vector<uint8_t> &data) {
+  uint8_t header[2];
+  if (fread(header, 1, 2, stdin) != 2) {
+    return false;
+  }
+  data.resize(header[0] | (header[1] << 8));
+  return data.empty() || (fread(&data[0], 1, data.size(), stdin) == data.size());
+}
+
+static void notify(const uint8_t *reply, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  uint8_t header[2] = {(uint8_t)(length & 0xFF), (uint8_t)(length >> 8)};
+  fwrite(header, 1, 2, stdout);
+  fwrite(reply, 1, length, stdout);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s flash.bin [dropEvery]\n", argv[0]);
+    return 2;
+  }
+  size_t dropEvery = (argc > 2) ? strtoul(argv[2], NULL, 10) : 0;
+  std::vector<uint8_t> flash;
+  std::vector<uint8_t> data;
+  uint8_t reply[16];
+  size_t replyLength;
+  uint32_t now        = 0;
+  size_t dataPackets  = 0;
+  uint32_t flashToken = 0;
+
+  while (readWrite(data)) {
+    now += 5;
+    if (data.empty()) {
+      continue;
+    }
+    if ((data[0] == OtaReceiver::OP_DATA) && (dropEvery != 0) && (++dataPackets % dropEvery == 0) && receiver.isActive() &&
+        (receiver.getStats().bytesReceived + data.size() - 3 < receiver.getSize())) {
+      continue;
+    }
+    receiver.onPacket(data.data(), data.size(), now, reply, &replyLength);
+    notify(reply, replyLength);
+
+    size_t length;
+    uint32_t token;
+    const uint8_t *buffer;
+    while ((buffer = receiver.nextFlush(&length, &token)) != nullptr) {
+      if (token != flashToken) {
+        flash.clear();  // A new image, not a resume
+        flashToken = token;
+      }
+      flash.insert(flash.end(), buffer, buffer + length);
+      receiver.flushed(token, 1000, reply, &replyLength);
+      notify(reply, replyLength);
+    }
+    if (receiver.isDrained()) {
+      bool verified = receiver.finish(reply, &replyLength);
+      notify(reply, replyLength);
+      FILE *out = fopen(argv[1], "wb");
+      if (out != NULL) {
+        fwrite(flash.data(), 1, flash.size(), out);
+        fclose(out);
+      }
+      fprintf(stderr, "Stub: %u bytes, %u packets, %u naks, %s\n", (unsigned)flash.size(), (unsigned)receiver.getStats().packets,
+              (unsigned)receiver.getStats().naks, verified ? "verified" : "rejected");
+      return verified ? 0 : 1;
+    }
+  }
+  return 1;
+}
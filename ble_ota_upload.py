@@ -0,0 +1,233 @@
+"""Upload firmware to a SmartSpin2k over BLE using the windowed OTA protocol.
+
+    python ble_ota_upload.py firmware.bin                       first SmartSpin2k found
+    python ble_ota_upload.py --address AA:BB:CC:DD:EE:FF out.patch
+    python ble_ota_upload.py --stub --drop 17 firmware.bin      no hardware, see ble_ota_stub.cpp
+
+The image can be a plain firmware.bin or a patch made with firmware_patch.py. A dropped connection is
+resumed from what the device last acknowledged. See lib/SS2K/include/OtaReceiver.h for the protocol.
+Needs bleak (pip install bleak), except with --stub, which needs a C++ compiler instead.
+"""
+
+import argparse
+import asyncio
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+try:
+    from bleak import BleakClient, BleakScanner
+    from bleak.exc import BleakError
+except ImportError:  # Only --stub works without it
+    BleakClient = BleakScanner = None
+    BleakError = OSError
+
+SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+TX_UUID = "62ec0272-3ec5-11eb-b378-0242ac130003"
+OTA_UUID = "62ec0272-3ec5-11eb-b378-0242ac130005"
+
+OP_BEGIN = 0x01
+OP_DATA = 0x02
+OP_END = 0x03
+
+REPLY_BEGIN = 0x81
+REPLY_ACK = 0x82
+REPLY_END = 0x83
+REPLY_NAK = 0x8F
+
+STATUS_BUSY = 0x01
+STATUS_NAMES = {0: "ok", 1: "busy", 2: "sequence", 3: "crc", 4: "flash", 5: "bad packet", 6: "too large", 7: "patch"}
+
+REPLY_TIMEOUT = 10  # Seconds without an ack before the connection is treated as lost
+BUSY_WAIT = 0.05  # Seconds to give the device's flash writer after it ran out of buffers
+RECONNECT_ATTEMPTS = 5
+
+
+class Upload:
+    def __init__(self, image):
+        self.image = image
+        self.crc = zlib.crc32(image) & 0xFFFFFFFF
+        self.window = 1
+        self.next_seq = 0
+        self.acked_seq = 0xFFFF
+        self.send_offset = 0
+        self.acked_offset = 0
+        self.end_status = None
+        self.busy = False
+        self.begun = asyncio.Event()
+        self.changed = asyncio.Event()
+
+    def begin_packet(self):
+        return struct.pack("<BII", OP_BEGIN, len(self.image), self.crc)
+
+    def on_reply(self, _, data):
+        data = bytes(data)
+        if data[0] == REPLY_BEGIN:
+            _, status, offset, window, _ = struct.unpack("<BBIBH", data[:9])
+            self.window = window
+            self.next_seq = 0
+            self.acked_seq = 0xFFFF
+            self.send_offset = self.acked_offset = offset
+            self.begun.set()
+        elif data[0] == REPLY_ACK:
+            _, seq, received = struct.unpack("<BHI", data[:7])
+            self.acked_seq = seq
+            self.acked_offset = received
+        elif data[0] == REPLY_NAK:
+            _, status, expected, received = struct.unpack("<BBHI", data[:8])
+            # Everything after the gap was ignored, resend from there.
+            self.next_seq = expected
+            self.acked_seq = (expected - 1) & 0xFFFF
+            self.send_offset = self.acked_offset = received
+            self.busy = status == STATUS_BUSY
+            if not self.busy:
+                print("\nResending from %d (%s)" % (received, STATUS_NAMES.get(status, status)))
+        elif data[0] == REPLY_END:
+            self.end_status = data[1]
+        self.changed.set()
+
+    def in_flight(self):
+        return (self.next_seq - self.acked_seq - 1) & 0xFFFF
+
+    async def run(self, client, payload):
+        self.begun.clear()
+        await client.start_notify(TX_UUID, self.on_reply)
+        await client.write_gatt_char(OTA_UUID, self.begin_packet(), response=True)
+        await asyncio.wait_for(self.begun.wait(), REPLY_TIMEOUT)
+        if self.acked_offset:
+            print("Resuming at %d bytes" % self.acked_offset)
+
+        started = time.monotonic()
+        first_offset = self.acked_offset
+        end_sent = False
+        while self.end_status is None:
+            if self.busy:
+                self.busy = False
+                await asyncio.sleep(BUSY_WAIT)
+            while (self.send_offset < len(self.image)) and (self.in_flight() < self.window):
+                chunk = self.image[self.send_offset : self.send_offset + payload]
+                packet = struct.pack("<BH", OP_DATA, self.next_seq) + chunk
+                self.next_seq = (self.next_seq + 1) & 0xFFFF
+                self.send_offset += len(chunk)
+                await client.write_gatt_char(OTA_UUID, packet, response=False)
+            if not end_sent and (self.acked_offset == len(self.image)):
+                await client.write_gatt_char(OTA_UUID, bytes([OP_END]), response=True)
+                end_sent = True
+            self.changed.clear()
+            await asyncio.wait_for(self.changed.wait(), REPLY_TIMEOUT)
+            elapsed = max(time.monotonic() - started, 0.001)
+            sys.stdout.write("\r%d/%d bytes, %d B/s" % (self.acked_offset, len(self.image), (self.acked_offset - first_offset) / elapsed))
+            sys.stdout.flush()
+        print()
+        return self.end_status
+
+
+class StubClient:
+    """Stands in for BleakClient, with ble_ota_stub running OtaReceiver natively on the other end of a pipe."""
+
+    mtu_size = 247
+
+    def __init__(self, command):
+        self.command = command
+        self.callback = None
+        self.returncode = None
+
+    async def __aenter__(self):
+        self.process = await asyncio.create_subprocess_exec(*self.command, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        self.reader = asyncio.ensure_future(self.read())
+        return self
+
+    async def __aexit__(self, *_):
+        self.process.stdin.close()
+        self.returncode = await self.process.wait()
+        await self.reader
+
+    async def start_notify(self, _, callback):
+        self.callback = callback
+
+    async def write_gatt_char(self, _, data, response=False):
+        self.process.stdin.write(struct.pack("<H", len(data)) + bytes(data))
+        await self.process.stdin.drain()
+
+    async def read(self):
+        try:
+            while True:
+                length = struct.unpack("<H", await self.process.stdout.readexactly(2))[0]
+                data = await self.process.stdout.readexactly(length)
+                if self.callback:
+                    self.callback(None, bytearray(data))
+        except asyncio.IncompleteReadError:
+            pass
+
+
+def build_stub(directory):
+    root = os.path.dirname(os.path.abspath(__file__))
+    stub = os.path.join(directory, "ble_ota_stub")
+    sources = [os.path.join(root, "ble_ota_stub.cpp"), os.path.join(root, "lib", "SS2K", "src", "OtaReceiver.cpp")]
+    subprocess.check_call([os.environ.get("CXX", "c++"), "-std=c++11", "-O2", "-I" + os.path.join(root, "lib", "SS2K", "include")] + sources + ["-o", stub])
+    return stub
+
+
+async def find(address):
+    if address:
+        return address
+    device = await BleakScanner.find_device_by_filter(lambda d, ad: SERVICE_UUID in [u.lower() for u in ad.service_uuids], timeout=15)
+    if device is None:
+        raise SystemExit("No SmartSpin2k found")
+    print("Found %s (%s)" % (device.name, device.address))
+    return device
+
+
+async def upload(connect, image):
+    session = Upload(image)
+    for _ in range(RECONNECT_ATTEMPTS):
+        try:
+            async with connect() as client:
+                # ATT write header and the 3 byte DATA header.
+                payload = max(client.mtu_size - 6, 20)
+                status = await session.run(client, payload)
+                print("Update %s" % ("complete, restarting" if status == 0 else "failed: " + STATUS_NAMES.get(status, str(status))))
+                return status == 0
+        except (asyncio.TimeoutError, BleakError, EOFError, OSError) as error:
+            print("\nConnection lost (%s), reconnecting" % (error or type(error).__name__))
+            await asyncio.sleep(1)
+    return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--address", help="device address, otherwise the first SmartSpin2k found")
+    parser.add_argument("--stub", action="store_true", help="upload to ble_ota_stub instead of a device")
+    parser.add_argument("--drop", type=int, default=0, help="with --stub, lose every Nth data packet")
+    parser.add_argument("image", help="firmware.bin or a patch from firmware_patch.py")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    if args.stub:
+        with tempfile.TemporaryDirectory() as directory:
+            flash = os.path.join(directory, "flash.bin")
+            client = StubClient([build_stub(directory), flash, str(args.drop)])
+            ok = asyncio.run(upload(lambda: client, image)) and (client.returncode == 0)
+            with open(flash, "rb") as f:
+                ok = ok and (f.read() == image)
+            print("Stub flash %s the image" % ("matches" if ok else "does not match"))
+            sys.exit(0 if ok else 1)
+
+    if BleakClient is None:
+        raise SystemExit("Needs bleak: pip install bleak")
+
+    async def run():
+        target = await find(args.address)
+        return await upload(lambda: BleakClient(target), image)
+
+    sys.exit(0 if asyncio.run(run()) else 1)
+
+
+if __name__ == "__main__":
+    main()
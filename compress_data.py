@@ -0,0 +1,42 @@
+# Precompresses the web files in data/ for the LittleFS image.
+#
+# Runs before every PlatformIO build and points the filesystem image at a staging copy of data/ where
+# text assets are replaced by name.gz. The web server serves those with Content-Encoding: gzip and an ETag
+# taken from their content, so the gzip output is kept byte for byte reproducible (no timestamp).
+Import("env")
+
+import gzip
+import hashlib
+import os
+import shutil
+
+COMPRESS = (".html", ".css", ".js", ".json", ".ico")
+KEEP_PLAIN = ("list.json",)  # Read by the online updater, not the browser
+
+source = env.subst("$PROJECT_DATA_DIR")
+staging = os.path.join(env.subst("$PROJECT_BUILD_DIR"), env.subst("$PIOENV"), "data")
+
+if os.path.isdir(source):
+    shutil.rmtree(staging, ignore_errors=True)
+    os.makedirs(staging)
+    raw_total = 0
+    packed_total = 0
+    for name in sorted(os.listdir(source)):
+        path = os.path.join(source, name)
+        if not os.path.isfile(path):
+            continue
+        with open(path, "rb") as f:
+            content = f.read()
+        raw_total += len(content)
+        if name.endswith(COMPRESS) and name not in KEEP_PLAIN:
+            packed = gzip.compress(content, 9, mtime=0)
+            if len(packed) < len(content):
+                with open(os.path.join(staging, name + ".gz"), "wb") as f:
+                    f.write(packed)
+                packed_total += len(packed)
+                print("  %-24s %6d -> %6d  %s" % (name, len(content), len(packed), hashlib.sha1(packed).hexdigest()[:8]))
+                continue
+        shutil.copyfile(path, os.path.join(staging, name))
+        packed_total += len(content)
+    print("Web assets: %d -> %d bytes" % (raw_total, packed_total))
+    env.Replace(PROJECT_DATA_DIR=staging)
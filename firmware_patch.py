@@ -0,0 +1,131 @@
+"""Build a compressed or delta firmware image for the SmartSpin2k OTA update.
+
+    python firmware_patch.py new.bin out.patch                 compress only
+    python firmware_patch.py --source old.bin new.bin out.patch  delta against the firmware on the device
+
+The device streams the patch straight into the OTA partition (see lib/SS2K/include/FirmwarePatch.h).
+A delta only applies to the exact firmware it was built from; anything else is rejected before flashing.
+"""
+
+import argparse
+import struct
+import zlib
+
+MAGIC = b"S2KP"
+VERSION = 1
+WINDOW = 4096
+OP_LITERAL = 0x01
+OP_MATCH = 0x02
+OP_COPY = 0x03
+SOURCE_BLOCK = 16  # Shortest COPY worth emitting
+MATCH_MIN = 6  # Shortest MATCH worth emitting, anything less costs more than the literal
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def match_length(a, a_pos, b, b_pos, limit):
+    length = 0
+    while length < limit and a[a_pos + length] == b[b_pos + length]:
+        length += 1
+    return length
+
+
+def encode(target, source=b""):
+    source_index = {}
+    for pos in range(0, len(source) - SOURCE_BLOCK + 1):
+        source_index.setdefault(source[pos : pos + SOURCE_BLOCK], pos)
+    window_index = {}
+
+    ops = bytearray()
+    literal = bytearray()
+    source_cursor = 0
+    i = 0
+
+    def flush_literal():
+        if literal:
+            ops.extend(bytes([OP_LITERAL]) + varint(len(literal)) + literal)
+            literal.clear()
+
+    while i < len(target):
+        remaining = len(target) - i
+        best_kind, best_len, best_arg = None, 0, 0
+
+        # Code that didn't change usually continues right where the last copy ended.
+        for candidate in (source_cursor, source_index.get(target[i : i + SOURCE_BLOCK])):
+            if candidate is None or candidate >= len(source):
+                continue
+            length = match_length(source, candidate, target, i, min(remaining, len(source) - candidate))
+            if length >= SOURCE_BLOCK and length > best_len:
+                best_kind, best_len, best_arg = OP_COPY, length, candidate
+
+        key = target[i : i + MATCH_MIN]
+        previous = window_index.get(key)
+        if previous is not None and i - previous <= WINDOW:
+            length = match_length(target, previous, target, i, remaining)
+            if length >= MATCH_MIN and length > best_len:
+                best_kind, best_len, best_arg = OP_MATCH, length, i - previous
+
+        if best_kind is None:
+            window_index[key] = i
+            literal.append(target[i])
+            i += 1
+            continue
+
+        flush_literal()
+        if best_kind == OP_COPY:
+            ops.extend(bytes([OP_COPY]) + varint(zigzag(best_arg - source_cursor)) + varint(best_len))
+            source_cursor = best_arg + best_len
+        else:
+            ops.extend(bytes([OP_MATCH]) + varint(best_arg) + varint(best_len))
+        for pos in range(i, i + best_len):
+            window_index[target[pos : pos + MATCH_MIN]] = pos
+        i += best_len
+    flush_literal()
+
+    header = MAGIC + struct.pack(
+        "<B3xIIII",
+        VERSION,
+        len(target),
+        zlib.crc32(target) & 0xFFFFFFFF,
+        len(source),
+        zlib.crc32(source) & 0xFFFFFFFF if source else 0,
+    )
+    return header + bytes(ops)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--source", help="firmware.bin currently on the device")
+    parser.add_argument("target", help="new firmware.bin")
+    parser.add_argument("output", help="patch to upload")
+    args = parser.parse_args()
+
+    with open(args.target, "rb") as f:
+        target = f.read()
+    source = b""
+    if args.source:
+        with open(args.source, "rb") as f:
+            source = f.read()
+
+    patch = encode(target, source)
+    with open(args.output, "wb") as f:
+        f.write(patch)
+    print("%s: %d -> %d bytes (%.1f%%)" % (args.output, len(target), len(patch), 100.0 * len(patch) / len(target)))
+
+
+if __name__ == "__main__":
+    main()
@@ -16,6 +16,9 @@
 #include <deque>
 #include "Main.h"
 #include "BLE_Definitions.h"
+#include <RideTotals.h>
+#include <DeviceCache.h>
+#include <PeerCache.h>
 
 #define BLE_CLIENT_LOG_TAG  "BLE_Client"
 #define BLE_COMMON_LOG_TAG  "BLE_Common"
@@ -23,6 +26,7 @@
 #define BLE_SETUP_LOG_TAG   "BLE_Setup"
 #define FMTS_SERVER_LOG_TAG "FTMS_SERVER"
 #define CUSTOM_CHAR_LOG_TAG "Custom_C"
+#define BLE_OTA_LOG_TAG     "BLE_OTA"
 
 // macros to convert different types of bytes into int The naming here sucks and
 // should be fixed.
@@ -54,6 +58,9 @@ class MyCallbacks : public NimBLECharacteristicCallbacks {
 class SpinBLEServer {
  private:
   void updateWheelAndCrankRev();
+  // Control point writes, pushed from the NimBLE host task and from replay on the main loop
+  std::queue<std::string> writeCache;
+  SemaphoreHandle_t writeCacheMutex = NULL;
 
  public:
   struct {
@@ -66,9 +73,17 @@ class SpinBLEServer {
   void setClientSubscribed(NimBLEUUID pUUID, bool subscribe);
   void notifyShift();
   double calculateSpeed();
+  // Speed reported to apps: the trainer's own if it sends one, otherwise estimated from power.
+  double getSpeed();
+  // Totals for the FTMS Indoor Bike Data. Fed with every sensor reading.
+  RideTotals rideTotals;
+  void updateRideTotals();
   void update();
-  // Queue to store writes to any of the callbacks to the server
-  std::queue<std::string> writeCache;
+  void createWriteCache();
+  // Queue a control point write for processFTMSWrite(). Safe from any task.
+  void queueWrite(const std::string &value);
+  // The oldest queued write, false when there are none.
+  bool nextWrite(std::string &value);
   SpinBLEServer() { memset(&clientSubscribed, 0, sizeof(clientSubscribed)); }
 };
 
@@ -132,7 +147,10 @@ class SpinBLEAdvertisedDevice {
   bool doConnect        = false;
   void setPostConnected(bool pc) { isPostConnected = pc; }
   bool getPostConnected() { return isPostConnected; }
+  // Taken by a device a scan found, a remembered peer waiting to be reconnected, or a connection.
+  bool isAssigned() { return (advertisedDevice != nullptr) || (connectedClientID != BLE_HS_CONN_HANDLE_NONE) || doConnect; }
   void set(BLEAdvertisedDevice *device, int id = BLE_HS_CONN_HANDLE_NONE, BLEUUID inServiceUUID = (uint16_t)0x0000, BLEUUID inCharUUID = (uint16_t)0x0000);
+  void set(NimBLEAddress address, int id, BLEUUID inServiceUUID, BLEUUID inCharUUID);
   void reset();
   void print();
   bool enqueueData(uint8_t data[25], size_t length);
@@ -158,6 +176,14 @@ class SpinBLEClient {
   long int cscCumulativeWheelRev = 0;
   double cscLastWheelEvtTime     = 0.0;
   int reconnectTries             = MAX_RECONNECT_TRIES;
+  volatile bool scanWindowOpen   = false;
+  unsigned long scanWindowEnd    = 0;
+
+  // Every device the background scan has heard, under deviceCacheMutex.
+  DeviceCache deviceCache;
+  SemaphoreHandle_t deviceCacheMutex = NULL;
+  // Peers we have subscribed to, saved in PEER_CACHE_FILENAME. Only used from the BLE client task.
+  PeerCache peerCache;
 
   BLERemoteCharacteristic *pRemoteCharacteristic = nullptr;
 
@@ -178,7 +204,14 @@ class SpinBLEClient {
   void handleBattInfo(NimBLEClient *pClient, bool updateNow);
   // Instead of using this directly, set the .doScan flag to start a scan.
   void scanProcess(int duration = DEFAULT_SCAN_DURATION);
+  // (Re)starts the continuous scan, at full duty while a requested scan is open.
+  void startScan(bool requested);
+  // Keeps the scan running around connects and updates, and publishes the found devices when a requested scan ends.
+  void maintainScan();
+  void publishFoundDevices();
   void checkBLEReconnect();
+  bool reconnectRemembered(uint8_t services, const char *name);
+  void rememberPeer(NimBLEClient *pClient, uint8_t service, NimBLERemoteService *pSvc, NimBLERemoteCharacteristic *pChr, const String &name);
   // Disconnects all devices. They will then be reconnected if scanned and preferred again.
   void reconnectAllDevices();
 
@@ -188,6 +221,9 @@ class SpinBLEClient {
 class MyAdvertisedDeviceCallback : public NimBLEAdvertisedDeviceCallbacks {
  public:
   void onResult(NimBLEAdvertisedDevice *);
+
+ private:
+  void matchDevice(NimBLEAdvertisedDevice *);
 };
 
 class MyClientCallback : public NimBLEClientCallbacks {
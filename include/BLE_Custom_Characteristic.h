@@ -11,10 +11,12 @@
 #include "BLE_Common.h"
 
 // Codes
-const uint8_t cc_read    = 0x01;  // value to request read operation
-const uint8_t cc_write   = 0x02;  // Value to request write operation
-const uint8_t cc_error   = 0xff;  // value server error/unable
-const uint8_t cc_success = 0x80;  // value for success
+const uint8_t cc_read      = 0x01;  // value to request read operation
+const uint8_t cc_write     = 0x02;  // Value to request write operation
+const uint8_t cc_bulkRead  = 0x03;  // value to request several variables in one indication
+const uint8_t cc_bulkWrite = 0x04;  // value to write several variables in one write
+const uint8_t cc_error     = 0xff;  // value server error/unable
+const uint8_t cc_success   = 0x80;  // value for success. Bulk replies are indicated as cc_success | opcode
 
 // custom characteristic codes
 const uint8_t BLE_firmwareUpdateURL     = 0x01;  // URL used to update firmware
@@ -56,6 +58,33 @@ const uint8_t BLE_scanBLE               = 0x24;  // Scan for new BLE devices
 const uint8_t BLE_firmwareVer           = 0x25;  // String of the current firmware version
 const uint8_t BLE_resetPowerTable       = 0x26;  // Delete all power table information.
 const uint8_t BLE_powerTableData        = 0x27;  // sets or requests power table data
+const uint8_t BLE_powerTableDelta       = 0x28;  // requests compressed power table changes since a version. Also pushed as the table learns.
+const uint8_t BLE_riderWeight           = 0x29;  // Rider and bike weight in kg. Used by the SIM mode road model.
+const uint8_t BLE_ergLookahead          = 0x2A;  // Upcoming ERG targets, so the knob can move before the interval starts.
+const uint8_t BLE_workout               = 0x2B;  // Upload and control a workout the SmartSpin2k runs by itself. Notifies progress.
+const uint8_t BLE_ftp                   = 0x2C;  // Functional Threshold Power in watts. Scales FTP relative workout targets.
+
+// Wire encodings used by the variable descriptor table
+const uint8_t cc_type_bool   = 0x00;  // 1 byte, 00 is false
+const uint8_t cc_type_u16    = 0x01;  // 2 bytes LSO, MSO
+const uint8_t cc_type_i16    = 0x02;  // 2 bytes LSO, MSO, two's complement
+const uint8_t cc_type_i32    = 0x03;  // 4 bytes LSO first
+const uint8_t cc_type_string = 0x04;  // Raw characters, no terminator
+const uint8_t cc_type_action = 0x05;  // Write only, no payload
+
+// Describes how one custom characteristic variable is encoded and where it lives.
+// Wire value = value * scale for numeric types.
+struct ccDescriptor {
+  uint8_t id;
+  uint8_t type;
+  float scale;
+  bool persist;  // Stored in userConfig. Saved to LittleFS and change notified by parseNemit()
+  const char *name;
+  double (*get)();                         // numeric getter, nullptr if not readable
+  void (*set)(double);                     // numeric setter or action, nullptr if not writable
+  const char *(*getString)();              // cc_type_string getter
+  void (*setString)(const String &value);  // cc_type_string setter
+};
 
 class BLE_ss2kCustomCharacteristic {
  public:
@@ -67,8 +96,17 @@ class BLE_ss2kCustomCharacteristic {
   static void notify(char _item, int tableRow = -1);
   // Notify any changed value in userConfig
   static void parseNemit();
+  // Descriptor for a variable id, nullptr if the id is not table driven.
+  static const ccDescriptor *findDescriptor(uint8_t id);
+  // Largest value that fits in one indication to every connected peer.
+  static size_t maxPayload();
 
  private:
+  static void processBulkRead(const std::string &rxValue, NimBLECharacteristic *pCharacteristic);
+  static void processBulkWrite(const std::string &rxValue, NimBLECharacteristic *pCharacteristic);
+  // Send the next chunk of the active power table transfer, if any.
+  static bool sendPowerTableChunk();
+
   BLEService *pSmartSpin2kService;
   BLECharacteristic *smartSpin2kCharacteristic;
   uint8_t ss2kCustomCharacteristicValue[3] = {0x00, 0x00, 0x00};
@@ -9,6 +9,7 @@
 
 #include <NimBLEDevice.h>
 #include "BLE_Common.h"
+#include <IndoorBikeData.h>
 
 class BLE_Fitness_Machine_Service {
  public:
@@ -26,7 +27,8 @@ class BLE_Fitness_Machine_Service {
   BLECharacteristic *fitnessMachinePowerRange;
   BLECharacteristic *fitnessMachineInclinationRange;
   BLECharacteristic *fitnessMachineTrainingStatus;
-  uint8_t ftmsIndoorBikeData[11] = {0};
+  uint8_t ftmsIndoorBikeData[IndoorBikeData::MAX_LENGTH] = {0};
+  size_t ftmsIndoorBikeDataLength                       = 0;
   bool spinDown();
   void processFTMSWrite();
 };
\ No newline at end of file
@@ -9,12 +9,14 @@
 
 #include "settings.h"
 #include "SmartSpin_parameters.h"
+#include <ErgLookahead.h>
 
 #define ERG_MODE_LOG_TAG     "ERG_Mode"
 #define ERG_MODE_LOG_CSV_TAG "ERG_Mode_CSV"
 #define POWERTABLE_LOG_TAG   "PTable"
 #define ERG_MODE_DELAY       700
 #define RETURN_ERROR         INT32_MIN
+#define ERG_LOOKAHEAD_GRACE  3000  // ms past an announced boundary to hold the knob while the app catches up
 
 class PowerEntry {
  public:
@@ -122,7 +124,7 @@ class PowerTable {
   void toLog();
 
  private:
-  unsigned long lastSaveTime     = millis();
+  uint32_t lastSaveTime          = 0;
   bool _hasBeenLoadedThisSession = false;
   TestResults testNeighbors(int i, int j, int value);
   void fillTable();
@@ -137,6 +139,7 @@ class ErgMode {
  public:
   void computeErg();
   void computeResistance();
+  static void computeSim();
   void _writeLogHeader();
   void _writeLog(float currentIncline, float newIncline, int currentSetPoint, int newSetPoint, int currentWatts, int newWatts, int currentCadence, int newCadence);
 
@@ -147,9 +150,14 @@ class ErgMode {
   int offsetMultiplier = 0;
   int resistance       = 0;
   int cadence          = 0;
+  int lookaheadWatts   = 0;  // Target the knob was sent ahead for, until the app switches to it
+  uint32_t lookaheadAt = 0;
 
   Measurement watts;
 
+  // move toward an announced target early. Returns true while holding there.
+  bool _lookAhead(int newCadence);
+
   // check if user is spinning, reset incline if user stops spinning
   bool _userIsSpinning(int cadence, float incline);
 
@@ -164,3 +172,5 @@ class ErgMode {
 };
 
 extern PowerTable* powerTable;
+extern ErgLookahead ergLookahead;
+extern SemaphoreHandle_t ergLookaheadMutex;  // Apps, the web server and workouts announce targets while ERG mode reads them
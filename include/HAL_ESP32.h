@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <hal/HAL.h>
+
+class FastAccelStepper;
+class TMC2208Stepper;
+
+// The real hardware behind hal/HAL.h.
+
+class EspClock : public Clock {
+ public:
+  uint32_t nowMs();
+  uint32_t nowUs();
+};
+
+// FastAccelStepper. Does nothing until attached, since the stepper only exists once the engine is running.
+class EspMotor : public Motor {
+ public:
+  EspMotor() : stepper(NULL), dirPin(0) {}
+  void attach(FastAccelStepper *stepper, int dirPin);
+
+  int32_t getCurrentPosition();
+  void setCurrentPosition(int32_t position);
+  int32_t getTargetPosition();
+  bool isRunning();
+  void moveTo(int32_t position);
+  void stopMove();
+  void setSpeed(uint32_t stepsPerSecond);
+  void setAcceleration(uint32_t stepsPerSec2);
+  void setHoldEnabled(bool hold);
+  void setDirection(bool direction);
+
+ private:
+  FastAccelStepper *stepper;
+  int dirPin;
+};
+
+// TMC2208 over UART. The maintenance loop, the web server and BLE all reach the driver, so every access holds mutex.
+class EspMotorDriver : public MotorDriver {
+ public:
+  explicit EspMotorDriver(TMC2208Stepper &driver) : driver(driver), mutex(NULL) {}
+  // Creates the lock and starts the UART. Call before anything else.
+  void begin();
+  // Microstepping, standstill power down and the board's current scale.
+  void applyDefaults(uint8_t pwrScaler);
+  void setCurrent(uint16_t runMa, float holdMultiplier);
+  uint16_t getCurrentScale();
+  void setStealthChop(bool enabled);
+  bool readStatus(uint32_t &status);
+
+ private:
+  TMC2208Stepper &driver;
+  SemaphoreHandle_t mutex;
+};
+
+class LittleFSFileSystem : public FileSystem {
+ public:
+  int32_t size(const char *path);
+  int32_t read(const char *path, uint32_t offset, uint8_t *buffer, size_t length);
+  bool write(const char *path, const uint8_t *data, size_t length);
+  bool append(const char *path, const uint8_t *data, size_t length);
+  bool remove(const char *path);
+};
+
+class NimBLELink : public BleLink {
+ public:
+  int connectedClients();
+  void writeControlPoint(const uint8_t *data, size_t length);
+};
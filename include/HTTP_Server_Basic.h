@@ -21,11 +21,19 @@ class HTTP_Server {
   static void handleBTScanner();
   static void handleLittleFSFile();
   static void handleIndexFile();
+  // Serve a static file from LittleFS, preferring a precompressed .gz copy. False if it doesn't exist.
+  static bool serveAsset(const String &path);
+  static bool assetExists(const String &path);
+  // Call after writing a file so stale cached or precompressed copies aren't served.
+  static void assetChanged(const String &path);
   static void settingsProcessor();
   static void handleHrSlider();
+  // Applies a JSON batch of simulator controls to rtConfig.
+  static void handleControl();
   static void FirmwareUpdate();
-  
-  static void webClientUpdate();
+
+  // Web server task. Polls the server, captive portal DNS and MDNS.
+  static void webClientUpdate(void *pvParameters);
 
   HTTP_Server() { internetConnection = false; }
 };
@@ -45,3 +53,5 @@ void stopWifi();
 
 
 extern HTTP_Server httpServer;
+extern TaskHandle_t webClientTask;
+extern volatile bool webRequestActive;  // True while the web task is inside handleClient()
@@ -14,6 +14,13 @@
 #include "boards.h"
 #include "SensorCollector.h"
 #include "SS2KLog.h"
+#include <Drivetrain.h>
+#include <PositionHealth.h>
+#include <MotionPlanner.h>
+#include <ThermalModel.h>
+#include <ShiftInput.h>
+#include <StepperControl.h>
+#include <hal/HAL.h>
 
 #define MAIN_LOG_TAG "Main"
 
@@ -21,8 +28,6 @@
 
 class SS2K {
  private:
-  uint64_t lastDebounceTime;
-  uint16_t debounceDelay;
   int lastShifterPosition;
   int shiftersHoldForScan;
   uint64_t scanDelayTime;
@@ -40,9 +45,30 @@ class SS2K {
   bool saveFlag            = false;
   bool resetDefaultsFlag   = false;
   bool resetPowerTableFlag = false;
+  bool stopTasksFlag       = false;
+  bool driverSettingsFlag  = false;  // Apply the stepper power and StealthChop settings
   bool isUpdating          = false;
+  Drivetrain drivetrain;
+  SemaphoreHandle_t drivetrainMutex;  // The web server changes the gearing while the loop shifts and reads it
+  SemaphoreHandle_t configMutex;      // Web handlers change rtConfig and userConfig while the loop's control pass reads them
+  PositionHealth positionHealth;
+  MotionPlanner motionPlanner;
+  StepperControl stepperControl;
+  ThermalModel thermalModel;
+  ThermalModel::Plan thermalPlan;  // What the driver is set to by the thermal model
+  ShiftQueue shiftQueue;           // Filled by the shifter interrupts
+  ShiftGestures shiftGestures;
+  ShiftLatency shiftToLoop;   // Button edge to shift applied
+  ShiftLatency shiftToMotor;  // Button edge to the stepper being sent the move
+  uint32_t shiftPendingUs;
+  bool shiftPending;
+  // Hardware, through hal/HAL.h so the control code can run against fakes
+  Clock *systemClock;
+  Motor *motor;  // NULL until the stepper is set up
+  MotorDriver *motorDriver;
+  FileSystem *fileSystem;
+  BleLink *bleLink;
 
-  bool IRAM_ATTR deBounce();
   static void IRAM_ATTR maintenanceLoop(void *pvParameters);
   static void IRAM_ATTR shiftUp();
   static void IRAM_ATTR shiftDown();
@@ -56,26 +82,37 @@ class SS2K {
   void updateStealthChop();
   void updateStepperSpeed(int speed = 0);
   void checkDriverTemperature();
+  void checkDriverStatus();
   void motorStop(bool releaseTension = false);
+  void processShifts();
   void FTMSModeShiftModifier();
   static void rxSerial(void);
+  void processAuxSerial();
   void txSerial();
   void pelotonConnected();
 
-  SS2K() {
+  SS2K() : motionPlanner(DEFAULT_STEPPER_SPEED, STEPPER_ACCELERATION), shiftGestures(DEBOUNCE_DELAY * 1000UL), stepperControl(motionPlanner, positionHealth) {
     targetPosition      = 0;
     currentPosition     = 0;
     stepperIsRunning    = false;
     externalControl     = false;
     syncMode            = false;
-    lastDebounceTime    = 0;
-    debounceDelay       = DEBOUNCE_DELAY;
     lastShifterPosition = 0;
     shiftersHoldForScan = SHIFTERS_HOLD_FOR_SCAN;
     scanDelayTime       = 10000;
     scanDelayStart      = 0;
     pelotonIsConnected  = false;
     txCheck             = TX_CHECK_INTERVAL;
+    drivetrainMutex     = NULL;
+    configMutex         = NULL;
+    thermalPlan         = thermalModel.schedule(THROTTLE_TEMP, DEFAULT_STEPPER_POWER, STEALTHCHOP);
+    shiftPendingUs      = 0;
+    shiftPending        = false;
+    systemClock         = NULL;
+    motor               = NULL;
+    motorDriver         = NULL;
+    fileSystem          = NULL;
+    bleLink             = NULL;
   }
 };
 
@@ -7,8 +7,14 @@
 #include <NimBLEDevice.h>
 #include <Arduino.h>
 #include <Main.h>
+#include <sensors/SensorFusion.h>
 
 #pragma once
 
+extern SensorFusion sensorFusion;
 
-void collectAndSet(NimBLEUUID charUUID, NimBLEUUID serviceUUID, NimBLEAddress address, uint8_t *pData, size_t length);
\ No newline at end of file
+void collectAndSet(NimBLEUUID charUUID, NimBLEUUID serviceUUID, NimBLEAddress address, uint8_t *pData, size_t length);
+// Fields at least one sensor has reported within SensorFusion::STALE_MS.
+uint8_t getFreshSensorFields();
+// Each sensor the fusion knows, with the fields it is selected for.
+String getSensorFusionJSON();
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <SessionCapture.h>
+#include "settings.h"
+
+#define CAPTURE_LOG_TAG  "Capture"
+#define CAPTURE_FILENAME "/capture.bin"
+
+// Records a ride's BLE traffic and shifts to CAPTURE_FILENAME, and plays a capture back through the same code paths.
+//
+// Records are encoded straight into a RAM buffer, under a mutex because control point writes arrive on the NimBLE
+// task. loop() swaps the buffers and appends the full one to the file, so a slow flash write never holds up BLE.
+// Recording stops by itself at CAPTURE_MAX_SIZE.
+// Replay also runs from loop(), so replayed notifications reach collectAndSet() on the task that normally calls it.
+class SessionRecorder {
+ public:
+  void begin();
+
+  bool startRecording();
+  void stopRecording();
+  // Feeds CAPTURE_FILENAME back in on its original timing. Live sensors keep working, so unpair them first.
+  // Nothing is written to a connected trainer's control point while it runs.
+  bool startReplay();
+  void stopReplay();
+  // Call from the maintenance loop.
+  void loop();
+
+  void recordNotify(NimBLEUUID charUUID, uint64_t address, const uint8_t *data, size_t length);
+  void recordControlPoint(const uint8_t *data, size_t length);
+  void recordShift(int8_t delta);
+  // What the firmware made of the last notification.
+  void recordState();
+
+  bool isRecording() const { return recording; }
+  bool isReplaying() const { return replaying; }
+  String getStatusJSON();
+
+ private:
+  void flush(bool force);
+  // Record writing, under mutex
+  uint32_t elapsed();
+  uint8_t *tail() { return buffers[active] + buffered[active]; }
+  size_t space() const { return CAPTURE_BUFFER_SIZE - buffered[active]; }
+  void commit(size_t length);
+
+  bool loadNextRecord();
+  void replayRecord(const SessionCapture::Record &record);
+
+  uint8_t buffers[2][CAPTURE_BUFFER_SIZE];
+  size_t buffered[2]          = {0, 0};
+  uint8_t active              = 0;  // Buffer the record* calls fill
+  uint32_t written            = 0;  // Bytes in the file
+  uint32_t records            = 0;
+  uint32_t dropped            = 0;  // Records that didn't fit in the buffer or the file
+  uint32_t startMs            = 0;
+  uint32_t lastFlush          = 0;
+  volatile bool recording     = false;
+  SemaphoreHandle_t mutex     = NULL;
+  SemaphoreHandle_t fileMutex = NULL;  // Held for file access, which the buffer mutex mustn't wait on
+
+  uint8_t replayBuffer[SessionCapture::MAX_RECORD_SIZE];
+  SessionCapture::Record next;
+  uint32_t replayOffset   = 0;
+  uint32_t replayed       = 0;
+  volatile bool replaying = false;
+};
+
+extern SessionRecorder sessionRecorder;
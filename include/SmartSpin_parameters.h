@@ -14,6 +14,7 @@
 #endif
 
 #include "settings.h"
+#include <RoadModel.h>
 
 #define CONFIG_LOG_TAG "Config"
 
@@ -65,6 +66,10 @@ class RuntimeParameters {
   int minResistance    = -DEFAULT_RESISTANCE_RANGE;
   int maxResistance    = DEFAULT_RESISTANCE_RANGE;
   bool simTargetWatts  = false;
+  float windSpeed      = 0.0;
+  float crr            = RoadModel::DEFAULT_CRR;
+  float cw             = RoadModel::DEFAULT_CW;
+  int32_t simPosition  = INT32_MIN;  // RETURN_ERROR until the power table has an answer
 
  public:
   Measurement watts;
@@ -83,7 +88,13 @@ class RuntimeParameters {
   void setSimulatedSpeed(float spd) { simulatedSpeed = spd; }
   float getSimulatedSpeed() { return simulatedSpeed; }
 
-  void setFTMSMode(uint8_t mde) { FTMSMode = mde; }
+  // A power table answer only belongs to the mode that asked for it
+  void setFTMSMode(uint8_t mde) {
+    if (mde != FTMSMode) {
+      simPosition = INT32_MIN;
+    }
+    FTMSMode = mde;
+  }
   uint8_t getFTMSMode() { return FTMSMode; }
 
   void setShifterPosition(int sp) { shifterPosition = sp; }
@@ -98,6 +109,19 @@ class RuntimeParameters {
   void setSimTargetWatts(int tgt) { simTargetWatts = tgt; }
   bool getSimTargetWatts() { return simTargetWatts; }
 
+  void setWindSpeed(float ws) { windSpeed = ws; }
+  float getWindSpeed() { return windSpeed; }
+
+  void setCrr(float rr) { crr = rr; }
+  float getCrr() { return crr; }
+
+  void setCw(float wr) { cw = wr; }
+  float getCw() { return cw; }
+
+  // Stepper position the road model asks for in SIM mode, before shifting.
+  void setSimPosition(int32_t pos) { simPosition = pos; }
+  int32_t getSimPosition() { return simPosition; }
+
   void setMinResistance(int min) { minResistance = min; }
   int getMinResistance() { return minResistance; }
 
@@ -120,10 +144,16 @@ class userParameters {
   int stepperPower;
   int maxWatts;
   int minWatts;
+  int riderWeight;
+  int ftp;
+  String chainrings;
+  String cassette;
+  int wheelCircumference;
   int stepperSpeed;
   bool stepperDir;
   bool shifterDir;
   bool udpLogEnabled = false;
+  bool preferBikeSensors = false;  // Bike power and cadence ahead of a power meter
  
   bool FTMSControlPointWrite = false;
   String ssid;
@@ -188,6 +218,21 @@ class userParameters {
   void setMinWatts(int minW) { minWatts = minW; }
   int getMinWatts() { return minWatts; }
 
+  void setRiderWeight(int rw) { riderWeight = rw; }
+  int getRiderWeight() { return riderWeight; }
+
+  void setFtp(int f) { ftp = f; }
+  int getFtp() { return ftp; }
+
+  void setChainrings(String crs) { chainrings = crs; }
+  const char* getChainrings() { return chainrings.c_str(); }
+
+  void setCassette(String cst) { cassette = cst; }
+  const char* getCassette() { return cassette.c_str(); }
+
+  void setWheelCircumference(int wc) { wheelCircumference = wc; }
+  int getWheelCircumference() { return wheelCircumference; }
+
   void setStepperDir(bool sd) { stepperDir = sd; }
   bool getStepperDir() { return stepperDir; }
 
@@ -197,6 +242,9 @@ class userParameters {
   void setUdpLogEnabled(bool enabled) { udpLogEnabled = enabled; }
   bool getUdpLogEnabled() { return udpLogEnabled; }
 
+  void setPreferBikeSensors(bool prefer) { preferBikeSensors = prefer; }
+  bool getPreferBikeSensors() { return preferBikeSensors; }
+
   void setFoundDevices(String fdv) { foundDevices = fdv; }
   const char* getFoundDevices() { return foundDevices.c_str(); }
 
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Workout.h>
+
+#define WORKOUT_LOG_TAG           "Workout"
+#define WORKOUT_FILENAME          "/workout.bin"
+#define WORKOUT_PROGRESS_INTERVAL 1000  // ms between progress notifications while a workout runs
+#define WORKOUT_PROGRESS_SIZE     8
+
+// Commands written to BLE_workout, and the HTTP /workout actions that match them
+const uint8_t workout_stop   = 0x00;
+const uint8_t workout_start  = 0x01;
+const uint8_t workout_pause  = 0x02;
+const uint8_t workout_resume = 0x03;
+const uint8_t workout_load   = 0x04;  // Reload WORKOUT_FILENAME
+const uint8_t workout_chunk  = 0x10;  // <offset (2)>, <bytes>
+const uint8_t workout_commit = 0x11;  // <length (2)>. Checks the uploaded file and saves it as WORKOUT_FILENAME
+
+// Runs a Workout from its own task, so targets keep changing on time without the app.
+class WorkoutRunner {
+ public:
+  void start();
+  bool loadFromLittleFS();
+  // False if the command is unknown or can't be done in the current state.
+  bool control(uint8_t command);
+  bool receive(uint16_t offset, const uint8_t *data, size_t length);
+  bool commit(size_t length);
+  // state, step, elapsed s (2), duration s (2), target watts (2)
+  void getProgress(uint8_t *out);
+  String getProgressJSON();
+
+ private:
+  static void workoutTask(void *pvParameters);
+  uint32_t _tick(uint32_t now);
+
+  Workout workout;
+  uint8_t upload[Workout::MAX_SIZE];
+  uint16_t watts                 = 0;
+  uint32_t lastProgress          = 0;
+  SemaphoreHandle_t mutex        = NULL;
+  TaskHandle_t workoutTaskHandle = NULL;
+};
+
+extern WorkoutRunner workoutRunner;
@@ -41,6 +41,9 @@ const char* const DEFAULT_PASSWORD = "password";
 // name of the local file to save the torque table.
 #define POWER_TABLE_FILENAME "/PowerTable.txt"
 
+// name of the local file to remember the BLE peers we have connected to.
+#define PEER_CACHE_FILENAME "/peers.bin"
+
 // Default Incline Multiplier.
 // Incline multiplier is the multiple required to convert incline received from the remote client (percent grade*100)
 // into actual stepper steps that move the stepper motor. It takes 2,181.76 steps to rotate the knob 1 full revolution. with hardware version 1.
@@ -93,6 +96,18 @@ const char* const DEFAULT_PASSWORD = "password";
 // This is used to set the lower travel limit for the motor.
 #define DEFAULT_MIN_WATTS 50
 
+// Default weight of the rider and bike, kg, for SIM mode's road model.
+#define DEFAULT_RIDER_WEIGHT 85
+
+// Default Functional Threshold Power in watts. Workouts with FTP relative targets are scaled by it.
+#define DEFAULT_FTP 200
+
+// Default virtual drivetrain for SIM mode: chainrings and cassette in teeth, wheel circumference in mm.
+// Shifting walks through every pairing from easiest to hardest.
+#define DEFAULT_CHAINRINGS          "34,50"
+#define DEFAULT_CASSETTE            "11,12,13,14,15,17,19,21,23,25,28"
+#define DEFAULT_WHEEL_CIRCUMFERENCE 2127
+
 // Default Max Watts that the brake on the spin bike can absorb from the user.
 // This is used to set the upper travel limit for the motor.
 #define DEFAULT_MAX_WATTS 1400
@@ -120,8 +135,12 @@ const char* const DEFAULT_PASSWORD = "password";
 // This is used until the PowerTable has enough data to compute travel limits
 #define DEFAULT_STEPPER_TRAVEL 200000000
 
-// Default debounce delay for shifters. Increase if you have false shifts. Decrease if shifting takes too long.
-#define DEBOUNCE_DELAY 400
+// How long (ms) a shifter button must stay pressed or released to count. Increase if you have false shifts. Every press
+// is counted however quickly they follow each other, so this only adds latency.
+#define DEBOUNCE_DELAY 30
+
+// Shift-to-motor latency is only measured for shifts followed by a move within this many ms.
+#define SHIFT_LATENCY_TIMEOUT 2000
 
 // Hardware Revision check pin
 #define REV_PIN 34
@@ -249,10 +268,13 @@ const char* const DEFAULT_PASSWORD = "password";
 #endif
 
 // Max size of userconfig
-#define USERCONFIG_JSON_SIZE 1524 + DEBUG_LOG_BUFFER_SIZE
+#define USERCONFIG_JSON_SIZE 1640 + DEBUG_LOG_BUFFER_SIZE
 
 #define RUNTIMECONFIG_JSON_SIZE 512 + DEBUG_LOG_BUFFER_SIZE
 
+// Max size of a batch of simulator controls posted to /control
+#define CONTROL_JSON_SIZE 256
+
 // PowerTable Version
 #define TABLE_VERSION 4
 
@@ -277,6 +299,9 @@ const char* const DEFAULT_PASSWORD = "password";
 // How often in ms to save the power table if no new data is added and user is pedaling.
 #define POWER_TABLE_SAVE_INTERVAL 240000
 
+// Minimum time in ms between pushes of power table changes to subscribed BLE clients.
+#define POWER_TABLE_PUSH_INTERVAL 2000
+
 // Normal cadence value (used in power table and other areas)
 #define NORMAL_CAD 90
 
@@ -287,12 +312,16 @@ const char* const DEFAULT_PASSWORD = "password";
 // Increase this value if the offset for the loaded table is inaccurate.
 #define MINIMUM_RELIABLE_POSITIONS 3
 
-// Temperature of the ESP32 at which to start reducing the power output of the stepper motor driver.
+// Temperature of the ESP32 the stepper driver must stay under. The thermal model starts cutting heat a few degrees
+// before it's predicted to get there and reduces the run current only as a last resort.
 #define THROTTLE_TEMP 90
 
 // Size of the Aux Serial Buffer for Peloton
 #define AUX_BUF_SIZE 10
 
+// Peloton reads waiting for the main loop. At 19200 baud and three requests per cycle a few is plenty.
+#define AUX_QUEUE_LENGTH 8
+
 // Interrogate Peloton bike for data?
 #define PELOTON_TX true
 
@@ -305,19 +334,62 @@ const char* const DEFAULT_PASSWORD = "password";
 // Interval for polling ble battery updates
 #define BATTERY_UPDATE_INTERVAL_MILLIS 300000
 
+// RAM used to hold the most requested small web files, and the largest file worth holding.
+#define HTTP_CACHE_BUDGET   12288
+#define HTTP_CACHE_MAX_FILE 4096
+
 // Initial and web scan duration.
 #define DEFAULT_SCAN_DURATION 5
 
 // BLE automatic reconnect duration. Set this low to avoid interruption.
 #define BLE_RECONNECT_SCAN_DURATION 5
 
+// Scan interval and window in ms. The background scan listens 10% of the time, leaving the radio to connected devices.
+#define BLE_BACKGROUND_SCAN_INTERVAL 500
+#define BLE_BACKGROUND_SCAN_WINDOW 50
+#define BLE_ACTIVE_SCAN_INTERVAL 49
+#define BLE_ACTIVE_SCAN_WINDOW 33
+
+// Seconds to wait on a direct connect to a remembered peer before leaving it to the scan.
+#define BLE_DIRECT_CONNECT_TIMEOUT 2
+
+// Advertised devices NimBLE may hold before the background scan clears them.
+#define BLE_SCAN_MAX_RESULTS 40
+
+// Room for the foundDevices JSON built from the device cache.
+#define BLE_FOUND_DEVICES_SIZE 2048
+
 // Task Stack Sizes
 #define MAIN_STACK 6000
 #define BLE_CLIENT_STACK 5500
+#define OTA_WRITER_STACK 4000
+#define WEBSERVER_STACK 5000
+#define WORKOUT_STACK 3000
+
+// How often to read the stepper driver's status over UART, ms. Each read blocks the main loop for about 2ms.
+#define DRIVER_STATUS_INTERVAL 500
+
+// How often to update the driver thermal model and its current plan, ms.
+#define THERMAL_INTERVAL 1000
+
+// Log BLE firmware update progress every this many bytes written to flash.
+#define OTA_STATS_INTERVAL 65536
+
+// Legacy BLE firmware writes (512 bytes each) held for the flash writer. The update fails if the host gets further ahead than this.
+#define OTA_LEGACY_QUEUE_LENGTH 16
+
+// Session capture: largest file kept on LittleFS, and the RAM each of its two buffers takes. A buffer is written out
+// when half full or after CAPTURE_FLUSH_INTERVAL ms.
+#define CAPTURE_MAX_SIZE 65536
+#define CAPTURE_BUFFER_SIZE 1024
+#define CAPTURE_FLUSH_INTERVAL 1000
 
 // Uncomment to enable stack size debugging info
 // #define DEBUG_STACK
 
+// Uncomment to log how late the main loop runs (average and worst interval, overall and while serving web requests)
+// #define DEBUG_LOOP_TIMING
+
 // Uncomment to enable sending Telegram debug messages back to the chat
 // specified in telegram_token.h
 // #define USE_TELEGRAM
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Remembers the content hash (ETag) of each static web asset and keeps the most requested small ones in RAM
+// so a page load doesn't have to go back to flash for every file.
+//
+// An entry is one representation of a path: the gzipped and the plain file each get their own.
+class AssetCache {
+ public:
+  static const size_t MAX_ENTRIES = 16;
+  static const size_t MAX_PATH    = 32;
+  static const size_t ETAG_LENGTH = 11;  // Quoted 8 hex digits plus terminator
+  static const uint32_t HASH_SEED = 2166136261UL;
+
+  struct Entry {
+    char path[MAX_PATH];
+    bool gzip;
+    uint32_t etag;
+    uint32_t size;
+    uint32_t hits;
+    uint8_t *data;  // nullptr unless held in RAM
+  };
+
+  struct Stats {
+    uint32_t requests;
+    uint32_t notModified;
+    uint32_t ramHits;
+    uint64_t bytesServed;
+  };
+
+  AssetCache(size_t budget, size_t maxFileSize);
+  ~AssetCache() { clear(); }
+
+  Entry *find(const char *path, bool gzip);
+  // Record the hash of a file that was just read. Replaces the least requested entry when full.
+  Entry *add(const char *path, bool gzip, uint32_t etag, uint32_t size);
+  // Make room to hold a small file in RAM, evicting colder files if this one is more popular. Returns the
+  // buffer to read entry->size bytes into, or nullptr if it isn't worth keeping.
+  uint8_t *reserve(Entry *entry);
+  // Forget a path (both representations) after the file changed.
+  void invalidate(const char *path);
+  void clear();
+
+  size_t getUsed() { return used; }
+  Stats &getStats() { return stats; }
+
+  // FNV-1a, fed in pieces while the file is read.
+  static uint32_t hash(uint32_t hash, const uint8_t *data, size_t length);
+  // Quoted strong ETag, e.g. "1a2b3c4d".
+  static void formatEtag(uint32_t etag, char *out);
+  // True if an If-None-Match header value covers this ETag.
+  static bool etagMatches(const char *ifNoneMatch, uint32_t etag);
+  // True unless the Accept-Encoding header value rules gzip out.
+  static bool acceptsGzip(const char *acceptEncoding);
+
+ private:
+  Entry entries[MAX_ENTRIES];
+  size_t count;
+  size_t budget;
+  size_t maxFileSize;
+  size_t used;
+  Stats stats;
+
+  void release(Entry *entry);
+};
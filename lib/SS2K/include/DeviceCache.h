@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every BLE device the background scan has heard that offers a service we can use, in fixed memory.
+//
+// An advertisement costs one hash lookup: the table is open addressed on the 48 bit address and never more than
+// MAX_DEVICES / CAPACITY full, so probes stay short. When it is full the device heard least recently makes room.
+// RSSI is smoothed so a reconnect can prefer the strongest of two matching devices without one stray packet deciding.
+//
+// Scanning is continuous, so "new in this scan" is tracked here instead of by the scanner's duplicate filter: each
+// device is reported as first in a round once, until newRound().
+class DeviceCache {
+ public:
+  static const size_t CAPACITY    = 32;  // Power of two
+  static const size_t MAX_DEVICES = 24;
+  static const size_t NAME_SIZE   = 30;
+  static const int RSSI_WEIGHT    = 4;  // New readings count 1 / RSSI_WEIGHT
+
+  // The services a device advertises, in the order connectToServer() prefers them.
+  enum Service : uint8_t {
+    Flywheel       = 0x01,
+    FitnessMachine = 0x02,
+    CyclingPower   = 0x04,
+    Echelon        = 0x08,
+    HeartRate      = 0x10,
+    Hid            = 0x20,
+  };
+  static const size_t SERVICES = 6;
+
+  struct Device {
+    uint64_t address;  // 0 for a free slot
+    int16_t rssi;      // dBm * 16
+    uint8_t services;
+    uint8_t round;
+    uint32_t lastSeenMs;
+    uint32_t adverts;
+    char name[NAME_SIZE];  // Empty until a scan response carries it
+  };
+
+  DeviceCache();
+
+  // Records an advertisement. firstInRound is set the first time the device is heard after newRound().
+  Device *update(uint32_t nowMs, uint64_t address, int8_t rssi, uint8_t services, bool &firstInRound);
+  void setName(Device *device, const char *name, size_t length);
+  const Device *find(uint64_t address) const;
+  void newRound() { round++; }
+  size_t size() const { return count; }
+  void clear();
+
+  // Name with the last byte of the address, or the address alone when the device has no name. Same as the
+  // names the settings page stores for the configured devices.
+  static size_t uniqueName(const Device &device, char *out, size_t capacity);
+  static int getRssi(const Device &device) { return device.rssi / 16; }
+  // UUID of the service connectToServer() would use, as NimBLEUUID prints it.
+  static const char *getServiceUUID(uint8_t services);
+  // The foundDevices JSON the settings page reads: {"device 0":{"name":,"UUID":,"rssi":,"ageMs":},...}. Returns
+  // the length, leaving out whole devices that don't fit.
+  size_t toJSON(uint32_t nowMs, char *out, size_t capacity) const;
+
+ private:
+  static size_t home(uint64_t address);
+  void remove(size_t index);
+
+  Device devices[CAPACITY];
+  size_t count;
+  uint8_t round;
+};
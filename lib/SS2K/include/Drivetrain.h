@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Virtual gearing for SIM mode. Every chainring and cog pairing is laid out as one ladder from the easiest gear
+// to the hardest, so the two shifter buttons walk through it the way a sequential shifter would. Pairings within
+// 1% of the gear below are dropped.
+//
+// Sized for the largest drivetrain it accepts, so nothing is allocated once constructed.
+class Drivetrain {
+ public:
+  static const size_t MAX_CHAINRINGS = 3;
+  static const size_t MAX_COGS       = 13;
+  static const size_t MAX_GEARS      = MAX_CHAINRINGS * MAX_COGS;
+
+  // Gear picked by the first configure(), about a 34x17.
+  static constexpr float START_RATIO = 2.0;
+
+  struct Gear {
+    uint8_t chainring;  // Teeth
+    uint8_t cog;        // Teeth
+    float ratio;
+  };
+
+  Drivetrain();
+
+  // Teeth as comma separated lists, e.g. "34,50" and "11,12,13,14,15,17,19,21,24,28", wheel circumference in mm.
+  // Returns false, keeping the current gearing, if either list is empty, too long or holds anything but teeth.
+  // New gearing keeps the rider in the gear nearest the ratio they were in. The same gearing changes nothing.
+  bool configure(const char *chainrings, const char *cassette, uint16_t wheelCircumference);
+
+  // Moves delta gears (positive is harder), stopping at either end. Returns how many gears it moved.
+  int shift(int delta);
+  void setGear(size_t gear);
+
+  size_t getGear() const { return gear; }
+  size_t getGearCount() const { return gearCount; }
+  const Gear &getCurrent() const { return gears[gear]; }
+
+  // Road speed (m/s) at cadence (RPM) in the current gear.
+  float speed(float cadence) const { return cadence / 60.0f * gears[gear].ratio * wheelCircumference / 1000.0f; }
+
+  // Reads up to max teeth counts from a comma separated list. Returns how many, or 0 if the list isn't valid.
+  static size_t parseTeeth(const char *text, uint8_t *teeth, size_t max);
+
+ private:
+  Gear gears[MAX_GEARS];
+  size_t gearCount;
+  size_t gear;
+  uint16_t wheelCircumference;  // mm
+  // As configured, to spot settings that didn't change.
+  uint8_t rings[MAX_CHAINRINGS];
+  uint8_t cogs[MAX_COGS];
+  size_t ringCount;
+  size_t cogCount;
+};
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The parts of ERG mode that don't need the firmware around them: the target an app sends, and how far to move the
+// knob toward it when the power table has no answer. Positions are in the same units as the target incline.
+class ErgControl {
+ public:
+  static const uint8_t SET_TARGET_POWER = 0x05;  // FTMS control point op code
+
+  // Reads the watts that follow the SetTargetPower op code, signed as they always have been.
+  // Returns false, leaving watts alone, if there are fewer than 2 bytes.
+  static bool targetFromFtms(const uint8_t *data, size_t length, int *watts);
+
+  // Where to send the knob from position for watts to reach target. sensitivity is steps per watt off, halved
+  // within 10% of the target.
+  static float inSetpoint(float position, int watts, int target, float sensitivity);
+
+  // The same for a new target the power table couldn't place, with twice the sensitivity when more than 10% off.
+  static float setPointChange(float position, int watts, int target, float sensitivity);
+};
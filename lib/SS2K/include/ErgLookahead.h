@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ERG targets announced ahead of time by an app or a stored workout, so the knob can be on its way before an
+// interval starts instead of after. Travel time comes from MotionPlanner::eta().
+//
+// Times are millis() and may wrap.
+class ErgLookahead {
+ public:
+  static const size_t MAX_TARGETS   = 8;
+  static const uint32_t MARGIN_MS   = 300;  // Arrive this early, for the brake and the rider to settle
+  static const uint32_t MAX_LEAD_MS = 10000;
+
+  struct Target {
+    uint32_t atMs;
+    uint16_t watts;
+  };
+
+  ErgLookahead();
+
+  // Announce watts starting inMs from nowMs. A target within MARGIN_MS of another replaces it.
+  // Returns false if the list is full.
+  bool schedule(uint32_t nowMs, uint32_t inMs, uint16_t watts);
+  void clear() { count = 0; }
+
+  // The first target still ahead of nowMs, or nullptr. Targets that have started are dropped.
+  const Target *next(uint32_t nowMs);
+  size_t getCount() const { return count; }
+  const Target &get(size_t i) const { return targets[i]; }
+
+  // True once it is time to leave for a target the knob takes travelMs to reach. Never more than MAX_LEAD_MS early.
+  static bool shouldStart(uint32_t nowMs, const Target &target, uint32_t travelMs);
+
+ private:
+  Target targets[MAX_TARGETS];  // In time order
+  size_t count;
+};
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming decoder for compressed and delta firmware images, built by firmware_patch.py.
+//
+// An image is a 24 byte header followed by ops that rebuild the new firmware:
+//   magic "S2KP", version(1), reserved(3), targetSize(4), targetCrc(4), sourceSize(4), sourceCrc(4)
+//   0x01 LITERAL  length, bytes...      Copy bytes from the patch
+//   0x02 MATCH    distance, length      Repeat earlier output, up to WINDOW bytes back
+//   0x03 COPY     offset, length        Copy from the running firmware. offset is zigzag, relative to where
+//                                       the last COPY ended
+// Numbers are little endian. length, distance and offset are varints. sourceSize is 0 for an image that
+// is only compressed. The source crc is checked before anything is written.
+//
+// Patch bytes can be fed in any chunk size. Output is handed to the writer in OUT_CHUNK sized pieces.
+class FirmwarePatch {
+ public:
+  typedef bool (*Reader)(void *context, uint32_t offset, uint8_t *data, size_t length);
+  typedef bool (*Writer)(void *context, const uint8_t *data, size_t length);
+
+  static const size_t HEADER_SIZE = 24;
+  static const size_t WINDOW      = 4096;
+  static const size_t OUT_CHUNK   = 256;
+  static const uint8_t VERSION    = 1;
+
+  static const uint8_t OP_LITERAL = 0x01;
+  static const uint8_t OP_MATCH   = 0x02;
+  static const uint8_t OP_COPY    = 0x03;
+
+  enum Error : uint8_t {
+    PATCH_OK = 0,
+    PATCH_BAD_HEADER,
+    PATCH_SOURCE_MISMATCH,
+    PATCH_BAD_OP,
+    PATCH_OUT_OF_RANGE,
+    PATCH_TOO_LONG,
+    PATCH_READ_FAILED,
+    PATCH_WRITE_FAILED,
+    PATCH_INCOMPLETE,
+    PATCH_CRC,
+  };
+
+  // reader is only used for delta images and may be nullptr otherwise.
+  FirmwarePatch(Reader reader, Writer writer, void *context) : reader(reader), writer(writer), context(context) { begin(); }
+
+  // True if data starts with the patch magic. Plain images start with 0xE9.
+  static bool isPatch(const uint8_t *data, size_t length);
+
+  void begin();
+  // Decode the next piece of the patch. Returns false, and stops, on the first error.
+  bool write(const uint8_t *data, size_t length);
+  // Flush the last output and check size and crc.
+  bool finish();
+
+  Error getError() { return error; }
+  const char *getErrorString();
+  uint32_t getTargetSize() { return targetSize; }
+  uint32_t getSourceSize() { return sourceSize; }
+  uint32_t getProduced() { return produced; }
+
+ private:
+  enum State : uint8_t { STATE_HEADER, STATE_OP, STATE_ARG1, STATE_ARG2, STATE_LITERAL, STATE_DONE, STATE_ERROR };
+
+  Reader reader;
+  Writer writer;
+  void *context;
+
+  State state;
+  Error error;
+  uint8_t header[HEADER_SIZE];
+  size_t headerLength;
+  uint32_t targetSize;
+  uint32_t targetCrc;
+  uint32_t sourceSize;
+  uint32_t sourceCrc;
+
+  uint8_t op;
+  uint32_t arg1;
+  uint32_t arg2;
+  uint32_t varint;
+  uint8_t varintShift;
+  uint32_t remaining;  // Literal bytes left in the current op
+  uint32_t sourceCursor;
+
+  uint8_t window[WINDOW];
+  uint32_t produced;
+  uint32_t outputCrc;
+  uint8_t out[OUT_CHUNK];
+  size_t outLength;
+
+  bool fail(Error e);
+  bool parseHeader();
+  bool checkSource();
+  // Accumulate a varint. Returns true once the last byte has been seen.
+  bool readVarint(uint8_t byte, uint32_t *value);
+  bool execute();
+  bool emit(uint8_t byte);
+  bool flush();
+};
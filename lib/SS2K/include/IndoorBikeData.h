@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FTMS Indoor Bike Data (0x2AD2), shared by the client that reads a trainer's packets and the server that sends ours.
+// See the FTMS spec section 4.9. The .xml on GitHub has the polarity of the first flag wrong.
+//
+// Fields are carried as whole numbers of their GATT resolution, which is exact fixed point: speed in 0.01 km/h,
+// cadence in 0.5 RPM, METs in 0.1. getFixed()/setFixed() convert to Q16.16 real units.
+class IndoorBikeData {
+ public:
+  enum Field : uint8_t {
+    InstantaneousSpeed   = 0,   // km/h
+    AverageSpeed         = 1,   // km/h
+    InstantaneousCadence = 2,   // RPM
+    AverageCadence       = 3,   // RPM
+    TotalDistance        = 4,   // Meters
+    ResistanceLevel      = 5,   // Unitless
+    InstantaneousPower   = 6,   // Watts
+    AveragePower         = 7,   // Watts
+    TotalEnergy          = 8,   // kcal
+    EnergyPerHour        = 9,   // kcal/h
+    EnergyPerMinute      = 10,  // kcal/min
+    HeartRate            = 11,  // BPM
+    MetabolicEquivalent  = 12,  // METs
+    ElapsedTime          = 13,  // Seconds
+    RemainingTime        = 14,  // Seconds
+    FIELD_COUNT          = 15
+  };
+
+  struct FieldSpec {
+    uint8_t flagBit;
+    bool presentWhenClear;  // Only speed, which is left out when "More Data" is set
+    uint8_t size;
+    bool isSigned;
+    uint8_t divisor;  // Units per step
+  };
+
+  // In packet order. The three energy fields share one flag and are always sent together.
+  static constexpr FieldSpec FIELDS[FIELD_COUNT] = {
+      {0, true, 2, false, 100},   // InstantaneousSpeed
+      {1, false, 2, false, 100},  // AverageSpeed
+      {2, false, 2, false, 2},    // InstantaneousCadence
+      {3, false, 2, false, 2},    // AverageCadence
+      {4, false, 3, false, 1},    // TotalDistance
+      {5, false, 2, true, 1},     // ResistanceLevel
+      {6, false, 2, true, 1},     // InstantaneousPower
+      {7, false, 2, true, 1},     // AveragePower
+      {8, false, 2, false, 1},    // TotalEnergy
+      {8, false, 2, false, 1},    // EnergyPerHour
+      {8, false, 1, false, 1},    // EnergyPerMinute
+      {9, false, 1, false, 1},    // HeartRate
+      {10, false, 1, false, 10},  // MetabolicEquivalent
+      {11, false, 2, false, 1},   // ElapsedTime
+      {12, false, 2, false, 1},   // RemainingTime
+  };
+
+  static const size_t FLAGS_SIZE = 2;
+  static const size_t MAX_LENGTH = 30;  // Flags plus every field. Longer than a default ATT MTU allows.
+
+  // Sent by a machine in place of an energy field it doesn't measure.
+  static const int32_t ENERGY_NOT_AVAILABLE        = 0xFFFF;
+  static const int32_t ENERGY_MINUTE_NOT_AVAILABLE = 0xFF;
+
+  static constexpr uint16_t bit(Field field) { return (uint16_t)(1U << field); }
+
+  // Flags word for a set of fields, e.g. flagsFor(bit(InstantaneousCadence) | bit(InstantaneousPower)).
+  static constexpr uint16_t flagsFor(uint16_t fields, int field = 0) {
+    return (field == FIELD_COUNT) ? ((fields & bit(InstantaneousSpeed)) ? 0 : 1)
+                                  : (uint16_t)(((field != InstantaneousSpeed) && (fields & (1U << field)) ? (1U << FIELDS[field].flagBit) : 0) | flagsFor(fields, field + 1));
+  }
+
+  // Bytes taken by a set of fields, flags included.
+  static constexpr size_t lengthOf(uint16_t fields, int field = 0) {
+    return (field == FIELD_COUNT) ? FLAGS_SIZE : (((fields >> field) & 1) ? FIELDS[field].size : 0) + lengthOf(fields, field + 1);
+  }
+
+  struct Values {
+    uint16_t present;  // bit(Field) for each field that holds a value
+    int32_t raw[FIELD_COUNT];
+
+    bool has(Field field) const { return (present & bit(field)) != 0; }
+    void clear() { present = 0; }
+    void set(Field field, int32_t value) {
+      raw[field] = value;
+      present |= bit(field);
+    }
+    // Q16.16 in the units listed on Field.
+    int32_t getFixed(Field field) const;
+    // Rounds to the nearest step of the field's resolution.
+    void setFixed(Field field, int32_t value);
+  };
+
+  // Reads every field the flags announce. Returns false if the packet ends early, keeping the fields that arrived whole.
+  // Energy fields holding the "not available" value are left out.
+  static bool decode(const uint8_t *data, size_t length, Values *values);
+
+  // Writes the present fields, clamped to what each can hold. Missing energy fields next to a present one are sent
+  // as "not available". Returns the number of bytes written, or 0 if they don't fit in capacity.
+  static size_t encode(const Values &values, uint8_t *out, size_t capacity);
+
+  // Splits a record that doesn't fit in one packet, as FTMS allows: every packet but the last sets More Data and
+  // leaves speed for the last one. Start with *sent = 0 and call until it returns 0.
+  static size_t encodeNext(const Values &values, uint16_t *sent, uint8_t *out, size_t capacity);
+
+ private:
+  static uint16_t fieldsOf(const Values &values);
+  static size_t write(const Values &values, uint16_t fields, uint8_t *out);
+};
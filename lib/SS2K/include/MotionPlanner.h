@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Picks the stepper speed and acceleration for each move and predicts how long a move will take on this bike.
+//
+// Moves run as fast as the configured limits allow until steps are lost in that direction (tightening fights the
+// brake, loosening doesn't), then that direction backs off and creeps back up after a run of clean moves.
+// The time a move takes is learned from the moves themselves: measured durations are fitted against the ideal
+// trapezoid profile as gain * ideal + latency, which folds in driver enable time and moves retargeted on the way.
+//
+// Times are millis() and may wrap.
+class MotionPlanner {
+ public:
+  static const uint8_t MIN_SCALE_PERCENT = 50;  // Never slower than this share of the limits
+  static const uint8_t BACKOFF_PERCENT   = 10;
+  static const uint8_t RECOVER_PERCENT   = 5;
+  static const uint32_t CLEAN_MOVES      = 50;  // Moves without lost steps before speeding back up
+  static const uint32_t MIN_MOVES        = 5;   // Moves before the fit is trusted over the ideal profile
+
+  struct Profile {
+    uint32_t speed;         // Steps per second
+    uint32_t acceleration;  // Steps per second squared
+  };
+
+  MotionPlanner(uint32_t maxSpeed, uint32_t maxAcceleration);
+  void setLimits(uint32_t maxSpeed, uint32_t maxAcceleration);
+
+  Profile plan(int32_t from, int32_t to) const;
+  // Milliseconds to get from one position to the other with the profile plan() gives.
+  uint32_t eta(int32_t from, int32_t to) const;
+
+  // Call as often as the stepper is polled. Learns from each move between starting and stopping.
+  void observeStepper(uint32_t nowMs, int32_t position, bool running);
+  // Steps were lost while moving toward higher (increasing) or lower positions.
+  void reportLostSteps(bool increasing);
+
+  uint8_t getScale(bool increasing) const { return scale[increasing]; }
+  float getGain() const;
+  float getLatency() const;
+  uint32_t getMoves() const { return moves; }
+
+  // Ideal trapezoid (or triangle, for short moves) time in ms.
+  static float profileTime(uint32_t distance, const Profile &profile);
+
+ private:
+  uint32_t maxSpeed;
+  uint32_t maxAcceleration;
+  uint8_t scale[2];  // Percent of the limits, indexed by increasing
+  uint32_t cleanMoves[2];
+
+  // Decaying least squares sums of measured against ideal time, so the fit follows the bike as it wears
+  float n, sx, sy, sxx, sxy;
+  uint32_t moves;
+
+  bool wasRunning;
+  uint32_t startMs;
+  int32_t startPosition;
+};
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Receives a firmware image over BLE and stages it in sector sized buffers for a separate writer task.
+//
+// The BLE write callback calls onPacket() and the writer task drains buffers with nextFlush()/flushed(),
+// so flash erase time never blocks the BLE stack. Only those two sides touch the buffers, and only the
+// onPacket() side resets a session. A failure the writer reports with fail() takes effect on the next packet.
+// Legacy writes are queued and the writer task feeds them to onPacket() itself, so it is both sides then.
+//
+// Framed protocol, written to the OTA characteristic:
+//   BEGIN  0x01, size(4), crc32(4)     Starts a session, or resumes one with the same size and crc.
+//   DATA   0x02, seq(2), payload...    seq starts at 0 after every BEGIN and increments per packet.
+//   END    0x03                        All data sent. Reply comes once flash is written and verified.
+//   ABORT  0x04
+// Replies, notified on the TX characteristic:
+//   0x81, status, resumeOffset(4), window, bufferSize(2)   Host continues from resumeOffset.
+//   0x82, seq(2), received(4)                              Everything up to seq is stored.
+//   0x8F, status, expectedSeq(2), received(4)              Resend starting at received with expectedSeq.
+//   0x83, status                                           Image verified (or not).
+// The host may have at most `window` unacknowledged DATA packets in flight.
+//
+// The image may also be a compressed or delta patch (see FirmwarePatch.h), which the writer expands.
+//
+// A first packet starting with the ESP image magic (0xE9) selects the legacy stream: raw 512 byte
+// writes where a shorter write marks the end. Legacy mode has no acks, so when onPacket() returns OTA_BUSY
+// the caller keeps the packet and offers it again once a buffer has been flushed. The only replies are the
+// single byte LEGACY_DONE or LEGACY_FAILED once it's over, as legacy uploaders expect.
+class OtaReceiver {
+ public:
+  static const size_t BUFFER_SIZE  = 4096;  // One flash sector
+  static const size_t BUFFER_COUNT = 2;
+  static const uint8_t WINDOW      = 8;
+  static const size_t LEGACY_CHUNK = 512;
+
+  static const uint8_t OP_BEGIN = 0x01;
+  static const uint8_t OP_DATA  = 0x02;
+  static const uint8_t OP_END   = 0x03;
+  static const uint8_t OP_ABORT = 0x04;
+
+  static const uint8_t REPLY_BEGIN = 0x81;
+  static const uint8_t REPLY_ACK   = 0x82;
+  static const uint8_t REPLY_END   = 0x83;
+  static const uint8_t REPLY_NAK   = 0x8F;
+
+  static const uint8_t STATUS_OK         = 0x00;
+  static const uint8_t STATUS_BUSY       = 0x01;
+  static const uint8_t STATUS_SEQUENCE   = 0x02;
+  static const uint8_t STATUS_CRC        = 0x03;
+  static const uint8_t STATUS_FLASH      = 0x04;
+  static const uint8_t STATUS_BAD_PACKET = 0x05;
+  static const uint8_t STATUS_TOO_LARGE  = 0x06;
+  static const uint8_t STATUS_PATCH      = 0x07;  // Compressed or delta image didn't apply
+
+  static const uint8_t ESP_IMAGE_MAGIC = 0xE9;
+  static const uint8_t LEGACY_FAILED   = 0x04;
+  static const uint8_t LEGACY_DONE     = 0x05;
+
+  // Events returned by onPacket(). More than one can be set.
+  static const uint8_t OTA_NONE         = 0x00;
+  static const uint8_t OTA_STARTED      = 0x01;  // Open the flash partition and start the writer.
+  static const uint8_t OTA_RESUMED      = 0x02;
+  static const uint8_t OTA_BUFFER_READY = 0x04;  // Wake the writer.
+  static const uint8_t OTA_FINISHING    = 0x08;  // Last buffer queued. Writer should finish once drained.
+  static const uint8_t OTA_ABORTED      = 0x10;
+  static const uint8_t OTA_BUSY         = 0x20;  // Packet dropped, no free buffer.
+
+  struct Stats {
+    uint32_t bytesReceived;
+    uint32_t bytesFlushed;
+    uint32_t packets;
+    uint32_t naks;
+    uint32_t flushes;
+    uint32_t maxFlushMicros;
+    uint64_t totalFlushMicros;
+    uint32_t startMillis;
+    uint32_t lastMillis;
+  };
+
+  OtaReceiver() : generation(0) { reset(); }
+
+  // Handle one write to the OTA characteristic. Anything to notify back is put in reply.
+  uint8_t onPacket(const uint8_t *data, size_t length, uint32_t nowMillis, uint8_t *reply, size_t *replyLength);
+
+  // Writer side. Returns the oldest full buffer or nullptr. token identifies the session the buffer belongs to.
+  const uint8_t *nextFlush(size_t *length, uint32_t *token);
+  // Mark the buffer returned by nextFlush() as written. Fills reply with a held back ack, if any.
+  // Ignored if the session was reset while the buffer was being written.
+  void flushed(uint32_t token, uint32_t flushMicros, uint8_t *reply, size_t *replyLength);
+  // Everything received has been handed to flash and END (or the short legacy packet) arrived.
+  bool isDrained();
+  // Verify the image once drained. Fills reply with the END result.
+  bool finish(uint8_t *reply, size_t *replyLength);
+  // Tell the host the session failed, e.g. when the flash partition can't be opened. Writer side: nextFlush()
+  // hands out nothing more and the session is reset by the next onPacket().
+  void fail(uint8_t status, uint8_t *reply, size_t *replyLength);
+  bool hasFailed() { return failure.load() != STATUS_OK; }
+
+  void reset();
+  bool isActive() { return active && !hasFailed(); }
+  uint32_t getToken() { return generation; }
+  bool isLegacy() { return legacy; }
+  uint32_t getSize() { return size; }
+  const Stats &getStats() { return stats; }
+  // Average bytes per second since BEGIN.
+  uint32_t getThroughput();
+
+  static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+ private:
+  static const uint8_t BUFFER_FREE    = 0;
+  static const uint8_t BUFFER_FULL    = 1;
+  static const uint8_t BUFFER_WRITING = 2;
+
+  uint8_t buffers[BUFFER_COUNT][BUFFER_SIZE];
+  size_t bufferLength[BUFFER_COUNT];
+  std::atomic<uint8_t> bufferState[BUFFER_COUNT];
+  size_t fillIndex;   // Buffer BLE data is being copied into. Owned by onPacket()
+  size_t flushIndex;  // Next buffer to write. Owned by the writer
+
+  std::atomic<uint32_t> generation;
+  std::atomic<bool> active;  // Read by the write callback to route legacy streams
+  bool legacy;
+  std::atomic<bool> ending;
+  std::atomic<bool> ackHeld;
+  std::atomic<uint8_t> failure;  // Status passed to fail(), STATUS_OK until then
+  bool nakSent;
+  uint32_t size;
+  uint32_t expectedCrc;
+  uint32_t runningCrc;
+  uint16_t expectedSeq;
+  uint16_t lastAckSeq;
+  std::atomic<uint16_t> lastGoodSeq;
+  std::atomic<uint32_t> received;
+  Stats stats;
+
+  uint8_t onBegin(const uint8_t *data, size_t length, uint32_t nowMillis, uint8_t *reply, size_t *replyLength);
+  uint8_t onData(const uint8_t *data, size_t length, uint8_t *reply, size_t *replyLength);
+  uint8_t onLegacy(const uint8_t *data, size_t length, uint32_t nowMillis);
+  // Copy into the fill buffer, moving on to the next one as needed. Returns OTA_BUSY if there isn't room.
+  uint8_t store(const uint8_t *data, size_t length);
+  // Queue a partially filled buffer for the writer.
+  uint8_t queueFillBuffer();
+  size_t freeSpace();
+  void buildAck(uint16_t seq, uint8_t *reply, size_t *replyLength);
+  void buildNak(uint8_t status, uint8_t *reply, size_t *replyLength);
+  void buildEnd(uint8_t status, uint8_t *reply, size_t *replyLength);
+};
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What it took to connect to each peripheral we have subscribed to, so a dropped or remembered sensor can be connected
+// to straight away instead of waiting for a scan to find it again.
+//
+// A peer is kept with its address type (a random address can't be connected to as public), the service we used, the
+// handles that service and its data characteristic had, and the connection parameters it accepted, so a reconnect
+// starts with parameters the peer is known to take. A peer whose direct connects keep failing is left to the scan.
+//
+// Saved as a 6 byte header ("SS2P", VERSION, count) and fixed RECORD_SIZE records, little endian.
+class PeerCache {
+ public:
+  static const uint8_t VERSION             = 1;
+  static const size_t MAX_PEERS            = 8;
+  static const size_t NAME_SIZE            = 34;  // DeviceCache::uniqueName() of the longest name we keep
+  static const uint8_t MAX_DIRECT_FAILURES = 2;
+  static const size_t HEADER_SIZE          = 6;
+  static const size_t RECORD_SIZE          = 25 + NAME_SIZE;
+  static const size_t SERIALIZED_SIZE      = HEADER_SIZE + MAX_PEERS * RECORD_SIZE;
+
+  struct Peer {
+    uint64_t address;  // 0 for a free slot
+    uint8_t addressType;
+    uint8_t service;  // The DeviceCache::Service connectToServer() subscribed to
+    uint16_t serviceStart;
+    uint16_t serviceEnd;
+    uint16_t valueHandle;  // Of the characteristic we subscribe to
+    uint16_t interval;     // 1.25ms
+    uint16_t latency;      // Connection events
+    uint16_t timeout;      // 10ms
+    uint8_t failures;      // Direct connects that failed since the last one that worked
+    uint32_t lastUsed;
+    char name[NAME_SIZE];
+  };
+
+  PeerCache();
+
+  // Stores a connection that worked. Returns true when the saved copy is out of date.
+  bool remember(const Peer &peer);
+  // Counts a direct connect that didn't work.
+  void failed(uint64_t address);
+  const Peer *find(uint64_t address) const;
+  // The most recently used peer offering one of services, named name, or any of them for "any".
+  const Peer *find(uint8_t services, const char *name) const;
+  static bool canConnectDirect(const Peer &peer) { return peer.failures < MAX_DIRECT_FAILURES; }
+  size_t size() const;
+  void clear();
+
+  size_t serialize(uint8_t *out, size_t capacity) const;
+  // Anything that isn't a whole cache of this VERSION leaves it empty.
+  bool deserialize(const uint8_t *in, size_t length);
+
+ private:
+  Peer peers[MAX_PEERS];
+  uint32_t sequence;
+};
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Notices when the stepper has probably lost steps, which FastAccelStepper can't see because it only counts the pulses
+// it sent, and works out how far to re-home so the power table keeps meaning the same knob positions.
+//
+// Two sources: DRV_STATUS read from the TMC2208 over UART (the 2208 has no StallGuard, but overtemperature, short and
+// open load all mean the coils weren't following the pulses), and the power table itself. A settled table cell is an
+// anchor: if new samples keep landing the same distance away from several anchors, the count has drifted, not the bike.
+class PositionHealth {
+ public:
+  // DRV_STATUS bits, TMC2208 datasheet section 5.5.3
+  static const uint32_t OTPW      = 1UL << 0;    // Overtemperature pre-warning
+  static const uint32_t OT        = 1UL << 1;    // Overtemperature shutdown
+  static const uint32_t SHORTS    = 0xFUL << 2;  // s2ga, s2gb, s2vsa, s2vsb
+  static const uint32_t OPEN_LOAD = 0x3UL << 6;  // ola, olb
+  static const uint32_t STST      = 1UL << 31;   // Standstill
+
+  static const size_t ANCHOR_SAMPLES    = 4;    // Cells that must agree before re-homing. Half as many after a fault.
+  static const int32_t REHOME_THRESHOLD = 300;  // Steps. Anything closer to the table is ordinary noise.
+  static const int32_t ANCHOR_SPREAD    = 200;  // Steps the agreeing cells may differ by
+
+  struct Counters {
+    uint32_t reads;
+    uint32_t readErrors;
+    uint32_t overtempWarnings;
+    uint32_t overtemps;
+    uint32_t shorts;
+    uint32_t openLoads;
+    uint32_t faultsWhileMoving;
+    uint32_t rehomes;
+    int32_t rehomedSteps;  // Sum of every correction, signed
+  };
+
+  PositionHealth();
+
+  // A DRV_STATUS read. moving is whether the stepper was driven since the last read. Each flag counts once as it appears.
+  void observeStatus(uint32_t drvStatus, bool moving);
+  // The driver didn't answer, or answered with a bad CRC.
+  void observeReadError();
+  // A new power table sample for a settled cell, as its distance in steps from what the cell holds.
+  // Returns the steps to take off the stepper's position once enough cells agree, otherwise 0.
+  int32_t observeAnchor(int cell, int32_t drift);
+  // False after a fault while moving, until re-homed. Samples taken meanwhile shouldn't be learned.
+  bool isTrusted() const { return trusted; }
+  uint32_t getStatus() const { return status; }
+  const Counters &getCounters() const { return counters; }
+
+ private:
+  uint32_t status;
+  bool trusted;
+  int anchorCells[ANCHOR_SAMPLES];
+  int32_t anchorDrift[ANCHOR_SAMPLES];
+  size_t anchorCount;
+  Counters counters;
+};
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact encoding for power table cells so the whole table (or only the cells that changed) can be sent over a
+// handful of BLE indications.
+//
+// Cells are walked in order from a start index. The stream is a series of ops:
+//   0x00-0x7F  SKIP     (n + 1) unchanged cells
+//   0x80-0xBF  REPEAT   (n & 0x3F) + 1 cells that all hold the value that follows
+//   0xC0-0xFF  LITERAL  (n & 0x3F) + 1 cells, each followed by its value
+// Values are zigzag varints of the difference from the previous value in the same chunk. The first value
+// is relative to 0. Every chunk can be decoded on its own.
+class PowerTableCodec {
+ public:
+  static const uint8_t SKIP        = 0x00;
+  static const uint8_t REPEAT      = 0x80;
+  static const uint8_t LITERAL     = 0xC0;
+  static const size_t MAX_SKIP     = 128;
+  static const size_t MAX_RUN      = 64;
+  static const size_t MAX_VALUE_SZ = 3;
+
+  // Encode cells with a version newer than `since` starting at *cursor. Stops when `out` is full and
+  // advances *cursor past everything encoded. *cursor == count once the table has been fully sent.
+  // Returns the number of bytes written.
+  static size_t encode(const int16_t *cells, const uint16_t *versions, size_t count, uint16_t since, size_t *cursor, uint8_t *out, size_t capacity);
+
+  // Apply one encoded chunk to cells starting at `start`. Returns false if the chunk is malformed or runs off the table.
+  static bool decode(const uint8_t *in, size_t length, size_t start, int16_t *cells, size_t count);
+
+ private:
+  static size_t putValue(int32_t delta, uint8_t *out, size_t capacity);
+  static size_t getValue(const uint8_t *in, size_t length, int32_t *delta);
+};
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal/HAL.h"
+
+// The power table as saved between sessions, on any FileSystem:
+//   int32 version, int32 readings in the whole table, then for every cell row by row
+//   int16 targetPosition (INT16_MIN when empty) and int8 readings, little endian and packed.
+//
+// A saved table is only taken over once the live one has enough reliable cells in common with it to work out how far
+// the knob has moved since, and is then shifted by the average difference.
+class PowerTableFile {
+ public:
+  struct Cell {
+    int16_t targetPosition;
+    int8_t readings;
+  };
+
+  static const size_t HEADER_SIZE = 8;
+  static const size_t CELL_SIZE   = 3;
+
+  enum Result {
+    MISSING,     // No saved table, or it's truncated
+    OLD_VERSION,
+    SUPERSEDED,  // The live table has more readings than the saved one
+    TOO_FEW_MATCHES,
+    LOADED,
+  };
+
+  // Replaces the saved table with cells. readings is stored as the table's quality.
+  static bool save(FileSystem &fileSystem, const char *path, int32_t version, const Cell *cells, size_t rows, size_t columns, int32_t readings);
+
+  // Replaces cells with the saved table when that's worth doing, see Result. A cell counts as reliable in the live table
+  // with more than minimumReadings readings. Columns below firstMatchColumn don't count towards minimumMatches, as low
+  // resistance positions are unreliable. *offset is what was added to every position.
+  static Result load(FileSystem &fileSystem, const char *path, int32_t version, Cell *cells, size_t rows, size_t columns, int32_t readings, int minimumReadings,
+                     int minimumMatches, size_t firstMatchColumn, float *offset);
+
+ private:
+  static const size_t BLOCK_CELLS = 40;  // Read at a time
+
+  static bool readCells(FileSystem &fileSystem, const char *path, size_t first, size_t count, Cell *cells);
+};
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Distance, energy and elapsed time for FTMS Indoor Bike Data. They're integrated on the device each time a reading
+// arrives, so apps don't have to rebuild them from the notifications they happen to catch.
+class RideTotals {
+ public:
+  // Anything longer is a dropout or the device sleeping, so it isn't integrated.
+  static const uint32_t MAX_STEP_MS = 3000;
+  // Joules of work per kcal burned. Riders are about 24% efficient, so 1 kJ of work costs about 1 kcal.
+  static const uint32_t WORK_PER_KCAL = 1004;
+
+  RideTotals() { reset(); }
+
+  void reset();
+  // speed is km/h in Q16.16, power is watts. Integrates the trapezoid since the previous call.
+  void update(uint32_t nowMs, int32_t speed, int power);
+
+  uint32_t getDistance() const { return (uint32_t)(distance / ((uint64_t)3600 << 16)); }  // Meters
+  uint32_t getEnergy() const { return (uint32_t)(work / (WORK_PER_KCAL * 1000ULL)); }      // kcal
+  uint32_t getEnergyPerHour() const { return (uint32_t)lastPower * 3600 / WORK_PER_KCAL; }
+  uint32_t getEnergyPerMinute() const { return (uint32_t)lastPower * 60 / WORK_PER_KCAL; }
+  uint32_t getElapsedTime() const { return (uint32_t)(elapsed / 1000); }  // Seconds spent moving
+
+ private:
+  bool started;
+  uint32_t lastMs;
+  int32_t lastSpeed;
+  int32_t lastPower;
+  uint64_t distance;  // km/h Q16.16 * ms
+  uint64_t work;      // W * ms, so mJ
+  uint64_t elapsed;   // ms
+};
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Steady-state power to ride a road at a given speed, from the FTMS Indoor Bike Simulation Parameters.
+// Martin et al. (1998) without the bearing and kinetic energy terms:
+//
+//   P = (Cw * (v + w) * |v + w| + m * g * (Crr * cos(atan(grade)) + sin(atan(grade)))) * v / efficiency
+//
+// Cw is FTMS's wind resistance coefficient, 0.5 * air density * CdA, in kg/m. Wind is a headwind when positive.
+class RoadModel {
+ public:
+  static constexpr float GRAVITY    = 9.81;
+  static constexpr float EFFICIENCY = 0.976;  // Chain and bearings, pedals to road
+
+  // Sent by apps that don't model the road surface or the rider.
+  static constexpr float DEFAULT_CRR = 0.004;
+  static constexpr float DEFAULT_CW  = 0.51;
+
+  struct Conditions {
+    float grade;      // Rise over run, 0.05 is 5%
+    float windSpeed;  // m/s
+    float crr;        // Rolling resistance
+    float cw;         // kg/m
+    float mass;       // Rider and bike, kg
+  };
+
+  // Reads the 6 bytes that follow the SetIndoorBikeSimulationParameters op code into everything but mass.
+  // Returns false, leaving conditions alone, if there are fewer.
+  static bool fromFtms(const uint8_t *data, size_t length, Conditions *conditions);
+
+  // Watts at the pedals to hold speed (m/s). Negative when the road does the work.
+  static float power(const Conditions &conditions, float speed);
+
+  // The speed (m/s) that power (W) holds on this road, up to maxSpeed.
+  static float speed(const Conditions &conditions, float power, float maxSpeed = 30);
+};
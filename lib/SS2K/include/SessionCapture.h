@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recording of everything that came into the SmartSpin2k during a ride, so a field problem can be played back
+// instead of pieced together from log lines.
+//
+// A capture is a 5 byte header ("SS2C", VERSION) followed by records, all little endian:
+//   type(1), time(4) ms since the capture started, length(2), payload
+//   NOTIFY         address(6), characteristic UUID(16, 128 bit, least significant byte first), data
+//   CONTROL_POINT  the FTMS control point write, as the app sent it
+//   SHIFT          delta(1, signed)
+//   STATE          watts(2), cadence(2, 0.01 rpm), heart rate(1), resistance(2), target position(4), position(4)
+// STATE follows each NOTIFY with what the firmware made of it, so a replay can check it gets the same.
+// A capture cut short by a reboot just ends at the last whole record.
+class SessionCapture {
+ public:
+  static const uint8_t VERSION           = 1;
+  static const size_t HEADER_SIZE        = 5;
+  static const size_t RECORD_HEADER_SIZE = 7;
+  static const size_t NOTIFY_HEADER_SIZE = 22;
+  static const size_t STATE_SIZE         = 15;
+  static const size_t MAX_RECORD_SIZE    = RECORD_HEADER_SIZE + NOTIFY_HEADER_SIZE + 512;  // Largest ATT value
+  static const uint8_t NOTIFY            = 0x01;
+  static const uint8_t CONTROL_POINT     = 0x02;
+  static const uint8_t SHIFT             = 0x03;
+  static const uint8_t STATE             = 0x04;
+
+  struct Record {
+    uint8_t type;
+    uint32_t timeMs;
+    const uint8_t *payload;  // Points into the buffer the record was parsed from
+    uint16_t length;
+  };
+
+  struct Notification {
+    uint64_t address;
+    uint8_t uuid[16];
+    const uint8_t *data;
+    size_t length;
+  };
+
+  struct State {
+    int16_t watts;
+    uint16_t cadence;
+    uint8_t heartRate;
+    int16_t resistance;
+    int32_t targetPosition;
+    int32_t position;
+  };
+
+  // Each returns the bytes written, or 0 if it doesn't fit.
+  static size_t writeHeader(uint8_t *out, size_t capacity);
+  static size_t encodeNotify(uint32_t timeMs, uint64_t address, const uint8_t *uuid, const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+  static size_t encodeControlPoint(uint32_t timeMs, const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+  static size_t encodeShift(uint32_t timeMs, int8_t delta, uint8_t *out, size_t capacity);
+  static size_t encodeState(uint32_t timeMs, const State &state, uint8_t *out, size_t capacity);
+
+  static bool checkHeader(const uint8_t *in, size_t length);
+  // Reads the record header only. The payload is the record.length bytes after it.
+  static bool parseRecordHeader(const uint8_t *in, size_t length, Record &record);
+  static bool parseNotify(const Record &record, Notification &notification);
+  static bool parseShift(const Record &record, int8_t &delta);
+  static bool parseState(const Record &record, State &state);
+
+ private:
+  static size_t putRecordHeader(uint8_t type, uint32_t timeMs, size_t length, uint8_t *out, size_t capacity);
+};
+
+// Plays a capture held in memory back on a clock, so the same inputs arrive at the same relative times.
+class SessionReplay {
+ public:
+  static const uint32_t FINISHED = 0xFFFFFFFF;
+
+  // Gets each record as its time comes.
+  class Target {
+   public:
+    virtual ~Target() {}
+    virtual void replay(const SessionCapture::Record &record) = 0;
+  };
+
+  SessionReplay(const uint8_t *capture, size_t length);
+  bool isValid() const { return valid; }
+
+  void start(uint32_t nowMs);
+  // Replays every record due by nowMs. Returns ms until the next one is due, or FINISHED.
+  uint32_t run(uint32_t nowMs, Target &target);
+  uint32_t getReplayed() const { return replayed; }
+
+ private:
+  bool peek(SessionCapture::Record &record) const;
+
+  const uint8_t *capture;
+  size_t length;
+  bool valid;
+  size_t offset;
+  uint32_t startMs;
+  uint32_t replayed;
+};
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shifter button edges, passed from the interrupt handlers to the maintenance loop.
+//
+// Single producer, single consumer: the up and down handlers are both dispatched by the one GPIO interrupt on the core
+// that attached them, so they never run at the same time, and only the maintenance loop pops. push() is inline so it
+// ends up in the handler's IRAM and never touches flash.
+class ShiftQueue {
+ public:
+  static const size_t CAPACITY = 32;  // Power of two. Each press is two edges, plus bounces.
+
+  struct Event {
+    uint32_t timeUs;  // micros() at the edge
+    uint8_t button;   // ShiftGestures::UP or DOWN
+    bool pressed;     // Level read in the handler
+  };
+
+  ShiftQueue() : head(0), tail(0), dropped(0) {}
+
+  // Interrupt side. False, and counted, when the loop has fallen CAPACITY edges behind.
+  bool push(const Event &event) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    events[h & (CAPACITY - 1)] = event;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(Event &event) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    event = events[t & (CAPACITY - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+ private:
+  Event events[CAPACITY];
+  std::atomic<uint32_t> head;  // Free running counts, so full and empty can't be confused
+  std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> dropped;
+};
+
+// Running latency figures, in microseconds.
+struct ShiftLatency {
+  uint32_t count;
+  uint32_t last;
+  uint32_t max;
+  uint64_t total;
+
+  ShiftLatency() : count(0), last(0), max(0), total(0) {}
+  void add(uint32_t us);
+  uint32_t mean() const { return count ? (uint32_t)(total / count) : 0; }
+};
+
+// Debounces the queued edges and turns them into gestures, without losing any press however fast they come.
+//
+// An edge only counts once the level has stayed put for debounceUs, so interference that flips the pin and flips it
+// back is ignored. Each press is a Shift, stamped with the time of the edge that stuck. A press held for HOLD_US
+// also reports Hold, once. A second press within DOUBLE_TAP_US of the first reports DoubleTap after its Shift.
+class ShiftGestures {
+ public:
+  static const uint8_t UP   = 0;
+  static const uint8_t DOWN = 1;
+
+  static const uint32_t HOLD_US       = 600000;
+  static const uint32_t DOUBLE_TAP_US = 350000;
+  static const size_t OUTPUT_SIZE     = 16;
+
+  enum Type : uint8_t { Shift = 0, Hold = 1, DoubleTap = 2 };
+
+  struct Gesture {
+    Type type;
+    uint8_t button;
+    uint32_t timeUs;  // When it happened, for latency
+  };
+
+  struct Counters {
+    uint32_t shifts;
+    uint32_t holds;
+    uint32_t doubleTaps;
+    uint32_t bounces;  // Edges reverted before they settled
+    uint32_t overflows;
+  };
+
+  explicit ShiftGestures(uint32_t debounceUs);
+
+  void onEdge(const ShiftQueue::Event &event);
+  // Settles edges and reports holds up to now. Call every loop, after feeding the queued edges.
+  void poll(uint32_t nowUs);
+  bool next(Gesture &gesture);
+
+  bool isPressed(uint8_t button) const { return buttons[button].stable; }
+  const Counters &getCounters() const { return counters; }
+
+ private:
+  struct Button {
+    bool raw;
+    bool stable;
+    uint32_t edgeUs;     // Last edge
+    uint32_t pressedUs;  // Start of the current or last press
+    uint32_t holdUs;     // When the current press becomes a hold
+    bool held;
+    bool tapped;  // A press recent enough to pair with the next one
+  };
+
+  void advance(uint8_t button, uint32_t nowUs);
+  void emit(Type type, uint8_t button, uint32_t timeUs);
+
+  uint32_t debounceUs;
+  Button buttons[2];
+  Gesture output[OUTPUT_SIZE];
+  size_t outputHead;
+  size_t outputCount;
+  Counters counters;
+};
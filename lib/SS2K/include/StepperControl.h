@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "hal/HAL.h"
+#include "MotionPlanner.h"
+#include "PositionHealth.h"
+
+// The stepper side of the maintenance loop, written against hal/HAL.h so it runs on the fakes too: reading the
+// motor back, re-homing once it stops, planning each new move and watching the driver for faults.
+//
+// Times are millis() and may wrap.
+class StepperControl {
+ public:
+  StepperControl(MotionPlanner &planner, PositionHealth &health);
+
+  // Call first every loop. Returns the steps taken off the position if a pending re-home was applied.
+  int32_t poll(Motor &motor, uint32_t nowMs);
+  // Heads for target, kept within minStep and maxStep. Returns true when that starts a new move.
+  bool moveTo(Motor &motor, int32_t target, int32_t minStep, int32_t maxStep);
+  // A DRV_STATUS read. Returns true when it just made the position suspect.
+  bool readDriverStatus(MotorDriver &driver, uint32_t &status);
+  // Steps to take off the position once the stepper next stops.
+  void rehome(int32_t steps) { pendingRehome += steps; }
+
+  int32_t getPosition() const { return position; }
+  bool isRunning() const { return running; }
+
+ private:
+  MotionPlanner &planner;
+  PositionHealth &health;
+  int32_t position;
+  int32_t target;  // Where the motor was last heading
+  bool running;
+  int32_t pendingRehome;
+  int32_t statusPosition;  // At the last DRV_STATUS read
+};
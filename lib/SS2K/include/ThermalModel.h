@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// First order thermal model of the stepper driver board, used to cut heat before the board gets hot enough to
+// throttle run current, which is what costs torque halfway up a climb.
+//
+// Heat goes as the mean square coil current: run current while moving, hold current while enabled and still, none
+// while the outputs are off. The rise above ambient settles at RISE_PER_A2 * I^2 with time constant TAU_MS. Ambient is
+// estimated from the ESP32's own temperature sensor, which sits on the same board, minus the modelled rise.
+//
+// As the temperature predicted HORIZON_MS ahead approaches the limit, schedule() steps through cheaper fixes first:
+//   Normal     the configured currents and chopper
+//   LowHold    hold current down to LOW_HOLD_PERCENT. The brake holds the knob between moves.
+//   Stealth    StealthChop forced on. Its automatic current scaling runs cooler at light load.
+//   Throttled  run current cut to what the prediction allows, never under MIN_RUN_PERCENT
+class ThermalModel {
+ public:
+  static const uint32_t TAU_MS          = 300000;  // Board time constant
+  static const uint32_t HORIZON_MS      = 600000;  // How far ahead to keep under the limit
+  static const uint8_t HOLD_PERCENT     = 50;      // Normal hold current, share of run current
+  static const uint8_t LOW_HOLD_PERCENT = 20;
+  static const uint8_t MIN_RUN_PERCENT  = 50;
+  static const uint8_t STEALTH_PERCENT  = 70;  // Mean square run current left by StealthChop's autoscaling
+  static const float RISE_PER_A2;              // Steady state rise, C per A^2 RMS
+  static const float MARGIN;                   // C under the limit to aim for
+  static const float HYSTERESIS;               // C further under before stepping back down
+
+  enum Level : uint8_t { Normal = 0, LowHold = 1, Stealth = 2, Throttled = 3 };
+
+  struct Plan {
+    Level level;
+    uint16_t runCurrent;  // mA RMS
+    uint8_t holdPercent;
+    bool stealthChop;
+  };
+
+  ThermalModel();
+
+  // Time passed at the given currents. running and enabled are the share of dtMs (0 to 1) the motor spent moving and
+  // with its outputs on.
+  void observe(uint32_t dtMs, uint16_t runCurrent, uint8_t holdPercent, bool stealthChop, float running, float enabled);
+  // A reading from the temperature sensor.
+  void measure(float temperature);
+
+  // The settings to use now for the configured current and chopper, staying under limit.
+  Plan schedule(float limit, uint16_t runCurrent, bool stealthChop);
+  // Temperature after horizonMs at the recent duty cycle with these settings.
+  float predict(uint32_t horizonMs, uint16_t runCurrent, uint8_t holdPercent, bool stealthChop) const;
+
+  float getTemperature() const { return ambient + rise; }
+  float getAmbient() const { return ambient; }
+  float getRise() const { return rise; }
+  float getDuty() const { return running; }
+  Level getLevel() const { return level; }
+
+  static float meanSquare(uint16_t runCurrent, uint8_t holdPercent, bool stealthChop, float running, float enabled);
+
+ private:
+  float rise;
+  float ambient;
+  bool measured;
+  bool observed;
+  float running;  // Recent duty cycles, averaged over about TAU_MS
+  float enabled;
+  Level level;
+};
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A structured ERG workout the device runs on its own clock, so it keeps going if the app drops out.
+//
+// Compact binary layout, little endian:
+//   'W', 'K', version, step count, FTP (2, 0 to use the rider's setting)
+//   then for each step: type, flags, duration in seconds (2), start target (2), end target (2)
+// A steady step holds the start target and ignores the end target. A ramp moves linearly between them.
+// Targets are watts, or tenths of a percent of FTP when the step has FTP_RELATIVE set (750 is 75%).
+class Workout {
+ public:
+  static const uint8_t VERSION       = 1;
+  static const size_t HEADER_SIZE    = 6;
+  static const size_t STEP_SIZE      = 8;
+  static const size_t MAX_STEPS      = 64;
+  static const size_t MAX_SIZE       = HEADER_SIZE + MAX_STEPS * STEP_SIZE;
+  static const uint32_t RAMP_STEP_MS = 100;  // Ramps never change the target more often than this
+
+  enum StepType : uint8_t { Steady = 0, Ramp = 1 };
+  static const uint8_t FTP_RELATIVE = 0x01;
+
+  enum State : uint8_t { Empty = 0, Ready = 1, Running = 2, Paused = 3, Finished = 4 };
+
+  struct Step {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t startMs;  // From the start of the workout
+    uint32_t durationMs;
+    uint16_t start;
+    uint16_t end;
+  };
+
+  Workout();
+
+  // Replaces the workout and leaves it Ready. On a malformed file, returns false and leaves it Empty.
+  bool load(const uint8_t *data, size_t length);
+  void start(uint32_t nowMs);
+  void pause(uint32_t nowMs);
+  void resume(uint32_t nowMs);
+  void stop();
+
+  // Moves the workout clock to nowMs. Returns true, with the new target in *watts, when it changed.
+  bool update(uint32_t nowMs, uint16_t ftp, uint16_t *watts);
+  // How long update() can wait before the target next changes, at most maxWaitMs.
+  uint32_t nextUpdate(uint32_t nowMs, uint16_t ftp, uint32_t maxWaitMs) const;
+  // The next step boundary where the target jumps, for ErgLookahead. False if there isn't one.
+  bool nextBoundary(uint32_t nowMs, uint16_t ftp, uint32_t *inMs, uint16_t *watts) const;
+
+  uint16_t targetAt(uint32_t elapsedMs, uint16_t ftp) const;
+  uint32_t getElapsed(uint32_t nowMs) const;
+  uint32_t getDuration() const { return (stepCount > 0) ? steps[stepCount - 1].startMs + steps[stepCount - 1].durationMs : 0; }
+  size_t getStepAt(uint32_t elapsedMs) const;
+  size_t getStepCount() const { return stepCount; }
+  State getState() const { return state; }
+
+ private:
+  Step steps[MAX_STEPS];
+  size_t stepCount;
+  uint16_t fileFtp;
+  State state;
+  uint32_t startedMs;  // millis() the workout would have started at without pauses
+  uint32_t pausedMs;
+  uint16_t lastWatts;
+
+  uint16_t toWatts(const Step &step, uint16_t target, uint16_t ftp) const;
+};
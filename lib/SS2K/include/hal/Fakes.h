@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "hal/HAL.h"
+
+// Deterministic in-memory hardware for env:native. Nothing moves on its own: time only passes when the test advances
+// the FakeClock, so hours of riding simulate in milliseconds.
+
+class FakeClock : public Clock {
+ public:
+  FakeClock() : us(0) {}
+  uint32_t nowMs() { return (uint32_t)(us / 1000); }
+  uint32_t nowUs() { return (uint32_t)us; }
+  void advanceMs(uint32_t ms) { us += (uint64_t)ms * 1000; }
+  void advanceUs(uint32_t microseconds) { us += microseconds; }
+
+ private:
+  uint64_t us;
+};
+
+// Follows the ideal trapezoid profile for each move, from standstill. A new target mid-move restarts the profile from
+// where the motor is, and stopMove() stops dead; close enough for control code, which doesn't see the difference.
+// With holding off the outputs are enabled at the start of each move, which takes enableDelayMs.
+// slip() loses steps: the motor ends up somewhere the position count doesn't know about.
+class FakeMotor : public Motor {
+ public:
+  explicit FakeMotor(Clock &clock, uint32_t enableDelayMs = 0);
+
+  int32_t getCurrentPosition();
+  void setCurrentPosition(int32_t position);
+  int32_t getTargetPosition() { return target; }
+  bool isRunning();
+  void moveTo(int32_t position);
+  void stopMove();
+  void setSpeed(uint32_t stepsPerSecond) { speed = stepsPerSecond; }
+  void setAcceleration(uint32_t stepsPerSec2) { acceleration = stepsPerSec2; }
+  void setHoldEnabled(bool hold) { holdEnabled = hold; }
+  void setDirection(bool direction) { this->direction = direction; }
+
+  void slip(int32_t steps) { slipped += steps; }
+  int32_t getActualPosition() { return this->getCurrentPosition() + slipped; }
+  uint32_t getMoves() const { return moves; }
+  uint32_t getSpeed() const { return speed; }
+  uint32_t getAcceleration() const { return acceleration; }
+  bool getDirection() const { return direction; }
+
+ private:
+  void update();
+
+  Clock &clock;
+  uint32_t enableDelayMs;
+  uint32_t speed;
+  uint32_t acceleration;
+  bool holdEnabled;
+  bool direction;
+  bool running;
+  int32_t position;  // As counted
+  int32_t from;
+  int32_t target;
+  uint32_t startUs;
+  uint32_t moveSpeed;  // Limits the current move started with
+  uint32_t moveAcceleration;
+  uint32_t moveDelayMs;
+  int32_t slipped;
+  uint32_t moves;
+};
+
+class FakeMotorDriver : public MotorDriver {
+ public:
+  FakeMotorDriver() : runMa(0), holdMultiplier(0), stealthChop(false), status(0), failedReads(0) {}
+  void setCurrent(uint16_t runMa, float holdMultiplier);
+  uint16_t getCurrentScale();
+  void setStealthChop(bool enabled) { stealthChop = enabled; }
+  bool readStatus(uint32_t &status);
+
+  uint16_t runMa;
+  float holdMultiplier;
+  bool stealthChop;
+  uint32_t status;       // What readStatus() answers
+  uint32_t failedReads;  // How many reads to fail before answering again
+};
+
+class FakeFileSystem : public FileSystem {
+ public:
+  FakeFileSystem() : capacity(0x20000), writes(0) {}
+  int32_t size(const char *path);
+  int32_t read(const char *path, uint32_t offset, uint8_t *buffer, size_t length);
+  bool write(const char *path, const uint8_t *data, size_t length);
+  bool append(const char *path, const uint8_t *data, size_t length);
+  bool remove(const char *path);
+
+  size_t used() const;
+  size_t capacity;  // Writes that would go over fail, like a full partition
+  uint32_t writes;  // Writes and appends that succeeded
+
+ private:
+  std::map<std::string, std::vector<uint8_t> > files;
+};
+
+class FakeBleLink : public BleLink {
+ public:
+  FakeBleLink() : clients(0) {}
+  int connectedClients() { return clients; }
+  void writeControlPoint(const uint8_t *data, size_t length) { controlPointWrites.push_back(std::vector<uint8_t>(data, data + length)); }
+
+  int clients;
+  std::vector<std::vector<uint8_t> > controlPointWrites;
+};
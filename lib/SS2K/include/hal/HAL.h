@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The hardware the control code talks to, kept to what it actually uses. HAL_ESP32.h has the real implementations
+// and hal/Fakes.h has in-memory ones with a virtual clock, so control code written against these runs in env:native.
+
+// Time since boot. Both wrap.
+class Clock {
+ public:
+  virtual ~Clock() {}
+  virtual uint32_t nowMs() = 0;
+  virtual uint32_t nowUs() = 0;
+};
+
+// The stepper, in steps.
+class Motor {
+ public:
+  virtual ~Motor() {}
+  virtual int32_t getCurrentPosition()                = 0;
+  virtual void setCurrentPosition(int32_t position)   = 0;
+  virtual int32_t getTargetPosition()                 = 0;  // Where it stops once every queued move is done
+  virtual bool isRunning()                            = 0;
+  virtual void moveTo(int32_t position)               = 0;
+  virtual void stopMove()                             = 0;  // Brakes to a stop
+  virtual void setSpeed(uint32_t stepsPerSecond)      = 0;
+  virtual void setAcceleration(uint32_t stepsPerSec2) = 0;
+  // Keep the outputs on between moves instead of switching them off to cool.
+  virtual void setHoldEnabled(bool hold)    = 0;
+  virtual void setDirection(bool direction) = 0;
+};
+
+// The stepper driver's configuration and status over UART.
+class MotorDriver {
+ public:
+  virtual ~MotorDriver() {}
+  virtual void setCurrent(uint16_t runMa, float holdMultiplier) = 0;
+  virtual uint16_t getCurrentScale()                            = 0;  // CS_ACTUAL, 0-31
+  virtual void setStealthChop(bool enabled)                     = 0;
+  // DRV_STATUS. False when the driver didn't answer or the CRC was bad.
+  virtual bool readStatus(uint32_t &status) = 0;
+};
+
+// Whole-file storage. Paths start with '/'.
+class FileSystem {
+ public:
+  virtual ~FileSystem() {}
+  virtual int32_t size(const char *path) = 0;  // -1 if missing
+  // Up to length bytes from offset. -1 if missing.
+  virtual int32_t read(const char *path, uint32_t offset, uint8_t *buffer, size_t length) = 0;
+  // Replaces the file.
+  virtual bool write(const char *path, const uint8_t *data, size_t length) = 0;
+  // Adds to the end, creating the file if needed.
+  virtual bool append(const char *path, const uint8_t *data, size_t length) = 0;
+  virtual bool remove(const char *path)                                     = 0;
+};
+
+// What the control code needs from BLE.
+class BleLink {
+ public:
+  virtual ~BleLink() {}
+  virtual int connectedClients() = 0;
+  // Writes to the connected FTMS trainer's control point, if there is one.
+  virtual void writeControlPoint(const uint8_t *data, size_t length) = 0;
+};
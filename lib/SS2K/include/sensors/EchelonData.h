@@ -13,20 +13,9 @@ class EchelonData : public SensorData {
  public:
   EchelonData() : SensorData("ECH") {}
 
-  bool hasHeartRate();
-  bool hasCadence();
-  bool hasPower();
-  bool hasSpeed();
-  bool hasResistance();
-  int getHeartRate();
-  float getCadence();
-  int getPower();
-  float getSpeed();
-  int getResistance();
   void decode(uint8_t *data, size_t length);
 
  private:
   float cadence  = nanf("");
   int resistance = INT_MIN;
-  int power      = INT_MIN;
 };
@@ -8,54 +8,17 @@
 #pragma once
 
 #include "SensorData.h"
+#include "IndoorBikeData.h"
 
 class FitnessMachineIndoorBikeData : public SensorData {
  public:
-  FitnessMachineIndoorBikeData() : SensorData("FTMS(IBD)") {
-    for (int i = 0; i < FieldCount; i++) {
-      this->values[i] = nan("");
-    }
-  }
+  FitnessMachineIndoorBikeData() : SensorData("FTMS(IBD)") { values.clear(); }
 
-  bool hasHeartRate();
-  bool hasCadence();
-  bool hasPower();
-  bool hasSpeed();
-  bool hasResistance();
-  int getHeartRate();
-  float getCadence();
-  int getPower();
-  float getSpeed();
-  int getResistance();
   void decode(uint8_t *data, size_t length);
 
-  enum Types : uint8_t {
-    InstantaneousSpeed   = 0,
-    AverageSpeed         = 1,
-    InstantaneousCadence = 2,
-    AverageCadence       = 3,
-    TotalDistance        = 4,
-    ResistanceLevel      = 5,
-    InstantaneousPower   = 6,
-    AveragePower         = 7,
-    TotalEnergy          = 8,
-    HeartRate            = 9,
-    EnergyPerMinute      = 10,
-    ElapsedTime          = 11,
-    RemainingTime        = 14
-  };
-
-  static constexpr uint8_t FieldCount = Types::RemainingTime + 1;
+  // Every field of the last packet, including the ones SensorSample has no place for.
+  const IndoorBikeData::Values &getValues() const { return values; }
 
  private:
-  double_t values[FieldCount];
-
-  // https://github.com/oesmith/gatt-xml/blob/master/org.bluetooth.characteristic.indoor_bike_data.xml
-  static uint8_t const flagBitIndices[];
-  static uint8_t const flagEnabledValues[];
-  static size_t const byteSizes[];
-  static uint8_t const signedFlags[];
-  static double_t const resolutions[];
-
-  static int convert(int value, size_t length, uint8_t isSigned);
+  IndoorBikeData::Values values;
 };
@@ -13,18 +13,5 @@ class HeartRateData : public SensorData {
  public:
   HeartRateData() : SensorData("HRS(HRM)") {}
 
-  bool hasHeartRate();
-  bool hasCadence();
-  bool hasPower();
-  bool hasSpeed();
-  bool hasResistance();
-  int getHeartRate();
-  float getCadence();
-  int getPower();
-  float getSpeed();
-  int getResistance();
   void decode(uint8_t *data, size_t length);
-
- private:
-  int heartrate = INT_MIN;
 };
@@ -13,22 +13,5 @@ class PelotonData : public SensorData {
  public:
   PelotonData() : SensorData("PTON") {}
 
-  bool hasHeartRate();
-  bool hasCadence();
-  bool hasPower();
-  bool hasSpeed();
-  bool hasResistance();
-  int getHeartRate();
-  float getCadence();
-  int getPower();
-  float getSpeed();
-  int getResistance();
   void decode(uint8_t *data, size_t length);
-
- private:
-  bool hasData  = false;
-  float cadence = nanf("");
-  int power     = INT_MIN;
-  int resistance = INT_MIN;
-  bool receivedResistance = false;
 };
\ No newline at end of file
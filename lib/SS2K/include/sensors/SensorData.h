@@ -10,93 +10,98 @@
 #include <climits>
 #include <cmath>
 #include <cstdint>
-#include <string>
+#include <cstring>
+#include "sensors/SensorSample.h"
 
 class SensorData {
  public:
   /**
    * @brief Constructor
    */
-  explicit SensorData(std::string id) : id(id) {}
+  explicit SensorData(const char *id) : id(id) { memset(&sample, 0, sizeof(sample)); }
 
   /**
    * @brief Get the Id.
    * @return The unique identifier of the sensor.
    */
-  std::string getId();
+  const char *getId() const { return this->id; }
+
+  /**
+   * @brief Get everything the last decode() produced.
+   * @return The sample. Only fields flagged in sample.present are valid.
+   */
+  const SensorSample &getSample() const { return this->sample; }
 
   /**
    * @brief Does this sensor have Heartrate data?
    * @return True if there is Heartrate data present.
    */
-  virtual bool hasHeartRate() = 0;
+  bool hasHeartRate() const { return sample.has(SensorSample::HEART_RATE); }
 
   /**
    * @brief Does this sensor have Cadence data?
    * @return True if there is Cadence data present.
    */
-  virtual bool hasCadence() = 0;
+  bool hasCadence() const { return sample.has(SensorSample::CADENCE); }
 
   /**
    * @brief Does this sensor have Power data?
    * @return True if there is Power data present.
    */
-  virtual bool hasPower() = 0;
+  bool hasPower() const { return sample.has(SensorSample::POWER); }
 
   /**
    * @brief Does this sensor have Speed data?
    * @return True if there is Speed data present.
    */
-  virtual bool hasSpeed() = 0;
+  bool hasSpeed() const { return sample.has(SensorSample::SPEED); }
 
   /**
    * @brief Does this sensor have Resistance data?
    * @return True if there is Resistance data present.
    */
-  virtual bool hasResistance() = 0;
+  bool hasResistance() const { return sample.has(SensorSample::RESISTANCE); }
 
   /**
    * @brief Get the Heartrate data.
-   * @details hasHeartRateData must be called first to check for the availability of data.
    * @return The Heartrate data or INT_MIN if the data is not present.
    */
-  virtual int getHeartRate() = 0;
+  int getHeartRate() const { return hasHeartRate() ? sample.heartRate : INT_MIN; }
 
   /**
    * @brief Get the Cadence data.
-   * @details hasCadenceData must be called first to check for the availability of data.
    * @return The Cadence data or NAN if the data is not present.
    */
-  virtual float getCadence() = 0;
+  float getCadence() const { return hasCadence() ? sample.getCadence() : nanf(""); }
 
   /**
    * @brief Get the Power data.
-   * @details hasPowerData must be called first to check for the availability of data.
    * @return The Power data or INT_MIN if the data is not present.
    */
-  virtual int getPower() = 0;
+  int getPower() const { return hasPower() ? sample.power : INT_MIN; }
 
   /**
    * @brief Get the Speed data.
-   * @details hasSpeedData must be called first to check for the availability of data.
    * @return The Speed data or NAN if the data is not present.
    */
-  virtual float getSpeed() = 0;
+  float getSpeed() const { return hasSpeed() ? sample.getSpeed() : nanf(""); }
 
   /**
    * @brief Get the resistance data.
-   * @details hasResistanceData must be called first to check for the availability of data.
    * @return The Resistance data or INT_MIN if the data is not present.
    */
-  virtual int getResistance() = 0;
+  int getResistance() const { return hasResistance() ? sample.resistance : INT_MIN; }
 
   /**
-   * @brief Decodes the sensor data and stores the parsed Heartrate, Cadence, Power and Speed.
+   * @brief Decodes the sensor data into the sample.
    * @param [in] data The sensor data.
    * @param [in] length The length of the data in bytes.
    */
   virtual void decode(uint8_t *data, size_t length) = 0;
 
+ protected:
+  SensorSample sample;
+
  private:
-  std::string id;
+  const char *id;
 };
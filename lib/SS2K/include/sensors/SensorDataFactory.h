@@ -7,48 +7,101 @@
 
 #pragma once
 
-#include <memory>
 #include <NimBLEUUID.h>
-#include <vector>
 #include "sensors/SensorData.h"
+#include "sensors/CyclePowerData.h"
+#include "sensors/FlywheelData.h"
+#include "sensors/FitnessMachineIndoorBikeData.h"
+#include "sensors/HeartRateData.h"
+#include "sensors/EchelonData.h"
+#include "sensors/PelotonData.h"
 
+// Finds the decoder for a (characteristic, peer) pair with one hash lookup per packet. Decoders live in
+// fixed pools inside the factory, so nothing is allocated or reference counted once a sensor is known.
+// When a new peer needs a decoder and the pool is taken, the one that has gone longest without a packet
+// is reset and reused. A peer that disconnected stops sending, so its decoder is the first to go.
 class SensorDataFactory {
  public:
-  SensorDataFactory() {}
+  static const size_t POOL_SIZE = 4;   // Decoders of each type. Only NUM_BLE_DEVICES peers are connected at once.
+  static const size_t MAP_SIZE  = 32;  // Power of two, kept well over the number of characteristics connected at once.
 
-  std::shared_ptr<SensorData> getSensorData(NimBLEUUID characteristicUUID, const uint64_t peerAddress, uint8_t *data, size_t length);
+  SensorDataFactory();
+
+  // Identifies a characteristic on a peer. The 16 and 128 bit forms of a UUID give the same key.
+  static uint64_t getKey(const NimBLEUUID &characteristicUUID, const uint64_t peerAddress);
+
+  // Decodes the packet with this peer's decoder, creating it on first use. Never null: characteristics
+  // that can't be decoded (or don't fit) get a decoder that reports no data.
+  SensorData *getSensorData(const NimBLEUUID &characteristicUUID, const uint64_t peerAddress, uint8_t *data, size_t length);
+  // Same as above for callers that keep the key.
+  SensorData *getSensorData(uint64_t key, const NimBLEUUID &characteristicUUID, uint8_t *data, size_t length);
 
  private:
-  class KnownDevice {
+  static const uint64_t EMPTY_KEY = 0;
+
+  template <typename T>
+  class DecoderPool {
    public:
-    KnownDevice(const NimBLEUUID characteristicUUID, const uint64_t peerAddress, std::shared_ptr<SensorData> sensorData)
-        : characteristicId(characteristicUUID), peerAddress(peerAddress), sensorData(sensorData) {}
-    std::shared_ptr<SensorData> decode(uint8_t *data, size_t length);
-    bool isSameDeviceCharacteristic(const NimBLEUUID characteristicUUID, const uint64_t peerAddress);
+    DecoderPool() { memset(inUse, 0, sizeof(inUse)); }
+    // A freshly reset decoder, or nullptr when all of them are taken.
+    T *acquire() {
+      for (size_t i = 0; i < POOL_SIZE; i++) {
+        if (!inUse[i]) {
+          inUse[i]    = true;
+          decoders[i] = T();
+          return &decoders[i];
+        }
+      }
+      return nullptr;
+    }
+    bool owns(const SensorData *sensorData) const {
+      for (size_t i = 0; i < POOL_SIZE; i++) {
+        if (sensorData == &decoders[i]) {
+          return true;
+        }
+      }
+      return false;
+    }
+    void release(const SensorData *sensorData) {
+      for (size_t i = 0; i < POOL_SIZE; i++) {
+        inUse[i] = inUse[i] && (sensorData != &decoders[i]);
+      }
+    }
 
    private:
-    NimBLEUUID characteristicId;
-    uint64_t peerAddress;
-    std::shared_ptr<SensorData> sensorData;
+    T decoders[POOL_SIZE];
+    bool inUse[POOL_SIZE];
+  };
+
+  struct Slot {
+    uint64_t key;
+    SensorData *sensorData;
+    uint32_t lastUsed;
   };
 
   class NullData : public SensorData {
    public:
     NullData() : SensorData("Null") {}
 
-    virtual bool hasHeartRate();
-    virtual bool hasCadence();
-    virtual bool hasPower();
-    virtual bool hasSpeed();
-    virtual bool hasResistance();
-    virtual int getHeartRate();
-    virtual float getCadence();
-    virtual int getPower();
-    virtual float getSpeed();
-    virtual int getResistance();
     virtual void decode(uint8_t *data, size_t length);
   };
 
-  std::vector<KnownDevice *> knownDevices;
-  static std::shared_ptr<SensorData> NULL_SENSOR_DATA;
+  Slot slots[MAP_SIZE];
+  DecoderPool<CyclePowerData> cyclePowerDecoders;
+  DecoderPool<HeartRateData> heartRateDecoders;
+  DecoderPool<FitnessMachineIndoorBikeData> indoorBikeDecoders;
+  DecoderPool<FlywheelData> flywheelDecoders;
+  DecoderPool<EchelonData> echelonDecoders;
+  DecoderPool<PelotonData> pelotonDecoders;
+  NullData nullData;
+  size_t count;
+  uint32_t sequence;  // Bumped every packet, for lastUsed
+
+  SensorData *createSensorData(const NimBLEUUID &characteristicUUID);
+  template <typename T>
+  SensorData *acquire(DecoderPool<T> &pool);
+  // Has slot index gone longer without a packet than slot than? Anything beats MAP_SIZE.
+  bool isOlder(size_t index, size_t than) const;
+  // Returns the slot's decoder to its pool.
+  void remove(size_t index);
 };
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <NimBLEUUID.h>
+#include "sensors/SensorSample.h"
+
+// Picks one source for each measurement out of every sensor that reports it.
+//
+// A source is one decoder on one peer (the SensorDataFactory key). Its kind sets its priority for each field, so power
+// and cadence come from a power meter over a bike's own estimate, and resistance from a Peloton over anything else.
+// A field follows the best source that reported it in the last STALE_MS; if that source goes quiet the next best takes
+// over, and once none is left the field stops being fresh so the caller can zero it. Readings outside what a rider can
+// produce are rejected and counted against the source rather than shown, and a heart rate of 0 (no skin contact)
+// leaves the field to other sources. Equal priorities keep to one source while it stays fresh, so the choice doesn't flap.
+class SensorFusion {
+ public:
+  static const uint32_t STALE_MS  = 3000;
+  static const size_t MAX_SOURCES = 8;
+  static const size_t FIELDS      = 5;     // SensorSample fields, HEART_RATE to RESISTANCE
+  static const uint8_t NEVER      = 0xFF;  // Priority that keeps a kind from supplying a field
+
+  enum Kind : uint8_t { PowerMeter = 0, HeartMonitor = 1, FitnessMachine = 2, Peloton = 3 };
+  static const size_t KINDS = 4;
+
+  struct Source {
+    uint64_t key;  // 0 for a free slot
+    Kind kind;
+    uint8_t seen;  // Fields ever accepted
+    uint32_t lastMs[FIELDS];
+    uint32_t lastPacketMs;
+    SensorSample latest;
+    uint32_t packets;
+    uint32_t rejected;  // Implausible readings
+  };
+
+  SensorFusion();
+
+  // Lower wins. The defaults are in the constructor.
+  void setPriority(Kind kind, SensorSample::Field field, uint8_t priority);
+  // Power and cadence from the bike's own sensors (FitnessMachine, then Peloton) ahead of a power meter, for riders
+  // who trust the bike more. False puts the defaults back.
+  void setPreferBike(bool preferBike);
+  uint8_t getPriority(Kind kind, SensorSample::Field field) const;
+
+  // Takes a decoded packet. Returns the fields this source is now selected for, which are the ones to apply.
+  uint8_t offer(uint32_t nowMs, uint64_t key, Kind kind, const SensorSample &sample);
+  // Fields with at least one source that isn't stale.
+  uint8_t getFresh(uint32_t nowMs) const;
+  // The selected source for a field, or nullptr when it has none.
+  const Source *getSelected(uint32_t nowMs, SensorSample::Field field) const;
+  const Source &getSource(size_t index) const { return sources[index]; }
+
+  static Kind getKind(const NimBLEUUID &characteristicUUID);
+  static const char *getKindName(Kind kind);
+
+ private:
+  static size_t fieldIndex(SensorSample::Field field);
+  static bool plausible(const SensorSample &sample, SensorSample::Field field);
+  bool isFresh(const Source &source, size_t field, uint32_t nowMs) const;
+  int select(uint32_t nowMs, size_t field) const;
+  Source *findSource(uint32_t nowMs, uint64_t key, Kind kind);
+
+  Source sources[MAX_SOURCES];
+  uint8_t priorities[KINDS][FIELDS];
+};
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Everything a decoder knows after a packet, in one plain struct. A field only means something when its
+// bit is set in present. Cadence and speed are Q16.16 fixed point so no floats are needed until display.
+struct SensorSample {
+  enum Field : uint8_t {
+    HEART_RATE = 0x01,
+    CADENCE    = 0x02,
+    POWER      = 0x04,
+    SPEED      = 0x08,
+    RESISTANCE = 0x10,
+  };
+
+  static const int FRACTION_BITS = 16;
+
+  uint8_t present;
+  uint16_t heartRate;  // BPM
+  int16_t power;       // Watts
+  int16_t resistance;  // Device specific units
+  int32_t cadence;     // RPM, Q16.16
+  int32_t speed;       // km/h, Q16.16
+
+  bool has(Field field) const { return (present & field) != 0; }
+  void clear() { present = 0; }
+
+  void setHeartRate(int value) {
+    heartRate = (uint16_t)value;
+    present |= HEART_RATE;
+  }
+  void setPower(int value) {
+    power = (int16_t)value;
+    present |= POWER;
+  }
+  void setResistance(int value) {
+    resistance = (int16_t)value;
+    present |= RESISTANCE;
+  }
+  void setCadence(float value) {
+    cadence = toFixed(value);
+    present |= CADENCE;
+  }
+  void setSpeed(float value) {
+    speed = toFixed(value);
+    present |= SPEED;
+  }
+
+  float getCadence() const { return fromFixed(cadence); }
+  float getSpeed() const { return fromFixed(speed); }
+
+  // Exact for anything the GATT formats produce (1/2 RPM, 1/100 km/h steps and coarser).
+  static int32_t fixed(int32_t numerator, int32_t denominator) { return (int32_t)(((int64_t)numerator << FRACTION_BITS) / denominator); }
+  // Saturates rather than wrapping negative when a malformed packet decodes to 32768 or more.
+  static int32_t toFixed(float value) {
+    float scaled = value * (1 << FRACTION_BITS);
+    if (std::isnan(scaled)) {
+      return 0;
+    }
+    if (scaled >= 2147483647.0f) {
+      return INT32_MAX;
+    }
+    if (scaled <= -2147483648.0f) {
+      return INT32_MIN;
+    }
+    return (int32_t)lroundf(scaled);
+  }
+  static float fromFixed(int32_t value) { return (float)value / (1 << FRACTION_BITS); }
+};
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "AssetCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+AssetCache::AssetCache(size_t budget, size_t maxFileSize) : count(0), budget(budget), maxFileSize(maxFileSize), used(0) {
+  memset(entries, 0, sizeof(entries));
+  memset(&stats, 0, sizeof(stats));
+}
+
+AssetCache::Entry *AssetCache::find(const char *path, bool gzip) {
+  for (size_t i = 0; i < count; i++) {
+    if ((entries[i].gzip == gzip) && (strcmp(entries[i].path, path) == 0)) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+AssetCache::Entry *AssetCache::add(const char *path, bool gzip, uint32_t etag, uint32_t size) {
+  if (strlen(path) >= MAX_PATH) {
+    return nullptr;
+  }
+  Entry *entry = find(path, gzip);
+  if (entry == nullptr) {
+    if (count < MAX_ENTRIES) {
+      entry = &entries[count++];
+    } else {
+      entry = &entries[0];
+      for (size_t i = 1; i < count; i++) {
+        if (entries[i].hits < entry->hits) {
+          entry = &entries[i];
+        }
+      }
+    }
+    entry->hits = 0;
+  }
+  release(entry);  // Evicted, or the file changed. Either way the old copy is stale.
+  strcpy(entry->path, path);
+  entry->gzip = gzip;
+  entry->etag = etag;
+  entry->size = size;
+  return entry;
+}
+
+uint8_t *AssetCache::reserve(Entry *entry) {
+  if ((entry == nullptr) || (entry->data != nullptr) || (entry->size == 0) || (entry->size > maxFileSize) || (entry->size > budget)) {
+    return nullptr;
+  }
+  while (used + entry->size > budget) {
+    Entry *coldest = nullptr;
+    for (size_t i = 0; i < count; i++) {
+      if ((entries[i].data != nullptr) && ((coldest == nullptr) || (entries[i].hits < coldest->hits))) {
+        coldest = &entries[i];
+      }
+    }
+    // Only make room for something more popular than what's already here.
+    if ((coldest == nullptr) || (coldest->hits >= entry->hits)) {
+      return nullptr;
+    }
+    release(coldest);
+  }
+  entry->data = (uint8_t *)malloc(entry->size);
+  if (entry->data != nullptr) {
+    used += entry->size;
+  }
+  return entry->data;
+}
+
+void AssetCache::invalidate(const char *path) {
+  for (size_t i = 0; i < count;) {
+    if (strcmp(entries[i].path, path) == 0) {
+      release(&entries[i]);
+      entries[i] = entries[--count];
+    } else {
+      i++;
+    }
+  }
+}
+
+void AssetCache::clear() {
+  for (size_t i = 0; i < count; i++) {
+    release(&entries[i]);
+  }
+  count = 0;
+}
+
+void AssetCache::release(Entry *entry) {
+  if (entry->data != nullptr) {
+    free(entry->data);
+    entry->data = nullptr;
+    used -= entry->size;
+  }
+}
+
+uint32_t AssetCache::hash(uint32_t hash, const uint8_t *data, size_t length) {
+  while (length--) {
+    hash ^= *data++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+void AssetCache::formatEtag(uint32_t etag, char *out) { snprintf(out, ETAG_LENGTH, "\"%08x\"", (unsigned int)etag); }
+
+bool AssetCache::etagMatches(const char *ifNoneMatch, uint32_t etag) {
+  if (ifNoneMatch == nullptr) {
+    return false;
+  }
+  char expected[ETAG_LENGTH];
+  formatEtag(etag, expected);
+  const char *p = ifNoneMatch;
+  while (*p) {
+    while ((*p == ' ') || (*p == ',')) {
+      p++;
+    }
+    if (*p == '*') {
+      return true;
+    }
+    // If-None-Match uses weak comparison
+    if (strncmp(p, "W/", 2) == 0) {
+      p += 2;
+    }
+    if (strncmp(p, expected, ETAG_LENGTH - 1) == 0) {
+      return true;
+    }
+    while (*p && (*p != ',')) {
+      p++;
+    }
+  }
+  return false;
+}
+
+bool AssetCache::acceptsGzip(const char *acceptEncoding) {
+  if (acceptEncoding == nullptr) {
+    return false;
+  }
+  const char *p = acceptEncoding;
+  while (*p) {
+    while ((*p == ' ') || (*p == ',')) {
+      p++;
+    }
+    const char *token = p;
+    while (*p && (*p != ',') && (*p != ';') && (*p != ' ')) {
+      p++;
+    }
+    size_t length = p - token;
+    bool named    = ((length == 4) && (strncasecmp(token, "gzip", 4) == 0)) || ((length == 1) && (*token == '*'));
+    // Skip to the parameters, if any. Only an explicit q=0 turns an encoding off.
+    while (*p == ' ') {
+      p++;
+    }
+    bool refused = false;
+    if (*p == ';') {
+      const char *q   = strstr(p, "q=");
+      const char *end = strchr(p, ',');
+      if ((q != nullptr) && ((end == nullptr) || (q < end))) {
+        refused = (atof(q + 2) == 0.0);
+      }
+    }
+    if (named) {
+      return !refused;
+    }
+    while (*p && (*p != ',')) {
+      p++;
+    }
+  }
+  return false;
+}
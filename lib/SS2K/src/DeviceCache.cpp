@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "DeviceCache.h"
+#include <stdio.h>
+#include <string.h>
+
+DeviceCache::DeviceCache() : round(0) { this->clear(); }
+
+void DeviceCache::clear() {
+  memset(devices, 0, sizeof(devices));
+  count = 0;
+}
+
+size_t DeviceCache::home(uint64_t address) {
+  // Fibonacci hashing. The low bytes of random addresses are random, but vendor addresses share their top three.
+  return (size_t)((address * 11400714819323198485ULL) >> 59) & (CAPACITY - 1);
+}
+
+const DeviceCache::Device *DeviceCache::find(uint64_t address) const {
+  for (size_t probe = 0; probe < CAPACITY; probe++) {
+    const Device &device = devices[(home(address) + probe) & (CAPACITY - 1)];
+    if ((device.address == address) || (device.address == 0)) {
+      return (device.address == 0) ? nullptr : &device;
+    }
+  }
+  return nullptr;
+}
+
+// Backward shift, so lookups never need tombstones.
+void DeviceCache::remove(size_t index) {
+  devices[index].address = 0;
+  count--;
+  size_t hole = index;
+  for (size_t next = (index + 1) & (CAPACITY - 1); devices[next].address != 0; next = (next + 1) & (CAPACITY - 1)) {
+    size_t wanted = home(devices[next].address);
+    // Move it back unless its home lies after the hole, up to where it sits.
+    bool stays = (hole <= next) ? ((hole < wanted) && (wanted <= next)) : ((hole < wanted) || (wanted <= next));
+    if (!stays) {
+      devices[hole]         = devices[next];
+      devices[next].address = 0;
+      hole                  = next;
+    }
+  }
+}
+
+DeviceCache::Device *DeviceCache::update(uint32_t nowMs, uint64_t address, int8_t rssi, uint8_t services, bool &firstInRound) {
+  Device *device = const_cast<Device *>(this->find(address));
+  if (device == nullptr) {
+    if (count >= MAX_DEVICES) {
+      size_t oldest = CAPACITY;
+      for (size_t i = 0; i < CAPACITY; i++) {
+        if ((devices[i].address != 0) && ((oldest == CAPACITY) || (nowMs - devices[i].lastSeenMs > nowMs - devices[oldest].lastSeenMs))) {
+          oldest = i;
+        }
+      }
+      this->remove(oldest);
+    }
+    size_t index = home(address);
+    while (devices[index].address != 0) {
+      index = (index + 1) & (CAPACITY - 1);
+    }
+    device = &devices[index];
+    memset(device, 0, sizeof(*device));
+    device->address = address;
+    device->rssi    = rssi * 16;
+    device->round   = round - 1;
+    count++;
+  }
+  device->rssi += (rssi * 16 - device->rssi) / RSSI_WEIGHT;
+  device->services |= services;
+  device->lastSeenMs = nowMs;
+  device->adverts++;
+  firstInRound  = (device->round != round);
+  device->round = round;
+  return device;
+}
+
+void DeviceCache::setName(Device *device, const char *name, size_t length) {
+  length = (length < NAME_SIZE - 1) ? length : NAME_SIZE - 1;
+  memcpy(device->name, name, length);
+  device->name[length] = '\0';
+}
+
+size_t DeviceCache::uniqueName(const Device &device, char *out, size_t capacity) {
+  int length;
+  if (device.name[0] != '\0') {
+    length = snprintf(out, capacity, "%s %02x", device.name, (unsigned)(device.address & 0xFF));
+  } else {
+    uint8_t bytes[6];
+    for (int i = 0; i < 6; i++) {
+      bytes[i] = (uint8_t)(device.address >> (8 * (5 - i)));
+    }
+    length = snprintf(out, capacity, "%02x:%02x:%02x:%02x:%02x:%02x", bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5]);
+  }
+  return (length < 0) ? 0 : ((size_t)length < capacity) ? (size_t)length : capacity - 1;
+}
+
+const char *DeviceCache::getServiceUUID(uint8_t services) {
+  static const char *const uuids[SERVICES] = {
+      "6e400001-b5a3-f393-e0a9-e50e24dcca9e",  // Flywheel
+      "0x1826",                                // Fitness Machine
+      "0x1818",                                // Cycling Power
+      "0bf669f0-45f2-11e7-9598-0800200c9a66",  // Echelon
+      "0x180d",                                // Heart Rate
+      "0x1812",                                // HID
+  };
+  for (size_t i = 0; i < SERVICES; i++) {
+    if (services & (1 << i)) {
+      return uuids[i];
+    }
+  }
+  return "";
+}
+
+// Appends a JSON string, escaping what a device name could break it with.
+static size_t putString(const char *value, char *out, size_t capacity) {
+  size_t length = 0;
+  if (length < capacity) {
+    out[length++] = '"';
+  }
+  for (const char *c = value; *c && (length + 2 < capacity); c++) {
+    if ((*c == '"') || (*c == '\\')) {
+      out[length++] = '\\';
+      out[length++] = *c;
+    } else if ((unsigned char)*c >= 0x20) {
+      out[length++] = *c;
+    }
+  }
+  if (length < capacity) {
+    out[length++] = '"';
+  }
+  return length;
+}
+
+size_t DeviceCache::toJSON(uint32_t nowMs, char *out, size_t capacity) const {
+  if (capacity < 3) {
+    return 0;
+  }
+  size_t length = 0;
+  out[length++] = '{';
+  int index     = 0;
+  for (size_t i = 0; i < CAPACITY; i++) {
+    const Device &device = devices[i];
+    if ((device.address == 0) || (device.services == 0)) {
+      continue;
+    }
+    char entry[160];
+    char name[NAME_SIZE + 4];
+    uniqueName(device, name, sizeof(name));
+    int used = snprintf(entry, sizeof(entry), "%s\"device %d\":{\"name\":", (index > 0) ? "," : "", index);
+    used += putString(name, entry + used, sizeof(entry) - used);
+    used += snprintf(entry + used, sizeof(entry) - used, ",\"UUID\":\"%s\",\"rssi\":%d,\"ageMs\":%lu}", getServiceUUID(device.services), getRssi(device),
+                     (unsigned long)(nowMs - device.lastSeenMs));
+    if ((used >= (int)sizeof(entry)) || (length + used + 2 > capacity)) {
+      break;
+    }
+    memcpy(out + length, entry, used);
+    length += used;
+    index++;
+  }
+  out[length++] = '}';
+  out[length]   = '\0';
+  return length;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "Drivetrain.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr float Drivetrain::START_RATIO;
+
+Drivetrain::Drivetrain() : gearCount(0), gear(0), wheelCircumference(0), ringCount(0), cogCount(0) {
+  // A 2x11 road bike until the user's settings are loaded.
+  configure("34,50", "11,12,13,14,15,17,19,21,23,25,28", 2127);
+}
+
+bool Drivetrain::configure(const char *chainrings, const char *cassette, uint16_t wheelCircumference) {
+  uint8_t newRings[MAX_CHAINRINGS];
+  uint8_t newCogs[MAX_COGS];
+  size_t newRingCount = parseTeeth(chainrings, newRings, MAX_CHAINRINGS);
+  size_t newCogCount  = parseTeeth(cassette, newCogs, MAX_COGS);
+  if ((newRingCount == 0) || (newCogCount == 0) || (wheelCircumference == 0)) {
+    return false;
+  }
+  if ((newRingCount == ringCount) && (newCogCount == cogCount) && (wheelCircumference == this->wheelCircumference) && (memcmp(newRings, rings, ringCount) == 0) &&
+      (memcmp(newCogs, cogs, cogCount) == 0)) {
+    return true;
+  }
+
+  // Insertion sort by ratio. There are at most 39 of them, and this only runs when the settings change.
+  // Built aside so the current ladder is untouched until the new one is complete.
+  Gear built[MAX_GEARS];
+  size_t builtCount = 0;
+  for (size_t r = 0; r < newRingCount; r++) {
+    for (size_t c = 0; c < newCogCount; c++) {
+      Gear next = {newRings[r], newCogs[c], (float)newRings[r] / newCogs[c]};
+      size_t i  = builtCount++;
+      while ((i > 0) && (built[i - 1].ratio > next.ratio)) {
+        built[i] = built[i - 1];
+        i--;
+      }
+      built[i] = next;
+    }
+  }
+  size_t kept = 1;
+  for (size_t i = 1; i < builtCount; i++) {
+    if (built[i].ratio > built[kept - 1].ratio * 1.01f) {
+      built[kept++] = built[i];
+    }
+  }
+
+  float ratio    = (gearCount > 0) ? gears[gear].ratio : START_RATIO;
+  size_t nearest = 0;
+  for (size_t i = 1; i < kept; i++) {
+    if (fabsf(built[i].ratio - ratio) < fabsf(built[nearest].ratio - ratio)) {
+      nearest = i;
+    }
+  }
+
+  memcpy(gears, built, kept * sizeof(Gear));
+  memcpy(rings, newRings, newRingCount);
+  memcpy(cogs, newCogs, newCogCount);
+  gearCount                = kept;
+  gear                     = nearest;
+  ringCount                = newRingCount;
+  cogCount                 = newCogCount;
+  this->wheelCircumference = wheelCircumference;
+  return true;
+}
+
+int Drivetrain::shift(int delta) {
+  int target = (int)gear + delta;
+  if (target < 0) {
+    target = 0;
+  }
+  if (target >= (int)gearCount) {
+    target = gearCount - 1;
+  }
+  int moved = target - (int)gear;
+  gear      = target;
+  return moved;
+}
+
+void Drivetrain::setGear(size_t gear) { this->gear = (gear < gearCount) ? gear : gearCount - 1; }
+
+size_t Drivetrain::parseTeeth(const char *text, uint8_t *teeth, size_t max) {
+  if (text == nullptr) {
+    return 0;
+  }
+  size_t count  = 0;
+  const char *p = text;
+  while (true) {
+    while (*p == ' ') {
+      p++;
+    }
+    if (!isdigit((unsigned char)*p)) {
+      return 0;
+    }
+    char *end   = nullptr;
+    long number = strtol(p, &end, 10);
+    if ((number <= 0) || (number > 255) || (count == max)) {
+      return 0;
+    }
+    teeth[count++] = (uint8_t)number;
+    p              = end;
+    while (*p == ' ') {
+      p++;
+    }
+    if (*p == '\0') {
+      return count;
+    }
+    if (*p != ',') {
+      return 0;
+    }
+    p++;
+  }
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "ErgControl.h"
+#include <math.h>
+
+bool ErgControl::targetFromFtms(const uint8_t *data, size_t length, int *watts) {
+  if (length < 2) {
+    return false;
+  }
+  *watts = (int16_t)(data[0] | (data[1] << 8));
+  return true;
+}
+
+static float deviation(int watts, int target) { return ((float)(target - watts) * 100.0) / ((float)target); }
+
+float ErgControl::inSetpoint(float position, int watts, int target, float sensitivity) {
+  float factor = fabsf(deviation(watts, target)) > 10 ? sensitivity : sensitivity / 2;
+  return position + ((target - watts) * factor);
+}
+
+float ErgControl::setPointChange(float position, int watts, int target, float sensitivity) {
+  float factor = fabsf(deviation(watts, target)) > 10 ? sensitivity * 2 : sensitivity / 2;
+  return position + ((target - watts) * factor);
+}
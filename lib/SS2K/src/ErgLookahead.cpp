@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "ErgLookahead.h"
+
+// Signed difference, correct across a millis() wrap.
+static int32_t since(uint32_t nowMs, uint32_t thenMs) { return (int32_t)(nowMs - thenMs); }
+
+ErgLookahead::ErgLookahead() : count(0) {}
+
+bool ErgLookahead::schedule(uint32_t nowMs, uint32_t inMs, uint16_t watts) {
+  Target target = {nowMs + inMs, watts};
+  for (size_t i = 0; i < count; i++) {
+    int32_t apart = since(target.atMs, targets[i].atMs);
+    if ((apart > -(int32_t)MARGIN_MS) && (apart < (int32_t)MARGIN_MS)) {  // Same boundary announced again
+      targets[i].watts = watts;
+      return true;
+    }
+  }
+  if (count == MAX_TARGETS) {
+    return false;
+  }
+  size_t i = count++;
+  while ((i > 0) && (since(targets[i - 1].atMs, target.atMs) > 0)) {
+    targets[i] = targets[i - 1];
+    i--;
+  }
+  targets[i] = target;
+  return true;
+}
+
+const ErgLookahead::Target *ErgLookahead::next(uint32_t nowMs) {
+  size_t started = 0;
+  while ((started < count) && (since(nowMs, targets[started].atMs) >= 0)) {
+    started++;
+  }
+  if (started > 0) {
+    for (size_t i = started; i < count; i++) {
+      targets[i - started] = targets[i];
+    }
+    count -= started;
+  }
+  return (count > 0) ? &targets[0] : nullptr;
+}
+
+bool ErgLookahead::shouldStart(uint32_t nowMs, const Target &target, uint32_t travelMs) {
+  uint32_t lead = ((travelMs > MAX_LEAD_MS) ? MAX_LEAD_MS : travelMs) + MARGIN_MS;
+  return since(nowMs, target.atMs - lead) >= 0;
+}
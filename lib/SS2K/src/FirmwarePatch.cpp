@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "FirmwarePatch.h"
+#include "OtaReceiver.h"
+#include <string.h>
+
+static const uint8_t patchMagic[4] = {'S', '2', 'K', 'P'};
+
+static uint32_t patchGet32(const uint8_t *data) { return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24); }
+
+bool FirmwarePatch::isPatch(const uint8_t *data, size_t length) { return (length >= sizeof(patchMagic)) && (memcmp(data, patchMagic, sizeof(patchMagic)) == 0); }
+
+void FirmwarePatch::begin() {
+  state        = STATE_HEADER;
+  error        = PATCH_OK;
+  headerLength = 0;
+  targetSize   = 0;
+  targetCrc    = 0;
+  sourceSize   = 0;
+  sourceCrc    = 0;
+  op           = 0;
+  arg1         = 0;
+  arg2         = 0;
+  varint       = 0;
+  varintShift  = 0;
+  remaining    = 0;
+  sourceCursor = 0;
+  produced     = 0;
+  outputCrc    = 0;
+  outLength    = 0;
+}
+
+bool FirmwarePatch::write(const uint8_t *data, size_t length) {
+  size_t pos = 0;
+  while (pos < length) {
+    switch (state) {
+      case STATE_HEADER:
+        header[headerLength++] = data[pos++];
+        if ((headerLength == HEADER_SIZE) && !parseHeader()) {
+          return false;
+        }
+        break;
+
+      case STATE_OP:
+        op    = data[pos++];
+        arg1  = 0;
+        arg2  = 0;
+        state = STATE_ARG1;
+        if ((op != OP_LITERAL) && (op != OP_MATCH) && (op != OP_COPY)) {
+          return fail(PATCH_BAD_OP);
+        }
+        break;
+
+      case STATE_ARG1:
+        if (readVarint(data[pos++], &arg1)) {
+          if (op == OP_LITERAL) {
+            remaining = arg1;
+            state     = STATE_LITERAL;
+            if ((uint64_t)produced + remaining > targetSize) {
+              return fail(PATCH_TOO_LONG);
+            }
+          } else {
+            state = STATE_ARG2;
+          }
+        }
+        break;
+
+      case STATE_ARG2:
+        if (readVarint(data[pos++], &arg2) && !execute()) {
+          return false;
+        }
+        break;
+
+      case STATE_LITERAL:
+        while ((pos < length) && (remaining > 0)) {
+          if (!emit(data[pos++])) {
+            return false;
+          }
+          remaining--;
+        }
+        if (remaining == 0) {
+          state = (produced == targetSize) ? STATE_DONE : STATE_OP;
+        }
+        break;
+
+      case STATE_DONE:
+        return fail(PATCH_TOO_LONG);
+
+      case STATE_ERROR:
+        return false;
+    }
+  }
+  return state != STATE_ERROR;
+}
+
+bool FirmwarePatch::finish() {
+  if (state == STATE_ERROR) {
+    return false;
+  }
+  if (state != STATE_DONE) {
+    return fail(PATCH_INCOMPLETE);
+  }
+  if (!flush()) {
+    return false;
+  }
+  if (outputCrc != targetCrc) {
+    return fail(PATCH_CRC);
+  }
+  return true;
+}
+
+bool FirmwarePatch::fail(Error e) {
+  error = e;
+  state = STATE_ERROR;
+  return false;
+}
+
+bool FirmwarePatch::parseHeader() {
+  if (!isPatch(header, headerLength) || (header[4] != VERSION)) {
+    return fail(PATCH_BAD_HEADER);
+  }
+  targetSize = patchGet32(header + 8);
+  targetCrc  = patchGet32(header + 12);
+  sourceSize = patchGet32(header + 16);
+  sourceCrc  = patchGet32(header + 20);
+  if ((sourceSize > 0) && !checkSource()) {
+    return false;
+  }
+  state = (targetSize == 0) ? STATE_DONE : STATE_OP;
+  return true;
+}
+
+// A delta only makes sense against the exact firmware it was made from.
+bool FirmwarePatch::checkSource() {
+  if (reader == nullptr) {
+    return fail(PATCH_SOURCE_MISMATCH);
+  }
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < sourceSize; offset += OUT_CHUNK) {
+    size_t length = (sourceSize - offset < OUT_CHUNK) ? sourceSize - offset : OUT_CHUNK;
+    if (!reader(context, offset, out, length)) {
+      return fail(PATCH_READ_FAILED);
+    }
+    crc = OtaReceiver::crc32(crc, out, length);
+  }
+  if (crc != sourceCrc) {
+    return fail(PATCH_SOURCE_MISMATCH);
+  }
+  return true;
+}
+
+bool FirmwarePatch::readVarint(uint8_t byte, uint32_t *value) {
+  if (varintShift > 28) {
+    fail(PATCH_BAD_OP);
+    return false;
+  }
+  varint |= (uint32_t)(byte & 0x7F) << varintShift;
+  varintShift += 7;
+  if (byte & 0x80) {
+    return false;
+  }
+  *value      = varint;
+  varint      = 0;
+  varintShift = 0;
+  return true;
+}
+
+bool FirmwarePatch::execute() {
+  uint32_t length = arg2;
+  if ((uint64_t)produced + length > targetSize) {
+    return fail(PATCH_TOO_LONG);
+  }
+
+  if (op == OP_MATCH) {
+    uint32_t distance = arg1;
+    if ((distance == 0) || (distance > WINDOW) || (distance > produced)) {
+      return fail(PATCH_OUT_OF_RANGE);
+    }
+    // Byte by byte so a match can overlap the output it is producing.
+    for (uint32_t i = 0; i < length; i++) {
+      if (!emit(window[(produced - distance) % WINDOW])) {
+        return false;
+      }
+    }
+  } else {
+    int32_t delta = (int32_t)(arg1 >> 1) ^ -(int32_t)(arg1 & 1);
+    int64_t start = (int64_t)sourceCursor + delta;
+    if ((reader == nullptr) || (start < 0) || (start + length > sourceSize)) {
+      return fail(PATCH_OUT_OF_RANGE);
+    }
+    sourceCursor = (uint32_t)start;
+    uint8_t chunk[64];
+    while (length > 0) {
+      size_t take = (length < sizeof(chunk)) ? length : sizeof(chunk);
+      if (!reader(context, sourceCursor, chunk, take)) {
+        return fail(PATCH_READ_FAILED);
+      }
+      for (size_t i = 0; i < take; i++) {
+        if (!emit(chunk[i])) {
+          return false;
+        }
+      }
+      sourceCursor += take;
+      length -= take;
+    }
+  }
+
+  state = (produced == targetSize) ? STATE_DONE : STATE_OP;
+  return true;
+}
+
+bool FirmwarePatch::emit(uint8_t byte) {
+  window[produced % WINDOW] = byte;
+  produced++;
+  out[outLength++] = byte;
+  if (outLength == OUT_CHUNK) {
+    return flush();
+  }
+  return true;
+}
+
+bool FirmwarePatch::flush() {
+  if (outLength == 0) {
+    return true;
+  }
+  outputCrc = OtaReceiver::crc32(outputCrc, out, outLength);
+  if (!writer(context, out, outLength)) {
+    return fail(PATCH_WRITE_FAILED);
+  }
+  outLength = 0;
+  return true;
+}
+
+const char *FirmwarePatch::getErrorString() {
+  switch (error) {
+    case PATCH_OK:
+      return "OK";
+    case PATCH_BAD_HEADER:
+      return "Bad header";
+    case PATCH_SOURCE_MISMATCH:
+      return "Patch is for different firmware";
+    case PATCH_BAD_OP:
+      return "Bad op";
+    case PATCH_OUT_OF_RANGE:
+      return "Reference out of range";
+    case PATCH_TOO_LONG:
+      return "Output too long";
+    case PATCH_READ_FAILED:
+      return "Read failed";
+    case PATCH_WRITE_FAILED:
+      return "Write failed";
+    case PATCH_INCOMPLETE:
+      return "Patch incomplete";
+    case PATCH_CRC:
+      return "CRC mismatch";
+  }
+  return "Unknown";
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "IndoorBikeData.h"
+#include "sensors/SensorSample.h"
+
+constexpr IndoorBikeData::FieldSpec IndoorBikeData::FIELDS[];
+
+static const uint16_t ALL_FIELDS = (1U << IndoorBikeData::FIELD_COUNT) - 1;
+static const uint16_t ENERGY     = IndoorBikeData::bit(IndoorBikeData::TotalEnergy) | IndoorBikeData::bit(IndoorBikeData::EnergyPerHour) | IndoorBikeData::bit(IndoorBikeData::EnergyPerMinute);
+
+static_assert(IndoorBikeData::lengthOf(ALL_FIELDS) == IndoorBikeData::MAX_LENGTH, "MAX_LENGTH doesn't match the field table");
+static_assert(IndoorBikeData::flagsFor(ALL_FIELDS) == 0x1FFE, "Every flag but More Data");
+static_assert(IndoorBikeData::flagsFor(0) == 0x0001, "No speed means More Data");
+
+static int32_t notAvailable(IndoorBikeData::Field field) {
+  return (field == IndoorBikeData::EnergyPerMinute) ? IndoorBikeData::ENERGY_MINUTE_NOT_AVAILABLE : IndoorBikeData::ENERGY_NOT_AVAILABLE;
+}
+
+int32_t IndoorBikeData::Values::getFixed(Field field) const { return SensorSample::fixed(raw[field], FIELDS[field].divisor); }
+
+void IndoorBikeData::Values::setFixed(Field field, int32_t value) {
+  int64_t scaled = (int64_t)value * FIELDS[field].divisor;
+  int64_t half   = (int64_t)1 << (SensorSample::FRACTION_BITS - 1);
+  set(field, (int32_t)((scaled + (scaled < 0 ? -half : half)) / ((int64_t)1 << SensorSample::FRACTION_BITS)));
+}
+
+bool IndoorBikeData::decode(const uint8_t *data, size_t length, Values *values) {
+  values->clear();
+  if (length < FLAGS_SIZE) {
+    return false;
+  }
+  uint16_t flags = data[0] | (data[1] << 8);
+  size_t index   = FLAGS_SIZE;
+  for (int field = 0; field < FIELD_COUNT; field++) {
+    const FieldSpec &spec = FIELDS[field];
+    if ((((flags >> spec.flagBit) & 1) == 0) != spec.presentWhenClear) {
+      continue;
+    }
+    if (index + spec.size > length) {
+      return false;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < spec.size; i++) {
+      value |= (uint32_t)data[index + i] << (8 * i);
+    }
+    index += spec.size;
+    if (spec.isSigned && (value & (1UL << (8 * spec.size - 1)))) {
+      value |= ~0UL << (8 * spec.size);
+    }
+    if ((bit((Field)field) & ENERGY) && ((int32_t)value == notAvailable((Field)field))) {
+      continue;
+    }
+    values->set((Field)field, (int32_t)value);
+  }
+  return true;
+}
+
+size_t IndoorBikeData::encode(const Values &values, uint8_t *out, size_t capacity) {
+  uint16_t fields = fieldsOf(values);
+  if (lengthOf(fields) > capacity) {
+    return 0;
+  }
+  return write(values, fields, out);
+}
+
+size_t IndoorBikeData::encodeNext(const Values &values, uint16_t *sent, uint8_t *out, size_t capacity) {
+  uint16_t pending = fieldsOf(values) & ~*sent;
+  if (pending == 0) {
+    return 0;
+  }
+  if (lengthOf(pending) <= capacity) {
+    *sent |= pending;
+    return write(values, pending, out);
+  }
+  // Not the last packet, so More Data is set and speed waits. Take whole fields in order while they fit.
+  uint16_t fields = 0;
+  for (int field = InstantaneousSpeed + 1; field < FIELD_COUNT; field++) {
+    uint16_t group = (bit((Field)field) & ENERGY) ? ENERGY : bit((Field)field);
+    if (((pending & group) == 0) || (fields & group)) {
+      continue;
+    }
+    if (lengthOf(fields | group) <= capacity) {
+      fields |= group;
+    }
+  }
+  if (fields == 0) {
+    return 0;
+  }
+  *sent |= fields;
+  return write(values, fields, out);
+}
+
+uint16_t IndoorBikeData::fieldsOf(const Values &values) {
+  uint16_t fields = values.present & ALL_FIELDS;
+  if (fields & ENERGY) {
+    fields |= ENERGY;
+  }
+  return fields;
+}
+
+size_t IndoorBikeData::write(const Values &values, uint16_t fields, uint8_t *out) {
+  uint16_t flags = flagsFor(fields);
+  out[0]         = (uint8_t)(flags & 0xff);
+  out[1]         = (uint8_t)(flags >> 8);
+  size_t index   = FLAGS_SIZE;
+  for (int field = 0; field < FIELD_COUNT; field++) {
+    if (((fields >> field) & 1) == 0) {
+      continue;
+    }
+    const FieldSpec &spec = FIELDS[field];
+    int32_t value;
+    if (values.has((Field)field)) {
+      int32_t max = spec.isSigned ? (1L << (8 * spec.size - 1)) - 1 : (1L << (8 * spec.size)) - 1;
+      int32_t min = spec.isSigned ? -max - 1 : 0;
+      // A real energy reading must not collide with "not available".
+      if (bit((Field)field) & ENERGY) {
+        max--;
+      }
+      value = (values.raw[field] > max) ? max : (values.raw[field] < min) ? min : values.raw[field];
+    } else {
+      value = notAvailable((Field)field);  // Only an energy field sent along with another one
+    }
+    for (int i = 0; i < spec.size; i++) {
+      out[index++] = (uint8_t)((uint32_t)value >> (8 * i));
+    }
+  }
+  return index;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "MotionPlanner.h"
+#include <math.h>
+
+static const float DECAY       = 0.95f;
+static const float MIN_GAIN    = 0.5f;
+static const float MAX_GAIN    = 4.0f;
+static const float MAX_LATENCY = 1000.0f;
+
+MotionPlanner::MotionPlanner(uint32_t maxSpeed, uint32_t maxAcceleration)
+    : n(0), sx(0), sy(0), sxx(0), sxy(0), moves(0), wasRunning(false), startMs(0), startPosition(0) {
+  this->setLimits(maxSpeed, maxAcceleration);
+  for (int i = 0; i < 2; i++) {
+    scale[i]      = 100;
+    cleanMoves[i] = 0;
+  }
+}
+
+void MotionPlanner::setLimits(uint32_t maxSpeed, uint32_t maxAcceleration) {
+  this->maxSpeed        = (maxSpeed > 0) ? maxSpeed : 1;
+  this->maxAcceleration = (maxAcceleration > 0) ? maxAcceleration : 1;
+}
+
+MotionPlanner::Profile MotionPlanner::plan(int32_t from, int32_t to) const {
+  uint8_t percent = scale[to > from];
+  Profile profile = {maxSpeed * percent / 100, maxAcceleration * percent / 100};
+  return profile;
+}
+
+float MotionPlanner::profileTime(uint32_t distance, const Profile &profile) {
+  if ((distance == 0) || (profile.speed == 0) || (profile.acceleration == 0)) {
+    return 0;
+  }
+  float d = distance;
+  float v = profile.speed;
+  float a = profile.acceleration;
+  if (d * a >= v * v) {
+    // Reaches full speed: accelerating and braking together take as long as v / a at full speed would
+    return (d / v + v / a) * 1000.0f;
+  }
+  return 2.0f * sqrtf(d / a) * 1000.0f;
+}
+
+float MotionPlanner::getGain() const {
+  if (moves < MIN_MOVES) {
+    return 1.0f;
+  }
+  float denominator = n * sxx - sx * sx;
+  float gain        = sy / sx;  // All moves the same length leave no latency to separate out
+  if (denominator > 1e-3f * n * sxx) {
+    gain = (n * sxy - sx * sy) / denominator;
+  }
+  return (gain < MIN_GAIN) ? MIN_GAIN : (gain > MAX_GAIN) ? MAX_GAIN : gain;
+}
+
+float MotionPlanner::getLatency() const {
+  if (moves < MIN_MOVES) {
+    return 0;
+  }
+  float latency = (sy - this->getGain() * sx) / n;
+  return (latency < 0) ? 0 : (latency > MAX_LATENCY) ? MAX_LATENCY : latency;
+}
+
+uint32_t MotionPlanner::eta(int32_t from, int32_t to) const {
+  if (from == to) {
+    return 0;
+  }
+  uint32_t distance = (to > from) ? to - from : from - to;
+  return (uint32_t)(this->getLatency() + this->getGain() * profileTime(distance, this->plan(from, to)) + 0.5f);
+}
+
+void MotionPlanner::observeStepper(uint32_t nowMs, int32_t position, bool running) {
+  if (running && !wasRunning) {
+    startMs       = nowMs;
+    startPosition = position;
+  } else if (!running && wasRunning && (position != startPosition)) {
+    bool increasing   = position > startPosition;
+    uint32_t distance = increasing ? position - startPosition : startPosition - position;
+    float x           = profileTime(distance, this->plan(startPosition, position));
+    float y           = nowMs - startMs;
+    n                 = n * DECAY + 1;
+    sx                = sx * DECAY + x;
+    sy                = sy * DECAY + y;
+    sxx               = sxx * DECAY + x * x;
+    sxy               = sxy * DECAY + x * y;
+    moves++;
+    if ((++cleanMoves[increasing] >= CLEAN_MOVES) && (scale[increasing] < 100)) {
+      scale[increasing]      = (scale[increasing] + RECOVER_PERCENT > 100) ? 100 : scale[increasing] + RECOVER_PERCENT;
+      cleanMoves[increasing] = 0;
+    }
+  }
+  wasRunning = running;
+}
+
+void MotionPlanner::reportLostSteps(bool increasing) {
+  cleanMoves[increasing] = 0;
+  if (scale[increasing] >= MIN_SCALE_PERCENT + BACKOFF_PERCENT) {
+    scale[increasing] -= BACKOFF_PERCENT;
+  } else {
+    scale[increasing] = MIN_SCALE_PERCENT;
+  }
+}
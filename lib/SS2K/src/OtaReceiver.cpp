@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "OtaReceiver.h"
+#include <string.h>
+
+static uint32_t otaGet32(const uint8_t *data) { return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24); }
+
+static void otaPut32(uint8_t *data, uint32_t value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+  data[2] = (value >> 16) & 0xFF;
+  data[3] = (value >> 24) & 0xFF;
+}
+
+void OtaReceiver::reset() {
+  for (size_t i = 0; i < BUFFER_COUNT; i++) {
+    bufferLength[i] = 0;
+    bufferState[i].store(BUFFER_FREE);
+  }
+  fillIndex  = 0;
+  flushIndex = 0;
+  generation.store(generation.load() + 1);
+  active = false;
+  legacy = false;
+  ending.store(false);
+  ackHeld.store(false);
+  failure.store(STATUS_OK);
+  nakSent     = false;
+  size        = 0;
+  expectedCrc = 0;
+  runningCrc  = 0;
+  expectedSeq = 0;
+  lastAckSeq  = 0xFFFF;
+  lastGoodSeq.store(0xFFFF);
+  received.store(0);
+  memset(&stats, 0, sizeof(stats));
+}
+
+uint8_t OtaReceiver::onPacket(const uint8_t *data, size_t length, uint32_t nowMillis, uint8_t *reply, size_t *replyLength) {
+  *replyLength = 0;
+  if (failure.load() != STATUS_OK) {
+    reset();
+  }
+  if (length == 0) {
+    return OTA_NONE;
+  }
+  if (legacy) {
+    return onLegacy(data, length, nowMillis);
+  }
+  if (!active && (data[0] == ESP_IMAGE_MAGIC)) {
+    reset();
+    active            = true;
+    legacy            = true;
+    stats.startMillis = nowMillis;
+    return OTA_STARTED | onLegacy(data, length, nowMillis);
+  }
+
+  switch (data[0]) {
+    case OP_BEGIN:
+      return onBegin(data, length, nowMillis, reply, replyLength);
+
+    case OP_DATA:
+      if (!active || ending.load()) {
+        buildNak(STATUS_BAD_PACKET, reply, replyLength);
+        return OTA_NONE;
+      }
+      stats.lastMillis = nowMillis;
+      return onData(data, length, reply, replyLength);
+
+    case OP_END:
+      if (!active || ending.load()) {
+        return OTA_NONE;
+      }
+      if (received.load() != size) {
+        buildNak(STATUS_SEQUENCE, reply, replyLength);
+        return OTA_NONE;
+      }
+      ending.store(true);
+      return OTA_FINISHING | queueFillBuffer();
+
+    case OP_ABORT:
+      if (!active) {
+        return OTA_NONE;
+      }
+      reset();
+      return OTA_ABORTED;
+
+    default:
+      buildNak(STATUS_BAD_PACKET, reply, replyLength);
+      return OTA_NONE;
+  }
+}
+
+uint8_t OtaReceiver::onBegin(const uint8_t *data, size_t length, uint32_t nowMillis, uint8_t *reply, size_t *replyLength) {
+  if (length < 9) {
+    buildNak(STATUS_BAD_PACKET, reply, replyLength);
+    return OTA_NONE;
+  }
+  uint32_t newSize = otaGet32(data + 1);
+  uint32_t newCrc  = otaGet32(data + 5);
+  uint8_t events   = OTA_NONE;
+
+  if (active && !ending.load() && (newSize == size) && (newCrc == expectedCrc)) {
+    // Same image, pick up where the last connection left off. Buffered data is kept.
+    expectedSeq = 0;
+    lastAckSeq  = 0xFFFF;
+    lastGoodSeq.store(0xFFFF);
+    nakSent = false;
+    ackHeld.store(false);
+    events = OTA_RESUMED;
+  } else {
+    if (active) {
+      events |= OTA_ABORTED;
+    }
+    reset();
+    active            = true;
+    size              = newSize;
+    expectedCrc       = newCrc;
+    stats.startMillis = nowMillis;
+    events |= OTA_STARTED;
+  }
+  stats.lastMillis = nowMillis;
+
+  reply[0] = REPLY_BEGIN;
+  reply[1] = STATUS_OK;
+  otaPut32(reply + 2, received.load());
+  reply[6]     = WINDOW;
+  reply[7]     = BUFFER_SIZE & 0xFF;
+  reply[8]     = (BUFFER_SIZE >> 8) & 0xFF;
+  *replyLength = 9;
+  return events;
+}
+
+uint8_t OtaReceiver::onData(const uint8_t *data, size_t length, uint8_t *reply, size_t *replyLength) {
+  if (length < 3) {
+    buildNak(STATUS_BAD_PACKET, reply, replyLength);
+    return OTA_NONE;
+  }
+  uint16_t seq = data[1] | (data[2] << 8);
+  if (seq != expectedSeq) {
+    // Ignore everything after a gap. One NAK is enough, the host rewinds to `received`.
+    if (!nakSent) {
+      buildNak(STATUS_SEQUENCE, reply, replyLength);
+      nakSent = true;
+    }
+    return OTA_NONE;
+  }
+  size_t payload = length - 3;
+  if (received.load() + payload > size) {
+    buildNak(STATUS_TOO_LARGE, reply, replyLength);
+    return OTA_NONE;
+  }
+
+  uint8_t events = store(data + 3, payload);
+  if (events & OTA_BUSY) {
+    buildNak(STATUS_BUSY, reply, replyLength);
+    nakSent = true;
+    return events;
+  }
+  nakSent = false;
+  expectedSeq++;
+  lastGoodSeq.store(seq);
+  stats.packets++;
+
+  // Ack every half window so the host never stalls, but only once there is room for a full window.
+  // Otherwise the writer sends it from flushed() when a buffer frees up.
+  bool complete = (received.load() == size);
+  if (complete || ((uint16_t)(seq - lastAckSeq) >= WINDOW / 2)) {
+    if (complete || (freeSpace() >= BUFFER_SIZE)) {
+      ackHeld.store(false);
+      buildAck(seq, reply, replyLength);
+      lastAckSeq = seq;
+    } else {
+      ackHeld.store(true);
+    }
+  }
+  return events;
+}
+
+uint8_t OtaReceiver::onLegacy(const uint8_t *data, size_t length, uint32_t nowMillis) {
+  if (ending.load()) {
+    return OTA_NONE;
+  }
+  uint8_t events = store(data, length);
+  if (events & OTA_BUSY) {
+    return events;
+  }
+  stats.packets++;
+  stats.lastMillis = nowMillis;
+  if (length < LEGACY_CHUNK) {
+    size = received.load();
+    ending.store(true);
+    events |= OTA_FINISHING | queueFillBuffer();
+  }
+  return events;
+}
+
+size_t OtaReceiver::freeSpace() {
+  size_t space = 0;
+  for (size_t i = 0; i < BUFFER_COUNT; i++) {
+    size_t index = (fillIndex + i) % BUFFER_COUNT;
+    if (bufferState[index].load() != BUFFER_FREE) {
+      break;
+    }
+    space += BUFFER_SIZE - bufferLength[index];
+  }
+  return space;
+}
+
+uint8_t OtaReceiver::store(const uint8_t *data, size_t length) {
+  if (freeSpace() < length) {
+    return OTA_BUSY;
+  }
+  runningCrc = crc32(runningCrc, data, length);
+  received.store(received.load() + length);
+  stats.bytesReceived += length;
+
+  uint8_t events = OTA_NONE;
+  while (length > 0) {
+    size_t room = BUFFER_SIZE - bufferLength[fillIndex];
+    size_t take = (length < room) ? length : room;
+    memcpy(buffers[fillIndex] + bufferLength[fillIndex], data, take);
+    bufferLength[fillIndex] += take;
+    data += take;
+    length -= take;
+    if (bufferLength[fillIndex] == BUFFER_SIZE) {
+      events |= queueFillBuffer();
+    }
+  }
+  return events;
+}
+
+uint8_t OtaReceiver::queueFillBuffer() {
+  if ((bufferLength[fillIndex] == 0) || (bufferState[fillIndex].load() != BUFFER_FREE)) {
+    return OTA_NONE;
+  }
+  bufferState[fillIndex].store(BUFFER_FULL);
+  fillIndex = (fillIndex + 1) % BUFFER_COUNT;
+  return OTA_BUFFER_READY;
+}
+
+const uint8_t *OtaReceiver::nextFlush(size_t *length, uint32_t *token) {
+  *token = generation.load();
+  if ((failure.load() != STATUS_OK) || (bufferState[flushIndex].load() != BUFFER_FULL)) {
+    *length = 0;
+    return nullptr;
+  }
+  bufferState[flushIndex].store(BUFFER_WRITING);
+  *length = bufferLength[flushIndex];
+  return buffers[flushIndex];
+}
+
+void OtaReceiver::flushed(uint32_t token, uint32_t flushMicros, uint8_t *reply, size_t *replyLength) {
+  *replyLength = 0;
+  if ((token != generation.load()) || (bufferState[flushIndex].load() != BUFFER_WRITING)) {
+    return;
+  }
+  stats.bytesFlushed += bufferLength[flushIndex];
+  stats.flushes++;
+  stats.totalFlushMicros += flushMicros;
+  if (flushMicros > stats.maxFlushMicros) {
+    stats.maxFlushMicros = flushMicros;
+  }
+  bufferLength[flushIndex] = 0;
+  bufferState[flushIndex].store(BUFFER_FREE);
+  flushIndex = (flushIndex + 1) % BUFFER_COUNT;
+
+  if (ackHeld.exchange(false)) {
+    buildAck(lastGoodSeq.load(), reply, replyLength);
+  }
+}
+
+bool OtaReceiver::isDrained() {
+  if (!active || !ending.load()) {
+    return false;
+  }
+  for (size_t i = 0; i < BUFFER_COUNT; i++) {
+    if (bufferState[i].load() != BUFFER_FREE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool OtaReceiver::finish(uint8_t *reply, size_t *replyLength) {
+  // The legacy stream carries no checksum, esp_ota_end() validating the image is all we get.
+  bool ok      = legacy || ((stats.bytesFlushed == size) && (runningCrc == expectedCrc));
+  this->buildEnd(ok ? STATUS_OK : STATUS_CRC, reply, replyLength);
+  active = false;
+  return ok;
+}
+
+void OtaReceiver::fail(uint8_t status, uint8_t *reply, size_t *replyLength) {
+  failure.store(status);
+  this->buildEnd(status, reply, replyLength);
+}
+
+void OtaReceiver::buildEnd(uint8_t status, uint8_t *reply, size_t *replyLength) {
+  if (legacy) {
+    reply[0]     = (status == STATUS_OK) ? LEGACY_DONE : LEGACY_FAILED;
+    *replyLength = 1;
+    return;
+  }
+  reply[0]     = REPLY_END;
+  reply[1]     = status;
+  *replyLength = 2;
+}
+
+uint32_t OtaReceiver::getThroughput() {
+  uint32_t elapsed = stats.lastMillis - stats.startMillis;
+  if (elapsed == 0) {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)stats.bytesReceived * 1000) / elapsed);
+}
+
+void OtaReceiver::buildAck(uint16_t seq, uint8_t *reply, size_t *replyLength) {
+  reply[0] = REPLY_ACK;
+  reply[1] = seq & 0xFF;
+  reply[2] = (seq >> 8) & 0xFF;
+  otaPut32(reply + 3, received.load());
+  *replyLength = 7;
+}
+
+void OtaReceiver::buildNak(uint8_t status, uint8_t *reply, size_t *replyLength) {
+  stats.naks++;
+  reply[0] = REPLY_NAK;
+  reply[1] = status;
+  reply[2] = expectedSeq & 0xFF;
+  reply[3] = (expectedSeq >> 8) & 0xFF;
+  otaPut32(reply + 4, received.load());
+  *replyLength = 8;
+}
+
+uint32_t OtaReceiver::crc32(uint32_t crc, const uint8_t *data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "PeerCache.h"
+#include <string.h>
+
+static const uint8_t MAGIC[4] = {'S', 'S', '2', 'P'};
+
+static void put16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+  put16(out, value & 0xFFFF);
+  put16(out + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+static uint32_t get32(const uint8_t *in) { return get16(in) | ((uint32_t)get16(in + 2) << 16); }
+
+PeerCache::PeerCache() { this->clear(); }
+
+void PeerCache::clear() {
+  memset(peers, 0, sizeof(peers));
+  sequence = 0;
+}
+
+size_t PeerCache::size() const {
+  size_t count = 0;
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    count += (peers[i].address != 0) ? 1 : 0;
+  }
+  return count;
+}
+
+const PeerCache::Peer *PeerCache::find(uint64_t address) const {
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    if ((address != 0) && (peers[i].address == address)) {
+      return &peers[i];
+    }
+  }
+  return nullptr;
+}
+
+const PeerCache::Peer *PeerCache::find(uint8_t services, const char *name) const {
+  bool any          = (strcmp(name, "any") == 0);
+  const Peer *found = nullptr;
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    const Peer &peer = peers[i];
+    if ((peer.address != 0) && (peer.service & services) && (any || (strcmp(peer.name, name) == 0)) && ((found == nullptr) || (peer.lastUsed > found->lastUsed))) {
+      found = &peer;
+    }
+  }
+  return found;
+}
+
+bool PeerCache::remember(const Peer &peer) {
+  Peer *slot      = const_cast<Peer *>(this->find(peer.address));
+  bool mostRecent = (slot != nullptr) && (slot->lastUsed == sequence);
+  if (slot == nullptr) {
+    slot = &peers[0];
+    for (size_t i = 0; i < MAX_PEERS; i++) {
+      if (peers[i].address == 0) {
+        slot = &peers[i];
+        break;
+      }
+      if (peers[i].lastUsed < slot->lastUsed) {
+        slot = &peers[i];
+      }
+    }
+    memset(slot, 0, sizeof(*slot));
+  }
+
+  bool changed = !mostRecent || (slot->addressType != peer.addressType) || (slot->service != peer.service) || (slot->serviceStart != peer.serviceStart) ||
+                 (slot->serviceEnd != peer.serviceEnd) || (slot->valueHandle != peer.valueHandle) || (slot->interval != peer.interval) ||
+                 (slot->latency != peer.latency) || (slot->timeout != peer.timeout) || (slot->failures != 0) || (strncmp(slot->name, peer.name, NAME_SIZE) != 0);
+  if (!mostRecent) {
+    sequence++;
+  }
+  *slot                     = peer;
+  slot->failures            = 0;
+  slot->lastUsed            = sequence;
+  slot->name[NAME_SIZE - 1] = '\0';
+  return changed;
+}
+
+void PeerCache::failed(uint64_t address) {
+  Peer *peer = const_cast<Peer *>(this->find(address));
+  if ((peer != nullptr) && (peer->failures < 0xFF)) {
+    peer->failures++;
+  }
+}
+
+size_t PeerCache::serialize(uint8_t *out, size_t capacity) const {
+  size_t count = this->size();
+  if (capacity < HEADER_SIZE + count * RECORD_SIZE) {
+    return 0;
+  }
+  memcpy(out, MAGIC, sizeof(MAGIC));
+  out[4]        = VERSION;
+  out[5]        = count;
+  uint8_t *next = out + HEADER_SIZE;
+  for (size_t i = 0; i < MAX_PEERS; i++) {
+    const Peer &peer = peers[i];
+    if (peer.address == 0) {
+      continue;
+    }
+    for (int b = 0; b < 6; b++) {
+      next[b] = (peer.address >> (8 * b)) & 0xFF;
+    }
+    next[6] = peer.addressType;
+    next[7] = peer.service;
+    put16(next + 8, peer.serviceStart);
+    put16(next + 10, peer.serviceEnd);
+    put16(next + 12, peer.valueHandle);
+    put16(next + 14, peer.interval);
+    put16(next + 16, peer.latency);
+    put16(next + 18, peer.timeout);
+    next[20] = peer.failures;
+    put32(next + 21, peer.lastUsed);
+    memcpy(next + 25, peer.name, NAME_SIZE);
+    next += RECORD_SIZE;
+  }
+  return next - out;
+}
+
+bool PeerCache::deserialize(const uint8_t *in, size_t length) {
+  this->clear();
+  if ((length < HEADER_SIZE) || (memcmp(in, MAGIC, sizeof(MAGIC)) != 0) || (in[4] != VERSION) || (in[5] > MAX_PEERS) || (length != HEADER_SIZE + in[5] * RECORD_SIZE)) {
+    return false;
+  }
+  const uint8_t *next = in + HEADER_SIZE;
+  for (size_t i = 0; i < in[5]; i++, next += RECORD_SIZE) {
+    Peer &peer = peers[i];
+    for (int b = 0; b < 6; b++) {
+      peer.address |= (uint64_t)next[b] << (8 * b);
+    }
+    peer.addressType  = next[6];
+    peer.service      = next[7];
+    peer.serviceStart = get16(next + 8);
+    peer.serviceEnd   = get16(next + 10);
+    peer.valueHandle  = get16(next + 12);
+    peer.interval     = get16(next + 14);
+    peer.latency      = get16(next + 16);
+    peer.timeout      = get16(next + 18);
+    peer.failures     = next[20];
+    peer.lastUsed     = get32(next + 21);
+    memcpy(peer.name, next + 25, NAME_SIZE);
+    peer.name[NAME_SIZE - 1] = '\0';
+    sequence                 = (peer.lastUsed > sequence) ? peer.lastUsed : sequence;
+  }
+  return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "PositionHealth.h"
+#include <string.h>
+
+static const uint32_t FAULTS = PositionHealth::OT | PositionHealth::SHORTS | PositionHealth::OPEN_LOAD;
+
+PositionHealth::PositionHealth() : status(0), trusted(true), anchorCount(0) { memset(&counters, 0, sizeof(counters)); }
+
+void PositionHealth::observeStatus(uint32_t drvStatus, bool moving) {
+  counters.reads++;
+  uint32_t appeared = drvStatus & ~status;
+  status            = drvStatus;
+  if (appeared & OTPW) {
+    counters.overtempWarnings++;
+  }
+  if (appeared & OT) {
+    counters.overtemps++;
+  }
+  if (appeared & SHORTS) {
+    counters.shorts++;
+  }
+  // Open load is only meaningful while the coils are being driven. It's normal at standstill with the current off.
+  if ((appeared & OPEN_LOAD) && moving) {
+    counters.openLoads++;
+  }
+  if ((drvStatus & FAULTS) && moving) {
+    if (trusted) {
+      counters.faultsWhileMoving++;
+    }
+    trusted = false;
+  }
+}
+
+void PositionHealth::observeReadError() { counters.readErrors++; }
+
+int32_t PositionHealth::observeAnchor(int cell, int32_t drift) {
+  if ((drift > -REHOME_THRESHOLD) && (drift < REHOME_THRESHOLD)) {
+    // Still where the table expects
+    anchorCount = 0;
+    trusted     = true;
+    return 0;
+  }
+  // One sample per cell, so a single bad cell can't outvote the rest
+  size_t i = 0;
+  while ((i < anchorCount) && (anchorCells[i] != cell)) {
+    i++;
+  }
+  if (i == ANCHOR_SAMPLES) {
+    memmove(anchorCells, anchorCells + 1, sizeof(anchorCells[0]) * (ANCHOR_SAMPLES - 1));
+    memmove(anchorDrift, anchorDrift + 1, sizeof(anchorDrift[0]) * (ANCHOR_SAMPLES - 1));
+    i--;
+  } else if (i == anchorCount) {
+    anchorCount++;
+  }
+  anchorCells[i] = cell;
+  anchorDrift[i] = drift;
+
+  int32_t lowest  = drift;
+  int32_t highest = drift;
+  int64_t sum     = 0;
+  for (size_t j = 0; j < anchorCount; j++) {
+    lowest  = (anchorDrift[j] < lowest) ? anchorDrift[j] : lowest;
+    highest = (anchorDrift[j] > highest) ? anchorDrift[j] : highest;
+    sum += anchorDrift[j];
+  }
+  if (((lowest < 0) != (highest < 0)) || (highest - lowest > ANCHOR_SPREAD)) {
+    // The cells disagree, so it's the table that's noisy. Start again from this one.
+    anchorCells[0] = cell;
+    anchorDrift[0] = drift;
+    anchorCount    = 1;
+    return 0;
+  }
+  size_t needed = ANCHOR_SAMPLES;
+  if (!trusted) {
+    needed /= 2;  // Steps were probably lost, so be quicker to believe it
+  }
+  if (anchorCount < needed) {
+    return 0;
+  }
+  int32_t offset = (int32_t)(sum / (int64_t)anchorCount);
+  anchorCount    = 0;
+  trusted        = true;
+  counters.rehomes++;
+  counters.rehomedSteps += offset;
+  return offset;
+}
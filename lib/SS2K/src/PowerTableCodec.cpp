@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "PowerTableCodec.h"
+
+size_t PowerTableCodec::encode(const int16_t *cells, const uint16_t *versions, size_t count, uint16_t since, size_t *cursor, uint8_t *out, size_t capacity) {
+  size_t written = 0;
+  int32_t prev   = 0;
+  size_t i       = *cursor;
+
+  while (i < count) {
+    // Unchanged cells
+    if (versions[i] <= since) {
+      size_t next = i + 1;
+      while ((next < count) && (versions[next] <= since)) {
+        next++;
+      }
+      if (next >= count) {  // Nothing left to send, no need to spend bytes skipping to the end.
+        i = count;
+        break;
+      }
+      size_t run = (next - i < MAX_SKIP) ? next - i : MAX_SKIP;
+      if (written + 1 > capacity) {
+        break;
+      }
+      out[written++] = SKIP | (uint8_t)(run - 1);
+      i += run;
+      continue;
+    }
+
+    // Changed cells holding the same value
+    size_t run = 1;
+    while ((i + run < count) && (versions[i + run] > since) && (cells[i + run] == cells[i]) && (run < MAX_RUN)) {
+      run++;
+    }
+    if (run >= 2) {
+      uint8_t value[MAX_VALUE_SZ];
+      size_t valueLength = putValue((int32_t)cells[i] - prev, value, sizeof(value));
+      if (written + 1 + valueLength > capacity) {
+        break;
+      }
+      out[written++] = REPEAT | (uint8_t)(run - 1);
+      for (size_t v = 0; v < valueLength; v++) {
+        out[written++] = value[v];
+      }
+      prev = cells[i];
+      i += run;
+      continue;
+    }
+
+    // Changed cells that all differ. Take as many as fit, stopping before a skip or a repeat.
+    if (written + 1 > capacity) {
+      break;
+    }
+    size_t header = written++;
+    size_t taken  = 0;
+    while ((i < count) && (versions[i] > since) && (taken < MAX_RUN)) {
+      if ((taken > 0) && (i + 1 < count) && (versions[i + 1] > since) && (cells[i + 1] == cells[i])) {
+        break;
+      }
+      size_t valueLength = putValue((int32_t)cells[i] - prev, out + written, capacity - written);
+      if (valueLength == 0) {
+        break;
+      }
+      written += valueLength;
+      prev = cells[i];
+      taken++;
+      i++;
+    }
+    if (taken == 0) {  // Not even one value fit
+      written = header;
+      break;
+    }
+    out[header] = LITERAL | (uint8_t)(taken - 1);
+  }
+
+  *cursor = i;
+  return written;
+}
+
+bool PowerTableCodec::decode(const uint8_t *in, size_t length, size_t start, int16_t *cells, size_t count) {
+  size_t pos   = 0;
+  size_t i     = start;
+  int32_t prev = 0;
+
+  while (pos < length) {
+    uint8_t op = in[pos++];
+    if ((op & 0x80) == SKIP) {
+      i += (op & 0x7F) + 1;
+      if (i > count) {
+        return false;
+      }
+      continue;
+    }
+
+    size_t run = (op & 0x3F) + 1;
+    if (i + run > count) {
+      return false;
+    }
+    if ((op & LITERAL) == REPEAT) {
+      int32_t delta;
+      size_t used = getValue(in + pos, length - pos, &delta);
+      if (used == 0) {
+        return false;
+      }
+      pos += used;
+      prev += delta;
+      for (size_t r = 0; r < run; r++) {
+        cells[i++] = (int16_t)prev;
+      }
+    } else {
+      for (size_t r = 0; r < run; r++) {
+        int32_t delta;
+        size_t used = getValue(in + pos, length - pos, &delta);
+        if (used == 0) {
+          return false;
+        }
+        pos += used;
+        prev += delta;
+        cells[i++] = (int16_t)prev;
+      }
+    }
+  }
+  return true;
+}
+
+// Zigzag so small negative steps stay small, then 7 bits per byte with the high bit as "more follows".
+size_t PowerTableCodec::putValue(int32_t delta, uint8_t *out, size_t capacity) {
+  uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  size_t written  = 0;
+  do {
+    if (written >= capacity) {
+      return 0;
+    }
+    uint8_t byte = zigzag & 0x7F;
+    zigzag >>= 7;
+    out[written++] = zigzag ? (byte | 0x80) : byte;
+  } while (zigzag);
+  return written;
+}
+
+size_t PowerTableCodec::getValue(const uint8_t *in, size_t length, int32_t *delta) {
+  uint32_t zigzag = 0;
+  for (size_t i = 0; (i < length) && (i < MAX_VALUE_SZ); i++) {
+    zigzag |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+    if (!(in[i] & 0x80)) {
+      *delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+      return i + 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "PowerTableFile.h"
+
+static void put32(uint8_t *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t get32(const uint8_t *in) { return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24); }
+
+bool PowerTableFile::save(FileSystem &fileSystem, const char *path, int32_t version, const Cell *cells, size_t rows, size_t columns, int32_t readings) {
+  uint8_t header[HEADER_SIZE];
+  put32(header, (uint32_t)version);
+  put32(header + 4, (uint32_t)readings);
+  if (!fileSystem.write(path, header, sizeof(header))) {
+    return false;
+  }
+  uint8_t block[BLOCK_CELLS * CELL_SIZE];
+  size_t count = rows * columns;
+  for (size_t first = 0; first < count; first += BLOCK_CELLS) {
+    size_t length = 0;
+    for (size_t i = first; (i < count) && (i < first + BLOCK_CELLS); i++) {
+      block[length++] = (uint16_t)cells[i].targetPosition & 0xFF;
+      block[length++] = (uint16_t)cells[i].targetPosition >> 8;
+      block[length++] = (uint8_t)cells[i].readings;
+    }
+    if (!fileSystem.append(path, block, length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PowerTableFile::readCells(FileSystem &fileSystem, const char *path, size_t first, size_t count, Cell *cells) {
+  uint8_t block[BLOCK_CELLS * CELL_SIZE];
+  int32_t length = (int32_t)(count * CELL_SIZE);
+  if (fileSystem.read(path, HEADER_SIZE + first * CELL_SIZE, block, length) != length) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    cells[i].targetPosition = (int16_t)(block[i * CELL_SIZE] | (block[i * CELL_SIZE + 1] << 8));
+    cells[i].readings       = (int8_t)block[i * CELL_SIZE + 2];
+  }
+  return true;
+}
+
+PowerTableFile::Result PowerTableFile::load(FileSystem &fileSystem, const char *path, int32_t version, Cell *cells, size_t rows, size_t columns, int32_t readings,
+                                            int minimumReadings, int minimumMatches, size_t firstMatchColumn, float *offset) {
+  *offset      = 0;
+  size_t count = rows * columns;
+  uint8_t header[HEADER_SIZE];
+  if ((fileSystem.size(path) < (int32_t)(HEADER_SIZE + count * CELL_SIZE)) || (fileSystem.read(path, 0, header, sizeof(header)) != (int32_t)sizeof(header))) {
+    return MISSING;
+  }
+  if ((int32_t)get32(header) != version) {
+    return OLD_VERSION;
+  }
+  if (readings > (int32_t)get32(header + 4)) {
+    return SUPERSEDED;
+  }
+
+  // Enough reliable cells in common to trust an offset?
+  Cell saved[BLOCK_CELLS];
+  int matches = 0;
+  for (size_t first = 0; first < count; first += BLOCK_CELLS) {
+    size_t length = (count - first < BLOCK_CELLS) ? count - first : BLOCK_CELLS;
+    if (!readCells(fileSystem, path, first, length, saved)) {
+      return MISSING;
+    }
+    for (size_t i = 0; i < length; i++) {
+      const Cell &live = cells[first + i];
+      if ((((first + i) % columns) >= firstMatchColumn) && (live.targetPosition != INT16_MIN) && (live.readings > minimumReadings) && (saved[i].readings > 0)) {
+        matches++;
+      }
+    }
+  }
+  if (matches < minimumMatches) {
+    return TOO_FEW_MATCHES;
+  }
+
+  // Take the saved table over, and how far off it is from where the knob is now
+  float difference = 0;
+  int differences  = 0;
+  for (size_t first = 0; first < count; first += BLOCK_CELLS) {
+    size_t length = (count - first < BLOCK_CELLS) ? count - first : BLOCK_CELLS;
+    if (!readCells(fileSystem, path, first, length, saved)) {
+      return MISSING;
+    }
+    for (size_t i = 0; i < length; i++) {
+      Cell &live = cells[first + i];
+      if ((live.targetPosition != INT16_MIN) && (saved[i].targetPosition != INT16_MIN) && (saved[i].readings > 0) && (live.readings > minimumReadings)) {
+        difference += live.targetPosition - saved[i].targetPosition;
+        differences++;
+      }
+      live = saved[i];
+    }
+  }
+  *offset = (differences > 0) ? difference / differences : 0;
+  for (size_t i = 0; i < count; i++) {
+    if (cells[i].targetPosition != INT16_MIN) {
+      cells[i].targetPosition = (int16_t)(cells[i].targetPosition + *offset);
+    }
+  }
+  return LOADED;
+}
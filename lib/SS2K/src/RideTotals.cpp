@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "RideTotals.h"
+
+void RideTotals::reset() {
+  started   = false;
+  lastMs    = 0;
+  lastSpeed = 0;
+  lastPower = 0;
+  distance  = 0;
+  work      = 0;
+  elapsed   = 0;
+}
+
+void RideTotals::update(uint32_t nowMs, int32_t speed, int power) {
+  if (speed < 0) {
+    speed = 0;
+  }
+  if (power < 0) {
+    power = 0;
+  }
+  uint32_t step = nowMs - lastMs;  // Wraps cleanly with millis()
+  if (started && (step <= MAX_STEP_MS)) {
+    distance += ((uint64_t)lastSpeed + (uint64_t)speed) * step / 2;
+    work += ((uint64_t)lastPower + (uint64_t)power) * step / 2;
+    if ((lastSpeed > 0) || (speed > 0) || (lastPower > 0) || (power > 0)) {
+      elapsed += step;
+    }
+  }
+  started   = true;
+  lastMs    = nowMs;
+  lastSpeed = speed;
+  lastPower = power;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "RoadModel.h"
+#include <math.h>
+
+constexpr float RoadModel::GRAVITY;
+constexpr float RoadModel::EFFICIENCY;
+constexpr float RoadModel::DEFAULT_CRR;
+constexpr float RoadModel::DEFAULT_CW;
+
+bool RoadModel::fromFtms(const uint8_t *data, size_t length, Conditions *conditions) {
+  if (length < 6) {
+    return false;
+  }
+  conditions->windSpeed = (int16_t)(data[0] | (data[1] << 8)) / 1000.0f;  // 0.001 m/s
+  conditions->grade     = (int16_t)(data[2] | (data[3] << 8)) / 10000.0f;  // 0.01 %
+  conditions->crr       = data[4] / 10000.0f;                              // 0.0001
+  conditions->cw        = data[5] / 100.0f;                                // 0.01 kg/m
+  return true;
+}
+
+float RoadModel::power(const Conditions &conditions, float speed) {
+  float angle    = atanf(conditions.grade);
+  float air      = speed + conditions.windSpeed;
+  float drag     = conditions.cw * air * fabsf(air);
+  float rolling  = conditions.crr * conditions.mass * GRAVITY * cosf(angle);
+  float climbing = conditions.mass * GRAVITY * sinf(angle);
+  return (drag + rolling + climbing) * speed / EFFICIENCY;
+}
+
+float RoadModel::speed(const Conditions &conditions, float power, float maxSpeed) {
+  // Downhill, power falls with speed until drag takes over. Only search above that point.
+  float angle  = atanf(conditions.grade);
+  float resist = conditions.mass * GRAVITY * (conditions.crr * cosf(angle) + sinf(angle));
+  float wind   = conditions.windSpeed;
+  float low    = 0;
+  if ((resist < 0) && (conditions.cw > 0)) {
+    low = (sqrtf(wind * wind - 3 * resist / conditions.cw) - 2 * wind) / 3;
+    if (low < 0) {
+      low = 0;
+    }
+  }
+  float high = maxSpeed;
+  if (RoadModel::power(conditions, high) <= power) {
+    return high;
+  }
+  if (RoadModel::power(conditions, low) >= power) {
+    return low;
+  }
+  for (int i = 0; i < 32; i++) {
+    float middle = (low + high) / 2;
+    if (RoadModel::power(conditions, middle) < power) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (low + high) / 2;
+}
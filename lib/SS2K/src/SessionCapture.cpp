@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "SessionCapture.h"
+#include <string.h>
+
+static const uint8_t MAGIC[4] = {'S', 'S', '2', 'C'};
+
+static void put16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+  put16(out, value & 0xFFFF);
+  put16(out + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+static uint32_t get32(const uint8_t *in) { return get16(in) | ((uint32_t)get16(in + 2) << 16); }
+
+size_t SessionCapture::writeHeader(uint8_t *out, size_t capacity) {
+  if (capacity < HEADER_SIZE) {
+    return 0;
+  }
+  memcpy(out, MAGIC, sizeof(MAGIC));
+  out[4] = VERSION;
+  return HEADER_SIZE;
+}
+
+bool SessionCapture::checkHeader(const uint8_t *in, size_t length) { return (length >= HEADER_SIZE) && (memcmp(in, MAGIC, sizeof(MAGIC)) == 0) && (in[4] == VERSION); }
+
+size_t SessionCapture::putRecordHeader(uint8_t type, uint32_t timeMs, size_t length, uint8_t *out, size_t capacity) {
+  if ((length > 0xFFFF) || (capacity < RECORD_HEADER_SIZE + length)) {
+    return 0;
+  }
+  out[0] = type;
+  put32(out + 1, timeMs);
+  put16(out + 5, length);
+  return RECORD_HEADER_SIZE;
+}
+
+size_t SessionCapture::encodeNotify(uint32_t timeMs, uint64_t address, const uint8_t *uuid, const uint8_t *data, size_t length, uint8_t *out, size_t capacity) {
+  if (!putRecordHeader(NOTIFY, timeMs, NOTIFY_HEADER_SIZE + length, out, capacity)) {
+    return 0;
+  }
+  uint8_t *payload = out + RECORD_HEADER_SIZE;
+  for (int i = 0; i < 6; i++) {
+    payload[i] = (address >> (8 * i)) & 0xFF;
+  }
+  memcpy(payload + 6, uuid, 16);
+  memcpy(payload + NOTIFY_HEADER_SIZE, data, length);
+  return RECORD_HEADER_SIZE + NOTIFY_HEADER_SIZE + length;
+}
+
+size_t SessionCapture::encodeControlPoint(uint32_t timeMs, const uint8_t *data, size_t length, uint8_t *out, size_t capacity) {
+  if (!putRecordHeader(CONTROL_POINT, timeMs, length, out, capacity)) {
+    return 0;
+  }
+  memcpy(out + RECORD_HEADER_SIZE, data, length);
+  return RECORD_HEADER_SIZE + length;
+}
+
+size_t SessionCapture::encodeShift(uint32_t timeMs, int8_t delta, uint8_t *out, size_t capacity) {
+  if (!putRecordHeader(SHIFT, timeMs, 1, out, capacity)) {
+    return 0;
+  }
+  out[RECORD_HEADER_SIZE] = (uint8_t)delta;
+  return RECORD_HEADER_SIZE + 1;
+}
+
+size_t SessionCapture::encodeState(uint32_t timeMs, const State &state, uint8_t *out, size_t capacity) {
+  if (!putRecordHeader(STATE, timeMs, STATE_SIZE, out, capacity)) {
+    return 0;
+  }
+  uint8_t *payload = out + RECORD_HEADER_SIZE;
+  put16(payload, (uint16_t)state.watts);
+  put16(payload + 2, state.cadence);
+  payload[4] = state.heartRate;
+  put16(payload + 5, (uint16_t)state.resistance);
+  put32(payload + 7, (uint32_t)state.targetPosition);
+  put32(payload + 11, (uint32_t)state.position);
+  return RECORD_HEADER_SIZE + STATE_SIZE;
+}
+
+bool SessionCapture::parseRecordHeader(const uint8_t *in, size_t length, Record &record) {
+  if (length < RECORD_HEADER_SIZE) {
+    return false;
+  }
+  record.type    = in[0];
+  record.timeMs  = get32(in + 1);
+  record.length  = get16(in + 5);
+  record.payload = in + RECORD_HEADER_SIZE;
+  return (record.type >= NOTIFY) && (record.type <= STATE);
+}
+
+bool SessionCapture::parseNotify(const Record &record, Notification &notification) {
+  if ((record.type != NOTIFY) || (record.length < NOTIFY_HEADER_SIZE)) {
+    return false;
+  }
+  notification.address = 0;
+  for (int i = 0; i < 6; i++) {
+    notification.address |= (uint64_t)record.payload[i] << (8 * i);
+  }
+  memcpy(notification.uuid, record.payload + 6, 16);
+  notification.data   = record.payload + NOTIFY_HEADER_SIZE;
+  notification.length = record.length - NOTIFY_HEADER_SIZE;
+  return true;
+}
+
+bool SessionCapture::parseShift(const Record &record, int8_t &delta) {
+  if ((record.type != SHIFT) || (record.length != 1)) {
+    return false;
+  }
+  delta = (int8_t)record.payload[0];
+  return true;
+}
+
+bool SessionCapture::parseState(const Record &record, State &state) {
+  if ((record.type != STATE) || (record.length != STATE_SIZE)) {
+    return false;
+  }
+  state.watts          = (int16_t)get16(record.payload);
+  state.cadence        = get16(record.payload + 2);
+  state.heartRate      = record.payload[4];
+  state.resistance     = (int16_t)get16(record.payload + 5);
+  state.targetPosition = (int32_t)get32(record.payload + 7);
+  state.position       = (int32_t)get32(record.payload + 11);
+  return true;
+}
+
+SessionReplay::SessionReplay(const uint8_t *capture, size_t length)
+    : capture(capture), length(length), valid(SessionCapture::checkHeader(capture, length)), offset(SessionCapture::HEADER_SIZE), startMs(0), replayed(0) {}
+
+void SessionReplay::start(uint32_t nowMs) {
+  offset   = SessionCapture::HEADER_SIZE;
+  startMs  = nowMs;
+  replayed = 0;
+}
+
+bool SessionReplay::peek(SessionCapture::Record &record) const {
+  if (!valid || (offset >= length)) {
+    return false;
+  }
+  // A record cut off at the end of the capture isn't replayed
+  return SessionCapture::parseRecordHeader(capture + offset, length - offset, record) && (record.length <= length - offset - SessionCapture::RECORD_HEADER_SIZE);
+}
+
+uint32_t SessionReplay::run(uint32_t nowMs, Target &target) {
+  SessionCapture::Record record;
+  uint32_t elapsed = nowMs - startMs;
+  while (this->peek(record)) {
+    if (record.timeMs > elapsed) {
+      return record.timeMs - elapsed;
+    }
+    offset += SessionCapture::RECORD_HEADER_SIZE + record.length;
+    replayed++;
+    target.replay(record);
+  }
+  return FINISHED;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "ShiftInput.h"
+
+void ShiftLatency::add(uint32_t us) {
+  count++;
+  last = us;
+  total += us;
+  if (us > max) {
+    max = us;
+  }
+}
+
+ShiftGestures::ShiftGestures(uint32_t debounceUs) : debounceUs(debounceUs), outputHead(0), outputCount(0) {
+  for (int i = 0; i < 2; i++) {
+    Button button = {false, false, 0, 0, 0, false, false};
+    buttons[i]    = button;
+  }
+  Counters zero = {0, 0, 0, 0, 0};
+  counters      = zero;
+}
+
+void ShiftGestures::onEdge(const ShiftQueue::Event &event) {
+  if (event.button > DOWN) {
+    return;
+  }
+  this->advance(event.button, event.timeUs);
+  Button &b = buttons[event.button];
+  if (event.pressed == b.raw) {
+    return;  // Same level again. An edge in between came and went too fast to read.
+  }
+  if (b.raw != b.stable) {
+    counters.bounces++;
+  }
+  b.raw    = event.pressed;
+  b.edgeUs = event.timeUs;
+}
+
+void ShiftGestures::poll(uint32_t nowUs) {
+  this->advance(UP, nowUs);
+  this->advance(DOWN, nowUs);
+}
+
+void ShiftGestures::advance(uint8_t button, uint32_t nowUs) {
+  Button &b = buttons[button];
+  // A release ends the press, even one that hasn't settled yet. If it turns out to be a bounce the hold comes late.
+  uint32_t heldUntil = (b.stable && !b.raw) ? b.edgeUs : nowUs;
+  if (b.stable && !b.held && ((int32_t)(heldUntil - b.holdUs) >= 0)) {
+    this->emit(Hold, button, b.holdUs);
+    b.held   = true;
+    b.tapped = false;
+  }
+
+  if ((b.raw == b.stable) || ((int32_t)(nowUs - b.edgeUs) < (int32_t)debounceUs)) {
+    return;
+  }
+  b.stable = b.raw;
+  if (!b.stable) {
+    return;
+  }
+  this->emit(Shift, button, b.edgeUs);
+  if (b.tapped && ((uint32_t)(b.edgeUs - b.pressedUs) <= DOUBLE_TAP_US)) {
+    this->emit(DoubleTap, button, b.edgeUs);
+    b.tapped = false;
+  } else {
+    b.tapped = true;
+  }
+  b.pressedUs = b.edgeUs;
+  b.holdUs    = b.edgeUs + HOLD_US;
+  b.held      = false;
+  this->advance(button, nowUs);  // It may already have been held a while
+}
+
+void ShiftGestures::emit(Type type, uint8_t button, uint32_t timeUs) {
+  if (outputCount == OUTPUT_SIZE) {
+    counters.overflows++;
+    return;
+  }
+  switch (type) {
+    case Shift:
+      counters.shifts++;
+      break;
+    case Hold:
+      counters.holds++;
+      break;
+    case DoubleTap:
+      counters.doubleTaps++;
+      break;
+  }
+  Gesture gesture                                  = {type, button, timeUs};
+  output[(outputHead + outputCount) % OUTPUT_SIZE] = gesture;
+  outputCount++;
+}
+
+bool ShiftGestures::next(Gesture &gesture) {
+  if (outputCount == 0) {
+    return false;
+  }
+  gesture    = output[outputHead];
+  outputHead = (outputHead + 1) % OUTPUT_SIZE;
+  outputCount--;
+  return true;
+}
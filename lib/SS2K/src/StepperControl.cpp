@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "StepperControl.h"
+
+StepperControl::StepperControl(MotionPlanner &planner, PositionHealth &health)
+    : planner(planner), health(health), position(0), target(0), running(false), pendingRehome(0), statusPosition(0) {}
+
+int32_t StepperControl::poll(Motor &motor, uint32_t nowMs) {
+  running         = motor.isRunning();
+  int32_t rehomed = 0;
+  if ((pendingRehome != 0) && !running) {
+    rehomed       = pendingRehome;
+    pendingRehome = 0;
+    motor.setCurrentPosition(motor.getCurrentPosition() - rehomed);
+  }
+  position = motor.getCurrentPosition();
+  target   = motor.getTargetPosition();
+  planner.observeStepper(nowMs, position, running);
+  return rehomed;
+}
+
+bool StepperControl::moveTo(Motor &motor, int32_t target, int32_t minStep, int32_t maxStep) {
+  int32_t destination = (target < minStep) ? minStep : ((target > maxStep) ? maxStep : target);
+  bool newMove        = (destination != motor.getTargetPosition());
+  if (newMove) {
+    // Use the speed this bike can take in this direction
+    MotionPlanner::Profile profile = planner.plan(motor.getCurrentPosition(), destination);
+    motor.setSpeed(profile.speed);
+    motor.setAcceleration(profile.acceleration);
+  }
+  motor.moveTo(destination);
+  this->target = destination;
+  return newMove;
+}
+
+bool StepperControl::readDriverStatus(MotorDriver &driver, uint32_t &status) {
+  if (!driver.readStatus(status)) {
+    health.observeReadError();
+    return false;
+  }
+  bool wasTrusted = health.isTrusted();
+  bool moving     = running || (position != statusPosition);
+  statusPosition  = position;
+  health.observeStatus(status, moving);
+  if (wasTrusted && !health.isTrusted()) {
+    planner.reportLostSteps(target > position);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "ThermalModel.h"
+#include <math.h>
+
+const float ThermalModel::RISE_PER_A2 = 40.0f;
+const float ThermalModel::MARGIN      = 5.0f;
+const float ThermalModel::HYSTERESIS  = 3.0f;
+
+static const float AMBIENT_SMOOTHING = 0.05f;  // Per reading. The ESP32 sensor is noisy by a degree or two.
+static const float DEFAULT_AMBIENT   = 25.0f;
+
+ThermalModel::ThermalModel() : rise(0), ambient(DEFAULT_AMBIENT), measured(false), observed(false), running(0), enabled(0), level(Normal) {}
+
+float ThermalModel::meanSquare(uint16_t runCurrent, uint8_t holdPercent, bool stealthChop, float running, float enabled) {
+  float run       = runCurrent / 1000.0f;
+  float hold      = run * holdPercent / 100.0f;
+  float runSquare = run * run;
+  if (stealthChop) {
+    runSquare = runSquare * STEALTH_PERCENT / 100.0f;
+  }
+  float still = (enabled > running) ? enabled - running : 0;
+  return running * runSquare + still * hold * hold;
+}
+
+void ThermalModel::observe(uint32_t dtMs, uint16_t runCurrent, uint8_t holdPercent, bool stealthChop, float running, float enabled) {
+  float decay   = expf(-(float)dtMs / TAU_MS);
+  float target  = RISE_PER_A2 * meanSquare(runCurrent, holdPercent, stealthChop, running, enabled);
+  rise          = target + (rise - target) * decay;
+  if (!observed) {
+    decay    = 0;  // Nothing to average with yet
+    observed = true;
+  }
+  this->running = running + (this->running - running) * decay;
+  this->enabled = enabled + (this->enabled - enabled) * decay;
+}
+
+void ThermalModel::measure(float temperature) {
+  if (!measured) {
+    ambient  = temperature - rise;
+    measured = true;
+    return;
+  }
+  ambient += (temperature - rise - ambient) * AMBIENT_SMOOTHING;
+}
+
+float ThermalModel::predict(uint32_t horizonMs, uint16_t runCurrent, uint8_t holdPercent, bool stealthChop) const {
+  float decay  = expf(-(float)horizonMs / TAU_MS);
+  float target = RISE_PER_A2 * meanSquare(runCurrent, holdPercent, stealthChop, running, enabled);
+  return ambient + target + (rise - target) * decay;
+}
+
+ThermalModel::Plan ThermalModel::schedule(float limit, uint16_t runCurrent, bool stealthChop) {
+  const Plan plans[] = {
+      {Normal, runCurrent, HOLD_PERCENT, stealthChop},
+      {LowHold, runCurrent, LOW_HOLD_PERCENT, stealthChop},
+      {Stealth, runCurrent, LOW_HOLD_PERCENT, true},
+  };
+  float ceiling = limit - MARGIN;
+  Plan plan     = plans[Stealth];
+  plan.level    = Throttled;
+  // Stepping back down needs a little room to spare so the settings don't flap
+  for (int i = Normal; i <= Stealth; i++) {
+    float allowed = (i < level) ? ceiling - HYSTERESIS : ceiling;
+    if (predict(HORIZON_MS, plans[i].runCurrent, plans[i].holdPercent, plans[i].stealthChop) <= allowed) {
+      plan = plans[i];
+      break;
+    }
+  }
+  if (plan.level == Throttled) {
+    // Largest run current whose prediction lands on the ceiling. Mean square current goes as its square.
+    float decay     = expf(-(float)HORIZON_MS / TAU_MS);
+    float target    = (ceiling - ambient - rise * decay) / (1.0f - decay);
+    float full      = RISE_PER_A2 * meanSquare(runCurrent, LOW_HOLD_PERCENT, true, running, enabled);
+    float fraction  = ((full > 0) && (target > 0)) ? sqrtf(target / full) : 0;
+    float minimum   = MIN_RUN_PERCENT / 100.0f;
+    fraction        = (fraction < minimum) ? minimum : (fraction > 1.0f) ? 1.0f : fraction;
+    plan.runCurrent = (uint16_t)(runCurrent * fraction);
+  }
+  level = plan.level;
+  return plan;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "Workout.h"
+
+static uint16_t u16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+
+Workout::Workout() : stepCount(0), fileFtp(0), state(Empty), startedMs(0), pausedMs(0), lastWatts(0) {}
+
+bool Workout::load(const uint8_t *data, size_t length) {
+  stepCount = 0;
+  state     = Empty;
+  if ((length < HEADER_SIZE) || (data[0] != 'W') || (data[1] != 'K') || (data[2] != VERSION)) {
+    return false;
+  }
+  size_t count = data[3];
+  if ((count == 0) || (count > MAX_STEPS) || (length != HEADER_SIZE + count * STEP_SIZE)) {
+    return false;
+  }
+  uint32_t startMs = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *p = data + HEADER_SIZE + i * STEP_SIZE;
+    Step &step       = steps[i];
+    step.type        = p[0];
+    step.flags       = p[1];
+    step.startMs     = startMs;
+    step.durationMs  = u16(p + 2) * 1000UL;
+    step.start       = u16(p + 4);
+    step.end         = u16(p + 6);
+    if (((step.type != Steady) && (step.type != Ramp)) || (step.durationMs == 0)) {
+      return false;
+    }
+    startMs += step.durationMs;
+  }
+  stepCount = count;
+  fileFtp   = u16(data + 4);
+  state     = Ready;
+  return true;
+}
+
+void Workout::start(uint32_t nowMs) {
+  if (state == Empty) {
+    return;
+  }
+  state     = Running;
+  startedMs = nowMs;
+  lastWatts = 0;
+}
+
+void Workout::pause(uint32_t nowMs) {
+  if (state == Running) {
+    state    = Paused;
+    pausedMs = nowMs;
+  }
+}
+
+void Workout::resume(uint32_t nowMs) {
+  if (state == Paused) {
+    state = Running;
+    startedMs += nowMs - pausedMs;
+    lastWatts = 0;  // Send the target again, something else may have changed it
+  }
+}
+
+void Workout::stop() {
+  if (state != Empty) {
+    state = Ready;
+  }
+}
+
+uint32_t Workout::getElapsed(uint32_t nowMs) const {
+  switch (state) {
+    case Running:
+      return nowMs - startedMs;
+    case Paused:
+      return pausedMs - startedMs;
+    case Finished:
+      return getDuration();
+    default:
+      return 0;
+  }
+}
+
+size_t Workout::getStepAt(uint32_t elapsedMs) const {
+  for (size_t i = 0; i < stepCount; i++) {
+    if (elapsedMs < steps[i].startMs + steps[i].durationMs) {
+      return i;
+    }
+  }
+  return stepCount;
+}
+
+uint16_t Workout::toWatts(const Step &step, uint16_t target, uint16_t ftp) const {
+  if (!(step.flags & FTP_RELATIVE)) {
+    return target;
+  }
+  uint16_t reference = (fileFtp != 0) ? fileFtp : ftp;
+  return (uint16_t)(((uint32_t)target * reference + 500) / 1000);
+}
+
+uint16_t Workout::targetAt(uint32_t elapsedMs, uint16_t ftp) const {
+  size_t i = getStepAt(elapsedMs);
+  if (i == stepCount) {
+    return 0;
+  }
+  const Step &step = steps[i];
+  int32_t start    = toWatts(step, step.start, ftp);
+  if (step.type == Steady) {
+    return start;
+  }
+  // Truncates toward the start target, so each watt lasts durationMs / |change| and nextUpdate() can find the edges
+  int32_t end  = toWatts(step, step.end, ftp);
+  int64_t into = elapsedMs - step.startMs;
+  return (uint16_t)(start + (end - start) * into / (int64_t)step.durationMs);
+}
+
+bool Workout::update(uint32_t nowMs, uint16_t ftp, uint16_t *watts) {
+  if (state != Running) {
+    return false;
+  }
+  uint32_t elapsed = getElapsed(nowMs);
+  if (elapsed >= getDuration()) {
+    state = Finished;
+    return false;
+  }
+  uint16_t target = targetAt(elapsed, ftp);
+  if (target == lastWatts) {
+    return false;
+  }
+  lastWatts = target;
+  *watts    = target;
+  return true;
+}
+
+uint32_t Workout::nextUpdate(uint32_t nowMs, uint16_t ftp, uint32_t maxWaitMs) const {
+  if (state != Running) {
+    return maxWaitMs;
+  }
+  uint32_t elapsed = getElapsed(nowMs);
+  size_t i         = getStepAt(elapsed);
+  if (i == stepCount) {
+    return 0;
+  }
+  const Step &step = steps[i];
+  uint32_t wait    = step.startMs + step.durationMs - elapsed;
+  if (step.type == Ramp) {
+    int32_t change = (int32_t)toWatts(step, step.end, ftp) - toWatts(step, step.start, ftp);
+    if (change != 0) {
+      uint64_t levels = (change < 0) ? -change : change;
+      uint64_t into   = elapsed - step.startMs;
+      uint64_t next   = levels * into / step.durationMs + 1;
+      uint32_t edge   = (uint32_t)((next * step.durationMs + levels - 1) / levels - into);
+      edge            = (edge < RAMP_STEP_MS) ? RAMP_STEP_MS : edge;
+      wait            = (edge < wait) ? edge : wait;
+    }
+  }
+  return (wait < maxWaitMs) ? wait : maxWaitMs;
+}
+
+bool Workout::nextBoundary(uint32_t nowMs, uint16_t ftp, uint32_t *inMs, uint16_t *watts) const {
+  if (state != Running) {
+    return false;
+  }
+  uint32_t elapsed = getElapsed(nowMs);
+  for (size_t i = getStepAt(elapsed) + 1; i < stepCount; i++) {
+    uint16_t before = targetAt(steps[i].startMs - 1, ftp);
+    uint16_t after  = targetAt(steps[i].startMs, ftp);
+    if (before != after) {
+      *inMs  = steps[i].startMs - elapsed;
+      *watts = after;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "hal/Fakes.h"
+#include <math.h>
+#include <string.h>
+
+FakeMotor::FakeMotor(Clock &clock, uint32_t enableDelayMs)
+    : clock(clock),
+      enableDelayMs(enableDelayMs),
+      speed(1000),
+      acceleration(1000),
+      holdEnabled(false),
+      direction(true),
+      running(false),
+      position(0),
+      from(0),
+      target(0),
+      startUs(0),
+      moveSpeed(1000),
+      moveAcceleration(1000),
+      moveDelayMs(0),
+      slipped(0),
+      moves(0) {}
+
+void FakeMotor::update() {
+  if (!running) {
+    return;
+  }
+  float t = (uint32_t)(clock.nowUs() - startUs) / 1000000.0f - moveDelayMs / 1000.0f;
+  if (t <= 0) {
+    return;
+  }
+  float d = (target > from) ? target - from : from - target;
+  float v = moveSpeed;
+  float a = moveAcceleration;
+  float ramp;   // Time spent accelerating, and again braking
+  float total;  // Time for the whole move
+  if (d * a >= v * v) {
+    ramp  = v / a;
+    total = d / v + v / a;
+  } else {
+    ramp  = sqrtf(d / a);
+    total = 2 * ramp;
+    v     = a * ramp;
+  }
+  float s;  // Distance covered
+  if (t >= total) {
+    position = target;
+    running  = false;
+    return;
+  } else if (t < ramp) {
+    s = 0.5f * a * t * t;
+  } else if (t < total - ramp) {
+    s = 0.5f * a * ramp * ramp + v * (t - ramp);
+  } else {
+    s = d - 0.5f * a * (total - t) * (total - t);
+  }
+  position = from + ((target > from) ? (int32_t)s : -(int32_t)s);
+}
+
+int32_t FakeMotor::getCurrentPosition() {
+  this->update();
+  return position;
+}
+
+void FakeMotor::setCurrentPosition(int32_t position) {
+  this->update();
+  int32_t shift = position - this->position;
+  slipped -= shift;  // The motor itself stays put
+  this->position = position;
+  from += shift;
+  target += shift;
+}
+
+bool FakeMotor::isRunning() {
+  this->update();
+  return running;
+}
+
+void FakeMotor::moveTo(int32_t position) {
+  this->update();
+  if (position == target) {
+    return;
+  }
+  moveDelayMs      = (running || holdEnabled) ? 0 : enableDelayMs;
+  from             = this->position;
+  target           = position;
+  startUs          = clock.nowUs();
+  moveSpeed        = (speed > 0) ? speed : 1;
+  moveAcceleration = (acceleration > 0) ? acceleration : 1;
+  running          = (from != target);
+  moves++;
+}
+
+void FakeMotor::stopMove() {
+  this->update();
+  from    = position;
+  target  = position;
+  running = false;
+}
+
+void FakeMotorDriver::setCurrent(uint16_t runMa, float holdMultiplier) {
+  this->runMa          = runMa;
+  this->holdMultiplier = holdMultiplier;
+}
+
+uint16_t FakeMotorDriver::getCurrentScale() {
+  // TMC2208 datasheet section 9, with the board's 0.11 ohm sense resistors and vsense high
+  float scale = 32.0f * 1.41421f * (runMa / 1000.0f) * (0.11f + 0.02f) / 0.180f - 1;
+  return (scale < 0) ? 0 : (scale > 31) ? 31 : (uint16_t)scale;
+}
+
+bool FakeMotorDriver::readStatus(uint32_t &status) {
+  if (failedReads > 0) {
+    failedReads--;
+    return false;
+  }
+  status = this->status;
+  return true;
+}
+
+int32_t FakeFileSystem::size(const char *path) {
+  std::map<std::string, std::vector<uint8_t> >::const_iterator file = files.find(path);
+  return (file == files.end()) ? -1 : (int32_t)file->second.size();
+}
+
+int32_t FakeFileSystem::read(const char *path, uint32_t offset, uint8_t *buffer, size_t length) {
+  std::map<std::string, std::vector<uint8_t> >::const_iterator file = files.find(path);
+  if (file == files.end()) {
+    return -1;
+  }
+  size_t available = (offset < file->second.size()) ? file->second.size() - offset : 0;
+  size_t count     = (available < length) ? available : length;
+  if (count > 0) {
+    memcpy(buffer, &file->second[offset], count);
+  }
+  return (int32_t)count;
+}
+
+bool FakeFileSystem::write(const char *path, const uint8_t *data, size_t length) {
+  int32_t existing = this->size(path);
+  if (this->used() - ((existing > 0) ? existing : 0) + length > capacity) {
+    return false;
+  }
+  files[path] = std::vector<uint8_t>(data, data + length);
+  writes++;
+  return true;
+}
+
+bool FakeFileSystem::append(const char *path, const uint8_t *data, size_t length) {
+  if (this->used() + length > capacity) {
+    return false;
+  }
+  std::vector<uint8_t> &file = files[path];
+  file.insert(file.end(), data, data + length);
+  writes++;
+  return true;
+}
+
+bool FakeFileSystem::remove(const char *path) { return files.erase(path) > 0; }
+
+size_t FakeFileSystem::used() const {
+  size_t total = 0;
+  for (std::map<std::string, std::vector<uint8_t> >::const_iterator file = files.begin(); file != files.end(); ++file) {
+    total += file->second.size();
+  }
+  return total;
+}
@@ -9,33 +9,18 @@
 #include "endian.h"
 #include "sensors/CyclePowerData.h"
 
-bool CyclePowerData::hasHeartRate() { return false; }
-
-bool CyclePowerData::hasCadence() { return !std::isnan(this->cadence); }
-
-bool CyclePowerData::hasPower() { return this->power != INT_MIN; }
-
-bool CyclePowerData::hasSpeed() { return false; }
-
-bool CyclePowerData::hasResistance() { return false; }
-
-int CyclePowerData::getHeartRate() { return INT_MIN; }
-
-float CyclePowerData::getCadence() { return this->cadence; }
-
-int CyclePowerData::getPower() { return this->power; }
-
-float CyclePowerData::getSpeed() { return nanf(""); }
-
-int CyclePowerData::getResistance() { return INT_MIN; }
-
 void CyclePowerData::decode(uint8_t *data, size_t length) {
+  sample.clear();
+  // Flags and instantaneous power are mandatory.
+  if (length < 4) {
+    return;
+  }
   uint8_t flags = data[0];
   int cPos      = 2;  // lowest position power could ever be
   // Instantaneous power is always present. Do that first.
   // first calculate which fields are present. Power is always 2 & 3, cadence
   // can move depending on the flags.
-  this->power = get_le16(&data[cPos]);
+  sample.setPower(get_le16(&data[cPos]));
   cPos += 2;
 
   if (bitRead(flags, 0)) {
@@ -59,15 +44,17 @@ void CyclePowerData::decode(uint8_t *data, size_t length) {
     // bits for wheel event time. Why is that so hard to find in the specs?
     cPos += 6;
   }
-  if (bitRead(flags, 5)) {
+  if (bitRead(flags, 5) && (cPos + 4 <= (int)length)) {
     // Crank Revolution data present, lets process it.
-    if (!this->hasCadence()) {
+    if (!this->hasCrankData) {
       // Handle the special case that this is first cadence reading
       // Since we have no lastCrankRev/EventTime we can't do a cadence calc
       // until the next reading
       this->crankRev       = get_le16(&data[cPos]);
       this->crankEventTime = get_le16(&data[cPos + 2]);
       this->cadence        = 0;
+      this->hasCrankData   = true;
+      sample.setCadence(this->cadence);
       return;
     }
 
@@ -97,5 +84,6 @@ void CyclePowerData::decode(uint8_t *data, size_t length) {
       }
       this->missedReadingCount++;
     }
+    sample.setCadence(this->cadence);
   }
 }
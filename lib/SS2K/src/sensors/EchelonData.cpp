@@ -7,43 +7,37 @@
 
 #include "sensors/EchelonData.h"
 
-bool EchelonData::hasHeartRate() { return false; }
-
-bool EchelonData::hasCadence() { return !std::isnan(this->cadence); }
-
-bool EchelonData::hasPower() { return this->cadence >= 0 && this->resistance >= 0; }
-
-bool EchelonData::hasSpeed() { return false; }
-
-bool EchelonData::hasResistance() { return true; }
-
-int EchelonData::getHeartRate() { return INT_MIN; }
-
-float EchelonData::getCadence() { return this->cadence; }
-
-int EchelonData::getPower() { return this->power; }
-
-int EchelonData::getResistance() { return this->resistance; }
-
-float EchelonData::getSpeed() { return nanf(""); }
-
 void EchelonData::decode(uint8_t *data, size_t length) {
+  sample.clear();
+  if (length < 2) {
+    return;
+  }
   switch (data[1]) {
     // Cadence notification
     case 0xD1:
+      if (length < 11) {
+        return;
+      }
       this->cadence = static_cast<int>((data[9] << 8) + data[10]);
+      sample.setCadence(this->cadence);
       break;
     // Resistance notification
     case 0xD2:
+      if (length < 4) {
+        return;
+      }
       this->resistance = static_cast<int>(data[3]);
+      sample.setResistance(this->resistance);
       break;
   }
   if (std::isnan(this->cadence) || this->resistance < 0) {
     return;
   }
   if (this->cadence == 0 || this->resistance == 0) {
-    power = 0;
+    sample.setPower(0);
   } else {
-    power = pow(1.090112, resistance) * pow(1.015343, cadence) * 7.228958;
+    // A corrupt cadence or resistance sends this far past anything the sample holds.
+    double power = pow(1.090112, resistance) * pow(1.015343, cadence) * 7.228958;
+    sample.setPower(power < INT16_MAX ? static_cast<int>(power) : INT16_MAX);
   }
 }
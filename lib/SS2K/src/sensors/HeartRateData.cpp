@@ -5,26 +5,21 @@
  * SPDX-License-Identifier: GPL-2.0-only
  */
 
+#include "Data.h"
+#include "endian.h"
 #include "sensors/HeartRateData.h"
 
-bool HeartRateData::hasHeartRate() { return this->heartrate != INT_MIN; }
-
-bool HeartRateData::hasCadence() { return false; }
-
-bool HeartRateData::hasPower() { return false; }
-
-bool HeartRateData::hasSpeed() { return false; }
-
-bool HeartRateData::hasResistance() { return false; }
-
-int HeartRateData::getHeartRate() { return this->heartrate; }
-
-float HeartRateData::getCadence() { return nanf(""); }
-
-int HeartRateData::getPower() { return INT_MIN; }
-
-float HeartRateData::getSpeed() { return nanf(""); }
-
-int HeartRateData::getResistance() { return INT_MIN; }
-
-void HeartRateData::decode(uint8_t *data, size_t length) { this->heartrate = static_cast<int>(data[1]); }
+void HeartRateData::decode(uint8_t *data, size_t length) {
+  sample.clear();
+  if (length < 2) {
+    return;
+  }
+  // Flag bit 0 selects a 16 bit heart rate.
+  if (bitRead(data[0], 0)) {
+    if (length >= 3) {
+      sample.setHeartRate(get_le16(&data[1]));
+    }
+  } else {
+    sample.setHeartRate(data[1]);
+  }
+}
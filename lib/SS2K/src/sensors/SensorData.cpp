@@ -1,10 +0,0 @@
-/*
- * Copyright (C) 2020  Anthony Doud & Joel Baranick
- * All rights reserved
- *
- * SPDX-License-Identifier: GPL-2.0-only
- */
-
-#include "sensors/SensorData.h"
-
-std::string SensorData::getId() { return this->id; }
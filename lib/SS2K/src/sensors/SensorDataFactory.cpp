@@ -5,74 +5,154 @@
  * SPDX-License-Identifier: GPL-2.0-only
  */
 
-#include <cmath>
+#include <cstring>
 #include "Constants.h"
+#include "endian.h"
 #include "sensors/SensorDataFactory.h"
-#include "sensors/CyclePowerData.h"
-#include "sensors/FlywheelData.h"
-#include "sensors/FitnessMachineIndoorBikeData.h"
-#include "sensors/HeartRateData.h"
-#include "sensors/EchelonData.h"
-#include "sensors/PelotonData.h"
 
-std::shared_ptr<SensorData> SensorDataFactory::getSensorData(const NimBLEUUID characteristicUUID, const uint64_t peerAddress, uint8_t *data, size_t length) {
-  for (auto &it : SensorDataFactory::knownDevices) {
-    if (it->isSameDeviceCharacteristic(characteristicUUID, peerAddress)) {
-      return it->decode(data, length);
-    }
-  }
+SensorDataFactory::SensorDataFactory() : count(0), sequence(0) { memset(slots, 0, sizeof(slots)); }
 
-  std::shared_ptr<SensorData> sensorData = NULL_SENSOR_DATA;
-  if (characteristicUUID == CYCLINGPOWERMEASUREMENT_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new CyclePowerData());
-  } else if (characteristicUUID == HEARTCHARACTERISTIC_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new HeartRateData());
-  } else if (characteristicUUID == FITNESSMACHINEINDOORBIKEDATA_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new FitnessMachineIndoorBikeData());
-  } else if (characteristicUUID == FLYWHEEL_UART_SERVICE_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new FlywheelData());
-  } else if (characteristicUUID == ECHELON_DATA_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new EchelonData());
-  } else if (characteristicUUID == PELOTON_DATA_UUID) {
-    sensorData = std::shared_ptr<SensorData>(new PelotonData());
+static size_t put32(uint8_t *bytes, uint32_t value) {
+  put_le32(bytes, value);
+  return 4;
+}
+
+uint64_t SensorDataFactory::getKey(const NimBLEUUID &characteristicUUID, const uint64_t peerAddress) {
+  // Bluetooth base UUID 0000xxxx-0000-1000-8000-00805f9b34fb, least significant byte first.
+  static const uint8_t baseUUID[12] = {0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00};
+  const ble_uuid_any_t *uuid        = characteristicUUID.getNative();
+
+  // NimBLEUUID treats a 16 or 32 bit UUID and its 128 bit expansion as equal, so they have to hash the same.
+  uint8_t bytes[16];
+  size_t length;
+  if (uuid->u.type == BLE_UUID_TYPE_16) {
+    length = put32(bytes, uuid->u16.value);
+  } else if (uuid->u.type == BLE_UUID_TYPE_32) {
+    length = put32(bytes, uuid->u32.value);
+  } else if (memcmp(uuid->u128.value, baseUUID, sizeof(baseUUID)) == 0) {
+    length = put32(bytes, get_le32(&uuid->u128.value[12]));
   } else {
-    return NULL_SENSOR_DATA;
+    memcpy(bytes, uuid->u128.value, 16);
+    length = 16;
   }
 
-  KnownDevice *knownDevice = new KnownDevice(characteristicUUID, peerAddress, sensorData);
-  SensorDataFactory::knownDevices.push_back(knownDevice);
-  return knownDevice->decode(data, length);
-}
-
-std::shared_ptr<SensorData> SensorDataFactory::KnownDevice::decode(uint8_t *data, size_t length) {
-  this->sensorData->decode(data, length);
-  return this->sensorData;
+  // FNV-1a
+  uint64_t key = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    key ^= bytes[i];
+    key *= 1099511628211ULL;
+  }
+  for (int i = 0; i < 8; i++) {
+    key ^= (uint8_t)(peerAddress >> (i * 8));
+    key *= 1099511628211ULL;
+  }
+  return (key == EMPTY_KEY) ? 1 : key;
 }
 
-bool SensorDataFactory::KnownDevice::isSameDeviceCharacteristic(const NimBLEUUID characteristicUUID, const uint64_t peerAddress) {
-  return this->characteristicId == characteristicUUID && this->peerAddress == peerAddress;
+SensorData *SensorDataFactory::getSensorData(const NimBLEUUID &characteristicUUID, const uint64_t peerAddress, uint8_t *data, size_t length) {
+  return getSensorData(getKey(characteristicUUID, peerAddress), characteristicUUID, data, length);
 }
 
-bool SensorDataFactory::NullData::hasHeartRate() { return false; }
-
-bool SensorDataFactory::NullData::hasCadence() { return false; }
-
-bool SensorDataFactory::NullData::hasPower() { return false; }
-
-bool SensorDataFactory::NullData::hasSpeed() { return false; }
-
-bool SensorDataFactory::NullData::hasResistance() { return false; }
+SensorData *SensorDataFactory::getSensorData(uint64_t key, const NimBLEUUID &characteristicUUID, uint8_t *data, size_t length) {
+  size_t index = (size_t)(key ^ (key >> 32));
+  sequence++;
+  for (size_t probe = 0; probe < MAP_SIZE; probe++) {
+    Slot &slot = slots[(index + probe) & (MAP_SIZE - 1)];
+    if (slot.key == EMPTY_KEY) {
+      break;
+    }
+    if (slot.key == key) {
+      slot.lastUsed = sequence;
+      slot.sensorData->decode(data, length);
+      return slot.sensorData;
+    }
+  }
 
-int SensorDataFactory::NullData::getHeartRate() { return INT_MIN; }
+  // First packet from this characteristic. Making room moves slots, so the decoder comes before the slot.
+  SensorData *sensorData = createSensorData(characteristicUUID);
+  if (count == MAP_SIZE) {
+    size_t oldest = MAP_SIZE;
+    for (size_t i = 0; i < MAP_SIZE; i++) {
+      oldest = isOlder(i, oldest) ? i : oldest;
+    }
+    remove(oldest);
+  }
+  size_t empty = index & (MAP_SIZE - 1);
+  while (slots[empty].key != EMPTY_KEY) {
+    empty = (empty + 1) & (MAP_SIZE - 1);
+  }
+  slots[empty].key        = key;
+  slots[empty].sensorData = sensorData;
+  slots[empty].lastUsed   = sequence;
+  count++;
+  sensorData->decode(data, length);
+  return sensorData;
+}
 
-float SensorDataFactory::NullData::getCadence() { return nanf(""); }
+template <typename T>
+SensorData *SensorDataFactory::acquire(DecoderPool<T> &pool) {
+  T *decoder = pool.acquire();
+  if (decoder == nullptr) {
+    size_t oldest = MAP_SIZE;
+    for (size_t i = 0; i < MAP_SIZE; i++) {
+      oldest = (pool.owns(slots[i].sensorData) && isOlder(i, oldest)) ? i : oldest;
+    }
+    if (oldest != MAP_SIZE) {
+      remove(oldest);
+      decoder = pool.acquire();
+    }
+  }
+  return decoder;
+}
 
-int SensorDataFactory::NullData::getPower() { return INT_MIN; }
+bool SensorDataFactory::isOlder(size_t index, size_t than) const {
+  if (slots[index].key == EMPTY_KEY) {
+    return false;
+  }
+  return (than == MAP_SIZE) || (sequence - slots[index].lastUsed > sequence - slots[than].lastUsed);
+}
 
-float SensorDataFactory::NullData::getSpeed() { return nanf(""); }
+// Backward shift, so lookups never need tombstones.
+void SensorDataFactory::remove(size_t index) {
+  const SensorData *sensorData = slots[index].sensorData;
+  cyclePowerDecoders.release(sensorData);
+  heartRateDecoders.release(sensorData);
+  indoorBikeDecoders.release(sensorData);
+  flywheelDecoders.release(sensorData);
+  echelonDecoders.release(sensorData);
+  pelotonDecoders.release(sensorData);
+
+  slots[index].key = EMPTY_KEY;
+  count--;
+  size_t hole = index;
+  for (size_t next = (index + 1) & (MAP_SIZE - 1); slots[next].key != EMPTY_KEY; next = (next + 1) & (MAP_SIZE - 1)) {
+    size_t wanted = (size_t)(slots[next].key ^ (slots[next].key >> 32)) & (MAP_SIZE - 1);
+    // Move it back unless its home lies after the hole, up to where it sits.
+    bool stays = (hole <= next) ? ((hole < wanted) && (wanted <= next)) : ((hole < wanted) || (wanted <= next));
+    if (!stays) {
+      slots[hole]     = slots[next];
+      slots[next].key = EMPTY_KEY;
+      hole            = next;
+    }
+  }
+}
 
-int SensorDataFactory::NullData::getResistance() { return INT_MIN; }
+SensorData *SensorDataFactory::createSensorData(const NimBLEUUID &characteristicUUID) {
+  SensorData *sensorData = nullptr;
+  if (characteristicUUID == CYCLINGPOWERMEASUREMENT_UUID) {
+    sensorData = acquire(cyclePowerDecoders);
+  } else if (characteristicUUID == HEARTCHARACTERISTIC_UUID) {
+    sensorData = acquire(heartRateDecoders);
+  } else if (characteristicUUID == FITNESSMACHINEINDOORBIKEDATA_UUID) {
+    sensorData = acquire(indoorBikeDecoders);
+  } else if (characteristicUUID == FLYWHEEL_UART_SERVICE_UUID) {
+    sensorData = acquire(flywheelDecoders);
+  } else if (characteristicUUID == ECHELON_DATA_UUID) {
+    sensorData = acquire(echelonDecoders);
+  } else if (characteristicUUID == PELOTON_DATA_UUID) {
+    sensorData = acquire(pelotonDecoders);
+  }
+  return (sensorData == nullptr) ? &nullData : sensorData;
+}
 
 void SensorDataFactory::NullData::decode(uint8_t *data, size_t length) {}
-
-std::shared_ptr<SensorData> SensorDataFactory::NULL_SENSOR_DATA = std::shared_ptr<SensorData>(new NullData());
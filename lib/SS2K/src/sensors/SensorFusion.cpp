@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include <cstring>
+#include "Constants.h"
+#include "sensors/SensorFusion.h"
+
+static const int MAX_HEART_RATE = 250;
+static const int MIN_HEART_RATE = 30;
+static const int MAX_POWER      = 3000;
+static const int MAX_CADENCE    = 250;
+static const int MAX_SPEED      = 120;
+
+SensorFusion::SensorFusion() {
+  memset(sources, 0, sizeof(sources));
+  // HEART_RATE, CADENCE, POWER, SPEED, RESISTANCE
+  const uint8_t defaults[KINDS][FIELDS] = {
+      {3, 0, 0, 1, 3},  // PowerMeter
+      {0, 3, 3, 3, 3},  // HeartMonitor
+      {1, 1, 1, 0, 1},  // FitnessMachine
+      {2, 2, 2, 2, 0},  // Peloton
+  };
+  memcpy(priorities, defaults, sizeof(priorities));
+}
+
+size_t SensorFusion::fieldIndex(SensorSample::Field field) {
+  size_t index = 0;
+  while ((index < FIELDS) && !(field & (1 << index))) {
+    index++;
+  }
+  return index;
+}
+
+void SensorFusion::setPriority(Kind kind, SensorSample::Field field, uint8_t priority) { priorities[kind][fieldIndex(field)] = priority; }
+
+void SensorFusion::setPreferBike(bool preferBike) {
+  const SensorSample::Field fields[] = {SensorSample::POWER, SensorSample::CADENCE};
+  for (size_t i = 0; i < 2; i++) {
+    this->setPriority(PowerMeter, fields[i], preferBike ? 2 : 0);
+    this->setPriority(FitnessMachine, fields[i], preferBike ? 0 : 1);
+    this->setPriority(Peloton, fields[i], preferBike ? 1 : 2);
+  }
+}
+
+uint8_t SensorFusion::getPriority(Kind kind, SensorSample::Field field) const { return priorities[kind][fieldIndex(field)]; }
+
+bool SensorFusion::plausible(const SensorSample &sample, SensorSample::Field field) {
+  switch (field) {
+    case SensorSample::HEART_RATE:
+      return (sample.heartRate >= MIN_HEART_RATE) && (sample.heartRate <= MAX_HEART_RATE);
+    case SensorSample::CADENCE:
+      return (sample.cadence >= 0) && (sample.cadence <= SensorSample::fixed(MAX_CADENCE, 1));
+    case SensorSample::POWER:
+      return (sample.power >= 0) && (sample.power <= MAX_POWER);
+    case SensorSample::SPEED:
+      return (sample.speed >= 0) && (sample.speed <= SensorSample::fixed(MAX_SPEED, 1));
+    default:
+      return true;
+  }
+}
+
+bool SensorFusion::isFresh(const Source &source, size_t field, uint32_t nowMs) const {
+  return (source.key != 0) && (source.seen & (1 << field)) && (nowMs - source.lastMs[field] <= STALE_MS) && (priorities[source.kind][field] != NEVER);
+}
+
+int SensorFusion::select(uint32_t nowMs, size_t field) const {
+  int best = -1;
+  for (size_t i = 0; i < MAX_SOURCES; i++) {
+    if (this->isFresh(sources[i], field, nowMs) && ((best < 0) || (priorities[sources[i].kind][field] < priorities[sources[best].kind][field]))) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+SensorFusion::Source *SensorFusion::findSource(uint32_t nowMs, uint64_t key, Kind kind) {
+  Source *slot = nullptr;
+  for (size_t i = 0; i < MAX_SOURCES; i++) {
+    if (sources[i].key == key) {
+      return &sources[i];
+    }
+    if ((slot == nullptr) && (sources[i].key == 0)) {
+      slot = &sources[i];
+    }
+  }
+  // New peer. Takes a free slot, or the one that has been quiet longest.
+  if (slot == nullptr) {
+    slot = &sources[0];
+    for (size_t i = 1; i < MAX_SOURCES; i++) {
+      if (nowMs - sources[i].lastPacketMs > nowMs - slot->lastPacketMs) {
+        slot = &sources[i];
+      }
+    }
+  }
+  memset(slot, 0, sizeof(*slot));
+  slot->key  = key;
+  slot->kind = kind;
+  return slot;
+}
+
+uint8_t SensorFusion::offer(uint32_t nowMs, uint64_t key, Kind kind, const SensorSample &sample) {
+  Source *source       = this->findSource(nowMs, (key == 0) ? 1 : key, kind);
+  source->lastPacketMs = nowMs;
+  source->packets++;
+
+  uint8_t accepted = 0;
+  for (size_t i = 0; i < FIELDS; i++) {
+    SensorSample::Field field = (SensorSample::Field)(1 << i);
+    if (!sample.has(field)) {
+      continue;
+    }
+    if ((field == SensorSample::HEART_RATE) && (sample.heartRate == 0)) {
+      continue;  // No contact. Not a fault, but not a reading either.
+    }
+    if (!plausible(sample, field)) {
+      source->rejected++;
+      continue;
+    }
+    source->seen |= field;
+    source->latest.present |= field;
+    source->lastMs[i] = nowMs;
+    accepted |= field;
+  }
+  source->latest.heartRate  = (accepted & SensorSample::HEART_RATE) ? sample.heartRate : source->latest.heartRate;
+  source->latest.cadence    = (accepted & SensorSample::CADENCE) ? sample.cadence : source->latest.cadence;
+  source->latest.power      = (accepted & SensorSample::POWER) ? sample.power : source->latest.power;
+  source->latest.speed      = (accepted & SensorSample::SPEED) ? sample.speed : source->latest.speed;
+  source->latest.resistance = (accepted & SensorSample::RESISTANCE) ? sample.resistance : source->latest.resistance;
+
+  uint8_t selected = 0;
+  for (size_t i = 0; i < FIELDS; i++) {
+    if ((accepted & (1 << i)) && (this->select(nowMs, i) == source - sources)) {
+      selected |= (1 << i);
+    }
+  }
+  return selected;
+}
+
+uint8_t SensorFusion::getFresh(uint32_t nowMs) const {
+  uint8_t fresh = 0;
+  for (size_t i = 0; i < FIELDS; i++) {
+    if (this->select(nowMs, i) >= 0) {
+      fresh |= (1 << i);
+    }
+  }
+  return fresh;
+}
+
+const SensorFusion::Source *SensorFusion::getSelected(uint32_t nowMs, SensorSample::Field field) const {
+  int index = this->select(nowMs, fieldIndex(field));
+  return (index < 0) ? nullptr : &sources[index];
+}
+
+SensorFusion::Kind SensorFusion::getKind(const NimBLEUUID &characteristicUUID) {
+  if (characteristicUUID == CYCLINGPOWERMEASUREMENT_UUID) {
+    return PowerMeter;
+  } else if (characteristicUUID == HEARTCHARACTERISTIC_UUID) {
+    return HeartMonitor;
+  } else if (characteristicUUID == PELOTON_DATA_UUID) {
+    return Peloton;
+  }
+  return FitnessMachine;  // FTMS, Echelon and Flywheel bikes
+}
+
+const char *SensorFusion::getKindName(Kind kind) {
+  const char *names[KINDS] = {"PM", "HRM", "Bike", "Peloton"};
+  return (kind < KINDS) ? names[kind] : "?";
+}
@@ -14,8 +14,8 @@ appearance: 1156, manufacturer data: 640302018743, serviceUUID:
 #include "Main.h"
 #include "BLE_Common.h"
 #include "SS2KLog.h"
+#include "SessionRecorder.h"
 
-#include <ArduinoJson.h>
 #include <Constants.h>
 #include <memory>
 #include <NimBLEDevice.h>
@@ -28,6 +28,14 @@ static MyClientCallback myClientCallback;
 static MyAdvertisedDeviceCallback myAdvertisedDeviceCallbacks;
 
 void SpinBLEClient::start() {
+  if (deviceCacheMutex == NULL) {
+    deviceCacheMutex = xSemaphoreCreateMutex();
+  }
+  uint8_t saved[PeerCache::SERIALIZED_SIZE];
+  int32_t length = ss2k->fileSystem->read(PEER_CACHE_FILENAME, 0, saved, sizeof(saved));
+  if ((length > 0) && peerCache.deserialize(saved, length)) {
+    SS2K_LOG(BLE_CLIENT_LOG_TAG, "Remembering %d peers", peerCache.size());
+  }
   // Create the task for the BLE Client loop
   xTaskCreatePinnedToCore(bleClientTask,    /* Task function. */
                           "BLEClientTask",  /* name of task. */
@@ -69,7 +77,7 @@ void bleClientTask(void *pvParameters) {
     if (ss2k->isUpdating) {
       for (auto &_BLEd : spinBLEClient.myBLEDevices) {  // loop through discovered devices
         if (_BLEd.connectedClientID != BLE_HS_CONN_HANDLE_NONE) {
-          if (_BLEd.advertisedDevice) {                                                                // is device registered?
+          if (_BLEd.isAssigned()) {                                                                    // is device registered?
             if ((_BLEd.connectedClientID != BLE_HS_CONN_HANDLE_NONE) && (_BLEd.doConnect == false)) {  // client must not be in connection process
               if (BLEDevice::getClientByPeerAddress(_BLEd.peerAddress)) {                              // nullptr check
                 NimBLEClient *pClient = NimBLEDevice::getClientByPeerAddress(_BLEd.peerAddress);
@@ -93,6 +101,7 @@ void bleClientTask(void *pvParameters) {
     if (spinBLEClient.doScan && (!ss2k->isUpdating)) {
       spinBLEClient.scanProcess();
     }
+    spinBLEClient.maintainScan();
 
     // Connect BLE Servers to this client
     for (int x = 0; x < NUM_BLE_DEVICES; x++) {
@@ -108,6 +117,36 @@ void bleClientTask(void *pvParameters) {
   }
 }
 
+// The service and data characteristic connectToServer() subscribes to for a DeviceCache::Service.
+static void getServiceUUIDs(uint8_t service, NimBLEUUID &serviceUUID, NimBLEUUID &charUUID) {
+  switch (service) {
+    case DeviceCache::Flywheel:
+      serviceUUID = FLYWHEEL_UART_SERVICE_UUID;
+      charUUID    = FLYWHEEL_UART_TX_UUID;
+      break;
+    case DeviceCache::FitnessMachine:
+      serviceUUID = FITNESSMACHINESERVICE_UUID;
+      charUUID    = FITNESSMACHINEINDOORBIKEDATA_UUID;
+      break;
+    case DeviceCache::CyclingPower:
+      serviceUUID = CYCLINGPOWERSERVICE_UUID;
+      charUUID    = CYCLINGPOWERMEASUREMENT_UUID;
+      break;
+    case DeviceCache::Echelon:
+      serviceUUID = ECHELON_SERVICE_UUID;
+      charUUID    = ECHELON_DATA_UUID;
+      break;
+    case DeviceCache::HeartRate:
+      serviceUUID = HEARTSERVICE_UUID;
+      charUUID    = HEARTCHARACTERISTIC_UUID;
+      break;
+    case DeviceCache::Hid:
+      serviceUUID = HID_SERVICE_UUID;
+      charUUID    = HID_REPORT_DATA_UUID;
+      break;
+  }
+}
+
 bool SpinBLEClient::connectToServer() {
   SS2K_LOG(BLE_CLIENT_LOG_TAG, "Initiating Server Connection");
   NimBLEUUID serviceUUID;
@@ -115,7 +154,9 @@ bool SpinBLEClient::connectToServer() {
 
   int successful                = 0;
   BLEAdvertisedDevice *myDevice = nullptr;
+  const PeerCache::Peer *peer   = nullptr;  // Remembered peer to connect to without a scan
   int device_number             = -1;
+  uint8_t service               = 0;
 
   for (int i = 0; i < NUM_BLE_DEVICES; i++) {
     if (spinBLEClient.myBLEDevices[i].doConnect == true) {   // Client wants to be connected
@@ -133,6 +174,9 @@ bool SpinBLEClient::connectToServer() {
         device_number = i;
         //   }
         break;
+      } else if ((peer = this->peerCache.find((uint64_t)spinBLEClient.myBLEDevices[i].peerAddress)) && PeerCache::canConnectDirect(*peer)) {
+        device_number = i;
+        break;
       } else {
         SS2K_LOG(BLE_CLIENT_LOG_TAG, "doConnect and client out of alignment. Resetting device slot.");
         spinBLEClient.myBLEDevices[i].reset();
@@ -142,35 +186,32 @@ bool SpinBLEClient::connectToServer() {
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "doConnect on slot %d not set", i);
     }
   }
-  if (myDevice == nullptr) {
+  if ((myDevice == nullptr) && (peer == nullptr)) {
     SS2K_LOG(BLE_CLIENT_LOG_TAG, "No Device Found to Connect");
     return false;
   }
   // FUTURE - Iterate through an array of UUID's we support instead of all the if checks.
-  if (myDevice->getServiceUUIDCount() > 0) {
+  if (peer) {
+    service = peer->service;
+    SS2K_LOG(BLE_CLIENT_LOG_TAG, "Trying to reconnect to %s without a scan", peer->name);
+  } else if (myDevice->getServiceUUIDCount() > 0) {
     if (myDevice->isAdvertisingService(FLYWHEEL_UART_SERVICE_UUID) && (myDevice->getName() == FLYWHEEL_BLE_NAME)) {
-      serviceUUID = FLYWHEEL_UART_SERVICE_UUID;
-      charUUID    = FLYWHEEL_UART_TX_UUID;
+      service = DeviceCache::Flywheel;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "trying to connect to Flywheel Bike");
     } else if (myDevice->isAdvertisingService(FITNESSMACHINESERVICE_UUID)) {
-      serviceUUID = FITNESSMACHINESERVICE_UUID;
-      charUUID    = FITNESSMACHINEINDOORBIKEDATA_UUID;
+      service = DeviceCache::FitnessMachine;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "trying to connect to Fitness Machine Service");
     } else if (myDevice->isAdvertisingService(CYCLINGPOWERSERVICE_UUID)) {
-      serviceUUID = CYCLINGPOWERSERVICE_UUID;
-      charUUID    = CYCLINGPOWERMEASUREMENT_UUID;
+      service = DeviceCache::CyclingPower;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "trying to connect to Cycling Power Service");
     } else if (myDevice->isAdvertisingService(ECHELON_DEVICE_UUID)) {
-      serviceUUID = ECHELON_SERVICE_UUID;
-      charUUID    = ECHELON_DATA_UUID;
+      service = DeviceCache::Echelon;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Trying to connect to Echelon Bike");
     } else if (myDevice->isAdvertisingService(HEARTSERVICE_UUID)) {
-      serviceUUID = HEARTSERVICE_UUID;
-      charUUID    = HEARTCHARACTERISTIC_UUID;
+      service = DeviceCache::HeartRate;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Trying to connect to HRM");
     } else if (myDevice->isAdvertisingService(HID_SERVICE_UUID)) {
-      serviceUUID = HID_SERVICE_UUID;
-      charUUID    = HID_REPORT_DATA_UUID;
+      service = DeviceCache::Hid;
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Trying to connect to BLE HID remote");
     } else {
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "No advertised UUID found");
@@ -183,8 +224,12 @@ bool SpinBLEClient::connectToServer() {
     // spinBLEClient.serverScan(true);
     return false;
   }
+  getServiceUUIDs(service, serviceUUID, charUUID);
+  NimBLEAddress peerAddress = myDevice ? myDevice->getAddress() : NimBLEAddress(peer->address, peer->addressType);
+  uint64_t directAddress    = peer ? peer->address : 0;  // Failures count against a remembered peer
+  String peerName           = myDevice ? this->adevName2UniqueName(myDevice) : String(peer->name);
 
-  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Forming a connection to: %s", this->adevName2UniqueName(myDevice).c_str());
+  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Forming a connection to: %s", peerName.c_str());
 
   NimBLEClient *pClient = nullptr;
 
@@ -194,12 +239,16 @@ bool SpinBLEClient::connectToServer() {
      *  second argument in connect() to prevent refreshing the service database.
      *  This saves considerable time and power.
      */
-    pClient = NimBLEDevice::getClientByPeerAddress(myDevice->getAddress());
+    pClient = NimBLEDevice::getClientByPeerAddress(peerAddress);
     if (pClient) {
       pClient->setConnectTimeout(2);
+      if (peer) {
+        pClient->setConnectionParams(peer->interval, peer->interval, peer->latency, peer->timeout);
+      }
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Reusing Client");
-      if (!pClient->connect(myDevice, false)) {
+      if (!pClient->connect(peerAddress, false)) {
         SS2K_LOG(BLE_CLIENT_LOG_TAG, "Reconnect failed ");
+        this->peerCache.failed(directAddress);
         this->reconnectTries--;
         SS2K_LOG(BLE_CLIENT_LOG_TAG, "%d left.", reconnectTries);
         if (reconnectTries < 1) {
@@ -241,9 +290,15 @@ bool SpinBLEClient::connectToServer() {
     pClient->setConnectionParams(6, 6, 0, 200);
     /** Set how long we are willing to wait for the connection to complete (seconds), default is 30. */
     pClient->setConnectTimeout(5);  // 5
+    /** A remembered peer starts on the parameters it took last time, and isn't waited on as long. */
+    if (peer) {
+      pClient->setConnectionParams(peer->interval, peer->interval, peer->latency, peer->timeout);
+      pClient->setConnectTimeout(BLE_DIRECT_CONNECT_TIMEOUT);
+    }
 
-    if (!pClient->connect(myDevice->getAddress())) {
+    if (!pClient->connect(peerAddress)) {
       SS2K_LOG(BLE_CLIENT_LOG_TAG, " - Failed to connect client");
+      this->peerCache.failed(directAddress);
       /** Created a client but failed to connect, don't need to keep it as it has no data */
       spinBLEClient.myBLEDevices[device_number].reset();
       pClient->deleteServices();
@@ -254,13 +309,14 @@ bool SpinBLEClient::connectToServer() {
   }
 
   if (!pClient->isConnected()) {
-    if (!pClient->connect(myDevice)) {
+    if (!pClient->connect(peerAddress)) {
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Failed to connect");
+      this->peerCache.failed(directAddress);
       return false;
     }
   }
 
-  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Connected to: %s - %s RSSI %d", this->adevName2UniqueName(myDevice).c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
+  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Connected to: %s - %s RSSI %d", peerName.c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
 
   if (serviceUUID == HID_SERVICE_UUID) {
     connectBLE_HID(pClient);
@@ -268,9 +324,10 @@ bool SpinBLEClient::connectToServer() {
     SS2K_LOG(BLE_CLIENT_LOG_TAG, "Successful remote subscription.");
     spinBLEClient.myBLEDevices[device_number].doConnect = false;
     this->reconnectTries                                = MAX_RECONNECT_TRIES;
-    spinBLEClient.myBLEDevices[device_number].set(myDevice, pClient->getConnId(), serviceUUID, charUUID);
-    spinBLEClient.myBLEDevices[device_number].peerAddress = pClient->getPeerAddress();
+    spinBLEClient.myBLEDevices[device_number].set(pClient->getPeerAddress(), pClient->getConnId(), serviceUUID, charUUID);
+    spinBLEClient.myBLEDevices[device_number].advertisedDevice = myDevice;
     removeDuplicates(pClient);
+    this->rememberPeer(pClient, service, nullptr, nullptr, peerName);
     return true;
   }
 
@@ -296,6 +353,7 @@ bool SpinBLEClient::connectToServer() {
         if (!pChr->subscribe(true, onNotify)) {
           /** Disconnect if subscribe failed */
           SS2K_LOG(BLE_CLIENT_LOG_TAG, "Notifications Failed for %s", pClient->getPeerAddress().toString().c_str());
+          this->peerCache.failed(directAddress);  // Its kept attributes may be out of date. The next try discovers them again.
           spinBLEClient.myBLEDevices[device_number].reset();
           pClient->deleteServices();
           NimBLEDevice::getScan()->erase(pClient->getPeerAddress());
@@ -307,6 +365,7 @@ bool SpinBLEClient::connectToServer() {
         /** Send false as first argument to subscribe to indications instead of notifications */
         if (!pChr->subscribe(false, onNotify)) {
           SS2K_LOG(BLE_CLIENT_LOG_TAG, "Indications Failed for %s", pClient->getPeerAddress().toString().c_str());
+          this->peerCache.failed(directAddress);
           /** Disconnect if subscribe failed */
           spinBLEClient.myBLEDevices[device_number].reset();
           pClient->deleteServices();
@@ -320,9 +379,13 @@ bool SpinBLEClient::connectToServer() {
       SS2K_LOG(BLE_CLIENT_LOG_TAG, "Successful %s subscription.", pChr->getUUID().toString().c_str());
       spinBLEClient.myBLEDevices[device_number].doConnect = false;
       this->reconnectTries                                = MAX_RECONNECT_TRIES;
-      spinBLEClient.myBLEDevices[device_number].set(myDevice, pClient->getConnId(), serviceUUID, charUUID);
-      spinBLEClient.myBLEDevices[device_number].peerAddress = pClient->getPeerAddress();
+      spinBLEClient.myBLEDevices[device_number].set(pClient->getPeerAddress(), pClient->getConnId(), serviceUUID, charUUID);
+      spinBLEClient.myBLEDevices[device_number].advertisedDevice = myDevice;
       removeDuplicates(pClient);
+      if (peer && (peer->valueHandle != pChr->getHandle())) {
+        SS2K_LOG(BLE_CLIENT_LOG_TAG, "%s moved its data from handle %d to %d", peerName.c_str(), peer->valueHandle, pChr->getHandle());
+      }
+      this->rememberPeer(pClient, service, pSvc, pChr, peerName);
     }
 
   } else {
@@ -348,9 +411,8 @@ void MyClientCallback::onDisconnect(NimBLEClient *pClient) {
       if (addr == spinBLEClient.myBLEDevices[i].peerAddress) {
         SS2K_LOG(BLE_CLIENT_LOG_TAG, "Detected %s Disconnect", spinBLEClient.myBLEDevices[i].serviceUUID.toString().c_str());
         // did another task disconnect this device?
-        if (!spinBLEClient.intentionalDisconnect) {
-          spinBLEClient.myBLEDevices[i].doConnect = true;
-        } else {
+        bool reconnect = !spinBLEClient.intentionalDisconnect;
+        if (!reconnect) {
           spinBLEClient.intentionalDisconnect--;
         }
         if ((spinBLEClient.myBLEDevices[i].charUUID == CYCLINGPOWERMEASUREMENT_UUID) || (spinBLEClient.myBLEDevices[i].charUUID == FITNESSMACHINEINDOORBIKEDATA_UUID) ||
@@ -367,6 +429,8 @@ void MyClientCallback::onDisconnect(NimBLEClient *pClient) {
           SS2K_LOG(BLE_CLIENT_LOG_TAG, "Deregistered Remote on Disconnect");
         }
         spinBLEClient.myBLEDevices[i].reset();
+        // The slot keeps the peer's address, so connectToServer() can go straight back to it if it's remembered.
+        spinBLEClient.myBLEDevices[i].doConnect = reconnect;
       }
     }
     return;
@@ -387,11 +451,43 @@ bool MyClientCallback::onConfirmPIN(uint32_t pass_key) {
 void MyClientCallback::onAuthenticationComplete(ble_gap_conn_desc desc) { SS2K_LOG(BLE_CLIENT_LOG_TAG, "Starting BLE work!"); }
 /*******************************************************************/
 
+// Called for every advertisement the continuous scan hears, so it only updates the device cache. Matching against the
+// saved devices happens once per device per requested scan, as it did when each scan reported a device once.
+void MyAdvertisedDeviceCallback::onResult(BLEAdvertisedDevice *advertisedDevice) {
+  // Same order as the DeviceCache::Service bits
+  static const NimBLEUUID serviceUUIDs[DeviceCache::SERVICES] = {FLYWHEEL_UART_SERVICE_UUID, FITNESSMACHINESERVICE_UUID, CYCLINGPOWERSERVICE_UUID,
+                                                                 ECHELON_DEVICE_UUID,        HEARTSERVICE_UUID,          HID_SERVICE_UUID};
+  uint8_t services = 0;
+  if (advertisedDevice->haveServiceUUID()) {
+    for (size_t i = 0; i < DeviceCache::SERVICES; i++) {
+      if (advertisedDevice->isAdvertisingService(serviceUUIDs[i])) {
+        services |= 1 << i;
+      }
+    }
+  }
+  if (services == 0) {
+    return;  // Nothing we could connect to
+  }
+
+  bool firstInRound;
+  xSemaphoreTake(spinBLEClient.deviceCacheMutex, portMAX_DELAY);
+  DeviceCache::Device *device =
+      spinBLEClient.deviceCache.update(millis(), (uint64_t)advertisedDevice->getAddress(), advertisedDevice->getRSSI(), services, firstInRound);
+  if ((device->name[0] == '\0') && advertisedDevice->haveName()) {
+    std::string name = advertisedDevice->getName();
+    spinBLEClient.deviceCache.setName(device, name.c_str(), name.length());
+  }
+  xSemaphoreGive(spinBLEClient.deviceCacheMutex);
+
+  if (firstInRound && spinBLEClient.scanWindowOpen) {
+    this->matchDevice(advertisedDevice);
+  }
+}
+
 /**
  * Scan for BLE servers and find the first one that advertises the service we are looking for.
  */
-
-void MyAdvertisedDeviceCallback::onResult(BLEAdvertisedDevice *advertisedDevice) {
+void MyAdvertisedDeviceCallback::matchDevice(BLEAdvertisedDevice *advertisedDevice) {
   // Define granular constants for maximal reuse during logging
   const char *const MATCHED               = "Matched ";
   const char *const DIDNT_MATCH_THE_SAVED = " didn't match the saved: ";
@@ -454,7 +550,7 @@ void MyAdvertisedDeviceCallback::onResult(BLEAdvertisedDevice *advertisedDevice)
     }
 
     for (size_t i = 0; i < NUM_BLE_DEVICES; i++) {
-      if ((spinBLEClient.myBLEDevices[i].advertisedDevice == nullptr) || (advertisedDevice->getAddress() == spinBLEClient.myBLEDevices[i].peerAddress)) {
+      if (!spinBLEClient.myBLEDevices[i].isAssigned() || (advertisedDevice->getAddress() == spinBLEClient.myBLEDevices[i].peerAddress)) {
         spinBLEClient.myBLEDevices[i].set(advertisedDevice, BLE_HS_CONN_HANDLE_NONE, advertisedDevice->getServiceUUID());
         spinBLEClient.myBLEDevices[i].doConnect = true;
         SS2K_LOG(BLE_CLIENT_LOG_TAG, "doConnect set on device: %d", i);
@@ -465,72 +561,81 @@ void MyAdvertisedDeviceCallback::onResult(BLEAdvertisedDevice *advertisedDevice)
   }
 }
 
+// Opens a scan window and returns straight away. The background scan goes to full duty, each device heard in the window
+// is matched against the saved devices, and maintainScan() publishes what was found when the window closes.
 void SpinBLEClient::scanProcess(int duration) {
   this->doScan = false;  // Confirming we did the scan
 
   SS2K_LOG(BLE_CLIENT_LOG_TAG, "Scanning for BLE servers and putting them into a list...");
 
+  xSemaphoreTake(deviceCacheMutex, portMAX_DELAY);
+  this->deviceCache.newRound();
+  xSemaphoreGive(deviceCacheMutex);
+  this->scanWindowEnd  = millis() + duration * 1000;
+  this->scanWindowOpen = true;
+  this->startScan(true);
+  this->dontBlockScan = false;
+}
+
+void SpinBLEClient::startScan(bool requested) {
   BLEScan *pBLEScan = BLEDevice::getScan();
-  pBLEScan->stop();
-  vTaskDelay(50 / portTICK_PERIOD_MS);
-  pBLEScan->clearDuplicateCache();
-  pBLEScan->clearResults();
-  pBLEScan->setAdvertisedDeviceCallbacks(&myAdvertisedDeviceCallbacks);
-  pBLEScan->setInterval(49);  // 97
-  pBLEScan->setWindow(33);    // 67
-  pBLEScan->setDuplicateFilter(true);
-  pBLEScan->setActiveScan(true);  // might cause memory leak if true - undetermined. We don't get device names without it.
-  BLEScanResults foundDevices = pBLEScan->start(duration, false);
-  this->dontBlockScan         = false;
-
-  int count = foundDevices.getCount();
-
-  StaticJsonDocument<1000> devices;
-
-  // Check if 'devices' JSON document already exists and has content; if so, deserialize it.
-  const char *foundDevicesJson = userConfig->getFoundDevices();
-  if (foundDevicesJson[0] != '\0') {
-    deserializeJson(devices, userConfig->getFoundDevices());
-  }
-
-  for (int i = 0; i < count; i++) {
-    BLEAdvertisedDevice d = foundDevices.getDevice(i);
-
-    // Check for duplicates by name or address before adding
-    bool isDuplicate = false;
-    for (JsonPair kv : devices.as<JsonObject>()) {
-      JsonObject obj = kv.value().as<JsonObject>();
-      if (obj.containsKey("name") && obj["name"] == this->adevName2UniqueName(&d)) {
-        isDuplicate = true;
-        break;
-      }
-    }
+  if (pBLEScan->isScanning()) {
+    pBLEScan->stop();
+  }
+  pBLEScan->setAdvertisedDeviceCallbacks(&myAdvertisedDeviceCallbacks, true);  // Every advertisement, to keep RSSI and last seen current
+  pBLEScan->setInterval(requested ? BLE_ACTIVE_SCAN_INTERVAL : BLE_BACKGROUND_SCAN_INTERVAL);
+  pBLEScan->setWindow(requested ? BLE_ACTIVE_SCAN_WINDOW : BLE_BACKGROUND_SCAN_WINDOW);
+  pBLEScan->setDuplicateFilter(false);
+  pBLEScan->setActiveScan(true);  // We don't get device names without it.
+  // Continue, so a restart doesn't free the advertised devices a slot is waiting to connect to
+  pBLEScan->start(0, nullptr, true);
+}
 
-    // is this device advertising something we're interested in?
-    if (!isDuplicate && (d.isAdvertisingService(CYCLINGPOWERSERVICE_UUID) || d.isAdvertisingService(HEARTSERVICE_UUID) || d.isAdvertisingService(FLYWHEEL_UART_SERVICE_UUID) ||
-                         d.isAdvertisingService(FITNESSMACHINESERVICE_UUID) || d.isAdvertisingService(ECHELON_DEVICE_UUID) || d.isAdvertisingService(HID_SERVICE_UUID))) {
-      String device = "device " + String(devices.size());  // Use the current size to index the new device
+void SpinBLEClient::maintainScan() {
+  BLEScan *pBLEScan = BLEDevice::getScan();
+  if (ss2k->isUpdating) {
+    if (pBLEScan->isScanning()) {
+      pBLEScan->stop();
+    }
+    return;
+  }
 
-      devices[device]["name"] = this->adevName2UniqueName(&d);
+  if (this->scanWindowOpen && ((long)(millis() - this->scanWindowEnd) >= 0)) {
+    this->scanWindowOpen = false;
+    this->publishFoundDevices();
+    this->startScan(false);
+  }
 
-      // Workaround for IC4 not advertising FTMS as the first service.
-      // Potentially others may need to be added in the future.
-      // The symptom was the bike name not showing up in the HTML.
-      if (d.haveServiceUUID() && d.isAdvertisingService(FITNESSMACHINESERVICE_UUID)) {
-        devices[device]["UUID"] = FITNESSMACHINESERVICE_UUID.toString();
-      } else {
-        devices[device]["UUID"] = d.getServiceUUID().toString();
-      }
+  // NimBLE keeps every device it hears. Start it over once nothing points into its list.
+  if (pBLEScan->getResults().getCount() > BLE_SCAN_MAX_RESULTS) {
+    bool connecting = false;
+    for (size_t i = 0; i < NUM_BLE_DEVICES; i++) {
+      connecting |= this->myBLEDevices[i].doConnect;
     }
+    if (!connecting) {
+      pBLEScan->stop();
+      vTaskDelay(50 / portTICK_PERIOD_MS);
+      pBLEScan->clearResults();
+    }
+  }
+
+  // A connect stops the scan
+  if (!pBLEScan->isScanning()) {
+    this->startScan(this->scanWindowOpen);
   }
+}
+
+void SpinBLEClient::publishFoundDevices() {
+  static char foundDevices[BLE_FOUND_DEVICES_SIZE];
+  xSemaphoreTake(deviceCacheMutex, portMAX_DELAY);
+  this->deviceCache.toJSON(millis(), foundDevices, sizeof(foundDevices));
+  xSemaphoreGive(deviceCacheMutex);
 
-  String output;
-  serializeJson(devices, output);
-  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Bluetooth Client Found Devices: %s", output.c_str());
+  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Bluetooth Client Found Devices: %s", foundDevices);
 #ifdef USE_TELEGRAM
-  SEND_TO_TELEGRAM("Bluetooth Client Found Devices: " + output);
+  SEND_TO_TELEGRAM("Bluetooth Client Found Devices: " + String(foundDevices));
 #endif
-  userConfig->setFoundDevices(output);  // Save the updated JSON document
+  userConfig->setFoundDevices(foundDevices);
 }
 
 // remove the last connected BLE Power Meter
@@ -547,7 +652,7 @@ void SpinBLEClient::removeDuplicates(NimBLEClient *pClient) {
 
   for (size_t i = 0; i < NUM_BLE_DEVICES; i++) {  // Disconnect oldest PM to avoid two connected.
     oldBLEd = this->myBLEDevices[i];
-    if (oldBLEd.advertisedDevice) {
+    if (oldBLEd.isAssigned()) {
       if ((tBLEd.serviceUUID == oldBLEd.serviceUUID) && (tBLEd.peerAddress != oldBLEd.peerAddress)) {
         if (BLEDevice::getClientByPeerAddress(oldBLEd.peerAddress)) {
           if (BLEDevice::getClientByPeerAddress(oldBLEd.peerAddress)->isConnected()) {
@@ -574,6 +679,9 @@ void SpinBLEClient::resetDevices(NimBLEClient *pClient) {
 
 // Control a connected FTMS trainer. If no args are passed, treat it like an external stepper motor.
 void SpinBLEClient::FTMSControlPointWrite(const uint8_t *pData, int length) {
+  if (sessionRecorder.isReplaying()) {
+    return;  // Replayed control points are for this device, not a trainer that happens to be connected
+  }
   if (userConfig->getFTMSControlPointWrite()) {
     NimBLEClient *pClient = nullptr;
     uint8_t modData[7];
@@ -787,21 +895,70 @@ void SpinBLEClient::keepAliveBLE_HID(NimBLEClient *pClient) {
   }
 }
 
+// A missing device we have connected to before is connected to directly, which only needs it to be advertising. The scan is
+// for devices we don't know yet, or ones that didn't take a direct connect.
 void SpinBLEClient::checkBLEReconnect() {
   if ((String(userConfig->getConnectedHeartMonitor()) != "none") && !(spinBLEClient.connectedHRM)) {
-    this->doScan = true;
+    this->doScan |= !this->reconnectRemembered(DeviceCache::HeartRate, userConfig->getConnectedHeartMonitor());
     SS2K_LOG(BLE_CLIENT_LOG_TAG, "No HRM Connected");
   }
   if ((String(userConfig->getConnectedPowerMeter()) != "none") && !(spinBLEClient.connectedPM)) {
-    this->doScan = true;
+    this->doScan |= !this->reconnectRemembered(DeviceCache::Flywheel | DeviceCache::FitnessMachine | DeviceCache::CyclingPower | DeviceCache::Echelon,
+                                               userConfig->getConnectedPowerMeter());
     SS2K_LOG(BLE_CLIENT_LOG_TAG, "No PM Connected");
   }
   if ((String(userConfig->getConnectedRemote()) != "none") && !(spinBLEClient.connectedRemote)) {
-    this->doScan = true;
+    this->doScan |= !this->reconnectRemembered(DeviceCache::Hid, userConfig->getConnectedRemote());
     SS2K_LOG(BLE_CLIENT_LOG_TAG, "No Rem Connected");
   }
 }
 
+// Puts the remembered peer for a saved device on a free slot for connectToServer().
+bool SpinBLEClient::reconnectRemembered(uint8_t services, const char *name) {
+  const PeerCache::Peer *peer = this->peerCache.find(services, name);
+  if ((peer == nullptr) || !PeerCache::canConnectDirect(*peer)) {
+    return false;
+  }
+  NimBLEAddress address(peer->address, peer->addressType);
+  for (size_t i = 0; i < NUM_BLE_DEVICES; i++) {
+    if (this->myBLEDevices[i].isAssigned() && (this->myBLEDevices[i].peerAddress == address)) {
+      return true;  // Already on it
+    }
+  }
+  for (size_t i = 0; i < NUM_BLE_DEVICES; i++) {
+    if (!this->myBLEDevices[i].isAssigned()) {
+      SS2K_LOG(BLE_CLIENT_LOG_TAG, "Reconnecting %s on slot %d", peer->name, i);
+      this->myBLEDevices[i].peerAddress = address;
+      this->myBLEDevices[i].doConnect   = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void SpinBLEClient::rememberPeer(NimBLEClient *pClient, uint8_t service, NimBLERemoteService *pSvc, NimBLERemoteCharacteristic *pChr, const String &name) {
+  NimBLEConnInfo connInfo = pClient->getConnInfo();
+  PeerCache::Peer peer    = PeerCache::Peer();
+  peer.address            = (uint64_t)pClient->getPeerAddress();
+  peer.addressType        = pClient->getPeerAddress().getType();
+  peer.service            = service;
+  peer.serviceStart       = pSvc ? pSvc->getHandle() : 0;
+  peer.serviceEnd         = pSvc ? pSvc->getEndHandle() : 0;
+  peer.valueHandle        = pChr ? pChr->getHandle() : 0;
+  peer.interval           = connInfo.getConnInterval();
+  peer.latency            = connInfo.getConnLatency();
+  peer.timeout            = connInfo.getConnTimeout();
+  strncpy(peer.name, name.c_str(), PeerCache::NAME_SIZE - 1);
+  if (!this->peerCache.remember(peer)) {
+    return;  // Saved as it is
+  }
+  uint8_t saved[PeerCache::SERIALIZED_SIZE];
+  size_t length = this->peerCache.serialize(saved, sizeof(saved));
+  if (!ss2k->fileSystem->write(PEER_CACHE_FILENAME, saved, length)) {
+    SS2K_LOG(BLE_CLIENT_LOG_TAG, "Couldn't save %s", PEER_CACHE_FILENAME);
+  }
+}
+
 void SpinBLEClient::reconnectAllDevices() {
   for (auto i : spinBLEClient.myBLEDevices) {
     if (NimBLEDevice::getClientByPeerAddress(i.peerAddress)) {
@@ -855,9 +1012,13 @@ String SpinBLEClient::adevName2UniqueName(NimBLEAdvertisedDevice *inDev) {
 }
 
 void SpinBLEAdvertisedDevice::set(BLEAdvertisedDevice *device, int id, BLEUUID inServiceUUID, BLEUUID inCharUUID) {
-  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Setting Device %s", device->getAddress().toString().c_str());
-  this->advertisedDevice  = device;
-  this->peerAddress       = device->getAddress();
+  this->set(device->getAddress(), id, inServiceUUID, inCharUUID);
+  this->advertisedDevice = device;
+}
+
+void SpinBLEAdvertisedDevice::set(NimBLEAddress address, int id, BLEUUID inServiceUUID, BLEUUID inCharUUID) {
+  SS2K_LOG(BLE_CLIENT_LOG_TAG, "Setting Device %s", address.toString().c_str());
+  this->peerAddress       = address;
   this->connectedClientID = id;
   this->serviceUUID       = BLEUUID(inServiceUUID);
   this->charUUID          = BLEUUID(inCharUUID);
@@ -28,7 +28,7 @@ void BLECommunications() {
                   _BLEd.peerAddress.toString().c_str(), _BLEd.connectedClientID, _BLEd.serviceUUID.toString().c_str(), _BLEd.charUUID.toString().c_str(),
                   _BLEd.isHRM ? "true" : "false", _BLEd.isPM ? "true" : "false", _BLEd.isCSC ? "true" : "false", _BLEd.isCT ? "true" : "false", _BLEd.doConnect ? "true" : "false",
                   _BLEd.getPostConnected() ? "true" : "false");
-        if (_BLEd.advertisedDevice) {                                                                // is device registered?
+        if (_BLEd.isAssigned()) {                                                                    // is device registered?
           if ((_BLEd.connectedClientID != BLE_HS_CONN_HANDLE_NONE) && (_BLEd.doConnect == false)) {  // client must not be in connection process
             if (BLEDevice::getClientByPeerAddress(_BLEd.peerAddress)) {                              // nullptr check
               BLEClient *pClient = NimBLEDevice::getClientByPeerAddress(_BLEd.peerAddress);
@@ -72,7 +72,8 @@ void BLECommunications() {
     }
 
     // ***********************************SERVER**************************************
-    if ((spinBLEClient.connectedHRM || rtConfig->hr.getSimulate()) && !spinBLEClient.connectedPM && !rtConfig->watts.getSimulate() && (rtConfig->hr.getValue() > 0) &&
+    uint8_t fresh = getFreshSensorFields();
+    if ((spinBLEClient.connectedHRM || rtConfig->hr.getSimulate()) && !(fresh & SensorSample::POWER) && !rtConfig->watts.getSimulate() && (rtConfig->hr.getValue() > 0) &&
         userPWC->hr2Pwr) {
       calculateInstPwrFromHR();
       hr2p = true;
@@ -83,12 +84,14 @@ void BLECommunications() {
     calculateInstPwrFromHR();
 #endif  // DEBUG_HR_TO_PWR
 
-    // Set outputs to zero if we're not simulating or have connected devices.
-    if (!spinBLEClient.connectedPM && !hr2p && !rtConfig->watts.getSimulate() && !rtConfig->cad.getSimulate()) {
-      rtConfig->cad.setValue(0);
+    // Zero whatever no sensor has reported for SensorFusion::STALE_MS, unless it's simulated or estimated from HR.
+    if (!(fresh & SensorSample::POWER) && !hr2p && !rtConfig->watts.getSimulate()) {
       rtConfig->watts.setValue(0);
     }
-    if (!spinBLEClient.connectedHRM && !rtConfig->hr.getSimulate()) {
+    if (!(fresh & SensorSample::CADENCE) && !rtConfig->cad.getSimulate()) {
+      rtConfig->cad.setValue(0);
+    }
+    if (!(fresh & SensorSample::HEART_RATE) && !rtConfig->hr.getSimulate()) {
       rtConfig->hr.setValue(0);
     }
 
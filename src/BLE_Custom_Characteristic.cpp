@@ -81,12 +81,260 @@ This characteristic allows for reading and writing various user configuration pa
      - ASCII for "MyDevice": 0x4D, 0x79, 0x44, 0x65, 0x76, 0x69, 0x63, 0x65
      - Response: 0x80, 0x07, 0x4D, 0x79, 0x44, 0x65, 0x76, 0x69, 0x63, 0x65
 
-*/
+**Bulk Operations:**
+Many variables can be moved in a single ATT write / indication. Payloads are sized to the MTU
+negotiated in onSubscribe() (up to 512 bytes of value).
+
+- Bulk read format:
+  0x03, <variable>, <variable>, ...
+  - An empty list requests every readable variable.
+  - Server response: 0x83, then <variable>, <length>, <value bytes> for each variable.
+  - Variables that don't fit in one indication are left off. Request them again.
+
+- Bulk write format:
+  0x04, <variable>, <length>, <value bytes>, <variable>, <length>, <value bytes>, ...
+  - Values are encoded exactly as in a single write. Actions (reboot, scanBLE...) use length 0.
+  - Server response: 0x84, then <variable>, <0x80 or 0xff> for each variable written.
+
+- Example:
+  Read shiftStep (0x08) and simulateHr (0x0D) at once:
+  - Write command: 0x03, 0x08, 0x0D
+  - Server response for 1200 steps and simulateHr off: 0x83, 0x08, 0x02, 0xB0, 0x04, 0x0D, 0x01, 0x00
 
+*/
 #include <BLE_Common.h>
 #include <ERG_Mode.h>
+#include <WorkoutRunner.h>
 #include <BLE_Custom_Characteristic.h>
 #include <Constants.h>
+#include <PowerTableCodec.h>
+
+// Every variable that is a plain value lives in this table. Anything with special framing (power table) is handled in process().
+static const ccDescriptor ccDescriptors[] = {
+    {BLE_firmwareUpdateURL, cc_type_string, 1, true, "Firmware Update URL", nullptr, nullptr, []() { return userConfig->getFirmwareUpdateURL(); },
+     [](const String &v) { userConfig->setFirmwareUpdateURL(v); }},
+    {BLE_incline, cc_type_i16, 10, false, "incline", []() -> double { return rtConfig->getTargetIncline(); }, [](double v) { rtConfig->setTargetIncline(v); }, nullptr, nullptr},
+    {BLE_simulatedWatts, cc_type_u16, 1, false, "simulatedWatts", []() -> double { return rtConfig->watts.getValue(); }, [](double v) { rtConfig->watts.setValue(v); }, nullptr,
+     nullptr},
+    {BLE_simulatedHr, cc_type_u16, 1, false, "simulatedHr", []() -> double { return rtConfig->hr.getValue(); }, [](double v) { rtConfig->hr.setValue(v); }, nullptr, nullptr},
+    {BLE_simulatedCad, cc_type_u16, 1, false, "simulatedCad", []() -> double { return rtConfig->cad.getValue(); }, [](double v) { rtConfig->cad.setValue(v); }, nullptr, nullptr},
+    {BLE_simulatedSpeed, cc_type_u16, 10, false, "simulatedSpeed", []() -> double { return rtConfig->getSimulatedSpeed(); }, [](double v) { rtConfig->setSimulatedSpeed(v); },
+     nullptr, nullptr},
+    {BLE_deviceName, cc_type_string, 1, true, "deviceName", nullptr, nullptr, []() { return userConfig->getDeviceName(); }, [](const String &v) { userConfig->setDeviceName(v); }},
+    {BLE_shiftStep, cc_type_u16, 1, true, "shiftStep", []() -> double { return userConfig->getShiftStep(); }, [](double v) { userConfig->setShiftStep(v); }, nullptr, nullptr},
+    {BLE_stepperPower, cc_type_u16, 1, true, "stepperPower", []() -> double { return userConfig->getStepperPower(); },
+     [](double v) {
+       userConfig->setStepperPower(v);
+       ss2k->updateStepperPower();
+     },
+     nullptr, nullptr},
+    {BLE_stealthChop, cc_type_bool, 1, true, "stealthChop", []() -> double { return userConfig->getStealthChop(); },
+     [](double v) {
+       userConfig->setStealthChop(v);
+       ss2k->updateStealthChop();
+     },
+     nullptr, nullptr},
+    {BLE_inclineMultiplier, cc_type_u16, 10, true, "inclineMultiplier", []() -> double { return userConfig->getInclineMultiplier(); },
+     [](double v) { userConfig->setInclineMultiplier(v); }, nullptr, nullptr},
+    {BLE_powerCorrectionFactor, cc_type_u16, 10, true, "powerCorrectionFactor", []() -> double { return userConfig->getPowerCorrectionFactor(); },
+     [](double v) { userConfig->setPowerCorrectionFactor(v); }, nullptr, nullptr},
+    {BLE_simulateHr, cc_type_bool, 1, false, "simulateHr", []() -> double { return rtConfig->hr.getSimulate(); }, [](double v) { rtConfig->hr.setSimulate(v); }, nullptr, nullptr},
+    {BLE_simulateWatts, cc_type_bool, 1, false, "simulateWatts", []() -> double { return rtConfig->watts.getSimulate(); }, [](double v) { rtConfig->watts.setSimulate(v); }, nullptr,
+     nullptr},
+    {BLE_simulateCad, cc_type_bool, 1, false, "simulateCad", []() -> double { return rtConfig->cad.getSimulate(); }, [](double v) { rtConfig->cad.setSimulate(v); }, nullptr, nullptr},
+    {BLE_FTMSMode, cc_type_u16, 1, false, "FTMSMode", []() -> double { return rtConfig->getFTMSMode(); }, [](double v) { rtConfig->setFTMSMode(v); }, nullptr, nullptr},
+    {BLE_autoUpdate, cc_type_bool, 1, true, "autoUpdate", []() -> double { return userConfig->getAutoUpdate(); }, [](double v) { userConfig->setAutoUpdate(v); }, nullptr, nullptr},
+    {BLE_ssid, cc_type_string, 1, true, "ssid", nullptr, nullptr, []() { return userConfig->getSsid(); }, [](const String &v) { userConfig->setSsid(v); }},
+    {BLE_password, cc_type_string, 1, true, "password", nullptr, nullptr, []() { return userConfig->getPassword(); }, [](const String &v) { userConfig->setPassword(v); }},
+    {BLE_foundDevices, cc_type_string, 1, true, "foundDevices", nullptr, nullptr, []() { return userConfig->getFoundDevices(); },
+     [](const String &v) { userConfig->setFoundDevices(v); }},
+    {BLE_connectedPowerMeter, cc_type_string, 1, true, "connectedPowerMeter", nullptr, nullptr, []() { return userConfig->getConnectedPowerMeter(); },
+     [](const String &v) { userConfig->setConnectedPowerMeter(v); }},
+    {BLE_connectedHeartMonitor, cc_type_string, 1, true, "connectedHeartMonitor", nullptr, nullptr, []() { return userConfig->getConnectedHeartMonitor(); },
+     [](const String &v) { userConfig->setConnectedHeartMonitor(v); }},
+    {BLE_shifterPosition, cc_type_i16, 1, false, "shifterPosition", []() -> double { return rtConfig->getShifterPosition(); }, [](double v) { rtConfig->setShifterPosition(v); },
+     nullptr, nullptr},
+    {BLE_saveToLittleFS, cc_type_action, 1, false, "saveToLittleFS", nullptr, [](double) { ss2k->saveFlag = true; }, nullptr, nullptr},
+    {BLE_targetPosition, cc_type_i32, 1, false, "targetPosition", []() -> double { return ss2k->targetPosition; }, [](double v) { ss2k->targetPosition = v; }, nullptr, nullptr},
+    {BLE_externalControl, cc_type_bool, 1, false, "externalControl", []() -> double { return ss2k->externalControl; }, [](double v) { ss2k->externalControl = v; }, nullptr,
+     nullptr},
+    {BLE_syncMode, cc_type_bool, 1, false, "syncMode", []() -> double { return ss2k->syncMode; }, [](double v) { ss2k->syncMode = v; }, nullptr, nullptr},
+    {BLE_reboot, cc_type_action, 1, false, "reboot", nullptr, [](double) { ss2k->rebootFlag = true; }, nullptr, nullptr},
+    {BLE_resetToDefaults, cc_type_action, 1, false, "reset to defaults", nullptr, [](double) { ss2k->resetDefaultsFlag = true; }, nullptr, nullptr},
+    {BLE_stepperSpeed, cc_type_u16, 1, true, "stepperSpeed", []() -> double { return userConfig->getStepperSpeed(); },
+     [](double v) {
+       userConfig->setStepperSpeed(v);
+       ss2k->updateStepperSpeed();
+     },
+     nullptr, nullptr},
+    {BLE_ERGSensitivity, cc_type_u16, 10, true, "ERGSensitivity", []() -> double { return userConfig->getERGSensitivity(); }, [](double v) { userConfig->setERGSensitivity(v); },
+     nullptr, nullptr},
+    {BLE_shiftDir, cc_type_bool, 1, true, "ShiftDir", []() -> double { return userConfig->getShifterDir(); }, [](double v) { userConfig->setShifterDir(v); }, nullptr, nullptr},
+    {BLE_minBrakeWatts, cc_type_u16, 1, true, "MinWatts", []() -> double { return userConfig->getMinWatts(); }, [](double v) { userConfig->setMinWatts(v); }, nullptr, nullptr},
+    {BLE_maxBrakeWatts, cc_type_u16, 1, true, "MaxWatts", []() -> double { return userConfig->getMaxWatts(); }, [](double v) { userConfig->setMaxWatts(v); }, nullptr, nullptr},
+    {BLE_riderWeight, cc_type_u16, 1, true, "RiderWeight", []() -> double { return userConfig->getRiderWeight(); }, [](double v) { userConfig->setRiderWeight(v); }, nullptr,
+     nullptr},
+    {BLE_ftp, cc_type_u16, 1, true, "FTP", []() -> double { return userConfig->getFtp(); }, [](double v) { userConfig->setFtp(v); }, nullptr, nullptr},
+    {BLE_restartBLE, cc_type_action, 1, false, "restart BLE", nullptr, [](double) { spinBLEClient.reconnectAllDevices(); }, nullptr, nullptr},
+    {BLE_scanBLE, cc_type_action, 1, false, "scan BLE", nullptr, [](double) { spinBLEClient.doScan = true; }, nullptr, nullptr},
+    {BLE_firmwareVer, cc_type_string, 1, false, "Firmware Version", nullptr, nullptr, []() { return (const char *)FIRMWARE_VERSION; }, nullptr},
+    {BLE_resetPowerTable, cc_type_action, 1, false, "Reset PTab", nullptr, [](double) { ss2k->resetPowerTableFlag = true; }, nullptr, nullptr},
+};
+
+static const size_t ccDescriptorCount = sizeof(ccDescriptors) / sizeof(ccDescriptors[0]);
+
+// Snapshot of the power table used for BLE_powerTableDelta. Each cell is stamped with the table version it last changed in.
+// The snapshot is only refreshed between transfers so every chunk of a transfer comes from the same table.
+static const size_t ptCells       = POWERTABLE_CAD_SIZE * POWERTABLE_WATT_SIZE;
+static const size_t ptHeaderSize  = 11;  // cc_success, id, epoch(2), since(2), version(2), start cell(2), flags
+static const uint8_t ptLastChunk  = 0x01;
+static const uint8_t ptPushedData = 0x02;
+static int16_t ptPositions[ptCells];
+static uint16_t ptVersions[ptCells];
+static uint16_t ptVersion = 0;
+static uint16_t ptEpoch   = 0;  // Changes on boot or version wrap. Clients holding another epoch get the full table.
+
+static struct {
+  bool active;
+  bool push;
+  uint16_t since;
+  size_t cursor;
+} ptTransfer = {false, false, 0, 0};
+
+// Written from the BLE host task, picked up in parseNemit() on the main task. -1 when nothing is pending.
+static volatile int32_t ptRequestedSince = -1;
+
+static void ptStampChanges() {
+  bool restamp = (ptVersion == 0) || (ptVersion == UINT16_MAX);
+  if (restamp) {
+    ptEpoch   = (uint16_t)esp_random();
+    ptVersion = 1;
+  }
+  bool changed = false;
+  for (size_t i = 0; i < ptCells; i++) {
+    int16_t position = powerTable->tableRow[i / POWERTABLE_WATT_SIZE].tableEntry[i % POWERTABLE_WATT_SIZE].targetPosition;
+    if (restamp) {
+      ptPositions[i] = position;
+      ptVersions[i]  = ptVersion;
+    } else if (position != ptPositions[i]) {
+      if (!changed) {
+        ptVersion++;
+        changed = true;
+      }
+      ptPositions[i] = position;
+      ptVersions[i]  = ptVersion;
+    }
+  }
+}
+
+// Number of value bytes on the wire for fixed width types. 0 for strings and actions.
+static size_t ccTypeWidth(uint8_t type) {
+  switch (type) {
+    case cc_type_bool:
+      return 1;
+    case cc_type_u16:
+    case cc_type_i16:
+      return 2;
+    case cc_type_i32:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// Append the current wire value of a variable. Returns false if the variable can't be read.
+static bool ccEncodeValue(const ccDescriptor *d, std::string &out) {
+  if (d->type == cc_type_string) {
+    if (d->getString == nullptr) {
+      return false;
+    }
+    out += d->getString();
+    return true;
+  }
+  if (d->get == nullptr) {
+    return false;
+  }
+  int32_t value = lround(d->get() * d->scale);
+  for (size_t i = 0; i < ccTypeWidth(d->type); i++) {
+    out += (char)((value >> (8 * i)) & 0xff);
+  }
+  return true;
+}
+
+// Apply a wire value to a variable. Returns false if the variable is read only or the value is too short.
+static bool ccDecodeValue(const ccDescriptor *d, const uint8_t *pData, size_t length) {
+  if (d->type == cc_type_string) {
+    if (d->setString == nullptr) {
+      return false;
+    }
+    d->setString(String(std::string((const char *)pData, length).c_str()));
+    return true;
+  }
+  if (d->set == nullptr || length < ccTypeWidth(d->type)) {
+    return false;
+  }
+  int32_t value = 0;
+  switch (d->type) {
+    case cc_type_bool:
+      value = pData[0] ? 1 : 0;
+      break;
+    case cc_type_u16:
+      value = (bytes_to_int(pData[1], pData[0]));
+      break;
+    case cc_type_i16:
+      value = (int16_t)(bytes_to_int(pData[1], pData[0]));
+      break;
+    case cc_type_i32:
+      value = (int32_t)((uint32_t)pData[0] | (uint32_t)pData[1] << 8 | (uint32_t)pData[2] << 16 | (uint32_t)pData[3] << 24);
+      break;
+    default:  // cc_type_action
+      break;
+  }
+  d->set(value / (double)d->scale);
+  return true;
+}
+
+// Cheap fingerprint so parseNemit() doesn't have to keep copies of every string setting.
+static int32_t ccHashString(const char *str) {
+  uint32_t hash = 2166136261u;
+  while (*str) {
+    hash = (hash ^ (uint8_t)*str++) * 16777619u;
+  }
+  return (int32_t)hash;
+}
+
+static int32_t ccFingerprint(const ccDescriptor *d) {
+  if (d->type == cc_type_string) {
+    return ccHashString(d->getString());
+  }
+  return lround(d->get() * d->scale);
+}
+
+const ccDescriptor *BLE_ss2kCustomCharacteristic::findDescriptor(uint8_t id) {
+  for (size_t i = 0; i < ccDescriptorCount; i++) {
+    if (ccDescriptors[i].id == id) {
+      return &ccDescriptors[i];
+    }
+  }
+  return nullptr;
+}
+
+size_t BLE_ss2kCustomCharacteristic::maxPayload() {
+  // ATT notifications carry MTU - 3 bytes and attribute values are capped at 512 bytes.
+  size_t payload            = 512;
+  NimBLEServer *pServer     = NimBLEDevice::getServer();
+  std::vector<uint16_t> ids = pServer->getPeerDevices();
+  if (ids.empty()) {
+    return BLE_ATT_MTU_DFLT - 3;
+  }
+  for (uint16_t id : ids) {
+    size_t peerPayload = pServer->getPeerMTU(id) - 3;
+    if (peerPayload < payload) {
+      payload = peerPayload;
+    }
+  }
+  return payload;
+}
 
 void BLE_ss2kCustomCharacteristic::setupService(NimBLEServer *pServer) {
   pSmartSpin2kService = spinBLEServer.pServer->createService(SMARTSPIN2K_SERVICE_UUID);
@@ -121,8 +369,21 @@ void BLE_ss2kCustomCharacteristic::process(std::string rxValue) {
     return;
   }
   NimBLECharacteristic *pCharacteristic = NimBLEDevice::getServer()->getServiceByUUID(SMARTSPIN2K_SERVICE_UUID)->getCharacteristic(SMARTSPIN2K_CHARACTERISTIC_UUID);
-  uint8_t *pData                        = reinterpret_cast<uint8_t *>(&rxValue[0]);
-  int length                            = rxValue.length();
+  // A bare bulk read is a single byte, so it goes before the length check.
+  if (!rxValue.empty() && (rxValue[0] == cc_bulkRead)) {
+    processBulkRead(rxValue, pCharacteristic);
+    return;
+  }
+  if (rxValue.length() < 2) {
+    SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "Ignoring short write");
+    return;
+  }
+  if (rxValue[0] == cc_bulkWrite) {
+    processBulkWrite(rxValue, pCharacteristic);
+    return;
+  }
+  uint8_t *pData = reinterpret_cast<uint8_t *>(&rxValue[0]);
+  int length     = rxValue.length();
 
   const int kLogBufCapacity = (rxValue.length() * 2) + 60;  // needs to be bigger than the largest message.
   char logBuf[kLogBufCapacity];
@@ -136,549 +397,117 @@ void BLE_ss2kCustomCharacteristic::process(std::string rxValue) {
     returnValue[i] = rxValue[i];
   }
 
-  switch (rxValue[1]) {
-    case BLE_firmwareUpdateURL:  // 0x01
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Firmware Update URL");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getFirmwareUpdateURL();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setFirmwareUpdateURL(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getFirmwareUpdateURL());
-      }
-      break;
-
-    case BLE_incline: {  // 0x02
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-incline");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        int inc        = rtConfig->getTargetIncline() * 10;
-        returnValue[2] = (uint8_t)(inc & 0xff);
-        returnValue[3] = (uint8_t)(inc >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->setTargetIncline(bytes_to_u16(rxValue[3], rxValue[2]) / 10);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%f)", rtConfig->getTargetIncline());
-      }
-    } break;
-
-    case BLE_simulatedWatts:  // 0x03
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulatedWatts");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->watts.getValue() & 0xff);
-        returnValue[3] = (uint8_t)(rtConfig->watts.getValue() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->watts.setValue(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", rtConfig->watts.getValue());
-      }
-      break;
-
-    case BLE_simulatedHr:  // 0x04
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulatedHr");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->hr.getValue() & 0xff);
-        returnValue[3] = (uint8_t)(rtConfig->hr.getValue() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->hr.setValue(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", rtConfig->hr.getValue());
-      }
-      break;
-
-    case BLE_simulatedCad:  // 0x05
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulatedCad");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->cad.getValue() & 0xff);
-        returnValue[3] = (uint8_t)(rtConfig->cad.getValue() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->cad.setValue(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", rtConfig->cad.getValue());
-      }
-      break;
-
-    case BLE_simulatedSpeed: {  // 0x06
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulatedSpeed");
-      int spd = rtConfig->getSimulatedSpeed() * 10;
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(spd & 0xff);
-        returnValue[3] = (uint8_t)(spd >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->setSimulatedSpeed(bytes_to_u16(rxValue[3], rxValue[2]) / 10);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", rtConfig->getSimulatedSpeed());
-      }
-    } break;
-
-    case BLE_deviceName:  // 0x07
-      logBufLength = snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-deviceName");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getDeviceName();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setDeviceName(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getDeviceName());
-      }
-      break;
-
-    case BLE_shiftStep:  // 0x08
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-shiftStep");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getShiftStep() & 0xff);
-        returnValue[3] = (uint8_t)(userConfig->getShiftStep() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setShiftStep(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", userConfig->getShiftStep());
-      }
-      break;
-
-    case BLE_stepperPower:  // 0x09
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-stepperPower");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getStepperPower() & 0xff);
-        returnValue[3] = (uint8_t)(userConfig->getStepperPower() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setStepperPower(bytes_to_u16(rxValue[3], rxValue[2]));
-        ss2k->updateStepperPower();
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", userConfig->getStepperPower());
-      }
-      break;
-
-    case BLE_stealthChop:  // 0x0A
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-stealthChop");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getStealthChop());
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setStealthChop(rxValue[2]);
-        ss2k->updateStealthChop();
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getStealthChop() ? "true" : "false");
-      }
-      break;
-
-    case BLE_inclineMultiplier: {  // 0x0B
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-inclineMultiplier");
-      int inc = userConfig->getInclineMultiplier() * 10;
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(inc & 0xff);
-        returnValue[3] = (uint8_t)(inc >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setInclineMultiplier((bytes_to_u16(rxValue[3], rxValue[2])) / 10.0);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%f)", userConfig->getInclineMultiplier());
-      }
-    } break;
-
-    case BLE_powerCorrectionFactor: {  // 0x0C
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-powerCorrectionFactor");
-      int pcf = userConfig->getPowerCorrectionFactor() * 10;
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(pcf & 0xff);
-        returnValue[3] = (uint8_t)(pcf >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setPowerCorrectionFactor((bytes_to_u16(rxValue[3], rxValue[2])) / 10.0);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%f)", userConfig->getPowerCorrectionFactor());
-      }
-    } break;
-
-    case BLE_simulateHr:  // 0x0D
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulateHr");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->hr.getSimulate());
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->hr.setSimulate(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", rtConfig->hr.getSimulate() ? "true" : "false");
-      }
-      break;
-
-    case BLE_simulateWatts:  // 0x0E
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulateWatts");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->watts.getSimulate());
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->watts.setSimulate(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", rtConfig->watts.getSimulate() ? "true" : "false");
-      }
-      break;
-
-    case BLE_simulateCad:  // 0x0F
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-simulateCad");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->cad.getSimulate());
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->cad.setSimulate(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", rtConfig->cad.getSimulate() ? "true" : "false");
-      }
-      break;
-
-    case BLE_FTMSMode:  // 0x10
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-FTMSMode");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->getFTMSMode() & 0xff);
-        returnValue[3] = (uint8_t)(rtConfig->getFTMSMode() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->setFTMSMode(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%hhu)", rtConfig->getFTMSMode());
-      }
-      break;
-
-    case BLE_autoUpdate:  // 0x11
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-autoUpdate");
-      if (rxValue[0] == cc_read) {
+  const ccDescriptor *d = findDescriptor(rxValue[1]);
+  if (d != nullptr) {
+    logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-%s", d->name);
+    if (rxValue[0] == cc_read) {
+      std::string value;
+      if (ccEncodeValue(d, value)) {
         returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getAutoUpdate());
-        returnLength += 1;
+        returnString   = value;
       }
-      if (rxValue[0] == cc_write) {
+    } else if (rxValue[0] == cc_write) {
+      if (ccDecodeValue(d, pData + 2, length - 2)) {
         returnValue[0] = cc_success;
-        userConfig->setAutoUpdate(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getAutoUpdate() ? "true" : "false");
-      }
-      break;
-
-    case BLE_ssid:  // 0x12
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-ssid");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getSsid();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setSsid(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getSsid());
-      }
-      break;
-
-    case BLE_password:  // 0x13
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-password");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getPassword();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setPassword(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", "******");
-      }
-      break;
-
-    case BLE_foundDevices:  // 0x14
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-foundDevices");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getFoundDevices();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setFoundDevices(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getFoundDevices());
-      }
-      break;
-
-    case BLE_connectedPowerMeter:  // 0x15
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-connectedPowerMete");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getConnectedPowerMeter();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setConnectedPowerMeter(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getConnectedPowerMeter());
-      }
-      break;
-
-    case BLE_connectedHeartMonitor:  // 0x16
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-connectedHeartMonitor");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = userConfig->getConnectedHeartMonitor();
-      } else if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        String str     = (char *)pData;
-        str.remove(0, 2);
-        userConfig->setConnectedHeartMonitor(str);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getConnectedHeartMonitor());
-      }
-      break;
-
-    case BLE_shifterPosition:  // 0x17
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-shifterPosition");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(rtConfig->getShifterPosition() & 0xff);
-        returnValue[3] = (uint8_t)(rtConfig->getShifterPosition() >> 8);
-        returnLength += 2;
+        if (d->id == BLE_password) {
+          logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", "******");
+        } else if (d->type == cc_type_string) {
+          logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", d->getString());
+        } else if (d->get != nullptr) {
+          logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%.2f)", d->get());
+        }
       }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        rtConfig->setShifterPosition(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", rtConfig->getShifterPosition());
+      if (d->id == BLE_shifterPosition) {
         SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s", logBuf);
         return;  // Return here and let SpinBLEServer::notifyShift() handle the return to prevent duplicate notifications.
       }
-      break;
-
-    case BLE_saveToLittleFS:  // 0x18
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-saveToLittleFS");
-      if (rxValue[0] == cc_write) {
-        ss2k->saveFlag = true;
-        returnValue[0] = cc_success;
-      }
-
-      break;
-
-    case BLE_targetPosition:  // 0x19
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-targetPosition");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(ss2k->targetPosition & 0xff);
-        returnValue[3] = (uint8_t)(ss2k->targetPosition >> 8);
-        returnValue[4] = (uint8_t)(ss2k->targetPosition >> 16);
-        returnValue[5] = (uint8_t)(ss2k->targetPosition >> 24);
-        returnLength += 4;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0]       = cc_success;
-        ss2k->targetPosition = (int32_t((uint8_t)(rxValue[2]) << 0 | (uint8_t)(rxValue[3]) << 8 | (uint8_t)(rxValue[4]) << 16 | (uint8_t)(rxValue[5]) << 24));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, " (%f)", ss2k->targetPosition);
-      }
-      break;
-
-    case BLE_externalControl:  // 0x1A
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-externalControl");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(ss2k->externalControl);
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0]        = cc_success;
-        ss2k->externalControl = static_cast<bool>(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", ss2k->externalControl ? "On" : "Off");
-      }
-      break;
-
-    case BLE_syncMode:  // 0x1B
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-syncMode");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(ss2k->syncMode);
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        ss2k->syncMode = static_cast<bool>(rxValue[2]);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", ss2k->syncMode ? "true" : "false");
-      }
-      break;
-
-    case BLE_reboot:  // 0x1C
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-reboot");
-      if (rxValue[0] == cc_write) {
-        ss2k->rebootFlag = true;
-        returnValue[0]   = cc_success;
-      }
-      break;
-
-    case BLE_resetToDefaults:  // 0x1D
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-reset to defaults");
-      if (rxValue[0] == cc_write) {
-        ss2k->resetDefaultsFlag = true;
-        returnValue[0]          = cc_success;
-      }
-
-      break;
-    case BLE_stepperSpeed:  // 0x1E
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-stepperSpeed");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getStepperSpeed() & 0xff);
-        returnValue[3] = (uint8_t)(userConfig->getStepperSpeed() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setStepperSpeed(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", userConfig->getStepperSpeed());
-        ss2k->updateStepperSpeed();
-        SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s", logBuf);
-      }
-      break;
-
-    case BLE_ERGSensitivity: {  // 0x1F
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-ERGSensitivity");
-      int pcf = userConfig->getERGSensitivity() * 10;
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(pcf & 0xff);
-        returnValue[3] = (uint8_t)(pcf >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setERGSensitivity((bytes_to_u16(rxValue[3], rxValue[2])) / 10);
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%f)", userConfig->getERGSensitivity());
-      }
-    } break;
-
-    case BLE_shiftDir:  // 0x20
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-ShiftDir");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getShifterDir());
-        returnLength += 1;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setShifterDir(static_cast<bool>(rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%s)", userConfig->getShifterDir() ? "Normal" : "Reverse");
-      }
-      break;
-      ///////////////
-    case BLE_minBrakeWatts:  // 0x21
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-MinWatts");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getMinWatts() & 0xff);
-        returnValue[3] = (uint8_t)(userConfig->getMinWatts() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setMinWatts(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", userConfig->getMinWatts());
-        SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s", logBuf);
-      }
-      break;
-    case BLE_maxBrakeWatts:  // 0x22
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-MaxWatts");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnValue[2] = (uint8_t)(userConfig->getMaxWatts() & 0xff);
-        returnValue[3] = (uint8_t)(userConfig->getMaxWatts() >> 8);
-        returnLength += 2;
-      }
-      if (rxValue[0] == cc_write) {
-        returnValue[0] = cc_success;
-        userConfig->setMaxWatts(bytes_to_u16(rxValue[3], rxValue[2]));
-        logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "(%d)", userConfig->getMaxWatts());
-        SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s", logBuf);
+    }
+  } else if (rxValue[1] == BLE_powerTableData) {  // 0x27
+    logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Power Tab Data");
+    if (rxValue[0] == cc_read) {
+      int row = 6;  // 90rpm
+      if ((length > 2) && (pData[2] < POWERTABLE_CAD_SIZE)) {
+        row = pData[2];
+      }
+      returnString += (uint8_t)row;
+      for (int i = 0; i < POWERTABLE_WATT_SIZE; i++) {
+        returnString += (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition & 0xff);
+        returnString += (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition >> 8);
       }
-      break;
-    case BLE_restartBLE:  // 0x23
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-restart BLE");
-      if (rxValue[0] == cc_write) {
+    }
+    if (rxValue[0] == cc_write) {
+      // Same layout as the read reply: row, then POWERTABLE_WATT_SIZE positions
+      if ((length >= 3 + POWERTABLE_WATT_SIZE * 2) && (pData[2] < POWERTABLE_CAD_SIZE)) {
         returnValue[0] = cc_success;
-        spinBLEClient.reconnectAllDevices();
-      }
-      break;
-    case BLE_scanBLE:  // 0x24
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-scan BLE");
-      if (rxValue[0] == cc_write) {
-        returnValue[0]       = cc_success;
-        spinBLEClient.doScan = true;
+        int row        = pData[2];
+        for (int i = 0; i < POWERTABLE_WATT_SIZE; i++) {
+          powerTable->tableRow[row].tableEntry[i].targetPosition = (int16_t)(pData[3 + i * 2] | pData[4 + i * 2] << 8);
+        }
+      } else {
+        SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "No table row specified");
       }
-      break;
-    case BLE_firmwareVer:  // 0x25
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Firmware Version");
-      if (rxValue[0] == cc_read) {
-        returnValue[0] = cc_success;
-        returnString   = FIRMWARE_VERSION;
+    }
+  } else if (rxValue[1] == BLE_powerTableDelta) {  // 0x28
+    logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Power Tab Delta");
+    if (rxValue[0] == cc_read) {
+      // A client that already mirrors the table sends back the epoch and version from its last chunk.
+      uint16_t since = 0;
+      if ((length >= 6) && ((bytes_to_int(pData[3], pData[2])) == ptEpoch)) {
+        since = (bytes_to_int(pData[5], pData[4]));
+      }
+      ptRequestedSince = since;
+      SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s since %d", logBuf, since);
+      return;  // Chunks are sent from parseNemit()
+    }
+  } else if (rxValue[1] == BLE_ergLookahead) {  // 0x2A
+    logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-ERG Lookahead");
+    uint32_t now = millis();
+    xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+    if (rxValue[0] == cc_write) {
+      // Replaces the list: <delay in 100 ms (2)>, <watts (2)> for each target. Nothing after the id clears it.
+      if (((length - 2) % 4 == 0) && ((size_t)(length - 2) / 4 <= ErgLookahead::MAX_TARGETS)) {
+        returnValue[0] = cc_success;
+        ergLookahead.clear();
+        for (int i = 2; i < length; i += 4) {
+          ergLookahead.schedule(now, (pData[i] | (pData[i + 1] << 8)) * 100, pData[i + 2] | (pData[i + 3] << 8));
+        }
       }
-      break;
-    case BLE_resetPowerTable:  // 0x26
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Reset PTab");
-      if (rxValue[0] == cc_write) {
-        returnValue[0]            = cc_success;
-        ss2k->resetPowerTableFlag = true;
+    }
+    if (rxValue[0] == cc_read) {
+      // Same layout, with the delay that remains
+      ergLookahead.next(now);
+      for (size_t i = 0; i < ergLookahead.getCount(); i++) {
+        uint16_t delay = (ergLookahead.get(i).atMs - now) / 100;
+        returnString += (uint8_t)(delay & 0xff);
+        returnString += (uint8_t)(delay >> 8);
+        returnString += (uint8_t)(ergLookahead.get(i).watts & 0xff);
+        returnString += (uint8_t)(ergLookahead.get(i).watts >> 8);
+      }
+      if (returnString == "") {
+        returnValue[0] = cc_success;  // Nothing announced
       }
-      break;
-    case BLE_powerTableData:  // 0x27
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Power Tab Data");
-      if (rxValue[0] == cc_read) {
-        int row = 6;  // 90rpm
-        if (rxValue[2] >= 0 || rxValue[2] < POWERTABLE_CAD_SIZE) {
-          row = rxValue[2];
-        }
-        returnString += (uint8_t)row;
-        for (int i = 0; i < POWERTABLE_WATT_SIZE; i++) {
-          returnString += (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition & 0xff);
-          returnString += (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition >> 8);
-          Serial.printf("%02x%02x ", (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition & 0xff),
-                        (uint8_t)(powerTable->tableRow[row].tableEntry[i].targetPosition >> 8));
-        }
+    }
+    xSemaphoreGive(ergLookaheadMutex);
+  } else if (rxValue[1] == BLE_workout) {  // 0x2B
+    logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "<-Workout");
+    if ((rxValue[0] == cc_write) && (length > 2)) {
+      bool accepted = false;
+      if (pData[2] == workout_chunk) {
+        accepted = (length > 5) && workoutRunner.receive(pData[3] | (pData[4] << 8), pData + 5, length - 5);
+      } else if (pData[2] == workout_commit) {
+        accepted = (length >= 5) && workoutRunner.commit(pData[3] | (pData[4] << 8));
+      } else {
+        accepted = workoutRunner.control(pData[2]);
       }
-      if (rxValue[0] == cc_write) {
+      if (accepted) {
         returnValue[0] = cc_success;
-        if (rxValue[3]) {
-          for (int i = 0; i < POWERTABLE_WATT_SIZE; i += 2) {
-            powerTable->tableRow[rxValue[3]].tableEntry[i].targetPosition = (int16_t((uint8_t)(rxValue[i + 3]) << 0 | (uint8_t)(rxValue[i + 4]) << 8));
-          }
-        } else {
-          SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "No table row specified");
-        }
       }
-      break;
+    }
+    if (rxValue[0] == cc_read) {
+      uint8_t progress[WORKOUT_PROGRESS_SIZE];
+      workoutRunner.getProgress(progress);
+      returnString.append((const char *)progress, sizeof(progress));
+    }
   }
 
   SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "%s", logBuf);
@@ -697,120 +526,171 @@ void BLE_ss2kCustomCharacteristic::process(std::string rxValue) {
   pCharacteristic->indicate();
 }
 
-// iterate through all smartspin user parameters and notify the specific one if changed
-void BLE_ss2kCustomCharacteristic::parseNemit() {
-  static userParameters _oldParams;
-
-  if (userConfig->getAutoUpdate() != _oldParams.getAutoUpdate()) {
-    _oldParams.setAutoUpdate(userConfig->getAutoUpdate());
-    BLE_ss2kCustomCharacteristic::notify(BLE_autoUpdate);
-    return;  // only do one at a time because immediate update isn't super important for these values
-  }
-
-  if (strcmp(userConfig->getFirmwareUpdateURL(), _oldParams.getFirmwareUpdateURL()) != 0) {
-    _oldParams.setFirmwareUpdateURL(userConfig->getFirmwareUpdateURL());
-    BLE_ss2kCustomCharacteristic::notify(BLE_firmwareUpdateURL);
-    return;
-  }
-
-  if (strcmp(userConfig->getDeviceName(), _oldParams.getDeviceName()) != 0) {
-    _oldParams.setDeviceName(userConfig->getDeviceName());
-    BLE_ss2kCustomCharacteristic::notify(BLE_deviceName);
-    return;
-  }
-
-  if (userConfig->getShiftStep() != _oldParams.getShiftStep()) {
-    _oldParams.setShiftStep(userConfig->getShiftStep());
-    BLE_ss2kCustomCharacteristic::notify(BLE_shiftStep);
-    return;
-  }
-
-  if (userConfig->getStealthChop() != _oldParams.getStealthChop()) {
-    _oldParams.setStealthChop(userConfig->getStealthChop());
-    BLE_ss2kCustomCharacteristic::notify(BLE_stealthChop);
-    return;
-  }
-
-  if (userConfig->getInclineMultiplier() != _oldParams.getInclineMultiplier()) {
-    _oldParams.setInclineMultiplier(userConfig->getInclineMultiplier());
-    BLE_ss2kCustomCharacteristic::notify(BLE_inclineMultiplier);
-    return;
+void BLE_ss2kCustomCharacteristic::processBulkRead(const std::string &rxValue, NimBLECharacteristic *pCharacteristic) {
+  const size_t payload = maxPayload();
+  std::string reply;
+  reply += (char)(cc_success | cc_bulkRead);
+
+  int sent    = 0;
+  int skipped = 0;
+  // An empty list means everything that can be read.
+  size_t count = (rxValue.length() > 1) ? rxValue.length() - 1 : ccDescriptorCount;
+  for (size_t i = 0; i < count; i++) {
+    const ccDescriptor *d = (rxValue.length() > 1) ? findDescriptor(rxValue[i + 1]) : &ccDescriptors[i];
+    std::string value;
+    if (d == nullptr || !ccEncodeValue(d, value) || value.length() > 0xff) {
+      continue;
+    }
+    if (reply.length() + 2 + value.length() > payload) {
+      skipped++;
+      continue;
+    }
+    reply += (char)d->id;
+    reply += (char)value.length();
+    reply += value;
+    sent++;
   }
 
-  if (userConfig->getPowerCorrectionFactor() != _oldParams.getPowerCorrectionFactor()) {
-    _oldParams.setPowerCorrectionFactor(userConfig->getPowerCorrectionFactor());
-    BLE_ss2kCustomCharacteristic::notify(BLE_powerCorrectionFactor);
-    return;
-  }
+  SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "<-Bulk read %d values (%d didn't fit in %d bytes)", sent, skipped, (int)payload);
+  pCharacteristic->setValue((const uint8_t *)reply.data(), reply.length());
+  pCharacteristic->indicate();
+}
 
-  if (strcmp(userConfig->getSsid(), _oldParams.getSsid()) != 0) {
-    _oldParams.setSsid(userConfig->getSsid());
-    BLE_ss2kCustomCharacteristic::notify(BLE_ssid);
-    return;
+void BLE_ss2kCustomCharacteristic::processBulkWrite(const std::string &rxValue, NimBLECharacteristic *pCharacteristic) {
+  const uint8_t *pData = reinterpret_cast<const uint8_t *>(rxValue.data());
+  const size_t length  = rxValue.length();
+  std::string reply;
+  reply += (char)(cc_success | cc_bulkWrite);
+
+  int written = 0;
+  size_t i    = 1;
+  while (i + 2 <= length) {
+    uint8_t id    = pData[i];
+    size_t valLen = pData[i + 1];
+    i += 2;
+    if (i + valLen > length) {
+      SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "Bulk write truncated at 0x%02x", id);
+      reply += (char)id;
+      reply += (char)cc_error;
+      break;
+    }
+    const ccDescriptor *d = findDescriptor(id);
+    bool ok               = (d != nullptr) && ccDecodeValue(d, pData + i, valLen);
+    reply += (char)id;
+    reply += (char)(ok ? cc_success : cc_error);
+    if (ok) {
+      written++;
+    }
+    i += valLen;
   }
 
-  if (strcmp(userConfig->getPassword(), _oldParams.getPassword()) != 0) {
-    _oldParams.setPassword(userConfig->getPassword());
-    BLE_ss2kCustomCharacteristic::notify(BLE_password);
-    return;
-  }
+  SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "<-Bulk write %d values", written);
+  pCharacteristic->setValue((const uint8_t *)reply.data(), reply.length());
+  pCharacteristic->indicate();
+}
 
-  if (strcmp(userConfig->getConnectedPowerMeter(), _oldParams.getConnectedPowerMeter()) != 0) {
-    _oldParams.setConnectedPowerMeter(userConfig->getConnectedPowerMeter());
-    BLE_ss2kCustomCharacteristic::notify(BLE_connectedPowerMeter);
-    return;
+bool BLE_ss2kCustomCharacteristic::sendPowerTableChunk() {
+  if (!ptTransfer.active) {
+    return false;
   }
-
-  if (strcmp(userConfig->getConnectedHeartMonitor(), _oldParams.getConnectedHeartMonitor()) != 0) {
-    _oldParams.setConnectedHeartMonitor(userConfig->getConnectedHeartMonitor());
-    BLE_ss2kCustomCharacteristic::notify(BLE_connectedHeartMonitor);
-    return;
-  }
-
-  if (userConfig->getStepperPower() != _oldParams.getStepperPower()) {
-    _oldParams.setStepperPower(userConfig->getStepperPower());
-    BLE_ss2kCustomCharacteristic::notify(BLE_stepperPower);
-    return;
+  NimBLEService *pService = NimBLEDevice::getServer()->getServiceByUUID(SMARTSPIN2K_SERVICE_UUID);
+  if (pService == nullptr) {
+    ptTransfer.active = false;
+    return false;
   }
+  NimBLECharacteristic *pCharacteristic = pService->getCharacteristic(SMARTSPIN2K_CHARACTERISTIC_UUID);
+
+  static uint8_t chunk[512];
+  size_t start  = ptTransfer.cursor;
+  size_t length = PowerTableCodec::encode(ptPositions, ptVersions, ptCells, ptTransfer.since, &ptTransfer.cursor, chunk + ptHeaderSize, maxPayload() - ptHeaderSize);
+  bool last     = ptTransfer.cursor >= ptCells;
+
+  chunk[0]  = cc_success;
+  chunk[1]  = BLE_powerTableDelta;
+  chunk[2]  = (uint8_t)(ptEpoch & 0xff);
+  chunk[3]  = (uint8_t)(ptEpoch >> 8);
+  chunk[4]  = (uint8_t)(ptTransfer.since & 0xff);
+  chunk[5]  = (uint8_t)(ptTransfer.since >> 8);
+  chunk[6]  = (uint8_t)(ptVersion & 0xff);
+  chunk[7]  = (uint8_t)(ptVersion >> 8);
+  chunk[8]  = (uint8_t)(start & 0xff);
+  chunk[9]  = (uint8_t)(start >> 8);
+  chunk[10] = (last ? ptLastChunk : 0) | (ptTransfer.push ? ptPushedData : 0);
+  pCharacteristic->setValue(chunk, ptHeaderSize + length);
+  pCharacteristic->indicate();
 
-  if (userConfig->getStepperSpeed() != _oldParams.getStepperSpeed()) {
-    _oldParams.setStepperSpeed(userConfig->getStepperSpeed());
-    BLE_ss2kCustomCharacteristic::notify(BLE_stepperSpeed);
-    return;
+  if (last) {
+    SS2K_LOG(CUSTOM_CHAR_LOG_TAG, "Power table v%d sent (since v%d)", ptVersion, ptTransfer.since);
+    ptTransfer.active = false;
   }
+  return true;
+}
 
-  if (userConfig->getERGSensitivity() != _oldParams.getERGSensitivity()) {
-    _oldParams.setERGSensitivity(userConfig->getERGSensitivity());
-    BLE_ss2kCustomCharacteristic::notify(BLE_ERGSensitivity);
-    return;
+// check one persisted setting per call and notify it if it changed since the last notify.
+// Round robin keeps the cost per maintenance loop constant no matter how many settings there are.
+// Also sends power table transfers one chunk per call so a large table never holds up the maintenance loop.
+void BLE_ss2kCustomCharacteristic::parseNemit() {
+  static int32_t _lastValues[ccDescriptorCount];
+  static bool _initialized       = false;
+  static size_t _next            = 0;
+  static unsigned long _lastPush = 0;
+  static uint16_t _pushedVersion = 0;
+  static uint16_t _pushedEpoch   = 0;
+
+  // A client asked for the table. Start over even if a push was in flight.
+  if (ptRequestedSince >= 0) {
+    ptStampChanges();
+    uint16_t since    = (uint16_t)ptRequestedSince;
+    ptRequestedSince  = -1;
+    ptTransfer.since  = (since > ptVersion) ? 0 : since;
+    ptTransfer.cursor = 0;
+    ptTransfer.push   = false;
+    ptTransfer.active = true;
   }
-
-  if (userConfig->getStepperDir() != _oldParams.getStepperDir()) {
-    _oldParams.setStepperDir(userConfig->getStepperDir());
-    BLE_ss2kCustomCharacteristic::notify(BLE_shiftDir);
+  if (sendPowerTableChunk()) {
     return;
   }
 
-  if (strcmp(userConfig->getFoundDevices(), _oldParams.getFoundDevices()) != 0) {
-    _oldParams.setFoundDevices(userConfig->getFoundDevices());
-    BLE_ss2kCustomCharacteristic::notify(BLE_foundDevices);
-    return;
+  // Batch whatever the power table learned since the last push into one transfer.
+  if (millis() - _lastPush > POWER_TABLE_PUSH_INTERVAL) {
+    _lastPush = millis();
+    ptStampChanges();
+    if ((ptVersion != _pushedVersion) || (ptEpoch != _pushedEpoch)) {
+      NimBLEService *pService = NimBLEDevice::getServer()->getServiceByUUID(SMARTSPIN2K_SERVICE_UUID);
+      if (pService && pService->getCharacteristic(SMARTSPIN2K_CHARACTERISTIC_UUID)->getSubscribedCount() > 0) {
+        ptTransfer.since  = (ptEpoch == _pushedEpoch) ? _pushedVersion : 0;
+        ptTransfer.cursor = 0;
+        ptTransfer.push   = true;
+        ptTransfer.active = true;
+      }
+      _pushedVersion = ptVersion;
+      _pushedEpoch   = ptEpoch;
+      return;
+    }
   }
 
-  if (userConfig->getMinWatts() != _oldParams.getMinWatts()) {
-    _oldParams.setMinWatts(userConfig->getMinWatts());
-    BLE_ss2kCustomCharacteristic::notify(BLE_minBrakeWatts);
+  if (!_initialized) {
+    for (size_t i = 0; i < ccDescriptorCount; i++) {
+      if (ccDescriptors[i].persist) {
+        _lastValues[i] = ccFingerprint(&ccDescriptors[i]);
+      }
+    }
+    _initialized = true;
     return;
   }
 
-  if (userConfig->getMaxWatts() != _oldParams.getMaxWatts()) {
-    _oldParams.setMaxWatts(userConfig->getMaxWatts());
-    BLE_ss2kCustomCharacteristic::notify(BLE_maxBrakeWatts);
-    return;
-  }
-  if (userConfig->getShifterDir() != _oldParams.getShifterDir()) {
-    _oldParams.setShifterDir(userConfig->getShifterDir());
-    BLE_ss2kCustomCharacteristic::notify(BLE_shiftDir);
+  // only do one at a time because immediate update isn't super important for these values
+  for (size_t checked = 0; checked < ccDescriptorCount; checked++) {
+    size_t i = _next;
+    _next    = (_next + 1) % ccDescriptorCount;
+    if (!ccDescriptors[i].persist) {
+      continue;
+    }
+    int32_t value = ccFingerprint(&ccDescriptors[i]);
+    if (value != _lastValues[i]) {
+      _lastValues[i] = value;
+      BLE_ss2kCustomCharacteristic::notify(ccDescriptors[i].id);
+    }
     return;
   }
-}
\ No newline at end of file
+}
@@ -14,6 +14,8 @@
 #include <Constants.h>
 #include <NimBLEDevice.h>
 #include <BLE_Custom_Characteristic.h>
+#include <OtaReceiver.h>
+#include <FirmwarePatch.h>
 
 /*------------------------------------------------------------------------------
   BLE instances & variables
@@ -21,20 +23,221 @@
 BLECharacteristic *pTxCharacteristic;
 BLECharacteristic *pOtaCharacteristic;
 
-bool deviceConnected    = false;
-bool oldDeviceConnected = false;
-
-String fileExtension = "";
-
 /*------------------------------------------------------------------------------
   OTA instances & variables
   ----------------------------------------------------------------------------*/
 static esp_ota_handle_t otaHandler             = 0;
 static const esp_partition_t *update_partition = NULL;
 
-uint8_t txValue   = 0;
-int bufferCount   = 0;
-bool downloadFlag = false;
+// BLE writes are staged here and written to flash by otaWriter so erase time never stalls the BLE stack.
+static OtaReceiver otaReceiver;
+static TaskHandle_t otaWriterTask = NULL;
+// Legacy writes have no flow control, so they are queued for otaWriter, which feeds them to otaReceiver as buffers free up.
+// otaWriter owns the session in legacy mode: the write callback only queues, and flags a write it had to drop.
+struct OtaLegacyPacket {
+  uint16_t length;
+  bool first;  // Starts a new legacy stream
+  uint8_t data[OtaReceiver::LEGACY_CHUNK];
+};
+static QueueHandle_t otaLegacyQueue    = NULL;
+static bool otaLegacyStream            = false;  // Owned by the write callback
+static bool otaLegacyDropping          = false;  // Owned by the write callback. Rest of the stream is discarded.
+static volatile bool otaLegacyOverflow = false;  // Set by the write callback, cleared by otaWriter
+// Set while the session is a compressed or delta image that has to be expanded on the way to flash.
+static FirmwarePatch *otaPatch = nullptr;
+static bool otaPatching        = false;
+
+static bool otaPatchRead(void *context, uint32_t offset, uint8_t *data, size_t length) {
+  return esp_partition_read(esp_ota_get_running_partition(), offset, data, length) == ESP_OK;
+}
+
+static bool otaPatchWrite(void *context, const uint8_t *data, size_t length) { return esp_ota_write(otaHandler, data, length) == ESP_OK; }
+
+static void otaReply(const uint8_t *reply, size_t replyLength) {
+  if (replyLength > 0) {
+    pTxCharacteristic->setValue(reply, replyLength);
+    pTxCharacteristic->notify();
+  }
+}
+
+static bool otaOpen() {
+  const esp_partition_t *configured = esp_ota_get_boot_partition();
+  const esp_partition_t *running    = esp_ota_get_running_partition();
+  if (configured != running) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "Configured OTA boot partition at offset 0x%08x, but running from offset 0x%08x", configured->address, running->address);
+  }
+
+  update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "No OTA partition");
+    return false;
+  }
+  SS2K_LOG(BLE_OTA_LOG_TAG, "Writing %d bytes to partition subtype %d at offset 0x%x", otaReceiver.getSize(), update_partition->subtype, update_partition->address);
+
+  // Sequential writes erase each sector as it's reached instead of the whole partition up front.
+  if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandler) != ESP_OK) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "esp_ota_begin failed");
+    return false;
+  }
+  return true;
+}
+
+static void otaLogStats(const char *state) {
+  const OtaReceiver::Stats &stats = otaReceiver.getStats();
+  uint32_t averageFlush           = stats.flushes ? (uint32_t)(stats.totalFlushMicros / stats.flushes) : 0;
+  SS2K_LOG(BLE_OTA_LOG_TAG, "%s %d/%d bytes, %d B/s, flush avg %dus max %dus, %d packets, %d naks", state, stats.bytesFlushed, otaReceiver.getSize(),
+           otaReceiver.getThroughput(), averageFlush, stats.maxFlushMicros, stats.packets, stats.naks);
+}
+
+// Runs on the writer. The session is reset by the next packet onPacket() gets.
+static void otaFail(uint8_t status) {
+  uint8_t reply[16];
+  size_t replyLength;
+  otaLogStats("Failed");
+  otaReceiver.fail(status, reply, &replyLength);
+  otaReply(reply, replyLength);
+  ss2k->isUpdating = false;
+}
+
+static void otaFinish() {
+  uint8_t reply[16];
+  size_t replyLength;
+  otaLogStats("Received");
+  bool verified = otaReceiver.finish(reply, &replyLength);
+  if (verified && otaPatching && !otaPatch->finish()) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "Patch failed: %s", otaPatch->getErrorString());
+    esp_ota_abort(otaHandler);
+    otaFail(OtaReceiver::STATUS_PATCH);
+    return;
+  }
+  esp_err_t err = esp_ota_end(otaHandler);
+  if (!verified || (err != ESP_OK)) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "Image rejected: %s", verified ? esp_err_to_name(err) : "crc mismatch");
+    otaFail(verified ? OtaReceiver::STATUS_FLASH : OtaReceiver::STATUS_CRC);
+    return;
+  }
+  if (esp_ota_set_boot_partition(update_partition) != ESP_OK) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "Set boot partition failed");
+    otaFail(OtaReceiver::STATUS_FLASH);
+    return;
+  }
+  otaReply(reply, replyLength);
+  SS2K_LOG(BLE_OTA_LOG_TAG, "Update complete. Restarting...");
+  ss2k->rebootFlag = true;
+}
+
+static void otaEvents(uint8_t events) {
+  if (events & (OtaReceiver::OTA_STARTED | OtaReceiver::OTA_RESUMED)) {
+    SS2K_LOG(BLE_OTA_LOG_TAG, "%s %s update", (events & OtaReceiver::OTA_STARTED) ? "Starting" : "Resuming", otaReceiver.isLegacy() ? "legacy" : "windowed");
+    ss2k->isUpdating = true;
+    esp_task_wdt_init(10, false);
+  } else if (events & OtaReceiver::OTA_ABORTED) {
+    ss2k->isUpdating = false;
+  }
+}
+
+// Feeds queued legacy writes to the receiver. Returns true if some are left waiting for a buffer.
+static bool otaDrainLegacy() {
+  static OtaLegacyPacket packet;  // Too big for the writer's stack
+  uint8_t reply[16];
+  size_t replyLength;
+  if (otaLegacyOverflow) {
+    otaLegacyOverflow = false;
+    if (otaReceiver.isLegacy() && !otaReceiver.hasFailed()) {
+      otaFail(OtaReceiver::STATUS_BUSY);
+    }
+  }
+  while (xQueuePeek(otaLegacyQueue, &packet, 0) == pdTRUE) {
+    if (!packet.first && otaReceiver.hasFailed()) {
+      xQueueReceive(otaLegacyQueue, &packet, 0);  // The rest of a stream that already failed
+      continue;
+    }
+    uint8_t events = otaReceiver.onPacket(packet.data, packet.length, millis(), reply, &replyLength);
+    if (events & OtaReceiver::OTA_BUSY) {
+      return true;
+    }
+    xQueueReceive(otaLegacyQueue, &packet, 0);
+    otaEvents(events);
+  }
+  return false;
+}
+
+// Owns the flash. Keeps the open OTA handle in step with the receiver's session and drains full buffers.
+static void otaWriter(void *pvParameters) {
+  bool open          = false;
+  uint32_t openToken = 0;
+  uint32_t nextStats = OTA_STATS_INTERVAL;
+  uint8_t reply[16];
+  size_t replyLength;
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bool legacyWaiting = otaDrainLegacy();
+
+    if (open && (!otaReceiver.isActive() || (openToken != otaReceiver.getToken()))) {
+      esp_ota_abort(otaHandler);
+      open = false;
+      SS2K_LOG(BLE_OTA_LOG_TAG, "Aborted");
+    }
+
+    size_t length;
+    uint32_t token;
+    const uint8_t *buffer;
+    while ((buffer = otaReceiver.nextFlush(&length, &token)) != nullptr) {
+      if (!open || (token != openToken)) {
+        if (open) {
+          esp_ota_abort(otaHandler);
+        }
+        open        = otaOpen();
+        openToken   = token;
+        nextStats   = OTA_STATS_INTERVAL;
+        otaPatching = open && FirmwarePatch::isPatch(buffer, length);
+        if (!open) {
+          otaFail(OtaReceiver::STATUS_FLASH);
+          break;
+        }
+        if (otaPatching) {
+          if (otaPatch == nullptr) {
+            otaPatch = new FirmwarePatch(otaPatchRead, otaPatchWrite, nullptr);
+          }
+          otaPatch->begin();
+          SS2K_LOG(BLE_OTA_LOG_TAG, "Expanding firmware patch");
+        }
+      }
+
+      uint32_t started = micros();
+      bool written;
+      if (otaPatching) {
+        written = otaPatch->write(buffer, length);
+      } else {
+        written = esp_ota_write(otaHandler, buffer, length) == ESP_OK;
+      }
+      if (!written) {
+        SS2K_LOG(BLE_OTA_LOG_TAG, "Flash write failed%s%s", otaPatching ? ": " : "", otaPatching ? otaPatch->getErrorString() : "");
+        esp_ota_abort(otaHandler);
+        open = false;
+        otaFail(otaPatching ? OtaReceiver::STATUS_PATCH : OtaReceiver::STATUS_FLASH);
+        break;
+      }
+      otaReceiver.flushed(token, micros() - started, reply, &replyLength);
+      otaReply(reply, replyLength);
+
+      if (otaReceiver.getStats().bytesFlushed >= nextStats) {
+        otaLogStats("Progress");
+        nextStats += OTA_STATS_INTERVAL;
+      }
+    }
+
+    if (open && otaReceiver.isDrained()) {
+      otaFinish();
+      open = false;
+    }
+    if (legacyWaiting) {
+      // The buffers just written make room for the rest.
+      xTaskNotifyGive(otaWriterTask);
+    }
+  }
+}
 
 /*------------------------------------------------------------------------------
   BLE Peripheral callback(s)
@@ -42,128 +245,45 @@ bool downloadFlag = false;
 
 class otaCallback : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic *pCharacteristic, ble_gap_conn_desc *connDesc) {
-    std::string rxData = pCharacteristic->getValue();
-    bufferCount++;
-
-    if (!downloadFlag) {
-      ss2k->isUpdating = true;
-      //-----------------------------------------------
-      // First BLE bytes have arrived
-      //-----------------------------------------------
-      // update the connection interval so that it provides enough time for the long writes
-
-      Serial.printf("1. BeginOTA");
-      BLEDevice::getServer()->updateConnParams(connDesc->conn_handle, 12, 12, 0, 1000);
-      const esp_partition_t *configured = esp_ota_get_boot_partition();
-      const esp_partition_t *running    = esp_ota_get_running_partition();
-
-      if (configured != running) {
-        Serial.printf("ERROR: Configured OTA boot partition at offset 0x%08x, but running from offset 0x%08x", configured->address, running->address);
-        Serial.printf("(This can happen if either the OTA boot data or preferred boot image become corrupted somehow.)");
-        downloadFlag = false;
-        esp_ota_end(otaHandler);
-      } else {
-        Serial.printf("2. Running partition type %d subtype %d (offset 0x%08x) \n", running->type, running->subtype, running->address);
-      }
-
-      update_partition = esp_ota_get_next_update_partition(NULL);
-      assert(update_partition != NULL);
-
-      Serial.printf("3. Writing to partition subtype %d at offset 0x%x \n", update_partition->subtype, update_partition->address);
-
-      //------------------------------------------------------------------------------------------
-      // esp_ota_begin can take a while to complete as it erase the flash partition (3-5 seconds)
-      // so make sure there's no timeout on the client side (iOS) that triggers before that.
-      //------------------------------------------------------------------------------------------
-      esp_task_wdt_init(10, false);
-
-      // if (BLECommunicationTask != NULL) {
-      //   SS2K_LOG(MAIN_LOG_TAG, "Stop BLE Tasks");
-      //   if (NimBLEDevice::getScan()->isScanning()) {
-      //     NimBLEDevice::getScan()->stop();
-      //   }
-      //   vTaskDelete(BLECommunicationTask);
-      //   BLECommunicationTask = NULL;
-      // }
-      // if (BLEClientTask != NULL) {
-      //   vTaskDelete(BLEClientTask);
-      //   BLEClientTask = NULL;
-      // }
-
-      // vTaskDelay(5);
-
-      if (esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &otaHandler) != ESP_OK) {
-        downloadFlag = false;
-         ss2k->isUpdating = false;
-        return;
-      }
-      downloadFlag = true;
+    std::string rxData  = pCharacteristic->getValue();
+    const uint8_t *data = (const uint8_t *)rxData.c_str();
+    uint8_t reply[16];
+    size_t replyLength;
+    if (rxData.empty()) {
+      return;
     }
 
-    if (bufferCount >= 1 || rxData.length() > 0) {
-      if (esp_ota_write(otaHandler, (uint8_t *)rxData.c_str(), rxData.length()) != ESP_OK) {
-        Serial.printf("Error: write to flash failed");
-        downloadFlag = false;
-        pTxCharacteristic->setValue(&txValue, 0x04);
-        pTxCharacteristic->notify();
-        return;
-      } else {
-        bufferCount = 1;
-        // Serial.printf("%d bytes", rxData.length());
-        //  Notify the iOS app so next batch can be sent
-        Serial.printf(".");
-        pTxCharacteristic->setValue(&txValue, 0x02);
-        // pTxCharacteristic->notify();
+    // An image header after a failure starts over, even if the uploader never finished the old stream.
+    bool restart = otaLegacyStream && otaReceiver.hasFailed() && (data[0] == OtaReceiver::ESP_IMAGE_MAGIC);
+    if (restart || otaLegacyStream || ((data[0] == OtaReceiver::ESP_IMAGE_MAGIC) && !otaReceiver.isActive())) {
+      static OtaLegacyPacket packet;  // Too big for the NimBLE host stack
+      packet.length = rxData.length();
+      packet.first  = restart || !otaLegacyStream;
+      if (packet.first) {
+        otaLegacyDropping = false;
       }
-
-      //-------------------------------------------------------------------
-      // check if this was the last data chunk? (normally the last chunk is
-      // smaller than the maximum MTU size). For improvement: let iOS app send byte
-      // length instead of hardcoding "510"
-      //-------------------------------------------------------------------
-      if (rxData.length() < 512)  // TODO Asumes at least 511 data bytes (@BLE 4.2).
-      {
-        Serial.printf("4. Final byte arrived");
-        //-----------------------------------------------------------------
-        // Final chunk arrived. Now check that
-        // the length of total file is correct
-        //-----------------------------------------------------------------
-        if (esp_ota_end(otaHandler) != ESP_OK) {
-          Serial.printf("OTA end failed ");
-          downloadFlag = false;
-          pTxCharacteristic->setValue(&txValue, 0x04);
-          pTxCharacteristic->notify();
-          return;
+      if (!otaLegacyDropping) {
+        if (packet.length <= OtaReceiver::LEGACY_CHUNK) {
+          memcpy(packet.data, data, packet.length);
         }
-        pTxCharacteristic->setValue(&txValue, 0x05);
-        pTxCharacteristic->notify();
-        //-----------------------------------------------------------------
-        // Clear download flag and restart the ESP32 if the firmware
-        // update was successful
-        //-----------------------------------------------------------------
-        Serial.printf("Set Boot partion");
-        if (ESP_OK == esp_ota_set_boot_partition(update_partition)) {
-          esp_ota_end(otaHandler);
-          downloadFlag = false;
-          Serial.printf("Restarting...");
-          ss2k->rebootFlag = true;
-          return;
-        } else {
-          //------------------------------------------------------------
-          // Something went wrong, the upload was not successful
-          //------------------------------------------------------------
-          Serial.printf("Upload Error");
-          pTxCharacteristic->setValue(&txValue, 4);
-          pTxCharacteristic->notify();
-          downloadFlag = false;
-          esp_ota_end(otaHandler);
-          return;
+        if ((packet.length > OtaReceiver::LEGACY_CHUNK) || (xQueueSend(otaLegacyQueue, &packet, 0) != pdTRUE)) {
+          SS2K_LOG(BLE_OTA_LOG_TAG, "Legacy write of %d bytes dropped", rxData.length());
+          otaLegacyDropping = true;
+          otaLegacyOverflow = true;
         }
       }
-    } else {
-       ss2k->isUpdating = false;
-      downloadFlag = false;
+      // A short write ends the stream.
+      otaLegacyStream = (packet.length == OtaReceiver::LEGACY_CHUNK);
+      xTaskNotifyGive(otaWriterTask);
+      return;
+    }
+
+    uint8_t events = otaReceiver.onPacket(data, rxData.length(), millis(), reply, &replyLength);
+    otaEvents(events);
+    if (events != OtaReceiver::OTA_NONE) {
+      xTaskNotifyGive(otaWriterTask);
     }
+    otaReply(reply, replyLength);
   }
 };
 
@@ -183,5 +303,14 @@ void BLEFirmwareSetup() {
   // 6. Start advertising
   spinBLEServer.pServer->getAdvertising()->addServiceUUID(pService->getUUID());
 
-  downloadFlag = false;
+  if (otaWriterTask == NULL) {
+    otaLegacyQueue = xQueueCreate(OTA_LEGACY_QUEUE_LENGTH, sizeof(OtaLegacyPacket));
+    xTaskCreatePinnedToCore(otaWriter,        /* Task function. */
+                            "otaWriter",      /* name of task. */
+                            OTA_WRITER_STACK, /* Stack size of task */
+                            NULL,             /* parameter of the task */
+                            1,                /* priority of the task */
+                            &otaWriterTask,   /* Task handle to keep track of created task */
+                            1);               /* pin task to core */
+  }
 }
@@ -7,6 +7,10 @@
 
 #include "BLE_Fitness_Machine_Service.h"
 #include <Constants.h>
+#include <ErgControl.h>
+#include <IndoorBikeData.h>
+#include <RoadModel.h>
+#include <sensors/SensorSample.h>
 
 BLE_Fitness_Machine_Service::BLE_Fitness_Machine_Service()
     : pFitnessMachineService(nullptr),
@@ -29,16 +33,12 @@ void BLE_Fitness_Machine_Service::setupService(NimBLEServer *pServer, MyCallback
   // Fitness Machine Feature Flags Setup
   struct FitnessMachineFeature ftmsFeature = {FitnessMachineFeatureFlags::Types::CadenceSupported | FitnessMachineFeatureFlags::Types::HeartRateMeasurementSupported |
                                                   FitnessMachineFeatureFlags::Types::PowerMeasurementSupported | FitnessMachineFeatureFlags::Types::InclinationSupported |
-                                                  FitnessMachineFeatureFlags::Types::ResistanceLevelSupported,
+                                                  FitnessMachineFeatureFlags::Types::ResistanceLevelSupported | FitnessMachineFeatureFlags::Types::TotalDistanceSupported |
+                                                  FitnessMachineFeatureFlags::Types::ExpendedEnergySupported | FitnessMachineFeatureFlags::Types::ElapsedTimeSupported,
                                               FitnessMachineTargetFlags::PowerTargetSettingSupported | FitnessMachineTargetFlags::Types::InclinationTargetSettingSupported |
                                                   FitnessMachineTargetFlags::Types::ResistanceTargetSettingSupported |
                                                   FitnessMachineTargetFlags::Types::IndoorBikeSimulationParametersSupported |
                                                   FitnessMachineTargetFlags::Types::SpinDownControlSupported};
-  // Fitness Machine Indoor Bike Data Flags Setup
-  FitnessMachineIndoorBikeDataFlags::Types ftmsIBDFlags = FitnessMachineIndoorBikeDataFlags::InstantaneousCadencePresent |
-                                                          FitnessMachineIndoorBikeDataFlags::ResistanceLevelPresent | FitnessMachineIndoorBikeDataFlags::InstantaneousPowerPresent |
-                                                          FitnessMachineIndoorBikeDataFlags::HeartRatePresent;
-
   // Fitness Machine service setup
   pFitnessMachineService             = spinBLEServer.pServer->createService(FITNESSMACHINESERVICE_UUID);
   fitnessMachineFeature              = pFitnessMachineService->createCharacteristic(FITNESSMACHINEFEATURE_UUID, NIMBLE_PROPERTY::READ);
@@ -51,9 +51,16 @@ void BLE_Fitness_Machine_Service::setupService(NimBLEServer *pServer, MyCallback
   fitnessMachineTrainingStatus       = pFitnessMachineService->createCharacteristic(FITNESSMACHINETRAININGSTATUS_UUID, NIMBLE_PROPERTY::NOTIFY);
 
   fitnessMachineFeature->setValue(ftmsFeature.bytes, sizeof(ftmsFeature));
-  ftmsIndoorBikeData[0] = static_cast<uint8_t>(ftmsIBDFlags & 0xFF);         // LSB, mask with 0xFF to get the lower 8 bits
-  ftmsIndoorBikeData[1] = static_cast<uint8_t>((ftmsIBDFlags >> 8) & 0xFF);  // MSB, shift right by 8 bits and mask with 0xFF
-  fitnessMachineIndoorBikeData->setValue(ftmsIndoorBikeData, sizeof(ftmsIndoorBikeData));
+  // Fitness Machine Indoor Bike Data, all 0 until the first update
+  IndoorBikeData::Values ftmsIBDValues;
+  ftmsIBDValues.clear();
+  for (IndoorBikeData::Field field : {IndoorBikeData::InstantaneousSpeed, IndoorBikeData::InstantaneousCadence, IndoorBikeData::TotalDistance, IndoorBikeData::ResistanceLevel,
+                                      IndoorBikeData::InstantaneousPower, IndoorBikeData::TotalEnergy, IndoorBikeData::EnergyPerHour, IndoorBikeData::EnergyPerMinute,
+                                      IndoorBikeData::HeartRate, IndoorBikeData::ElapsedTime}) {
+    ftmsIBDValues.set(field, 0);
+  }
+  ftmsIndoorBikeDataLength = IndoorBikeData::encode(ftmsIBDValues, ftmsIndoorBikeData, sizeof(ftmsIndoorBikeData));
+  fitnessMachineIndoorBikeData->setValue(ftmsIndoorBikeData, ftmsIndoorBikeDataLength);
   fitnessMachineResistanceLevelRange->setValue(ftmsResistanceLevelRange, sizeof(ftmsResistanceLevelRange));
   fitnessMachinePowerRange->setValue(ftmsPowerRange, sizeof(ftmsPowerRange));
   fitnessMachineInclinationRange->setValue(ftmsInclinationRange, sizeof(ftmsInclinationRange));
@@ -68,47 +75,61 @@ void BLE_Fitness_Machine_Service::update() {
     return;
   }*/
   float cadRaw      = rtConfig->cad.getValue();
-  int cad           = static_cast<int>(cadRaw * 2);
   int watts         = rtConfig->watts.getValue();
   int hr            = rtConfig->hr.getValue();
   int res           = rtConfig->resistance.getValue();
-  int speedFtmsUnit = 0;
-  if (rtConfig->getSimulatedSpeed() > 5) {
-    speedFtmsUnit = rtConfig->getSimulatedSpeed() * 100;
+  int speedFtmsUnit = spinBLEServer.getSpeed() * 100;
+
+  const RideTotals &totals = spinBLEServer.rideTotals;
+  IndoorBikeData::Values values;
+  values.clear();
+  values.set(IndoorBikeData::InstantaneousSpeed, speedFtmsUnit);
+  values.setFixed(IndoorBikeData::InstantaneousCadence, SensorSample::toFixed(cadRaw));
+  values.set(IndoorBikeData::TotalDistance, totals.getDistance());
+  values.set(IndoorBikeData::ResistanceLevel, res);
+  values.set(IndoorBikeData::InstantaneousPower, watts);
+  values.set(IndoorBikeData::TotalEnergy, totals.getEnergy());
+  values.set(IndoorBikeData::EnergyPerHour, totals.getEnergyPerHour());
+  values.set(IndoorBikeData::EnergyPerMinute, totals.getEnergyPerMinute());
+  values.set(IndoorBikeData::HeartRate, hr);
+  values.set(IndoorBikeData::ElapsedTime, totals.getElapsedTime());
+  ftmsIndoorBikeDataLength = IndoorBikeData::encode(values, ftmsIndoorBikeData, sizeof(ftmsIndoorBikeData));
+
+  // The whole record is too long for the default MTU, so split it for anyone who didn't negotiate a bigger one.
+  size_t packetCapacity = sizeof(ftmsIndoorBikeData);
+  for (uint16_t peer : spinBLEServer.pServer->getPeerDevices()) {
+    size_t peerCapacity = spinBLEServer.pServer->getPeerMTU(peer) - 3;
+    if (peerCapacity < packetCapacity) {
+      packetCapacity = peerCapacity;
+    }
+  }
+  if (ftmsIndoorBikeDataLength > packetCapacity) {
+    uint8_t packet[IndoorBikeData::MAX_LENGTH];
+    uint16_t sent = 0;
+    size_t packetLength;
+    while ((packetLength = IndoorBikeData::encodeNext(values, &sent, packet, packetCapacity)) > 0) {
+      fitnessMachineIndoorBikeData->setValue(packet, packetLength);
+      fitnessMachineIndoorBikeData->notify();
+    }
+    // Reads get the whole record
+    fitnessMachineIndoorBikeData->setValue(ftmsIndoorBikeData, ftmsIndoorBikeDataLength);
   } else {
-    speedFtmsUnit = spinBLEServer.calculateSpeed() * 100;
+    fitnessMachineIndoorBikeData->setValue(ftmsIndoorBikeData, ftmsIndoorBikeDataLength);
+    fitnessMachineIndoorBikeData->notify();
   }
 
-  ftmsIndoorBikeData[2] = (uint8_t)(speedFtmsUnit & 0xff);
-  ftmsIndoorBikeData[3] = (uint8_t)(speedFtmsUnit >> 8);
-
-  ftmsIndoorBikeData[4] = (uint8_t)(cad & 0xff);
-  ftmsIndoorBikeData[5] = (uint8_t)(cad >> 8);
-
-  ftmsIndoorBikeData[6] = (uint8_t)(res & 0xff);
-  ftmsIndoorBikeData[7] = (uint8_t)(res >> 8);
-
-  ftmsIndoorBikeData[8] = (uint8_t)(watts & 0xff);
-  ftmsIndoorBikeData[9] = (uint8_t)(watts >> 8);
-
-  ftmsIndoorBikeData[10] = (uint8_t)hr;
-
-  fitnessMachineIndoorBikeData->setValue(ftmsIndoorBikeData, 11);
-  fitnessMachineIndoorBikeData->notify();
-
-  const int kLogBufCapacity = 200;  // Data(30), Sep(data/2), Arrow(3), CharId(37), Sep(3), CharId(37), Sep(3), Name(10), Prefix(2), HR(7), SEP(1), CD(10), SEP(1), PW(8),
-                                    // SEP(1), SD(7), Suffix(2), Nul(1), rounded up
+  const int kLogBufCapacity = 250;  // Data(60), Sep(data/2), Arrow(3), CharId(37), Sep(3), CharId(37), Sep(3), Name(10), Prefix(2), HR(7), SEP(1), CD(10), SEP(1), PW(8),
+                                    // SEP(1), SD(7), SEP(1), DS(12), Suffix(2), Nul(1), rounded up
   char logBuf[kLogBufCapacity];
-  const size_t ftmsIndoorBikeDataLength = sizeof(ftmsIndoorBikeData) / sizeof(ftmsIndoorBikeData[0]);
   logCharacteristic(logBuf, kLogBufCapacity, ftmsIndoorBikeData, ftmsIndoorBikeDataLength, FITNESSMACHINESERVICE_UUID, fitnessMachineIndoorBikeData->getUUID(),
-                    "FTMS(IBD)[ HR(%d) CD(%.2f) PW(%d) SD(%.2f) ]", hr % 1000, fmodf(cadRaw, 1000.0), watts % 10000, fmodf((float)speedFtmsUnit / 100.0, 1000.0));
+                    "FTMS(IBD)[ HR(%d) CD(%.2f) PW(%d) SD(%.2f) DS(%d) ]", hr % 1000, fmodf(cadRaw, 1000.0), watts % 10000, fmodf((float)speedFtmsUnit / 100.0, 1000.0),
+                    (int)(totals.getDistance() % 10000000));
 }
 
 // The things that happen when we receive a FitnessMachineControlPointProcedure from a Client.
 void BLE_Fitness_Machine_Service::processFTMSWrite() {
-  while (!spinBLEServer.writeCache.empty()) {
-    std::string rxValue = spinBLEServer.writeCache.front();
-    spinBLEServer.writeCache.pop();
+  std::string rxValue;
+  while (spinBLEServer.nextWrite(rxValue)) {
     if (rxValue == "") {
       return;
     }
@@ -142,6 +163,7 @@ void BLE_Fitness_Machine_Service::processFTMSWrite() {
           pCharacteristic->setValue(returnValue, 3);
 
           logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "-> Reset");
+          spinBLEServer.rideTotals.reset();
           ftmsTrainingStatus[1] = FitnessMachineTrainingStatus::Idle;  // 0x01;
           ftmsStatus            = {FitnessMachineStatus::Reset};
           fitnessMachineTrainingStatus->setValue(ftmsTrainingStatus, 2);
@@ -190,10 +212,14 @@ void BLE_Fitness_Machine_Service::processFTMSWrite() {
 
         case FitnessMachineControlPointProcedure::SetTargetPower: {
           rtConfig->setFTMSMode((uint8_t)rxValue[0]);
-          if (spinBLEClient.connectedPM || rtConfig->watts.getSimulate()) {
+          int targetWatts;
+          if (!ErgControl::targetFromFtms(pData + 1, length - 1, &targetWatts)) {
+            returnValue[2] = FitnessMachineControlPointResultCode::InvalidParameter;
+            logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "-> ERG Mode: No Target");
+          } else if (spinBLEClient.connectedPM || rtConfig->watts.getSimulate()) {
             returnValue[2] = FitnessMachineControlPointResultCode::Success;  // 0x01;
 
-            rtConfig->watts.setTarget(bytes_to_u16(rxValue[2], rxValue[1]));
+            rtConfig->watts.setTarget(targetWatts);
             logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "-> ERG Mode Target: %d Current: %d Incline: %2f", rtConfig->watts.getTarget(),
                                      rtConfig->watts.getValue(), rtConfig->getTargetIncline() / 100);
 
@@ -240,15 +266,20 @@ void BLE_Fitness_Machine_Service::processFTMSWrite() {
           pCharacteristic->setValue(returnValue, 3);
 
           signed char buf[2];
-          // int16_t windSpeed        = (rxValue[2] << 8) + rxValue[1];
           buf[0] = rxValue[3];  // (Least significant byte)
           buf[1] = rxValue[4];  // (Most significant byte)
-          // int8_t rollingResistance = rxValue[5];
-          // int8_t windResistance    = rxValue[6];
-          port = bytes_to_u16(buf[1], buf[0]);
+          port   = bytes_to_u16(buf[1], buf[0]);
           rtConfig->setTargetIncline(port);
           logBufLength += snprintf(logBuf + logBufLength, kLogBufCapacity - logBufLength, "-> Sim Mode Incline %2f", rtConfig->getTargetIncline() / 100);
 
+          // Wind, Crr and Cw for the road model. Apps that send a short packet keep the last ones.
+          RoadModel::Conditions road;
+          if (RoadModel::fromFtms(pData + 1, length - 1, &road)) {
+            rtConfig->setWindSpeed(road.windSpeed);
+            rtConfig->setCrr(road.crr);
+            rtConfig->setCw(road.cw);
+          }
+
           ftmsStatus = {FitnessMachineStatus::IndoorBikeSimulationParametersChanged,
                         (uint8_t)rxValue[1],
                         (uint8_t)rxValue[2],
@@ -14,10 +14,12 @@
 #include "BLE_Fitness_Machine_Service.h"
 #include "BLE_Custom_Characteristic.h"
 #include "BLE_Device_Information_Service.h"
+#include "SessionRecorder.h"
 
 #include <ArduinoJson.h>
 #include <Constants.h>
 #include <NimBLEDevice.h>
+#include <sensors/SensorSample.h>
 #include <cmath>
 #include <limits>
 
@@ -36,6 +38,7 @@ BLE_Device_Information_Service deviceInformationService;
 void startBLEServer() {
   // Server Setup
   SS2K_LOG(BLE_SERVER_LOG_TAG, "Starting BLE Server");
+  spinBLEServer.createWriteCache();
   spinBLEServer.pServer = BLEDevice::createServer();
   spinBLEServer.pServer->setCallbacks(new MyServerCallbacks());
 
@@ -67,6 +70,8 @@ void startBLEServer() {
 }
 
 void SpinBLEServer::update() {
+  // Catch the totals up in case no sensor has reported since the last packet.
+  spinBLEServer.updateRideTotals();
   // Wheel and crank is used in multiple characteristics. Update first.
   spinBLEServer.updateWheelAndCrankRev();
   // update the BLE information on the server
@@ -96,14 +101,41 @@ double SpinBLEServer::calculateSpeed() {
   return speedKmH;
 }
 
-void SpinBLEServer::updateWheelAndCrankRev() {
-  float wheelSize     = 2.127;  // 700cX28 circumference, typical in meters
-  float wheelSpeedMps = 0.0;
+double SpinBLEServer::getSpeed() {
   if (rtConfig->getSimulatedSpeed() > 5) {
-    wheelSpeedMps = rtConfig->getSimulatedSpeed() / 3.6;
-  } else {
-    wheelSpeedMps = this->calculateSpeed() / 3.6;  // covert km/h to m/s
+    return rtConfig->getSimulatedSpeed();
+  }
+  return this->calculateSpeed();
+}
+
+void SpinBLEServer::createWriteCache() {
+  if (writeCacheMutex == NULL) {
+    writeCacheMutex = xSemaphoreCreateMutex();
+  }
+}
+
+void SpinBLEServer::queueWrite(const std::string &value) {
+  xSemaphoreTake(writeCacheMutex, portMAX_DELAY);
+  writeCache.push(value);
+  xSemaphoreGive(writeCacheMutex);
+}
+
+bool SpinBLEServer::nextWrite(std::string &value) {
+  xSemaphoreTake(writeCacheMutex, portMAX_DELAY);
+  bool found = !writeCache.empty();
+  if (found) {
+    value = writeCache.front();
+    writeCache.pop();
   }
+  xSemaphoreGive(writeCacheMutex);
+  return found;
+}
+
+void SpinBLEServer::updateRideTotals() { rideTotals.update(millis(), SensorSample::toFixed(this->getSpeed()), rtConfig->watts.getValue()); }
+
+void SpinBLEServer::updateWheelAndCrankRev() {
+  float wheelSize     = 2.127;                   // 700cX28 circumference, typical in meters
+  float wheelSpeedMps = this->getSpeed() / 3.6;  // covert km/h to m/s
 
   // Calculate wheel revolutions per minute
   float wheelRpm        = (wheelSpeedMps / wheelSize) * 60;
@@ -152,7 +184,9 @@ bool MyServerCallbacks::onConnParamsUpdateRequest(NimBLEClient *pClient, const b
 
 void MyCallbacks::onWrite(BLECharacteristic *pCharacteristic) {
   if (pCharacteristic->getUUID() == FITNESSMACHINECONTROLPOINT_UUID) {
-    spinBLEServer.writeCache.push(pCharacteristic->getValue());
+    std::string value = pCharacteristic->getValue();
+    sessionRecorder.recordControlPoint((const uint8_t *)value.data(), value.length());
+    spinBLEServer.queueWrite(value);
   } else {
     SS2K_LOG(BLE_SERVER_LOG_TAG, "Write to %s is not supported", pCharacteristic->getUUID().toString());
   }
@@ -9,19 +9,21 @@
 #include "SS2KLog.h"
 #include "Main.h"
 #include "BLE_Custom_Characteristic.h"
-#include <LittleFS.h>
-#include <vector>
+#include <ErgControl.h>
+#include <PowerTableFile.h>
+#include <RoadModel.h>
 #include <algorithm>
 #include <cmath>
 #include <limits>
-#include <numeric>
 
 PowerTable* powerTable = new PowerTable;
+ErgLookahead ergLookahead;
+SemaphoreHandle_t ergLookaheadMutex = NULL;
 
 // Create a torque table representing 0w-1000w in 50w increments.
 // i.e. powerTable[1] corresponds to the incline required for 50w. powerTable[2] is the incline required for 100w and so on.
 
-static unsigned long int ergTimer = millis();
+static uint32_t ergTimer = 0;
 
 void PowerTable::runERG() {
   static ErgMode ergMode;
@@ -30,9 +32,10 @@ void PowerTable::runERG() {
   static bool simulationRunning      = false;
   static int loopCounter             = 0;
 
-  if ((millis() - ergTimer) > ERG_MODE_DELAY) {
+  // Signed, as a set point change pushes ergTimer ahead of now
+  if ((int32_t)(ss2k->systemClock->nowMs() - ergTimer) > ERG_MODE_DELAY) {
     // reset the timer.
-    ergTimer = millis();
+    ergTimer = ss2k->systemClock->nowMs();
     // be quiet while updating via BLE
     if (ss2k->isUpdating) {
       return;
@@ -763,6 +766,24 @@ void PowerTable::newEntry(PowerBuffer& powerBuffer) {
     return;
   }
 
+  // A cell with settled history is an anchor for spotting lost steps. Samples that land far from it aren't learned.
+  TableEntry& anchor = this->tableRow[k].tableEntry[i];
+  if ((anchor.readings >= POWER_SAMPLES) && (anchor.targetPosition != INT16_MIN)) {
+    int32_t drift  = (targetPosition - anchor.targetPosition) * 100;  // The table holds steps / 100
+    int32_t rehome = ss2k->positionHealth.observeAnchor(k * POWERTABLE_WATT_SIZE + i, drift);
+    if (rehome != 0) {
+      SS2K_LOG(POWERTABLE_LOG_TAG, "Lost steps: position is %d steps off the table", (int)rehome);
+      ss2k->stepperControl.rehome(rehome);
+      ss2k->motionPlanner.reportLostSteps(rehome > 0);  // The count ran ahead of the knob while tightening
+    }
+    if (abs(drift) >= PositionHealth::REHOME_THRESHOLD) {
+      return;
+    }
+  } else if (!ss2k->positionHealth.isTrusted()) {
+    SS2K_LOG(POWERTABLE_LOG_TAG, "Position suspect, entry not recorded");
+    return;
+  }
+
   // Downvote out of position neighbors and discard entry if it doesn't match the logic of the table
   TestResults testResults = this->testNeighbors(k, i, targetPosition);
   if (!(testResults.bottomNeighbor.passedTest && testResults.topNeighbor.passedTest && testResults.rightNeighbor.passedTest && testResults.leftNeighbor.passedTest)) {
@@ -817,161 +838,74 @@ void PowerTable::newEntry(PowerBuffer& powerBuffer) {
       newEntries = getNumEntries();
     }
   }
-  // Notify connected client of new data
-  BLE_ss2kCustomCharacteristic::notify(0x27, k);
+  // Connected clients are sent the changes in batches by BLE_ss2kCustomCharacteristic::parseNemit()
 }
 
+// The live table as the cells PowerTableFile stores
+static PowerTableFile::Cell tableCells[POWERTABLE_CAD_SIZE * POWERTABLE_WATT_SIZE];
+
 bool PowerTable::_manageSaveState() {
   // Check if the table has been loaded in this session
   if (!this->_hasBeenLoadedThisSession) {
     SS2K_LOG(POWERTABLE_LOG_TAG, "Loading Power Table....");
-    File file = LittleFS.open(POWER_TABLE_FILENAME, FILE_READ);
-    if (!file) {
-      SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to Load Power Table.");
-      file.close();
-      this->_save();
-      return false;
-    }
-
-    // Read version and size
-    int version;
-    file.read((uint8_t*)&version, sizeof(version));
-    int savedQuality;
-    file.read((uint8_t*)&savedQuality, sizeof(savedQuality));
-    if (version != TABLE_VERSION) {
-      SS2K_LOG(POWERTABLE_LOG_TAG, "Expected power table version %d, found version %d", TABLE_VERSION, version);
-      file.close();
-      this->_save();
-      return false;
-    }
-
-    // Is the data we are working with better than the saved file?
-    int activeReadings = this->getNumReadings();
-    if (activeReadings > savedQuality) {
-      SS2K_LOG(POWERTABLE_LOG_TAG, "Active table had a reliability of %d, vs %d for the saved file. Overwriting save.", activeReadings, savedQuality);
-      file.close();
-      this->_save();
-    }
-
-    SS2K_LOG(POWERTABLE_LOG_TAG, "Loading power table version %d, Size %d", version, savedQuality);
-
-    // Initialize a counter for reliable positions
-    int reliablePositions = 0;
-
-    // Check if we have at least 3 reliable positions in the active table in order to determine a reliable offset to load the saved table
     for (int i = 0; i < POWERTABLE_CAD_SIZE; i++) {
       for (int j = 0; j < POWERTABLE_WATT_SIZE; j++) {
-        int16_t savedTargetPosition = INT16_MIN;
-        int8_t savedReadings        = 0;
-        file.read((uint8_t*)&savedTargetPosition, sizeof(savedTargetPosition));
-        file.read((uint8_t*)&savedReadings, sizeof(savedReadings));
-        // Does the saved file have a position that the active session has also recorded?
-        // We start comparing at watt position 3 (j>2) because low resistance positions are notoriously unreliable.
-        if ((j > 2) && (this->tableRow[i].tableEntry[j].targetPosition != INT16_MIN) && (this->tableRow[i].tableEntry[j].readings > MINIMUM_RELIABLE_POSITIONS) &&
-            (savedReadings > 0)) {
-          reliablePositions++;
-        }
+        tableCells[i * POWERTABLE_WATT_SIZE + j] = {this->tableRow[i].tableEntry[j].targetPosition, this->tableRow[i].tableEntry[j].readings};
       }
     }
-    if (reliablePositions < MINIMUM_RELIABLE_POSITIONS) {  // Do we have enough active data in order to calculate a (good) offset when we load the new table?
-      SS2K_LOG(POWERTABLE_LOG_TAG, "Not enough matching positions to load the Power Table. %d of %d needed.", reliablePositions, MINIMUM_RELIABLE_POSITIONS);
-      file.close();
-      return false;
-    } else {
-      // continue loading
-    }
-    file.close();
-
-    // We passed our checks to load, lets load the saved table into active memory
-    file = LittleFS.open(POWER_TABLE_FILENAME, FILE_READ);
-    if (!file) {
-      SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to Load Power Table. Resetting the save.");
-      file.close();
-      this->_save();
-      return false;
-    }
-
-    // get these reads done, so that we're in the right position to read the data from the file.
-    file.read((uint8_t*)&version, sizeof(version));
-    file.read((uint8_t*)&savedQuality, sizeof(savedQuality));
-    std::vector<float> offsetDifferences;
-
-    reliablePositions = 0;
-    // Read table entries and calculate offsets
-    for (int i = 0; i < POWERTABLE_CAD_SIZE; i++) {
-      for (int j = 0; j < POWERTABLE_WATT_SIZE; j++) {
-        int16_t savedTargetPosition = INT16_MIN;
-        int8_t savedReadings        = 0;
-        file.read((uint8_t*)&savedTargetPosition, sizeof(savedTargetPosition));
-        file.read((uint8_t*)&savedReadings, sizeof(savedReadings));
-        if ((this->tableRow[i].tableEntry[j].targetPosition != INT16_MIN) && (savedTargetPosition != INT16_MIN) && (savedReadings > 0) &&
-            (this->tableRow[i].tableEntry[j].readings > MINIMUM_RELIABLE_POSITIONS)) {
-          int offset = this->tableRow[i].tableEntry[j].targetPosition - savedTargetPosition;
-          offsetDifferences.push_back(offset);
-          SS2K_LOG(POWERTABLE_LOG_TAG, "offset %d", offset);
-          reliablePositions++;
-        }
-        this->tableRow[i].tableEntry[j].targetPosition = savedTargetPosition;
-        this->tableRow[i].tableEntry[j].readings       = savedReadings;
-        // SS2K_LOG(POWERTABLE_LOG_TAG, "Position %d, %d, Target %d, Readings %d, loaded", i, j, this->tableRow[i].tableEntry[j].targetPosition,
-        //          this->tableRow[i].tableEntry[j].readings);
-      }
+    // We start comparing at watt position 3 because low resistance positions are notoriously unreliable.
+    float offset                  = 0;
+    PowerTableFile::Result result = PowerTableFile::load(*ss2k->fileSystem, POWER_TABLE_FILENAME, TABLE_VERSION, tableCells, POWERTABLE_CAD_SIZE, POWERTABLE_WATT_SIZE,
+                                                         this->getNumReadings(), MINIMUM_RELIABLE_POSITIONS, MINIMUM_RELIABLE_POSITIONS, 3, &offset);
+    switch (result) {
+      case PowerTableFile::MISSING:
+        SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to Load Power Table.");
+        this->_save();
+        return false;
+      case PowerTableFile::OLD_VERSION:
+        SS2K_LOG(POWERTABLE_LOG_TAG, "Saved power table isn't version %d.", TABLE_VERSION);
+        this->_save();
+        return false;
+      case PowerTableFile::SUPERSEDED:
+        SS2K_LOG(POWERTABLE_LOG_TAG, "Active table has more readings than the saved file. Overwriting save.");
+        this->_save();
+        return false;
+      case PowerTableFile::TOO_FEW_MATCHES:
+        SS2K_LOG(POWERTABLE_LOG_TAG, "Not enough matching positions to load the Power Table. %d needed.", MINIMUM_RELIABLE_POSITIONS);
+        return false;
+      case PowerTableFile::LOADED:
+        break;
     }
-
-    file.close();
-    float averageOffset = std::accumulate(offsetDifferences.begin(), offsetDifferences.end(), 0.0) / offsetDifferences.size();
-
-    // Apply the offset to all loaded positions except for INT16_MIN values
     for (int i = 0; i < POWERTABLE_CAD_SIZE; i++) {
       for (int j = 0; j < POWERTABLE_WATT_SIZE; j++) {
-        if (this->tableRow[i].tableEntry[j].targetPosition != INT16_MIN) {
-          this->tableRow[i].tableEntry[j].targetPosition += averageOffset;
-        }
+        this->tableRow[i].tableEntry[j].targetPosition = tableCells[i * POWERTABLE_WATT_SIZE + j].targetPosition;
+        this->tableRow[i].tableEntry[j].readings       = tableCells[i * POWERTABLE_WATT_SIZE + j].readings;
       }
     }
     // set the flag so it isn't loaded again this session.
     this->_hasBeenLoadedThisSession = true;
-    SS2K_LOG(POWERTABLE_LOG_TAG, "Power Table loaded with an offset of %d.", averageOffset);
+    SS2K_LOG(POWERTABLE_LOG_TAG, "Power Table loaded with an offset of %.1f.", offset);
   }
 
   // Implement saving on a timer
-  if ((millis() - lastSaveTime) > POWER_TABLE_SAVE_INTERVAL) {
+  if ((ss2k->systemClock->nowMs() - lastSaveTime) > POWER_TABLE_SAVE_INTERVAL) {
     this->_save();
-    lastSaveTime = millis();
   }
   return true;
 }
 
 bool PowerTable::_save() {
-  // Delete existing file to avoid appending
-  LittleFS.remove(POWER_TABLE_FILENAME);
-
-  // Open file for writing
   SS2K_LOG(POWERTABLE_LOG_TAG, "Writing File: %s", POWER_TABLE_FILENAME);
-  File file = LittleFS.open(POWER_TABLE_FILENAME, FILE_WRITE);
-  if (!file) {
-    SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to create file");
-    return false;
-  }
-
-  // Write version and size
-  int version = TABLE_VERSION;
-  file.write((uint8_t*)&version, sizeof(version));
-
-  int size = getNumReadings();
-  file.write((uint8_t*)&size, sizeof(size));
-
-  // Write table entries
   for (int i = 0; i < POWERTABLE_CAD_SIZE; i++) {
     for (int j = 0; j < POWERTABLE_WATT_SIZE; j++) {
-      file.write((uint8_t*)&this->tableRow[i].tableEntry[j].targetPosition, sizeof(this->tableRow[i].tableEntry[j].targetPosition));
-      file.write((uint8_t*)&this->tableRow[i].tableEntry[j].readings, sizeof(this->tableRow[i].tableEntry[j].readings));
+      tableCells[i * POWERTABLE_WATT_SIZE + j] = {this->tableRow[i].tableEntry[j].targetPosition, this->tableRow[i].tableEntry[j].readings};
     }
   }
-
-  // Close the file
-  file.close();
-  lastSaveTime                    = millis();
+  lastSaveTime = ss2k->systemClock->nowMs();
+  if (!PowerTableFile::save(*ss2k->fileSystem, POWER_TABLE_FILENAME, TABLE_VERSION, tableCells, POWERTABLE_CAD_SIZE, POWERTABLE_WATT_SIZE, getNumReadings())) {
+    SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to create file");
+    return false;
+  }
   this->_hasBeenLoadedThisSession = true;
   return true;  // return successful
 }
@@ -985,16 +919,12 @@ bool PowerTable::reset() {
       this->tableRow[i].tableEntry[j].readings       = 0;
     }
   }
-  File file = LittleFS.open(POWER_TABLE_FILENAME, FILE_READ);
-  if (!file) {
+  bool existed = (ss2k->fileSystem->size(POWER_TABLE_FILENAME) >= 0);
+  if (!existed) {
     SS2K_LOG(POWERTABLE_LOG_TAG, "Failed to Load Power Table.");
-    file.close();
-    this->_save();
-    return false;
   }
-  file.close();
   this->_save();
-  return true;
+  return existed;
 }
 
 void PowerTable::toLog() {
@@ -1068,11 +998,43 @@ void ErgMode::computeResistance() {
   oldResistance = rtConfig->resistance;
 }
 
+// compute position for sim mode from the power the road would take at the speed the rider's gear gives.
+// Runs on every sensor update and on every shift.
+void ErgMode::computeSim() {
+  int newCadence = rtConfig->cad.getValue();
+  if (newCadence <= 0) {
+    // Nothing to look up without cadence. Fall back to following the grade.
+    rtConfig->setSimPosition(RETURN_ERROR);
+    return;
+  }
+  xSemaphoreTake(ss2k->drivetrainMutex, portMAX_DELAY);
+  float speed              = ss2k->drivetrain.speed(newCadence);  // m/s
+  Drivetrain::Gear current = ss2k->drivetrain.getCurrent();
+  xSemaphoreGive(ss2k->drivetrainMutex);
+
+  RoadModel::Conditions road = {rtConfig->getTargetIncline() / 10000, rtConfig->getWindSpeed(), rtConfig->getCrr(), rtConfig->getCw(), (float)userConfig->getRiderWeight()};
+  int targetWatts            = RoadModel::power(road, speed);
+  if (targetWatts < userConfig->getMinWatts()) {
+    targetWatts = userConfig->getMinWatts();
+  }
+  if ((userConfig->getMaxWatts() > 0) && (targetWatts > userConfig->getMaxWatts())) {
+    targetWatts = userConfig->getMaxWatts();
+  }
+
+  int32_t tableResult = powerTable->lookup(targetWatts, newCadence);
+  rtConfig->setSimPosition(tableResult);
+  SS2K_LOGD(ERG_MODE_LOG_TAG, "Sim %dx%d %.1fkm/h %dw PowerTable Result: %d", current.chainring, current.cog, speed * 3.6, targetWatts, tableResult);
+}
+
 // as a note, Trainer Road sends 50w target whenever the app is connected.
 void ErgMode::computeErg() {
   Measurement newWatts = rtConfig->watts;
   int newCadence       = rtConfig->cad.getValue();
 
+  if ((newCadence > MIN_ERG_CADENCE) && _lookAhead(newCadence)) {
+    return;
+  }
+
   // check for new torque value or new set point, if watts < 10 treat as faulty
   if ((this->watts.getTimestamp() == newWatts.getTimestamp() && this->setPoint == newWatts.getTarget()) || newWatts.getValue() < 10) {
     SS2K_LOGW(ERG_MODE_LOG_TAG, "Watts previously processed.");
@@ -1101,11 +1063,47 @@ void ErgMode::computeErg() {
   _inSetpointState(newCadence, newWatts);
 }
 
+bool ErgMode::_lookAhead(int newCadence) {
+  uint32_t now = ss2k->systemClock->nowMs();
+  if (this->lookaheadWatts != 0) {
+    if (rtConfig->watts.getTarget() == this->lookaheadWatts) {
+      return false;  // The app switched over. _setPointChangeState() takes it from here.
+    }
+    if ((int32_t)(now - this->lookaheadAt) < ERG_LOOKAHEAD_GRACE) {
+      return true;
+    }
+    SS2K_LOG(ERG_MODE_LOG_TAG, "Lookahead: %dw never started", this->lookaheadWatts);
+    this->lookaheadWatts = 0;
+  }
+
+  xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+  const ErgLookahead::Target* next = ergLookahead.next(now);
+  ErgLookahead::Target upcoming    = (next != nullptr) ? *next : ErgLookahead::Target{0, 0};
+  xSemaphoreGive(ergLookaheadMutex);
+  if ((next == nullptr) || (upcoming.watts == rtConfig->watts.getTarget())) {
+    return false;
+  }
+  int32_t tableResult = powerTable->lookup(upcoming.watts, newCadence);
+  if (tableResult == RETURN_ERROR) {
+    return false;
+  }
+  uint32_t travelMs = ss2k->motionPlanner.eta(ss2k->currentPosition, tableResult);
+  if (!ErgLookahead::shouldStart(now, upcoming, travelMs)) {
+    return false;
+  }
+  SS2K_LOG(ERG_MODE_LOG_TAG, "Lookahead: %dw in %dms. Moving to %d, %dms away", upcoming.watts, (int)(upcoming.atMs - now), tableResult, (int)travelMs);
+  rtConfig->setTargetIncline(tableResult);
+  this->lookaheadWatts = upcoming.watts;
+  this->lookaheadAt    = upcoming.atMs;
+  return true;
+}
+
 void ErgMode::_setPointChangeState(int newCadence, Measurement& newWatts) {
-  int32_t tableResult = powerTable->lookup(newWatts.getTarget(), newCadence);
+  bool sentAhead      = (newWatts.getTarget() == this->lookaheadWatts);
+  int32_t tableResult = sentAhead ? rtConfig->getTargetIncline() : powerTable->lookup(newWatts.getTarget(), newCadence);
 
-  // Sanity check for targets
-  if (tableResult != RETURN_ERROR) {
+  // Sanity check for targets. A knob sent ahead has already moved the watts toward the new target.
+  if ((tableResult != RETURN_ERROR) && !sentAhead) {
     if (rtConfig->watts.getValue() > newWatts.getTarget() && tableResult > rtConfig->getCurrentIncline()) {
       SS2K_LOG(ERG_MODE_LOG_TAG, "Table Result Failed High Test: %d", tableResult);
       tableResult = RETURN_ERROR;
@@ -1118,17 +1116,16 @@ void ErgMode::_setPointChangeState(int newCadence, Measurement& newWatts) {
 
   // Handle return errors
   if (tableResult == RETURN_ERROR) {
-    int wattChange  = newWatts.getTarget() - newWatts.getValue();
-    float deviation = ((float)wattChange * 100.0) / ((float)newWatts.getTarget());
-    float factor    = abs(deviation) > 10 ? userConfig->getERGSensitivity() * 2 : userConfig->getERGSensitivity() / 2;
-    tableResult     = rtConfig->getCurrentIncline() + (wattChange * factor);
+    tableResult = ErgControl::setPointChange(rtConfig->getCurrentIncline(), newWatts.getValue(), newWatts.getTarget(), userConfig->getERGSensitivity());
   }
 
   SS2K_LOG(ERG_MODE_LOG_TAG, "SetPoint changed:%dw PowerTable Result: %d", newWatts.getTarget(), tableResult);
   _updateValues(newCadence, newWatts, tableResult);
 
-  if (rtConfig->getTargetIncline() != rtConfig->getCurrentIncline()) {  // add some time to wait while the knob moves to target position.
-    int timeToAdd = abs(rtConfig->getCurrentIncline() - rtConfig->getTargetIncline());
+  if (sentAhead) {
+    SS2K_LOG(ERG_MODE_LOG_TAG, "Knob was sent ahead for %dw", newWatts.getTarget());
+  } else if (rtConfig->getTargetIncline() != rtConfig->getCurrentIncline()) {  // add some time to wait while the knob moves to target position.
+    int timeToAdd = ss2k->motionPlanner.eta(rtConfig->getCurrentIncline(), rtConfig->getTargetIncline());
     if (timeToAdd > 5000) {  // 5 seconds
       SS2K_LOG(ERG_MODE_LOG_TAG, "Capping ERG seek time to 5 seconds");
       timeToAdd = 5000;
@@ -1139,13 +1136,7 @@ void ErgMode::_setPointChangeState(int newCadence, Measurement& newWatts) {
 }
 
 void ErgMode::_inSetpointState(int newCadence, Measurement& newWatts) {
-  int watts = newWatts.getValue();
-
-  int wattChange  = newWatts.getTarget() - watts;  // setpoint_form_trainer - current_torque => Amount to increase or decrease incline
-  float deviation = ((float)wattChange * 100.0) / ((float)newWatts.getTarget());
-
-  float factor     = abs(deviation) > 10 ? userConfig->getERGSensitivity() : userConfig->getERGSensitivity() / 2;
-  float newIncline = rtConfig->getCurrentIncline() + (wattChange * factor);
+  float newIncline = ErgControl::inSetpoint(rtConfig->getCurrentIncline(), newWatts.getValue(), newWatts.getTarget(), userConfig->getERGSensitivity());
 
   _updateValues(newCadence, newWatts, newIncline);
 }
@@ -1157,6 +1148,9 @@ void ErgMode::_updateValues(int newCadence, Measurement& newWatts, float newIncl
   this->watts    = newWatts;
   this->setPoint = newWatts.getTarget();
   this->cadence  = newCadence;
+  if (this->setPoint == this->lookaheadWatts) {
+    this->lookaheadWatts = 0;
+  }
 }
 
 bool ErgMode::_userIsSpinning(int cadence, float incline) {
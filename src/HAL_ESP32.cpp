@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "HAL_ESP32.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <TMCStepper.h>
+#include "FastAccelStepper.h"
+#include "BLE_Common.h"
+
+uint32_t EspClock::nowMs() { return millis(); }
+
+uint32_t EspClock::nowUs() { return micros(); }
+
+void EspMotor::attach(FastAccelStepper *stepper, int dirPin) {
+  this->stepper = stepper;
+  this->dirPin  = dirPin;
+}
+
+int32_t EspMotor::getCurrentPosition() { return stepper ? stepper->getCurrentPosition() : 0; }
+
+void EspMotor::setCurrentPosition(int32_t position) {
+  if (stepper) {
+    stepper->setCurrentPosition(position);
+  }
+}
+
+int32_t EspMotor::getTargetPosition() { return stepper ? stepper->getPositionAfterCommandsCompleted() : 0; }
+
+bool EspMotor::isRunning() { return stepper ? stepper->isRunning() : false; }
+
+void EspMotor::moveTo(int32_t position) {
+  if (stepper) {
+    stepper->moveTo(position);
+  }
+}
+
+void EspMotor::stopMove() {
+  if (stepper) {
+    stepper->stopMove();
+  }
+}
+
+void EspMotor::setSpeed(uint32_t stepsPerSecond) {
+  if (stepper) {
+    stepper->setSpeedInHz(stepsPerSecond);
+  }
+}
+
+void EspMotor::setAcceleration(uint32_t stepsPerSec2) {
+  if (stepper) {
+    stepper->setAcceleration(stepsPerSec2);
+  }
+}
+
+void EspMotor::setHoldEnabled(bool hold) {
+  if (!stepper) {
+    return;
+  }
+  if (hold) {
+    stepper->setAutoEnable(false);
+    stepper->enableOutputs();
+  } else {
+    stepper->setAutoEnable(true);
+  }
+}
+
+void EspMotor::setDirection(bool direction) {
+  if (stepper) {
+    stepper->setDirectionPin(dirPin, direction);
+  }
+}
+
+void EspMotorDriver::begin() {
+  mutex = xSemaphoreCreateMutex();
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  driver.begin();
+  driver.pdn_disable(true);
+  driver.mstep_reg_select(true);
+  xSemaphoreGive(mutex);
+}
+
+void EspMotorDriver::applyDefaults(uint8_t pwrScaler) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  driver.microsteps(4);  // Set microsteps to 1/8th
+  driver.irun(pwrScaler);
+  driver.ihold((uint8_t)(pwrScaler * .5));  // hold current % 0-DRIVER_MAX_PWR_SCALER
+  driver.iholddelay(10);                    // Controls the number of clock cycles for motor
+  // power down after standstill is detected
+  driver.TPOWERDOWN(128);
+  driver.toff(5);
+  xSemaphoreGive(mutex);
+}
+
+void EspMotorDriver::setCurrent(uint16_t runMa, float holdMultiplier) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  driver.rms_current(runMa, holdMultiplier);
+  xSemaphoreGive(mutex);
+}
+
+uint16_t EspMotorDriver::getCurrentScale() {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint16_t scale = driver.cs_actual();
+  xSemaphoreGive(mutex);
+  return scale;
+}
+
+void EspMotorDriver::setStealthChop(bool enabled) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  driver.en_spreadCycle(!enabled);
+  driver.pwm_autoscale(enabled);
+  driver.pwm_autograd(enabled);
+  xSemaphoreGive(mutex);
+}
+
+bool EspMotorDriver::readStatus(uint32_t &status) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  status = driver.DRV_STATUS();
+  // 0xFFFFFFFF is what a disconnected UART reads as
+  bool valid = !driver.CRCerror && (status != 0xFFFFFFFF);
+  xSemaphoreGive(mutex);
+  return valid;
+}
+
+int32_t LittleFSFileSystem::size(const char *path) {
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) {
+    return -1;
+  }
+  int32_t size = file.size();
+  file.close();
+  return size;
+}
+
+int32_t LittleFSFileSystem::read(const char *path, uint32_t offset, uint8_t *buffer, size_t length) {
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) {
+    return -1;
+  }
+  int32_t count = file.seek(offset) ? file.read(buffer, length) : 0;
+  file.close();
+  return count;
+}
+
+bool LittleFSFileSystem::write(const char *path, const uint8_t *data, size_t length) {
+  File file = LittleFS.open(path, FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool written = (file.write(data, length) == length);
+  file.close();
+  return written;
+}
+
+bool LittleFSFileSystem::append(const char *path, const uint8_t *data, size_t length) {
+  File file = LittleFS.open(path, FILE_APPEND);
+  if (!file) {
+    return false;
+  }
+  bool written = (file.write(data, length) == length);
+  file.close();
+  return written;
+}
+
+bool LittleFSFileSystem::remove(const char *path) { return LittleFS.remove(path); }
+
+int NimBLELink::connectedClients() { return connectedClientCount(); }
+
+void NimBLELink::writeControlPoint(const uint8_t *data, size_t length) { spinBLEClient.FTMSControlPointWrite(data, length); }
@@ -11,6 +11,9 @@
 #include "HTTP_Server_Basic.h"
 #include "cert.h"
 #include "SS2KLog.h"
+#include "ERG_Mode.h"
+#include "WorkoutRunner.h"
+#include "SessionRecorder.h"
 #include <WebServer.h>
 #include <HTTPClient.h>
 #include <HTTPUpdate.h>
@@ -23,8 +26,22 @@
 #include <ArduinoJson.h>
 #include <BLE_Custom_Characteristic.h>
 #include <WiFiProv.h>
+#include <esp_ota_ops.h>
+#include <FirmwarePatch.h>
+#include <AssetCache.h>
 
 File fsUploadFile;
+AssetCache assetCache(HTTP_CACHE_BUDGET, HTTP_CACHE_MAX_FILE);
+
+// Compressed and delta firmware uploads are expanded on the way into the OTA partition.
+static FirmwarePatch *firmwarePatch = nullptr;
+static bool firmwarePatching        = false;
+
+static bool firmwarePatchRead(void *context, uint32_t offset, uint8_t *data, size_t length) {
+  return esp_partition_read(esp_ota_get_running_partition(), offset, data, length) == ESP_OK;
+}
+
+static bool firmwarePatchWrite(void *context, const uint8_t *data, size_t length) { return Update.write((uint8_t *)data, length) == length; }
 
 IPAddress myIP;
 
@@ -35,6 +52,11 @@ HTTP_Server httpServer;
 WiFiClientSecure client;
 WebServer server(80);
 
+// Requests are served from their own task so a slow client only ever stalls the web server, never the main loop.
+TaskHandle_t webClientTask       = NULL;
+SemaphoreHandle_t webServerMutex = NULL;
+volatile bool webRequestActive   = false;
+
 #ifdef USE_TELEGRAM
 #include <UniversalTelegramBot.h>
 TaskHandle_t telegramTask;
@@ -141,6 +163,8 @@ void stopWifi() {
 
 void HTTP_Server::start() {
   server.enableCORS(true);
+  const char *assetHeaders[] = {"Accept-Encoding", "If-None-Match"};
+  server.collectHeaders(assetHeaders, 2);
   server.onNotFound(handleIndexFile);
 
   /***************************Begin Handlers*******************/
@@ -194,99 +218,183 @@ void HTTP_Server::start() {
 
   server.on("/hrslider", []() {
     String value = server.arg("value");
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if (value == "enable") {
       rtConfig->hr.setSimulate(true);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "HR Simulator turned on");
     } else if (value == "disable") {
       rtConfig->hr.setSimulate(false);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "HR Simulator turned off");
     } else {
       rtConfig->hr.setValue(value.toInt());
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "HR is now: %d", rtConfig->hr.getValue());
-      server.send(200, "text/plain", "OK");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
   });
 
   server.on("/wattsslider", []() {
     String value = server.arg("value");
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if (value == "enable") {
       rtConfig->watts.setSimulate(true);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Watt Simulator turned on");
     } else if (value == "disable") {
       rtConfig->watts.setSimulate(false);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Watt Simulator turned off");
     } else {
       rtConfig->watts.setValue(value.toInt());
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Watts are now: %d", rtConfig->watts.getValue());
-      server.send(200, "text/plain", "OK");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
   });
 
   server.on("/cadslider", []() {
     String value = server.arg("value");
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if (value == "enable") {
       rtConfig->cad.setSimulate(true);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "CAD Simulator turned on");
     } else if (value == "disable") {
       rtConfig->cad.setSimulate(false);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "CAD Simulator turned off");
     } else {
       rtConfig->cad.setValue(value.toInt());
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "CAD is now: %d", rtConfig->cad.getValue());
-      server.send(200, "text/plain", "OK");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
   });
 
   server.on("/ergmode", []() {
     String value = server.arg("value");
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if (value == "enable") {
       rtConfig->setFTMSMode(FitnessMachineControlPointProcedure::SetTargetPower);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "ERG Mode turned on");
     } else {
       rtConfig->setFTMSMode(FitnessMachineControlPointProcedure::RequestControl);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "ERG Mode turned off");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
   });
 
   server.on("/targetwattsslider", []() {
     String value = server.arg("value");
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if (value == "enable") {
       rtConfig->setSimTargetWatts(true);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Target Watts Simulator turned on");
     } else if (value == "disable") {
       rtConfig->setSimTargetWatts(false);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Target Watts Simulator turned off");
     } else {
       rtConfig->watts.setTarget(value.toInt());
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Target Watts are now: %d", rtConfig->watts.getTarget());
-      server.send(200, "text/plain", "OK");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
+  });
+
+  // Announce an upcoming ERG target: ?watts=300&in=30 (seconds). ?clear empties the list. Answers with what's pending.
+  server.on("/ergLookahead", []() {
+    uint32_t now = millis();
+    xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+    if (server.hasArg("clear")) {
+      ergLookahead.clear();
+    }
+    if (!server.arg("watts").isEmpty() && !server.arg("in").isEmpty()) {
+      int watts = server.arg("watts").toInt();
+      float in  = server.arg("in").toFloat();
+      if ((watts <= 0) || (watts > 2000) || (in <= 0) || (in > 3600) || !ergLookahead.schedule(now, in * 1000, watts)) {
+        xSemaphoreGive(ergLookaheadMutex);
+        server.send(400, "text/plain", "Lookahead target rejected");
+        return;
+      }
+      SS2K_LOG(HTTP_SERVER_LOG_TAG, "Lookahead %dw in %.1fs", watts, in);
+    }
+    ergLookahead.next(now);
+    String json = "[";
+    for (size_t i = 0; i < ergLookahead.getCount(); i++) {
+      json += (i ? "," : "");
+      json += "{\"in\":" + String((ergLookahead.get(i).atMs - now) / 1000.0, 1) + ",\"watts\":" + String(ergLookahead.get(i).watts) + "}";
+    }
+    xSemaphoreGive(ergLookaheadMutex);
+    server.send(200, "application/json", json + "]");
+  });
+
+  // Control the stored workout: ?action=start|pause|resume|stop|load. Upload a new /workout.bin first to change it.
+  server.on("/workout", []() {
+    String action = server.arg("action");
+    if (!action.isEmpty()) {
+      const char *actions[] = {"stop", "start", "pause", "resume", "load"};  // Indexed by workout_ command
+      bool accepted         = false;
+      for (uint8_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++) {
+        if (action == actions[i]) {
+          accepted = workoutRunner.control(i);
+        }
+      }
+      if (!accepted) {
+        server.send(400, "text/plain", "Workout " + action + " rejected");
+        return;
+      }
+    }
+    server.send(200, "application/json", workoutRunner.getProgressJSON());
+  });
+
+  // Session capture: ?action=start|stop|replay|stopreplay. Download the recording from /capture.bin.
+  server.on("/capture", []() {
+    String action = server.arg("action");
+    bool accepted = true;
+    if (action == "start") {
+      accepted = sessionRecorder.startRecording();
+    } else if (action == "stop") {
+      sessionRecorder.stopRecording();
+    } else if (action == "replay") {
+      accepted = sessionRecorder.startReplay();
+    } else if (action == "stopreplay") {
+      sessionRecorder.stopReplay();
+    } else if (!action.isEmpty()) {
+      accepted = false;
+    }
+    if (!accepted) {
+      server.send(400, "text/plain", "Capture " + action + " rejected");
+      return;
+    }
+    server.send(200, "application/json", sessionRecorder.getStatusJSON());
+  });
+
+  // Not through the asset cache: the file changes while it records.
+  server.on(CAPTURE_FILENAME, []() {
+    File file = LittleFS.open(CAPTURE_FILENAME, FILE_READ);
+    if (!file) {
+      server.send(404, "text/plain", "No capture recorded");
+      return;
+    }
+    server.sendHeader("Cache-Control", "no-store");
+    server.streamFile(file, "application/octet-stream");
+    file.close();
   });
 
   server.on("/shift", []() {
     int value = server.arg("value").toInt();
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     if ((value > -10) && (value < 10)) {
       rtConfig->setShifterPosition(rtConfig->getShifterPosition() + value);
-      server.send(200, "text/plain", "OK");
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Shift From HTML");
     } else {
       rtConfig->setShifterPosition(value);
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Invalid HTML Shift");
-      server.send(200, "text/plain", "OK");
     }
+    xSemaphoreGive(ss2k->configMutex);
+    server.send(200, "text/plain", "OK");
     // BLE Shift notifications are handles by the shift processing in main.cpp
   });
 
+  server.on("/control", HTTP_POST, handleControl);
+
   server.on("/configJSON", []() {
     String tString;
     tString = userConfig->returnJSON();
@@ -299,6 +407,65 @@ void HTTP_Server::start() {
     server.send(200, "text/plain", tString);
   });
 
+  server.on("/positionHealthJSON", []() {
+    const PositionHealth::Counters &counters = ss2k->positionHealth.getCounters();
+    DynamicJsonDocument doc(512);
+    doc["trusted"]           = ss2k->positionHealth.isTrusted();
+    doc["status"]            = ss2k->positionHealth.getStatus();
+    doc["reads"]             = counters.reads;
+    doc["readErrors"]        = counters.readErrors;
+    doc["overtempWarnings"]  = counters.overtempWarnings;
+    doc["overtemps"]         = counters.overtemps;
+    doc["shorts"]            = counters.shorts;
+    doc["openLoads"]         = counters.openLoads;
+    doc["faultsWhileMoving"] = counters.faultsWhileMoving;
+    doc["rehomes"]           = counters.rehomes;
+    doc["rehomedSteps"]      = counters.rehomedSteps;
+    String tString;
+    serializeJson(doc, tString);
+    server.send(200, "text/plain", tString);
+  });
+
+  server.on("/shifterJSON", []() {
+    const ShiftGestures::Counters &counters = ss2k->shiftGestures.getCounters();
+    DynamicJsonDocument doc(512);
+    doc["shifts"]          = counters.shifts;
+    doc["holds"]           = counters.holds;
+    doc["doubleTaps"]      = counters.doubleTaps;
+    doc["bounces"]         = counters.bounces;
+    doc["dropped"]         = ss2k->shiftQueue.getDropped() + counters.overflows;
+    doc["toLoopLastUs"]    = ss2k->shiftToLoop.last;
+    doc["toLoopMaxUs"]     = ss2k->shiftToLoop.max;
+    doc["toMotorLastUs"]   = ss2k->shiftToMotor.last;
+    doc["toMotorMeanUs"]   = ss2k->shiftToMotor.mean();
+    doc["toMotorMaxUs"]    = ss2k->shiftToMotor.max;
+    doc["toMotorMeasured"] = ss2k->shiftToMotor.count;
+    String tString;
+    serializeJson(doc, tString);
+    server.send(200, "text/plain", tString);
+  });
+
+  server.on("/sensorsJSON", []() {
+    String tString;
+    tString = getSensorFusionJSON();
+    server.send(200, "text/plain", tString);
+  });
+
+  server.on("/thermalJSON", []() {
+    DynamicJsonDocument doc(256);
+    doc["level"]       = ss2k->thermalPlan.level;
+    doc["temperature"] = ss2k->thermalModel.getTemperature();
+    doc["ambient"]     = ss2k->thermalModel.getAmbient();
+    doc["rise"]        = ss2k->thermalModel.getRise();
+    doc["duty"]        = ss2k->thermalModel.getDuty();
+    doc["runCurrent"]  = ss2k->thermalPlan.runCurrent;
+    doc["holdPercent"] = ss2k->thermalPlan.holdPercent;
+    doc["stealthChop"] = ss2k->thermalPlan.stealthChop;
+    String tString;
+    serializeJson(doc, tString);
+    server.send(200, "text/plain", tString);
+  });
+
   server.on("/PWCJSON", []() {
     String tString;
     tString = userPWC->returnJSON();
@@ -311,7 +478,7 @@ void HTTP_Server::start() {
   });
 
   server.on("/OTAIndex", HTTP_GET, []() {
-    ss2k->stopTasks();
+    ss2k->stopTasksFlag = true;
     server.sendHeader("Connection", "close");
     server.send(200, "text/html", OTAServerIndex);
   });
@@ -325,7 +492,7 @@ void HTTP_Server::start() {
       },
       []() {
         HTTPUpload &upload = server.upload();
-        if (upload.filename == String("firmware.bin").c_str()) {
+        if ((upload.filename == String("firmware.bin").c_str()) || (upload.filename == String("firmware.patch").c_str())) {
           if (upload.status == UPLOAD_FILE_START) {
             SS2K_LOG(HTTP_SERVER_LOG_TAG, "Update: %s", upload.filename.c_str());
             if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {  // start with max
@@ -333,13 +500,32 @@ void HTTP_Server::start() {
               Update.printError(Serial);
             }
           } else if (upload.status == UPLOAD_FILE_WRITE) {
-            /* flashing firmware to ESP*/
-            if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+            if (upload.totalSize == 0) {
+              firmwarePatching = FirmwarePatch::isPatch(upload.buf, upload.currentSize);
+              if (firmwarePatching) {
+                SS2K_LOG(HTTP_SERVER_LOG_TAG, "Expanding firmware patch");
+                if (firmwarePatch == nullptr) {
+                  firmwarePatch = new FirmwarePatch(firmwarePatchRead, firmwarePatchWrite, nullptr);
+                }
+                firmwarePatch->begin();
+              }
+            }
+            if (firmwarePatching) {
+              if (!firmwarePatch->write(upload.buf, upload.currentSize) && !Update.hasError()) {
+                SS2K_LOG(HTTP_SERVER_LOG_TAG, "Patch failed: %s", firmwarePatch->getErrorString());
+                Update.abort();
+              }
+            } else if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+              /* flashing firmware to ESP*/
               Update.printError(Serial);
             }
           } else if (upload.status == UPLOAD_FILE_END) {
-            if (Update.end(true)) {  // true to set the size to the
-                                     // current progress
+            if (firmwarePatching && !firmwarePatch->finish()) {
+              SS2K_LOG(HTTP_SERVER_LOG_TAG, "Patch failed: %s", firmwarePatch->getErrorString());
+              Update.abort();
+              server.send(500, "text/plain", String("Firmware patch failed: ") + firmwarePatch->getErrorString());
+            } else if (Update.end(true)) {  // true to set the size to the
+                                            // current progress
               server.send(200, "text/plain", "Firmware Uploaded Successfully. Rebooting...");
               ESP.restart();
             } else {
@@ -386,6 +572,11 @@ void HTTP_Server::start() {
             if (fsUploadFile) {
               fsUploadFile.close();
             }
+            String filename = upload.filename;
+            if (!filename.startsWith("/")) {
+              filename = "/" + filename;
+            }
+            assetChanged(filename);
             SS2K_LOG(HTTP_SERVER_LOG_TAG, "handleFileUpload Size: %zu", upload.totalSize);
             server.send(200, "text/plain", String(upload.filename + " Uploaded Successfully."));
           }
@@ -404,25 +595,118 @@ void HTTP_Server::start() {
                           &telegramTask,    /* Task handle to keep track of created task */
                           1);               /* pin task to core 1 */
 #endif                                      // USE_TELEGRAM
+  if (webServerMutex == NULL) {
+    webServerMutex = xSemaphoreCreateMutex();
+  }
+  xSemaphoreTake(webServerMutex, portMAX_DELAY);
   server.begin();
+  xSemaphoreGive(webServerMutex);
+  if (webClientTask == NULL) {
+    xTaskCreatePinnedToCore(HTTP_Server::webClientUpdate, /* Task function. */
+                            "webClientUpdate",            /* name of task. */
+                            WEBSERVER_STACK,              /* Stack size of task */
+                            NULL,                         /* parameter of the task */
+                            1,                            /* priority of the task - below the main loop so it always yields to it */
+                            &webClientTask,               /* Task handle to keep track of created task */
+                            1);                           /* pin task to core */
+  }
   SS2K_LOG(HTTP_SERVER_LOG_TAG, "HTTP server started");
 }
 
-void HTTP_Server::webClientUpdate() {
-  static unsigned long int _webClientTimer = millis();
-  if (millis() - _webClientTimer > WEBSERVER_DELAY) {
-    _webClientTimer                = millis();
-    static unsigned long mDnsTimer = millis();  // NOLINT: There is no overload in String for uint64_t
+void HTTP_Server::webClientUpdate(void *pvParameters) {
+  static unsigned long mDnsTimer = millis();  // NOLINT: There is no overload in String for uint64_t
+  for (;;) {
+    // Held for the whole request so stop() can't close the server out from under a handler.
+    xSemaphoreTake(webServerMutex, portMAX_DELAY);
+    webRequestActive = true;
     server.handleClient();
+    webRequestActive = false;
     if (WiFi.getMode() != WIFI_MODE_STA) {
       dnsServer.processNextRequest();
     }
+    xSemaphoreGive(webServerMutex);
     // Keep MDNS alive
     if ((millis() - mDnsTimer) > 30000) {
       MDNS.addServiceTxt("http", "_tcp", "lf", String(mDnsTimer));
       mDnsTimer = millis();
     }
+    vTaskDelay(WEBSERVER_DELAY / portTICK_PERIOD_MS);
+  }
+}
+
+static bool controlIntIsValid(JsonVariantConst value, int min, int max) { return value.isNull() || (value.is<int>() && (value.as<int>() >= min) && (value.as<int>() <= max)); }
+
+static bool controlBoolIsValid(JsonVariantConst value) { return value.isNull() || value.is<bool>(); }
+
+// One request for everything the simulator page changed, e.g. {"simHr":true,"hr":120,"shift":-1}.
+// Keys match /runtimeConfigJSON, plus "erg" and a relative "shift". Nothing is applied unless the whole batch is valid.
+void HTTP_Server::handleControl() {
+  static const char *const keys[] = {"hr", "simHr", "watts", "simWatts", "cad", "simCad", "targetWatts", "simTargetWatts", "erg", "shift"};
+  StaticJsonDocument<CONTROL_JSON_SIZE> doc;
+  DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  if (error || !doc.is<JsonObject>()) {
+    SS2K_LOG(HTTP_SERVER_LOG_TAG, "Bad control batch: %s", error.c_str());
+    server.send(400, "text/plain", "Bad control batch");
+    return;
+  }
+  JsonObject batch = doc.as<JsonObject>();
+  for (JsonPair control : batch) {
+    bool known = false;
+    for (const char *key : keys) {
+      known |= (strcmp(control.key().c_str(), key) == 0);
+    }
+    if (!known) {
+      SS2K_LOG(HTTP_SERVER_LOG_TAG, "Unknown control: %s", control.key().c_str());
+      server.send(400, "text/plain", "Unknown control");
+      return;
+    }
   }
+  if (!controlIntIsValid(batch["hr"], 0, 250) || !controlIntIsValid(batch["watts"], 0, 2000) || !controlIntIsValid(batch["cad"], 0, 250) ||
+      !controlIntIsValid(batch["targetWatts"], 0, 2000) || !controlIntIsValid(batch["shift"], -9, 9) || !controlBoolIsValid(batch["simHr"]) ||
+      !controlBoolIsValid(batch["simWatts"]) || !controlBoolIsValid(batch["simCad"]) || !controlBoolIsValid(batch["simTargetWatts"]) || !controlBoolIsValid(batch["erg"])) {
+    SS2K_LOG(HTTP_SERVER_LOG_TAG, "Control out of range");
+    server.send(400, "text/plain", "Control out of range");
+    return;
+  }
+
+  // Everything was validated above, so a bad batch changes nothing. The loop sees all of it or none of it.
+  xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
+  if (!batch["simHr"].isNull()) {
+    rtConfig->hr.setSimulate(batch["simHr"].as<bool>());
+  }
+  if (!batch["hr"].isNull()) {
+    rtConfig->hr.setValue(batch["hr"].as<int>());
+  }
+  if (!batch["simWatts"].isNull()) {
+    rtConfig->watts.setSimulate(batch["simWatts"].as<bool>());
+  }
+  if (!batch["watts"].isNull()) {
+    rtConfig->watts.setValue(batch["watts"].as<int>());
+  }
+  if (!batch["simCad"].isNull()) {
+    rtConfig->cad.setSimulate(batch["simCad"].as<bool>());
+  }
+  if (!batch["cad"].isNull()) {
+    rtConfig->cad.setValue(batch["cad"].as<int>());
+  }
+  if (!batch["simTargetWatts"].isNull()) {
+    rtConfig->setSimTargetWatts(batch["simTargetWatts"].as<bool>());
+  }
+  if (!batch["targetWatts"].isNull()) {
+    rtConfig->watts.setTarget(batch["targetWatts"].as<int>());
+  }
+  if (!batch["erg"].isNull()) {
+    rtConfig->setFTMSMode(batch["erg"].as<bool>() ? FitnessMachineControlPointProcedure::SetTargetPower : FitnessMachineControlPointProcedure::RequestControl);
+  }
+  if (!batch["shift"].isNull()) {
+    // BLE Shift notifications are handled by the shift processing in main.cpp
+    rtConfig->setShifterPosition(rtConfig->getShifterPosition() + batch["shift"].as<int>());
+  }
+  String state = rtConfig->returnJSON();
+  xSemaphoreGive(ss2k->configMutex);
+
+  // Answer with the new state so the page doesn't need another round trip to show it.
+  server.send(200, "application/json", state);
 }
 
 void HTTP_Server::handleBTScanner() {
@@ -431,31 +715,18 @@ void HTTP_Server::handleBTScanner() {
 }
 
 void HTTP_Server::handleIndexFile() {
-  String filename = "/index.html";
-  if (LittleFS.exists(filename)) {
-    File file = LittleFS.open(filename, FILE_READ);
-    server.streamFile(file, "text/html");
-    file.close();
-    SS2K_LOG(HTTP_SERVER_LOG_TAG, "Served %s", filename.c_str());
-  } else {
-    SS2K_LOG(HTTP_SERVER_LOG_TAG, "%s not found. Sending builtin Index.html", filename.c_str());
+  if (!serveAsset("/index.html")) {
+    SS2K_LOG(HTTP_SERVER_LOG_TAG, "/index.html not found. Sending builtin Index.html");
     server.send(200, "text/html", noIndexHTML);
   }
 }
 
 void HTTP_Server::handleLittleFSFile() {
   String filename = server.uri();
-  int dotPosition = filename.lastIndexOf(".");
-  String fileType = filename.substring((dotPosition + 1), filename.length());
-  if (LittleFS.exists(filename)) {
-    File file = LittleFS.open(filename, FILE_READ);
-    if (fileType == "gz") {
-      fileType = "html";  // no need to change content type as it's done automatically by .streamfile below VV
-    }
-    server.streamFile(file, "text/" + fileType);
-    file.close();
-    SS2K_LOG(HTTP_SERVER_LOG_TAG, "Served %s", filename.c_str());
-  } else if (!LittleFS.exists("/index.html")) {
+  if (serveAsset(filename)) {
+    return;
+  }
+  if (!assetExists("/index.html")) {
     SS2K_LOG(HTTP_SERVER_LOG_TAG, "%s not found and no filesystem. Sending builtin index.html", filename.c_str());
     handleIndexFile();
   } else {
@@ -465,11 +736,136 @@ void HTTP_Server::handleLittleFSFile() {
   }
 }
 
+static String assetContentType(String path) {
+  if (path.endsWith(".gz")) {
+    path = path.substring(0, path.length() - 3);
+  }
+  if (path.endsWith(".html")) {
+    return "text/html";
+  } else if (path.endsWith(".css")) {
+    return "text/css";
+  } else if (path.endsWith(".js")) {
+    return "application/javascript";
+  } else if (path.endsWith(".json")) {
+    return "application/json";
+  } else if (path.endsWith(".ico")) {
+    return "image/x-icon";
+  }
+  return "text/plain";
+}
+
+// Hash the file the first time it's asked for. The hash is the ETag until the file changes.
+static AssetCache::Entry *loadAsset(const String &path, bool acceptsGzip) {
+  bool hasGzip  = !path.endsWith(".gz") && LittleFS.exists(path + ".gz");
+  bool hasPlain = LittleFS.exists(path);
+  bool gzip     = hasGzip && acceptsGzip;
+  // Only the compressed copy exists and the client can't read it.
+  if (!gzip && !hasPlain) {
+    return nullptr;
+  }
+  File file = LittleFS.open(gzip ? path + ".gz" : path, FILE_READ);
+  if (!file) {
+    return nullptr;
+  }
+  uint32_t etag = AssetCache::HASH_SEED;
+  uint8_t buffer[256];
+  size_t length;
+  while ((length = file.read(buffer, sizeof(buffer))) > 0) {
+    etag = AssetCache::hash(etag, buffer, length);
+  }
+  uint32_t size = file.size();
+  file.close();
+  return assetCache.add(path.c_str(), gzip, etag, size);
+}
+
+bool HTTP_Server::serveAsset(const String &path) {
+  unsigned long started    = micros();
+  AssetCache::Stats &stats = assetCache.getStats();
+  bool acceptsGzip         = AssetCache::acceptsGzip(server.header("Accept-Encoding").c_str());
+
+  AssetCache::Entry *entry = assetCache.find(path.c_str(), acceptsGzip);
+  if ((entry == nullptr) && acceptsGzip) {
+    entry = assetCache.find(path.c_str(), false);
+  }
+  if (entry == nullptr) {
+    entry = loadAsset(path, acceptsGzip);
+  }
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->hits++;
+  stats.requests++;
+
+  char etag[AssetCache::ETAG_LENGTH];
+  AssetCache::formatEtag(entry->etag, etag);
+  server.sendHeader("ETag", etag);
+  // The same URL is gzipped for some clients and not others, so caches have to key on the encoding.
+  server.sendHeader("Vary", "Accept-Encoding");
+  // Always revalidate. With the ETag that costs a 304 and no body.
+  server.sendHeader("Cache-Control", "no-cache");
+  if (AssetCache::etagMatches(server.header("If-None-Match").c_str(), entry->etag)) {
+    server.send(304);
+    stats.notModified++;
+    SS2K_LOG(HTTP_SERVER_LOG_TAG, "Served %s: not modified, %luus", path.c_str(), micros() - started);
+    return true;
+  }
+
+  String filename    = entry->gzip ? path + ".gz" : path;
+  String contentType = assetContentType(path);
+  const char *source = "ram";
+  if (entry->data == nullptr) {
+    File file = LittleFS.open(filename, FILE_READ);
+    if (!file) {
+      assetCache.invalidate(path.c_str());
+      return false;
+    }
+    uint8_t *data = assetCache.reserve(entry);
+    if (data == nullptr) {
+      server.streamFile(file, contentType);
+      file.close();
+      stats.bytesServed += entry->size;
+      SS2K_LOG(HTTP_SERVER_LOG_TAG, "Served %s: %d bytes from flash, %luus", filename.c_str(), entry->size, micros() - started);
+      return true;
+    }
+    size_t length = file.read(data, entry->size);
+    file.close();
+    if (length != entry->size) {
+      assetCache.invalidate(path.c_str());
+      return false;
+    }
+    source = "flash";
+  } else {
+    stats.ramHits++;
+  }
+
+  if (filename.endsWith(".gz")) {
+    server.sendHeader("Content-Encoding", "gzip");
+  }
+  server.send_P(200, contentType.c_str(), (const char *)entry->data, entry->size);
+  stats.bytesServed += entry->size;
+  SS2K_LOG(HTTP_SERVER_LOG_TAG, "Served %s: %d bytes from %s, %luus", filename.c_str(), entry->size, source, micros() - started);
+  return true;
+}
+
+bool HTTP_Server::assetExists(const String &path) { return LittleFS.exists(path) || LittleFS.exists(path + ".gz"); }
+
+void HTTP_Server::assetChanged(const String &path) {
+  if (path.endsWith(".gz")) {
+    assetCache.invalidate(path.substring(0, path.length() - 3).c_str());
+  } else {
+    // A new plain file replaces the precompressed one from the filesystem image.
+    LittleFS.remove(path + ".gz");
+  }
+  assetCache.invalidate(path.c_str());
+}
+
 void HTTP_Server::settingsProcessor() {
   String tString;
   bool wasBTUpdate       = false;
   bool wasSettingsUpdate = false;
   bool reboot            = false;
+  // Held until the whole form is applied; the drivetrain mutex below is only ever taken inside it.
+  xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
   if (!server.arg("ssid").isEmpty()) {
     tString = server.arg("ssid");
     tString.trim();
@@ -496,7 +892,7 @@ void HTTP_Server::settingsProcessor() {
     uint64_t stepperPower = server.arg("stepperPower").toInt();
     if (stepperPower >= 500 && stepperPower <= 2000) {
       userConfig->setStepperPower(stepperPower);
-      ss2k->updateStepperPower();
+      ss2k->driverSettingsFlag = true;
     }
   }
   if (!server.arg("maxWatts").isEmpty()) {
@@ -511,6 +907,35 @@ void HTTP_Server::settingsProcessor() {
       userConfig->setMinWatts(minWatts);
     }
   }
+  if (!server.arg("riderWeight").isEmpty()) {
+    int riderWeight = server.arg("riderWeight").toInt();
+    if (riderWeight >= 30 && riderWeight <= 250) {
+      userConfig->setRiderWeight(riderWeight);
+    }
+  }
+  if (!server.arg("ftp").isEmpty()) {
+    int ftp = server.arg("ftp").toInt();
+    if (ftp >= 50 && ftp <= 600) {
+      userConfig->setFtp(ftp);
+    }
+  }
+  // Gearing is only kept if the drivetrain accepts it
+  if (!server.arg("chainrings").isEmpty() || !server.arg("cassette").isEmpty() || !server.arg("wheelCircumference").isEmpty()) {
+    String chainrings      = server.arg("chainrings").isEmpty() ? String(userConfig->getChainrings()) : server.arg("chainrings");
+    String cassette        = server.arg("cassette").isEmpty() ? String(userConfig->getCassette()) : server.arg("cassette");
+    int wheelCircumference = server.arg("wheelCircumference").isEmpty() ? userConfig->getWheelCircumference() : server.arg("wheelCircumference").toInt();
+    chainrings.trim();
+    cassette.trim();
+    // Only a change rebuilds the gear table, which the loop waits out on the mutex.
+    xSemaphoreTake(ss2k->drivetrainMutex, portMAX_DELAY);
+    bool accepted = (wheelCircumference >= 1000) && (wheelCircumference <= 3000) && ss2k->drivetrain.configure(chainrings.c_str(), cassette.c_str(), wheelCircumference);
+    xSemaphoreGive(ss2k->drivetrainMutex);
+    if (accepted) {
+      userConfig->setChainrings(chainrings);
+      userConfig->setCassette(cassette);
+      userConfig->setWheelCircumference(wheelCircumference);
+    }
+  }
   if (!server.arg("ERGSensitivity").isEmpty()) {
     float ERGSensitivity = server.arg("ERGSensitivity").toFloat();
     if (ERGSensitivity >= .5 && ERGSensitivity <= 20) {
@@ -539,12 +964,17 @@ void HTTP_Server::settingsProcessor() {
   } else if (wasSettingsUpdate) {
     userConfig->setUdpLogEnabled(false);
   }
+  if (!server.arg("preferBikeSensors").isEmpty()) {
+    userConfig->setPreferBikeSensors(true);
+  } else if (wasSettingsUpdate) {
+    userConfig->setPreferBikeSensors(false);
+  }
   if (!server.arg("stealthChop").isEmpty()) {
     userConfig->setStealthChop(true);
-    ss2k->updateStealthChop();
+    ss2k->driverSettingsFlag = true;
   } else if (wasSettingsUpdate) {
     userConfig->setStealthChop(false);
-    ss2k->updateStealthChop();
+    ss2k->driverSettingsFlag = true;
   }
   if (!server.arg("inclineMultiplier").isEmpty()) {
     float inclineMultiplier = server.arg("inclineMultiplier").toFloat();
@@ -614,6 +1044,7 @@ void HTTP_Server::settingsProcessor() {
       userPWC->hr2Pwr = false;
     }
   }
+  xSemaphoreGive(ss2k->configMutex);
   String response = "<!DOCTYPE html><html><body><h2>";
 
   if (wasBTUpdate) {  // Special BT page update response
@@ -649,8 +1080,14 @@ void HTTP_Server::settingsProcessor() {
 
 void HTTP_Server::stop() {
   SS2K_LOG(HTTP_SERVER_LOG_TAG, "Stopping Http Server");
+  if (webServerMutex != NULL) {
+    xSemaphoreTake(webServerMutex, portMAX_DELAY);
+  }
   server.stop();
   server.close();
+  if (webServerMutex != NULL) {
+    xSemaphoreGive(webServerMutex);
+  }
 }
 
 // github fingerprint
@@ -680,14 +1117,14 @@ void HTTP_Server::FirmwareUpdate() {
   http.end();
   if (httpCode == HTTP_CODE_OK) {  // if version received
     bool updateAnyway = false;
-    if (!LittleFS.exists("/index.html")) {
+    if (!assetExists("/index.html")) {
       // updateAnyway = true;
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "  -index.html not found.");
     }
     Version availableVer(payload.c_str());
     Version currentVer(FIRMWARE_VERSION);
 
-    if (((availableVer > currentVer) && (userConfig->getAutoUpdate())) || (!LittleFS.exists("/index.html"))) {
+    if (((availableVer > currentVer) && (userConfig->getAutoUpdate())) || (!assetExists("/index.html"))) {
       //////////////// Update LittleFS//////////////
       SS2K_LOG(HTTP_SERVER_LOG_TAG, "Updating FileSystem");
       http.begin(DATA_UPDATEURL + String(DATA_FILELIST),
@@ -732,6 +1169,7 @@ void HTTP_Server::FirmwareUpdate() {
           }
           file.print(payload);
           file.close();
+          assetChanged(fileName);
           SS2K_LOG(HTTP_SERVER_LOG_TAG, "Created: %s", fileName);
           httpServer.internetConnection = true;
         } else {
@@ -16,6 +16,9 @@
 #include "UdpAppender.h"
 #include "WebsocketAppender.h"
 #include "BLE_Custom_Characteristic.h"
+#include "WorkoutRunner.h"
+#include "SessionRecorder.h"
+#include "HAL_ESP32.h"
 #include <Constants.h>
 #include "settings.h"
 
@@ -26,10 +29,18 @@ TMC2208Stepper driver(&SERIAL_PORT, R_SENSE);  // Hardware Serial
 // Peloton Serial
 HardwareSerial auxSerial(1);
 AuxSerialBuffer auxSerialBuffer;
+QueueHandle_t auxSerialQueue = NULL;  // Reads from the UART callback, decoded by the main loop
 
 FastAccelStepperEngine engine = FastAccelStepperEngine();
 FastAccelStepper *stepper     = NULL;
 
+// What SS2K reaches the hardware through
+EspClock espClock;
+EspMotor espMotor;
+EspMotorDriver espMotorDriver(driver);
+LittleFSFileSystem littleFSFileSystem;
+NimBLELink nimBLELink;
+
 TaskHandle_t maintenanceLoopTask;
 
 Boards boards;
@@ -91,8 +102,12 @@ void setup() {
     if (!auxSerial) {
       SS2K_LOG(MAIN_LOG_TAG, "Invalid Serial Pin Configuration");
     }
-    auxSerial.onReceive(SS2K::rxSerial, false);  // setup callback
   }
+  ss2k->systemClock = &espClock;
+  ss2k->motorDriver = &espMotorDriver;
+  ss2k->fileSystem  = &littleFSFileSystem;
+  ss2k->bleLink     = &nimBLELink;
+
   // Initialize LittleFS
   SS2K_LOG(MAIN_LOG_TAG, "Mounting Filesystem");
   if (!LittleFS.begin(false)) {
@@ -105,6 +120,16 @@ void setup() {
   userConfig->loadFromLittleFS();
   userConfig->printFile();  // Print userConfig->contents to serial
   userConfig->saveToLittleFS();
+  ss2k->drivetrainMutex = xSemaphoreCreateMutex();
+  ss2k->configMutex     = xSemaphoreCreateMutex();
+  ergLookaheadMutex     = xSemaphoreCreateMutex();
+  if (currentBoard.auxSerialTxPin) {
+    auxSerialQueue = xQueueCreate(AUX_QUEUE_LENGTH, sizeof(AuxSerialBuffer));
+    auxSerial.onReceive(SS2K::rxSerial, false);  // setup callback
+  }
+  if (!ss2k->drivetrain.configure(userConfig->getChainrings(), userConfig->getCassette(), userConfig->getWheelCircumference())) {
+    SS2K_LOG(MAIN_LOG_TAG, "Gearing %s / %s not valid. Using the default drivetrain.", userConfig->getChainrings(), userConfig->getCassette());
+  }
 
   // load PWC for HR to Pwr Calculation
   userPWC->loadFromLittleFS();
@@ -142,7 +167,9 @@ void setup() {
   logHandler.addAppender(&udpAppender);
   logHandler.initialize();
 
+  sessionRecorder.begin();
   ss2k->startTasks();
+  workoutRunner.start();
   httpServer.start();
 
   ss2k->resetIfShiftersHeld();
@@ -170,22 +197,52 @@ void SS2K::maintenanceLoop(void *pvParameters) {
   static unsigned long intervalTimer2 = millis();
   static unsigned long rebootTimer    = millis();
   static bool isScanning              = false;
+#ifdef DEBUG_LOOP_TIMING
+  static unsigned long loopTimer = micros();
+  static unsigned long loopMax   = 0;
+  static unsigned long loopTotal = 0;
+  static unsigned long loopCount = 0;
+  static unsigned long webMax    = 0;  // Worst interval for passes that ran while a web request was being served
+  static unsigned long webCount  = 0;
+#endif  // DEBUG_LOOP_TIMING
 
   while (true) {
     vTaskDelay(5 / portTICK_RATE_MS);
+#ifdef DEBUG_LOOP_TIMING
+    // Anything well past the 5ms delay is time another task or a blocking call took from us.
+    unsigned long loopInterval = micros() - loopTimer;
+    loopTimer                  = micros();
+    loopTotal += loopInterval;
+    loopCount++;
+    if (loopInterval > loopMax) {
+      loopMax = loopInterval;
+    }
+    if (webRequestActive) {
+      webCount++;
+      if (loopInterval > webMax) {
+        webMax = loopInterval;
+      }
+    }
+#endif  // DEBUG_LOOP_TIMING
 
+    // The control pass acts on rtConfig and userConfig as a whole, so web changes land between passes.
+    xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
     // Run what used to be in the BLECommunications Task.
     BLECommunications();
     // send BLE notification for any userConfig values that changed.
     BLE_ss2kCustomCharacteristic::parseNemit();
     // Run What used to be in the Stepper Task.
     ss2k->moveStepper();
+    ss2k->checkDriverStatus();
+    ss2k->checkDriverTemperature();
     // Run what used to be in the ERG Mode Task.
     powerTable->runERG();
-    // Run what used to be in the WebClient Task.
-    httpServer.webClientUpdate();
+    // Shifter presses queued by the interrupts
+    ss2k->processShifts();
     // If we're in ERG mode, modify shift commands to inc/dec the target watts instead.
     ss2k->FTMSModeShiftModifier();
+    // Write out the session capture, or replay the next part of one
+    sessionRecorder.loop();
     // If we have a resistance bike attached, slow down when we're close to the limits.
     if (ss2k->pelotonIsConnected) {
       int speed           = userConfig->getStepperSpeed();
@@ -199,7 +256,7 @@ void SS2K::maintenanceLoop(void *pvParameters) {
         if (speed < 500) {
           speed = 500;
         }
-        if (ss2k->targetPosition > stepper->getCurrentPosition()) {
+        if (ss2k->targetPosition > ss2k->currentPosition) {
           speed = userConfig->getStepperSpeed();
         }
       }
@@ -211,7 +268,7 @@ void SS2K::maintenanceLoop(void *pvParameters) {
         if (speed < 500) {
           speed = 500;
         }
-        if (ss2k->targetPosition < stepper->getCurrentPosition()) {
+        if (ss2k->targetPosition < ss2k->currentPosition) {
           speed = userConfig->getStepperSpeed();
         }
       }
@@ -221,8 +278,10 @@ void SS2K::maintenanceLoop(void *pvParameters) {
 
     // if this hardware version has serial pins, check and process their data.
     if (currentBoard.auxSerialTxPin) {
+      ss2k->processAuxSerial();
       ss2k->txSerial();
     }
+    xSemaphoreGive(ss2k->configMutex);
 
     // Handle flag set for rebooting
     if (ss2k->rebootFlag) {
@@ -240,8 +299,10 @@ void SS2K::maintenanceLoop(void *pvParameters) {
     // Handle a flag set to reset SmartSpin2k to defaults
     if (ss2k->resetDefaultsFlag) {
       LittleFS.format();
+      xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
       userConfig->setDefaults();
       userConfig->saveToLittleFS();
+      xSemaphoreGive(ss2k->configMutex);
       ss2k->resetDefaultsFlag = false;
       ss2k->rebootFlag        = true;
     }
@@ -249,8 +310,21 @@ void SS2K::maintenanceLoop(void *pvParameters) {
     // required to set a flag instead of directly calling the function for saving from BLE_Custom Characteristic.
     if (ss2k->saveFlag) {
       ss2k->saveFlag = false;
+      xSemaphoreTake(ss2k->configMutex, portMAX_DELAY);
       userConfig->saveToLittleFS();
       userPWC->saveToLittleFS();
+      xSemaphoreGive(ss2k->configMutex);
+    }
+
+    // The web server runs in its own task, so it asks for these instead of touching BLE or the driver mid loop.
+    if (ss2k->stopTasksFlag) {
+      ss2k->stopTasksFlag = false;
+      ss2k->stopTasks();
+    }
+    if (ss2k->driverSettingsFlag) {
+      ss2k->driverSettingsFlag = false;
+      ss2k->updateStepperPower();
+      ss2k->updateStealthChop();
     }
 
     // Things to do every two seconds
@@ -289,10 +363,21 @@ void SS2K::maintenanceLoop(void *pvParameters) {
 
 #ifdef DEBUG_STACK
       Serial.printf("Main Task: %d \n", uxTaskGetStackHighWaterMark(maintenanceLoopTask));
+      Serial.printf("Web Task: %d \n", uxTaskGetStackHighWaterMark(webClientTask));
       Serial.printf("Free Heap: %d \n", ESP.getFreeHeap());
       Serial.printf("Best Blok: %d \n", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
 #endif  // DEBUG_STACK
 
+#ifdef DEBUG_LOOP_TIMING
+      SS2K_LOG(MAIN_LOG_TAG, "Loop interval avg %luus max %luus over %lu loops, max %luus over %lu during web requests", loopTotal / loopCount, loopMax,
+               loopCount, webMax, webCount);
+      loopMax   = 0;
+      loopTotal = 0;
+      loopCount = 0;
+      webMax    = 0;
+      webCount  = 0;
+#endif  // DEBUG_LOOP_TIMING
+
       intervalTimer2 = millis();
     }
   }
@@ -318,7 +403,7 @@ void SS2K::FTMSModeShiftModifier() {
 #ifndef INTERNAL_ERG_4EXT_FTMS
         int adjustedTarget         = rtConfig->watts.getTarget() / userConfig->getPowerCorrectionFactor();
         const uint8_t translated[] = {FitnessMachineControlPointProcedure::SetTargetPower, (uint8_t)(adjustedTarget & 0xff), (uint8_t)(adjustedTarget >> 8)};
-        spinBLEClient.FTMSControlPointWrite(translated, 3);
+        bleLink->writeControlPoint(translated, 3);
 #endif
         break;
       }
@@ -347,8 +432,11 @@ void SS2K::FTMSModeShiftModifier() {
         SS2K_LOG(MAIN_LOG_TAG, "Shift %+d pos %d tgt %d min %d max %d r_min %d r_max %d", shiftDelta, rtConfig->getShifterPosition(), ss2k->targetPosition, rtConfig->getMinStep(),
                  rtConfig->getMaxStep(), rtConfig->getMinResistance(), rtConfig->getMaxResistance());
 
-        if (((ss2k->targetPosition + shiftDelta * userConfig->getShiftStep()) < rtConfig->getMinStep()) ||
-            ((ss2k->targetPosition + shiftDelta * userConfig->getShiftStep()) > rtConfig->getMaxStep())) {
+        // Shifts only move the knob directly while the power table can't place the gear
+        bool simMode     = (rtConfig->getFTMSMode() == FitnessMachineControlPointProcedure::SetIndoorBikeSimulationParameters);
+        bool linearShift = !simMode || (rtConfig->getSimPosition() == RETURN_ERROR);
+        if (linearShift && (((ss2k->targetPosition + shiftDelta * userConfig->getShiftStep()) < rtConfig->getMinStep()) ||
+                            ((ss2k->targetPosition + shiftDelta * userConfig->getShiftStep()) > rtConfig->getMaxStep()))) {
           SS2K_LOG(MAIN_LOG_TAG, "Shift Blocked by stepper limits.");
           rtConfig->setShifterPosition(ss2k->lastShifterPosition);
         } else if ((rtConfig->resistance.getValue() <= rtConfig->getMinResistance()) && (shiftDelta > 0)) {
@@ -362,8 +450,21 @@ void SS2K::FTMSModeShiftModifier() {
           SS2K_LOG(MAIN_LOG_TAG, "Shift Blocked by resistance limit.");
           rtConfig->setShifterPosition(ss2k->lastShifterPosition);
         }
+        // Only SIM mode rides the virtual drivetrain, which stops at the ends of the cassette. Without FTMS control
+        // the shifter keeps moving the knob by shiftStep with no gear count to stop it.
+        if (simMode) {
+          xSemaphoreTake(ss2k->drivetrainMutex, portMAX_DELAY);
+          int gearsMoved           = ss2k->drivetrain.shift(rtConfig->getShifterPosition() - ss2k->lastShifterPosition);
+          Drivetrain::Gear current = ss2k->drivetrain.getCurrent();
+          int gear                 = ss2k->drivetrain.getGear() + 1;
+          int gearCount            = ss2k->drivetrain.getGearCount();
+          xSemaphoreGive(ss2k->drivetrainMutex);
+          rtConfig->setShifterPosition(ss2k->lastShifterPosition + gearsMoved);
+          SS2K_LOG(MAIN_LOG_TAG, "Gear %d of %d: %dx%d", gear, gearCount, current.chainring, current.cog);
+          ErgMode::computeSim();
+        }
         uint8_t _controlData[] = {FitnessMachineControlPointProcedure::SetIndoorBikeSimulationParameters, 0x00, 0x00, 0x00, 0x00, 0x28, 0x33};
-        spinBLEClient.FTMSControlPointWrite(_controlData, 7);
+        bleLink->writeControlPoint(_controlData, 7);
       }
     }
     ss2k->lastShifterPosition = rtConfig->getShifterPosition();
@@ -382,104 +483,126 @@ void SS2K::restartWifi() {
 
 void SS2K::moveStepper() {
   bool _stepperDir = userConfig->getStepperDir();
-  if (stepper) {
-    ss2k->stepperIsRunning = stepper->isRunning();
-    ss2k->currentPosition  = stepper->getCurrentPosition();
+  Motor *motor     = ss2k->motor;
+  if (motor) {
+    int32_t rehomed = ss2k->stepperControl.poll(*motor, ss2k->systemClock->nowMs());
+    if (rehomed != 0) {
+      SS2K_LOG(MAIN_LOG_TAG, "Re-homed by %d steps", (int)rehomed);
+    }
+    ss2k->stepperIsRunning = ss2k->stepperControl.isRunning();
+    ss2k->currentPosition  = ss2k->stepperControl.getPosition();
     if (!ss2k->externalControl) {
       if ((rtConfig->getFTMSMode() == FitnessMachineControlPointProcedure::SetTargetPower) ||
           (rtConfig->getFTMSMode() == FitnessMachineControlPointProcedure::SetTargetResistanceLevel)) {
         ss2k->targetPosition = rtConfig->getTargetIncline();
       } else {
-        // Simulation Mode
-        ss2k->targetPosition = rtConfig->getShifterPosition() * userConfig->getShiftStep();
-        ss2k->targetPosition += rtConfig->getTargetIncline() * userConfig->getInclineMultiplier();
+        // Simulation Mode, or no FTMS control at all
+        if ((rtConfig->getFTMSMode() == FitnessMachineControlPointProcedure::SetIndoorBikeSimulationParameters) && (rtConfig->getSimPosition() != RETURN_ERROR)) {
+          // The gear is already in the road model's answer
+          ss2k->targetPosition = rtConfig->getSimPosition();
+        } else {
+          ss2k->targetPosition = rtConfig->getShifterPosition() * userConfig->getShiftStep();
+          ss2k->targetPosition += rtConfig->getTargetIncline() * userConfig->getInclineMultiplier();
+        }
       }
     }
 
     if (ss2k->syncMode) {
-      stepper->stopMove();
+      motor->stopMove();
       vTaskDelay(100 / portTICK_PERIOD_MS);
-      stepper->setCurrentPosition(ss2k->targetPosition);
+      motor->setCurrentPosition(ss2k->targetPosition);
       vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 
     if (ss2k->pelotonIsConnected) {
       if ((rtConfig->resistance.getValue() > rtConfig->getMinResistance()) && (rtConfig->resistance.getValue() < rtConfig->getMaxResistance())) {
-        stepper->moveTo(ss2k->targetPosition);
+        motor->moveTo(ss2k->targetPosition);
       } else if (rtConfig->resistance.getValue() <= rtConfig->getMinResistance()) {  // Limit Stepper to Min Resistance
         if (rtConfig->resistance.getValue() != rtConfig->getMinResistance()) {
-          stepper->moveTo(stepper->getCurrentPosition() + 20);
+          motor->moveTo(motor->getCurrentPosition() + 20);
         }
         // Let the user Shift Out of this Position
-        if (ss2k->targetPosition > stepper->getCurrentPosition()) {
-          stepper->moveTo(ss2k->targetPosition);
+        if (ss2k->targetPosition > motor->getCurrentPosition()) {
+          motor->moveTo(ss2k->targetPosition);
         }
       } else {  // Limit Stepper to Max Resistance
         if (rtConfig->resistance.getValue() != rtConfig->getMaxResistance()) {
-          stepper->moveTo(stepper->getCurrentPosition() - 20);
+          motor->moveTo(motor->getCurrentPosition() - 20);
         }
         // Let the user Shift Out of this Position
-        if (ss2k->targetPosition < stepper->getCurrentPosition()) {
-          stepper->moveTo(ss2k->targetPosition);
+        if (ss2k->targetPosition < motor->getCurrentPosition()) {
+          motor->moveTo(ss2k->targetPosition);
         }
       }
 
     } else {
-      if ((ss2k->targetPosition >= rtConfig->getMinStep()) && (ss2k->targetPosition <= rtConfig->getMaxStep())) {
-        stepper->moveTo(ss2k->targetPosition);
-      } else if (ss2k->targetPosition <= rtConfig->getMinStep()) {  // Limit Stepper to Min Position
-        stepper->moveTo(rtConfig->getMinStep());
-      } else {  // Limit Stepper to Max Position
-        stepper->moveTo(rtConfig->getMaxStep());
+      if (ss2k->stepperControl.moveTo(*motor, ss2k->targetPosition, rtConfig->getMinStep(), rtConfig->getMaxStep()) && ss2k->shiftPending) {
+        ss2k->shiftToMotor.add(ss2k->systemClock->nowUs() - ss2k->shiftPendingUs);
+        ss2k->shiftPending = false;
       }
     }
-    rtConfig->setCurrentIncline((float)stepper->getCurrentPosition());
+    rtConfig->setCurrentIncline((float)motor->getCurrentPosition());
 
-    if (connectedClientCount() > 0) {
-      stepper->setAutoEnable(false);  // Keep the stepper from rolling back due to head tube slack. Motor Driver still lowers power between moves
-      stepper->enableOutputs();
+    if (ss2k->bleLink->connectedClients() > 0) {
+      motor->setHoldEnabled(true);  // Keep the stepper from rolling back due to head tube slack. Motor Driver still lowers power between moves
     } else {
-      stepper->setAutoEnable(true);  // disable output FETs between moves so stepper can cool. Can still shift.
+      motor->setHoldEnabled(false);  // disable output FETs between moves so stepper can cool. Can still shift.
     }
 
     if (_stepperDir != userConfig->getStepperDir()) {  // User changed the config direction of the stepper wires
       _stepperDir = userConfig->getStepperDir();
-      while (stepper->isRunning()) {  // Wait until the motor stops running
+      while (motor->isRunning()) {  // Wait until the motor stops running
         vTaskDelay(100 / portTICK_PERIOD_MS);
       }
-      stepper->setDirectionPin(currentBoard.dirPin, _stepperDir);
+      motor->setDirection(_stepperDir);
     }
   }
 }
 
-bool IRAM_ATTR SS2K::deBounce() {
-  if ((millis() - lastDebounceTime) > debounceDelay) {  // <----------------This should be assigned it's own task and just switch a global bool whatever the reading is at, it's
-                                                        // been there for longer than the debounce delay, so take it as the actual current state: if the button state has changed:
-    lastDebounceTime = millis();
-    return true;
-  }
-
-  return false;
-}
-
 ///////////// Interrupt Functions /////////////
+// Both shifter interrupts only queue the edge. Debouncing and gestures happen in processShifts().
 void IRAM_ATTR SS2K::shiftUp() {  // Handle the shift up interrupt IRAM_ATTR is to keep the interrupt code in ram always
-  if (ss2k->deBounce()) {
-    if (!digitalRead(currentBoard.shiftUpPin)) {  // double checking to make sure the interrupt wasn't triggered by emf
-      rtConfig->setShifterPosition(rtConfig->getShifterPosition() - 1 + userConfig->getShifterDir() * 2);
-    } else {
-      ss2k->lastDebounceTime = 0;
-    }  // Probably Triggered by EMF, reset the debounce
-  }
+  ShiftQueue::Event event = {(uint32_t)micros(), ShiftGestures::UP, digitalRead(currentBoard.shiftUpPin) == LOW};
+  ss2k->shiftQueue.push(event);
 }
 
 void IRAM_ATTR SS2K::shiftDown() {  // Handle the shift down interrupt
-  if (ss2k->deBounce()) {
-    if (!digitalRead(currentBoard.shiftDownPin)) {  // double checking to make sure the interrupt wasn't triggered by emf
-      rtConfig->setShifterPosition(rtConfig->getShifterPosition() + 1 - userConfig->getShifterDir() * 2);
-    } else {
-      ss2k->lastDebounceTime = 0;
-    }  // Probably Triggered by EMF, reset the debounce
+  ShiftQueue::Event event = {(uint32_t)micros(), ShiftGestures::DOWN, digitalRead(currentBoard.shiftDownPin) == LOW};
+  ss2k->shiftQueue.push(event);
+}
+
+// Turns the queued shifter edges into shifter position changes for FTMSModeShiftModifier(), one per press.
+void SS2K::processShifts() {
+  ShiftQueue::Event event;
+  while (shiftQueue.pop(event)) {
+    shiftGestures.onEdge(event);
+  }
+  uint32_t now = systemClock->nowUs();
+  shiftGestures.poll(now);
+
+  ShiftGestures::Gesture gesture;
+  while (shiftGestures.next(gesture)) {
+    const char *button = (gesture.button == ShiftGestures::UP) ? "up" : "down";
+    switch (gesture.type) {
+      case ShiftGestures::Shift: {
+        int delta = ((gesture.button == ShiftGestures::UP) ? 1 : -1) * (userConfig->getShifterDir() * 2 - 1);
+        rtConfig->setShifterPosition(rtConfig->getShifterPosition() + delta);
+        sessionRecorder.recordShift(delta);
+        shiftToLoop.add(now - gesture.timeUs);
+        shiftPendingUs = gesture.timeUs;
+        shiftPending   = true;
+        break;
+      }
+      case ShiftGestures::Hold:
+        SS2K_LOG(MAIN_LOG_TAG, "Shifter %s held", button);
+        break;
+      case ShiftGestures::DoubleTap:
+        SS2K_LOG(MAIN_LOG_TAG, "Shifter %s double tapped", button);
+        break;
+    }
+  }
+  if (shiftPending && ((now - shiftPendingUs) > SHIFT_LATENCY_TIMEOUT * 1000UL)) {
+    shiftPending = false;  // Blocked or didn't move the knob
   }
 }
 
@@ -512,37 +635,29 @@ void SS2K::setupTMCStepperDriver() {
   stepper->setSpeedInHz(DEFAULT_STEPPER_SPEED);
   stepper->setAcceleration(STEPPER_ACCELERATION);
   stepper->setDelayToDisable(1000);
+  espMotor.attach(stepper, currentBoard.dirPin);
+  ss2k->motor = &espMotor;
 
   // TMC Driver Setup
-  driver.begin();
-  driver.pdn_disable(true);
-  driver.mstep_reg_select(true);
+  espMotorDriver.begin();
   ss2k->updateStepperSpeed();
   ss2k->updateStepperPower();
-  driver.microsteps(4);  // Set microsteps to 1/8th
-  driver.irun(currentBoard.pwrScaler);
-  driver.ihold((uint8_t)(currentBoard.pwrScaler * .5));  // hold current % 0-DRIVER_MAX_PWR_SCALER
-  driver.iholddelay(10);                                 // Controls the number of clock cycles for motor
-  // power down after standstill is detected
-  driver.TPOWERDOWN(128);
-  driver.toff(5);
+  espMotorDriver.applyDefaults(currentBoard.pwrScaler);
   ss2k->updateStealthChop();
 }
 
 // Applies current power to driver
 void SS2K::updateStepperPower() {
   uint16_t rmsPwr = (userConfig->getStepperPower());
-  driver.rms_current(rmsPwr);
-  uint16_t current = driver.cs_actual();
+  motorDriver->setCurrent(rmsPwr, ThermalModel::HOLD_PERCENT / 100.0);
+  uint16_t current = motorDriver->getCurrentScale();
   SS2K_LOG(MAIN_LOG_TAG, "Stepper power is now %d.  read:cs=%U", userConfig->getStepperPower(), current);
 }
 
 // Applies current StealthChop to driver
 void SS2K::updateStealthChop() {
   bool t_bool = userConfig->getStealthChop();
-  driver.en_spreadCycle(!t_bool);
-  driver.pwm_autoscale(t_bool);
-  driver.pwm_autograd(t_bool);
+  motorDriver->setStealthChop(t_bool);
   SS2K_LOG(MAIN_LOG_TAG, "StealthChop is now %d", t_bool);
 }
 
@@ -551,32 +666,77 @@ void SS2K::updateStepperSpeed(int speed) {
   if (speed == 0) {
     speed = userConfig->getStepperSpeed();
     SS2K_LOG(MAIN_LOG_TAG, "StepperSpeed is now %d", speed);
+    ss2k->motionPlanner.setLimits(speed, STEPPER_ACCELERATION);
+  }
+  if (motor) {
+    motor->setSpeed(speed);
   }
-  stepper->setSpeedInHz(speed);
 }
 
-// Checks the driver temperature and throttles power if above threshold.
+// Runs the driver thermal model and applies its plan for hold current, chopper and run current before the board gets
+// hot enough to lose torque. Called every loop to sample the duty cycle.
 void SS2K::checkDriverTemperature() {
-  static bool overTemp = false;
-  if (static_cast<int>(temperatureRead()) > THROTTLE_TEMP) {  // Start throttling driver power at 72C on the ESP32
-    uint8_t throttledPower = (THROTTLE_TEMP - static_cast<int>(temperatureRead())) + currentBoard.pwrScaler;
-    driver.irun(throttledPower);
-    SS2K_LOG(MAIN_LOG_TAG, "Over temp! Driver is throttling down! ESP32 @ %f C", temperatureRead());
-    overTemp = true;
-  } else if (static_cast<int>(temperatureRead()) < THROTTLE_TEMP) {
-    if (overTemp) {
-      SS2K_LOG(MAIN_LOG_TAG, "Temperature is now under control. Driver current reset.");
-      driver.irun(currentBoard.pwrScaler);
+  static unsigned long lastUpdate     = systemClock->nowMs();
+  static uint32_t samples             = 0;
+  static uint32_t runningSamples      = 0;
+  static uint32_t enabledSamples      = 0;
+  static ThermalModel::Level reported = ThermalModel::Normal;
+  samples++;
+  runningSamples += ss2k->stepperIsRunning;
+  enabledSamples += (ss2k->stepperIsRunning || (bleLink->connectedClients() > 0));  // Outputs stay on between moves while a client is connected
+  if ((systemClock->nowMs() - lastUpdate) < THERMAL_INTERVAL) {
+    return;
+  }
+  uint16_t runCurrent = (thermalPlan.level == ThermalModel::Normal) ? userConfig->getStepperPower() : thermalPlan.runCurrent;
+  bool stealthChop    = (thermalPlan.level == ThermalModel::Normal) ? userConfig->getStealthChop() : thermalPlan.stealthChop;
+  thermalModel.observe(systemClock->nowMs() - lastUpdate, runCurrent, thermalPlan.holdPercent, stealthChop, (float)runningSamples / samples, (float)enabledSamples / samples);
+  thermalModel.measure(temperatureRead());
+  lastUpdate     = systemClock->nowMs();
+  samples        = 0;
+  runningSamples = 0;
+  enabledSamples = 0;
+
+  ThermalModel::Plan plan = thermalModel.schedule(THROTTLE_TEMP, userConfig->getStepperPower(), userConfig->getStealthChop());
+  if (plan.level != reported) {
+    SS2K_LOG(MAIN_LOG_TAG, "Driver thermal level %d: %dmA run, %d%% hold, StealthChop %d. %.1fC now, ambient %.1fC", plan.level, plan.runCurrent, plan.holdPercent,
+             plan.stealthChop, thermalModel.getTemperature(), thermalModel.getAmbient());
+    reported = plan.level;
+  }
+  if (plan.level == ThermalModel::Normal) {
+    if (thermalPlan.level != ThermalModel::Normal) {
+      // Back to what the user configured
+      ss2k->updateStepperPower();
+      ss2k->updateStealthChop();
     }
-    overTemp = false;
+  } else {
+    // Every update, so a settings change can't undo the plan for long
+    motorDriver->setCurrent(plan.runCurrent, plan.holdPercent / 100.0);
+    motorDriver->setStealthChop(plan.stealthChop);
+  }
+  thermalPlan = plan;
+}
+
+// Reads the driver's fault flags at a bounded rate, so lost steps can be suspected even without StallGuard.
+void SS2K::checkDriverStatus() {
+  static unsigned long lastRead = 0;
+  if ((systemClock->nowMs() - lastRead) < DRIVER_STATUS_INTERVAL) {
+    return;
+  }
+  lastRead        = systemClock->nowMs();
+  uint32_t status = 0;
+  if (stepperControl.readDriverStatus(*motorDriver, status)) {
+    SS2K_LOGW(MAIN_LOG_TAG, "Driver fault 0x%08x while moving. Position is suspect until re-homed.", (unsigned int)status);
   }
 }
 
 void SS2K::motorStop(bool releaseTension) {
-  stepper->stopMove();
-  stepper->setCurrentPosition(ss2k->targetPosition);
+  if (!motor) {
+    return;
+  }
+  motor->stopMove();
+  motor->setCurrentPosition(ss2k->targetPosition);
   if (releaseTension) {
-    stepper->moveTo(ss2k->targetPosition - userConfig->getShiftStep() * 4);
+    motor->moveTo(ss2k->targetPosition - userConfig->getShiftStep() * 4);
   }
 }
 
@@ -627,17 +787,27 @@ void SS2K::pelotonConnected() {
   }
 }
 
+// Runs on the UART event task, so it only reads. Everything else happens in processAuxSerial() on the main loop.
 void SS2K::rxSerial(void) {
   while (auxSerial.available()) {
-    ss2k->pelotonConnected();
     auxSerialBuffer.len = auxSerial.readBytesUntil(PELOTON_FOOTER, auxSerialBuffer.data, AUX_BUF_SIZE);
-    for (int i = 0; i < auxSerialBuffer.len; i++) {  // Find start of data string
-      if (auxSerialBuffer.data[i] == PELOTON_HEADER) {
-        ss2k->pelotonIsConnected = true;
-        size_t newLen            = auxSerialBuffer.len - i;  // find length of sub data
+    if (xQueueSend(auxSerialQueue, &auxSerialBuffer, 0) != pdTRUE) {
+      SS2K_LOG(MAIN_LOG_TAG, "Peloton queue full, read dropped");
+    }
+  }
+}
+
+void SS2K::processAuxSerial() {
+  AuxSerialBuffer read;
+  while (xQueueReceive(auxSerialQueue, &read, 0) == pdTRUE) {
+    pelotonConnected();
+    for (int i = 0; i < read.len; i++) {  // Find start of data string
+      if (read.data[i] == PELOTON_HEADER) {
+        pelotonIsConnected = true;
+        size_t newLen      = read.len - i;  // find length of sub data
         uint8_t newBuf[newLen];
-        for (int j = i; j < auxSerialBuffer.len; j++) {
-          newBuf[j - i] = auxSerialBuffer.data[j];
+        for (int j = i; j < read.len; j++) {
+          newBuf[j - i] = read.data[j];
         }
         collectAndSet(PELOTON_DATA_UUID, PELOTON_DATA_UUID, PELOTON_ADDRESS, newBuf, newLen);
       }
@@ -8,68 +8,123 @@
 #include "Main.h"
 #include "SS2KLog.h"
 #include "Constants.h"
+#include "ERG_Mode.h"
+#include "SessionRecorder.h"
 
+#include <ArduinoJson.h>
 #include <sensors/SensorData.h>
 #include <sensors/SensorDataFactory.h>
+#include <sensors/SensorFusion.h>
 
 SensorDataFactory sensorDataFactory;
+SensorFusion sensorFusion;
+// Peloton packets are collected from the UART callback, everything else from the maintenance loop
+static portMUX_TYPE fusionMux = portMUX_INITIALIZER_UNLOCKED;
 
-void collectAndSet(NimBLEUUID charUUID, NimBLEUUID serviceUUID, NimBLEAddress address, uint8_t *pData, size_t length) {
-  const int kLogBufMaxLength = 250;
-  char logBuf[kLogBufMaxLength];
-  SS2K_LOGD(BLE_COMMON_LOG_TAG, "Data length: %d", length);
-  int logBufLength = ss2k_log_hex_to_buffer(pData, length, logBuf, 0, kLogBufMaxLength);
+uint8_t getFreshSensorFields() {
+  portENTER_CRITICAL(&fusionMux);
+  uint8_t fresh = sensorFusion.getFresh(millis());
+  portEXIT_CRITICAL(&fusionMux);
+  return fresh;
+}
 
-  logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, "<- %.8s | %.8s", serviceUUID.toString().c_str(), charUUID.toString().c_str());
+String getSensorFusionJSON() {
+  uint32_t now = millis();
+  SensorFusion::Source sources[SensorFusion::MAX_SOURCES];
+  uint8_t selected[SensorFusion::MAX_SOURCES] = {0};
+  portENTER_CRITICAL(&fusionMux);
+  for (size_t i = 0; i < SensorFusion::MAX_SOURCES; i++) {
+    sources[i] = sensorFusion.getSource(i);
+  }
+  for (size_t field = 0; field < SensorFusion::FIELDS; field++) {
+    const SensorFusion::Source *source = sensorFusion.getSelected(now, (SensorSample::Field)(1 << field));
+    if (source != nullptr) {
+      selected[source - &sensorFusion.getSource(0)] |= (1 << field);
+    }
+  }
+  portEXIT_CRITICAL(&fusionMux);
+
+  DynamicJsonDocument doc(1024);
+  for (size_t i = 0; i < SensorFusion::MAX_SOURCES; i++) {
+    if (sources[i].key == 0) {
+      continue;
+    }
+    JsonObject source  = doc.createNestedObject();
+    source["kind"]     = SensorFusion::getKindName(sources[i].kind);
+    source["ageMs"]    = now - sources[i].lastPacketMs;
+    source["fields"]   = sources[i].seen;
+    source["selected"] = selected[i];
+    source["packets"]  = sources[i].packets;
+    source["rejected"] = sources[i].rejected;
+  }
+  String tString;
+  serializeJson(doc, tString);
+  return tString;
+}
 
-  std::shared_ptr<SensorData> sensorData = sensorDataFactory.getSensorData(charUUID, (uint64_t)address, pData, length);
+// Applies the fields this packet's sensor is selected for to rtConfig and describes them in the log buffer. Returns the
+// length written.
+static int mergeSensorSample(const SensorSample &sample, uint8_t selected, char *logBuf, int logBufMaxLength) {
+  int logBufLength = 0;
 
-  logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " | %s[", sensorData->getId().c_str());
-  if (sensorData->hasHeartRate() && !rtConfig->hr.getSimulate()) {
-    int heartRate = sensorData->getHeartRate();
-    rtConfig->hr.setValue(heartRate);
+  if ((selected & SensorSample::HEART_RATE) && !rtConfig->hr.getSimulate()) {
+    rtConfig->hr.setValue(sample.heartRate);
     spinBLEClient.connectedHRM = true;
-    logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " HR(%d)", heartRate % 1000);
+    logBufLength += snprintf(logBuf + logBufLength, logBufMaxLength - logBufLength, " HR(%d)", sample.heartRate % 1000);
   }
 
-  if (sensorData->hasCadence() && !rtConfig->cad.getSimulate()) {
-    if ((charUUID == PELOTON_DATA_UUID) && !((String(userConfig->getConnectedPowerMeter()) == "none") || (String(userConfig->getConnectedPowerMeter()) == "any"))) {
-      // Peloton connected but using BLE Power Meter. So skip cad for Peloton UUID.
-    } else {
-      float cadence = sensorData->getCadence();
-      rtConfig->cad.setValue(cadence);
-      spinBLEClient.connectedCD = true;
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " CD(%.2f)", fmodf(cadence, 1000.0));
-    }
+  if ((selected & SensorSample::CADENCE) && !rtConfig->cad.getSimulate()) {
+    float cadence = sample.getCadence();
+    rtConfig->cad.setValue(cadence);
+    spinBLEClient.connectedCD = true;
+    logBufLength += snprintf(logBuf + logBufLength, logBufMaxLength - logBufLength, " CD(%.2f)", fmodf(cadence, 1000.0));
   }
 
-  if (sensorData->hasPower() && !rtConfig->watts.getSimulate()) {
-    if ((charUUID == PELOTON_DATA_UUID) && !((String(userConfig->getConnectedPowerMeter()) == "none") || (String(userConfig->getConnectedPowerMeter()) == "any"))) {
-      // Peloton connected but using BLE Power Meter. So skip power for Peloton UUID.
-    } else {
-      int power = sensorData->getPower() * userConfig->getPowerCorrectionFactor();
-      rtConfig->watts.setValue(power);
-      spinBLEClient.connectedPM = true;
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " PW(%d)", power % 10000);
-    }
+  if ((selected & SensorSample::POWER) && !rtConfig->watts.getSimulate()) {
+    int power = sample.power * userConfig->getPowerCorrectionFactor();
+    rtConfig->watts.setValue(power);
+    spinBLEClient.connectedPM = true;
+    logBufLength += snprintf(logBuf + logBufLength, logBufMaxLength - logBufLength, " PW(%d)", power % 10000);
   }
 
-  if (sensorData->hasSpeed()) {
-    float speed = sensorData->getSpeed();
+  if (selected & SensorSample::SPEED) {
+    float speed = sample.getSpeed();
     rtConfig->setSimulatedSpeed(speed);
     spinBLEClient.connectedSpeed = true;
-    logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " SD(%.2f)", fmodf(speed, 1000.0));
+    logBufLength += snprintf(logBuf + logBufLength, logBufMaxLength - logBufLength, " SD(%.2f)", fmodf(speed, 1000.0));
   }
 
-  if (sensorData->hasResistance()) {
-    if ((rtConfig->getMaxResistance() == MAX_PELOTON_RESISTANCE) && (charUUID != PELOTON_DATA_UUID)) {
-      // Peloton connected but using BLE Power Meter. So skip resistance for UUID's that aren't Peloton.
-    } else {
-      int resistance = sensorData->getResistance();
-      rtConfig->resistance.setValue(resistance);
-      logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " RS(%d)", resistance % 1000);
-    }
+  if (selected & SensorSample::RESISTANCE) {
+    rtConfig->resistance.setValue(sample.resistance);
+    logBufLength += snprintf(logBuf + logBufLength, logBufMaxLength - logBufLength, " RS(%d)", sample.resistance % 1000);
+  }
+  return logBufLength;
+}
+
+void collectAndSet(NimBLEUUID charUUID, NimBLEUUID serviceUUID, NimBLEAddress address, uint8_t *pData, size_t length) {
+  const int kLogBufMaxLength = 250;
+  char logBuf[kLogBufMaxLength];
+  SS2K_LOGD(BLE_COMMON_LOG_TAG, "Data length: %d", length);
+  sessionRecorder.recordNotify(charUUID, (uint64_t)address, pData, length);
+  int logBufLength = ss2k_log_hex_to_buffer(pData, length, logBuf, 0, kLogBufMaxLength);
+
+  logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, "<- %.8s | %.8s", serviceUUID.toString().c_str(), charUUID.toString().c_str());
+
+  uint64_t key            = SensorDataFactory::getKey(charUUID, (uint64_t)address);
+  SensorData *sensorData  = sensorDataFactory.getSensorData(key, charUUID, pData, length);
+  SensorFusion::Kind kind = SensorFusion::getKind(charUUID);
+  portENTER_CRITICAL(&fusionMux);
+  sensorFusion.setPreferBike(userConfig->getPreferBikeSensors());
+  uint8_t selected = sensorFusion.offer(millis(), key, kind, sensorData->getSample());
+  portEXIT_CRITICAL(&fusionMux);
+
+  logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " | %s[", sensorData->getId());
+  logBufLength += mergeSensorSample(sensorData->getSample(), selected, logBuf + logBufLength, kLogBufMaxLength - logBufLength);
+  spinBLEServer.updateRideTotals();
+  if (rtConfig->getFTMSMode() == FitnessMachineControlPointProcedure::SetIndoorBikeSimulationParameters) {
+    ErgMode::computeSim();
   }
+  sessionRecorder.recordState();
 
   //////adding incline so that i can plot it
   logBufLength += snprintf(logBuf + logBufLength, kLogBufMaxLength - logBufLength, " POS(%d)", ss2k->currentPosition);
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "SessionRecorder.h"
+#include "Main.h"
+#include "SS2KLog.h"
+
+SessionRecorder sessionRecorder;
+
+void SessionRecorder::begin() {
+  mutex     = xSemaphoreCreateMutex();
+  fileMutex = xSemaphoreCreateMutex();
+}
+
+bool SessionRecorder::startRecording() {
+  if (replaying) {
+    return false;
+  }
+  xSemaphoreTake(fileMutex, portMAX_DELAY);
+  uint8_t header[SessionCapture::HEADER_SIZE];
+  SessionCapture::writeHeader(header, sizeof(header));
+  bool started = ss2k->fileSystem->write(CAPTURE_FILENAME, header, sizeof(header));
+  if (started) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    buffered[0] = 0;
+    buffered[1] = 0;
+    active      = 0;
+    written     = sizeof(header);
+    records     = 0;
+    dropped     = 0;
+    startMs     = ss2k->systemClock->nowMs();
+    lastFlush   = startMs;
+    recording   = true;
+    xSemaphoreGive(mutex);
+  }
+  xSemaphoreGive(fileMutex);
+  SS2K_LOG(CAPTURE_LOG_TAG, started ? "Recording to %s" : "Couldn't create %s", CAPTURE_FILENAME);
+  return started;
+}
+
+// loop() writes out whatever is still buffered
+void SessionRecorder::stopRecording() {
+  if (recording) {
+    recording = false;
+    SS2K_LOG(CAPTURE_LOG_TAG, "Stopped recording after %d records", records);
+  }
+}
+
+bool SessionRecorder::startReplay() {
+  if (recording || replaying) {
+    return false;
+  }
+  xSemaphoreTake(fileMutex, portMAX_DELAY);
+  uint8_t header[SessionCapture::HEADER_SIZE];
+  bool started = (ss2k->fileSystem->read(CAPTURE_FILENAME, 0, header, sizeof(header)) == (int32_t)sizeof(header)) && SessionCapture::checkHeader(header, sizeof(header));
+  if (started) {
+    replayOffset = sizeof(header);
+    replayed     = 0;
+    started      = this->loadNextRecord();
+    startMs      = ss2k->systemClock->nowMs();
+    replaying    = started;
+  }
+  xSemaphoreGive(fileMutex);
+  SS2K_LOG(CAPTURE_LOG_TAG, started ? "Replaying %s" : "Nothing to replay in %s", CAPTURE_FILENAME);
+  return started;
+}
+
+void SessionRecorder::stopReplay() {
+  if (replaying) {
+    replaying = false;
+    SS2K_LOG(CAPTURE_LOG_TAG, "Stopped replay after %d records", replayed);
+  }
+}
+
+void SessionRecorder::loop() {
+  if (recording || (buffered[active] > 0)) {
+    this->flush(!recording);
+  }
+  if (!replaying) {
+    return;
+  }
+  xSemaphoreTake(fileMutex, portMAX_DELAY);
+  uint32_t elapsed = ss2k->systemClock->nowMs() - startMs;
+  bool more        = true;
+  while (replaying && more && (elapsed >= next.timeMs)) {
+    this->replayRecord(next);
+    replayed++;
+    more = this->loadNextRecord();
+  }
+  if (replaying && !more) {
+    replaying = false;
+    SS2K_LOG(CAPTURE_LOG_TAG, "Replay finished, %d records", replayed);
+  }
+  xSemaphoreGive(fileMutex);
+}
+
+void SessionRecorder::flush(bool force) {
+  uint32_t now = ss2k->systemClock->nowMs();
+  // Always fileMutex first, so startRecording() can't reset the buffers between the swap and the write
+  xSemaphoreTake(fileMutex, portMAX_DELAY);
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint8_t full = active;
+  bool due     = (buffered[full] > 0) && (force || (buffered[full] >= CAPTURE_BUFFER_SIZE / 2) || (now - lastFlush >= CAPTURE_FLUSH_INTERVAL));
+  if (due) {
+    active = !active;  // Emptied by the last flush
+  }
+  xSemaphoreGive(mutex);
+  if (!due) {
+    xSemaphoreGive(fileMutex);
+    return;
+  }
+
+  lastFlush     = now;
+  size_t length = buffered[full];
+  if (written + length > CAPTURE_MAX_SIZE) {
+    recording = false;
+    dropped++;
+    SS2K_LOG(CAPTURE_LOG_TAG, "Capture full at %d bytes. Stopped recording.", written);
+  } else if (ss2k->fileSystem->append(CAPTURE_FILENAME, buffers[full], length)) {
+    written += length;
+  } else {
+    recording = false;
+    dropped++;
+    SS2K_LOG(CAPTURE_LOG_TAG, "Couldn't write %s. Stopped recording.", CAPTURE_FILENAME);
+  }
+  buffered[full] = 0;
+  xSemaphoreGive(fileMutex);
+}
+
+uint32_t SessionRecorder::elapsed() { return ss2k->systemClock->nowMs() - startMs; }
+
+void SessionRecorder::commit(size_t length) {
+  if (length == 0) {
+    dropped++;  // loop() hasn't kept up
+    return;
+  }
+  buffered[active] += length;
+  records++;
+}
+
+void SessionRecorder::recordNotify(NimBLEUUID charUUID, uint64_t address, const uint8_t *data, size_t length) {
+  if (!recording) {
+    return;
+  }
+  const uint8_t *uuid = charUUID.to128().getNative()->u128.value;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (recording) {
+    this->commit(SessionCapture::encodeNotify(this->elapsed(), address, uuid, data, length, this->tail(), this->space()));
+  }
+  xSemaphoreGive(mutex);
+}
+
+void SessionRecorder::recordControlPoint(const uint8_t *data, size_t length) {
+  if (!recording) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (recording) {
+    this->commit(SessionCapture::encodeControlPoint(this->elapsed(), data, length, this->tail(), this->space()));
+  }
+  xSemaphoreGive(mutex);
+}
+
+void SessionRecorder::recordShift(int8_t delta) {
+  if (!recording) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (recording) {
+    this->commit(SessionCapture::encodeShift(this->elapsed(), delta, this->tail(), this->space()));
+  }
+  xSemaphoreGive(mutex);
+}
+
+void SessionRecorder::recordState() {
+  if (!recording) {
+    return;
+  }
+  SessionCapture::State state;
+  state.watts          = rtConfig->watts.getValue();
+  state.cadence        = rtConfig->cad.getValue() * 100;
+  state.heartRate      = rtConfig->hr.getValue();
+  state.resistance     = rtConfig->resistance.getValue();
+  state.targetPosition = ss2k->targetPosition;
+  state.position       = ss2k->currentPosition;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (recording) {
+    this->commit(SessionCapture::encodeState(this->elapsed(), state, this->tail(), this->space()));
+  }
+  xSemaphoreGive(mutex);
+}
+
+bool SessionRecorder::loadNextRecord() {
+  const size_t header = SessionCapture::RECORD_HEADER_SIZE;
+  if ((ss2k->fileSystem->read(CAPTURE_FILENAME, replayOffset, replayBuffer, header) != (int32_t)header) ||
+      !SessionCapture::parseRecordHeader(replayBuffer, header, next) || (next.length > sizeof(replayBuffer) - header)) {
+    return false;  // The end, or a record cut short
+  }
+  if ((next.length > 0) && (ss2k->fileSystem->read(CAPTURE_FILENAME, replayOffset + header, replayBuffer + header, next.length) != (int32_t)next.length)) {
+    return false;
+  }
+  replayOffset += header + next.length;
+  return true;
+}
+
+void SessionRecorder::replayRecord(const SessionCapture::Record &record) {
+  switch (record.type) {
+    case SessionCapture::NOTIFY: {
+      SessionCapture::Notification notification;
+      if (SessionCapture::parseNotify(record, notification)) {
+        collectAndSet(NimBLEUUID(notification.uuid, 16, false), NimBLEUUID(), NimBLEAddress(notification.address), const_cast<uint8_t *>(notification.data),
+                      notification.length);
+      }
+      break;
+    }
+    case SessionCapture::CONTROL_POINT:
+      spinBLEServer.queueWrite(std::string((const char *)record.payload, record.length));
+      break;
+    case SessionCapture::SHIFT: {
+      int8_t delta;
+      if (SessionCapture::parseShift(record, delta)) {
+        rtConfig->setShifterPosition(rtConfig->getShifterPosition() + delta);
+      }
+      break;
+    }
+    default:
+      break;  // STATE is for checking a replay against, off the device
+  }
+}
+
+String SessionRecorder::getStatusJSON() {
+  return "{\"recording\":" + String(recording ? "true" : "false") + ",\"replaying\":" + String(replaying ? "true" : "false") + ",\"bytes\":" + String(written) +
+         ",\"records\":" + String(records) + ",\"dropped\":" + String(dropped) + ",\"replayed\":" + String(replayed) + "}";
+}
@@ -10,7 +10,21 @@
 #include "SmartSpin_parameters.h"
 
 #include <ArduinoJson.h>
-#include <LittleFS.h>
+#include <vector>
+
+// Config files are read and written whole through ss2k->fileSystem. False if the file is missing.
+static bool readConfigFile(const char *path, std::vector<char> &contents) {
+  int32_t size = ss2k->fileSystem->size(path);
+  if (size < 0) {
+    return false;
+  }
+  contents.assign(size + 1, 0);
+  return ss2k->fileSystem->read(path, 0, (uint8_t *)contents.data(), size) == size;
+}
+
+static bool writeConfigFile(const char *path, const String &contents) {
+  return (contents.length() > 0) && ss2k->fileSystem->write(path, (const uint8_t *)contents.c_str(), contents.length());
+}
 
 String RuntimeParameters::returnJSON() {
   // Allocate a temporary JsonDocument
@@ -64,9 +78,15 @@ void userParameters::setDefaults() {
   foundDevices          = " ";
   maxWatts              = DEFAULT_MAX_WATTS;
   minWatts              = DEFAULT_MIN_WATTS;
+  riderWeight           = DEFAULT_RIDER_WEIGHT;
+  ftp                   = DEFAULT_FTP;
+  chainrings            = DEFAULT_CHAINRINGS;
+  cassette              = DEFAULT_CASSETTE;
+  wheelCircumference    = DEFAULT_WHEEL_CIRCUMFERENCE;
   stepperDir            = true;
   shifterDir            = true;
   udpLogEnabled         = false;
+  preferBikeSensors     = false;
 }
 
 //---------------------------------------------------------------------------------
@@ -97,9 +117,15 @@ String userParameters::returnJSON() {
   doc["foundDevices"]          = foundDevices;
   doc["maxWatts"]              = maxWatts;
   doc["minWatts"]              = minWatts;
+  doc["riderWeight"]           = riderWeight;
+  doc["ftp"]                   = ftp;
+  doc["chainrings"]            = chainrings;
+  doc["cassette"]              = cassette;
+  doc["wheelCircumference"]    = wheelCircumference;
   doc["shifterDir"]            = shifterDir;
   doc["stepperDir"]            = stepperDir;
   doc["udpLogEnabled"]         = udpLogEnabled;
+  doc["preferBikeSensors"]     = preferBikeSensors;
 
   String output;
   serializeJson(doc, output);
@@ -108,16 +134,7 @@ String userParameters::returnJSON() {
 
 //-- Saves all parameters to LittleFS
 void userParameters::saveToLittleFS() {
-  // Delete existing file, otherwise the configuration is appended to the file
-  LittleFS.remove(configFILENAME);
-
-  // Open file for writing
   SS2K_LOG(CONFIG_LOG_TAG, "Writing File: %s", configFILENAME);
-  File file = LittleFS.open(configFILENAME, FILE_WRITE);
-  if (!file) {
-    SS2K_LOG(CONFIG_LOG_TAG, "Failed to create file");
-    return;
-  }
 
   // Allocate a temporary JsonDocument
   // Don't forget to change the capacity to match your requirements.
@@ -145,16 +162,22 @@ void userParameters::saveToLittleFS() {
   //doc["foundDevices"]          = foundDevices;
   doc["maxWatts"]              = maxWatts;
   doc["minWatts"]              = minWatts;
+  doc["riderWeight"]           = riderWeight;
+  doc["ftp"]                   = ftp;
+  doc["chainrings"]            = chainrings;
+  doc["cassette"]              = cassette;
+  doc["wheelCircumference"]    = wheelCircumference;
   doc["shifterDir"]            = shifterDir;
   doc["stepperDir"]            = stepperDir;
   doc["udpLogEnabled"]         = udpLogEnabled;
+  doc["preferBikeSensors"]     = preferBikeSensors;
 
   // Serialize JSON to file
-  if (serializeJson(doc, file) == 0) {
+  String output;
+  serializeJson(doc, output);
+  if (!writeConfigFile(configFILENAME, output)) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to write to file");
   }
-  // Close the file
-  file.close();
 }
 
 // Loads the JSON configuration from a file into a userParameters Object
@@ -162,10 +185,10 @@ void userParameters::loadFromLittleFS() {
   setDefaults();
   // Open file for reading
   SS2K_LOG(CONFIG_LOG_TAG, "Reading File: %s", configFILENAME);
-  File file = LittleFS.open(configFILENAME);
+  std::vector<char> file;
 
   // load defaults if filename doesn't exist
-  if (!file) {
+  if (!readConfigFile(configFILENAME, file)) {
     SS2K_LOG(CONFIG_LOG_TAG, "Couldn't find configuration file.");
     return;
   }
@@ -175,7 +198,7 @@ void userParameters::loadFromLittleFS() {
   DynamicJsonDocument doc(USERCONFIG_JSON_SIZE);
 
   // Deserialize the JSON document
-  DeserializationError error = deserializeJson(doc, file);
+  DeserializationError error = deserializeJson(doc, (const char *)file.data());
   if (error) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to deserialize. Using defaults");
     return;
@@ -208,6 +231,21 @@ void userParameters::loadFromLittleFS() {
   if (doc["minWatts"]) {
     setMinWatts(doc["minWatts"]);
   }
+  if (doc["riderWeight"]) {
+    setRiderWeight(doc["riderWeight"]);
+  }
+  if (doc["ftp"]) {
+    setFtp(doc["ftp"]);
+  }
+  if (doc["chainrings"]) {
+    setChainrings(doc["chainrings"]);
+  }
+  if (doc["cassette"]) {
+    setCassette(doc["cassette"]);
+  }
+  if (doc["wheelCircumference"]) {
+    setWheelCircumference(doc["wheelCircumference"]);
+  }
   if (!doc["stepperDir"].isNull()) {
     setStepperDir(doc["stepperDir"]);
   }
@@ -217,6 +255,9 @@ void userParameters::loadFromLittleFS() {
   if (!doc["udpLogEnabled"].isNull()) {
     setUdpLogEnabled(doc["udpLogEnabled"]);
   }
+  if (!doc["preferBikeSensors"].isNull()) {
+    setPreferBikeSensors(doc["preferBikeSensors"]);
+  }
   if (doc["powerCorrectionFactor"]) {
     setPowerCorrectionFactor(doc["powerCorrectionFactor"]);
     if ((getPowerCorrectionFactor() < MIN_PCF) || (getPowerCorrectionFactor() > MAX_PCF)) {
@@ -228,21 +269,15 @@ void userParameters::loadFromLittleFS() {
   }
 
   SS2K_LOG(CONFIG_LOG_TAG, "Config File Loaded: %s", configFILENAME);
-  file.close();
 }
 
 // Prints the content of a file to the Serial
 void userParameters::printFile() {
   // Open file for reading
   SS2K_LOG(CONFIG_LOG_TAG, "Contents of file: %s", configFILENAME);
-  File file = LittleFS.open(configFILENAME);
-  if (!file) {
+  if (ss2k->fileSystem->size(configFILENAME) < 0) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to read file");
-    return;
   }
-
-  // Close the file
-  file.close();
 }
 
 /*****************************************USERPWC*****************************************/
@@ -272,15 +307,7 @@ String physicalWorkingCapacity::returnJSON() {
 
 //-- Saves all parameters to LittleFS
 void physicalWorkingCapacity::saveToLittleFS() {
-  // Delete existing file, otherwise the configuration is appended to the file
-  LittleFS.remove(userPWCFILENAME);
-  // Open file for writing
   SS2K_LOG(CONFIG_LOG_TAG, "Writing File: %s", userPWCFILENAME);
-  File file = LittleFS.open(userPWCFILENAME, FILE_WRITE);
-  if (!file) {
-    SS2K_LOG(CONFIG_LOG_TAG, "Failed to create file");
-    return;
-  }
 
   StaticJsonDocument<500> doc;
 
@@ -291,21 +318,21 @@ void physicalWorkingCapacity::saveToLittleFS() {
   doc["hr2Pwr"]      = hr2Pwr;
 
   // Serialize JSON to file
-  if (serializeJson(doc, file) == 0) {
+  String output;
+  serializeJson(doc, output);
+  if (!writeConfigFile(userPWCFILENAME, output)) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to write to file");
   }
-  // Close the file
-  file.close();
 }
 
 // Loads the JSON configuration from a file
 void physicalWorkingCapacity::loadFromLittleFS() {
   // Open file for reading
   SS2K_LOG(CONFIG_LOG_TAG, "Reading File: %s", userPWCFILENAME);
-  File file = LittleFS.open(userPWCFILENAME);
+  std::vector<char> file;
 
   // load defaults if filename doesn't exist
-  if (!file) {
+  if (!readConfigFile(userPWCFILENAME, file)) {
     SS2K_LOG(CONFIG_LOG_TAG, "Couldn't find configuration file. Loading Defaults");
     setDefaults();
     return;
@@ -314,7 +341,7 @@ void physicalWorkingCapacity::loadFromLittleFS() {
   StaticJsonDocument<500> doc;
 
   // Deserialize the JSON document
-  DeserializationError error = deserializeJson(doc, file);
+  DeserializationError error = deserializeJson(doc, (const char *)file.data());
   if (error) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to read file, using default configuration");
     setDefaults();
@@ -329,19 +356,13 @@ void physicalWorkingCapacity::loadFromLittleFS() {
   hr2Pwr      = doc["hr2Pwr"];
 
   SS2K_LOG(CONFIG_LOG_TAG, "Config File Loaded: %s", userPWCFILENAME);
-  file.close();
 }
 
 // Prints the content of a file to the Serial
 void physicalWorkingCapacity::printFile() {
   // Open file for reading
   SS2K_LOG(CONFIG_LOG_TAG, "Contents of file: %s", userPWCFILENAME);
-  File file = LittleFS.open(userPWCFILENAME);
-  if (!file) {
+  if (ss2k->fileSystem->size(userPWCFILENAME) < 0) {
     SS2K_LOG(CONFIG_LOG_TAG, "Failed to read file");
-    return;
   }
-
-  // Close the file
-  file.close();
 }
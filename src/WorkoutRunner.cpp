@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "WorkoutRunner.h"
+#include "Main.h"
+#include "ERG_Mode.h"
+#include "BLE_Custom_Characteristic.h"
+
+WorkoutRunner workoutRunner;
+
+void WorkoutRunner::start() {
+  mutex = xSemaphoreCreateMutex();
+  this->loadFromLittleFS();
+  xTaskCreatePinnedToCore(workoutTask,        /* Task function. */
+                          "WorkoutTask",      /* name of task. */
+                          WORKOUT_STACK,      /* Stack size of task */
+                          NULL,               /* parameter of the task */
+                          2,                  /* priority of the task  */
+                          &workoutTaskHandle, /* Task handle to keep track of created task */
+                          1);                 /* pin task to core */
+}
+
+void WorkoutRunner::workoutTask(void *pvParameters) {
+  for (;;) {
+    uint32_t wait = workoutRunner._tick(millis());
+    // Sleeps until the next target change, or until control() wakes it
+    ulTaskNotifyTake(pdTRUE, (wait == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+  }
+}
+
+uint32_t WorkoutRunner::_tick(uint32_t now) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint16_t ftp            = userConfig->getFtp();
+  Workout::State previous = workout.getState();
+  if (workout.update(now, ftp, &watts)) {
+    rtConfig->setFTMSMode(FitnessMachineControlPointProcedure::SetTargetPower);
+    rtConfig->watts.setTarget(watts);
+    SS2K_LOG(WORKOUT_LOG_TAG, "Step %d target %dw", (int)workout.getStepAt(workout.getElapsed(now)) + 1, watts);
+  }
+  // Let ERG mode see the next jump coming
+  uint32_t inMs;
+  uint16_t nextWatts;
+  if (workout.nextBoundary(now, ftp, &inMs, &nextWatts) && (inMs <= ErgLookahead::MAX_LEAD_MS)) {
+    xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+    ergLookahead.schedule(now, inMs, nextWatts);
+    xSemaphoreGive(ergLookaheadMutex);
+  }
+  Workout::State state = workout.getState();
+  if ((state == Workout::Finished) && (previous == Workout::Running)) {
+    SS2K_LOG(WORKOUT_LOG_TAG, "Finished");
+  }
+  uint32_t wait = (state == Workout::Running) ? workout.nextUpdate(now, ftp, WORKOUT_PROGRESS_INTERVAL) : portMAX_DELAY;
+  bool report   = (state != previous) || ((state == Workout::Running) && (now - lastProgress >= WORKOUT_PROGRESS_INTERVAL));
+  xSemaphoreGive(mutex);
+
+  if (report) {
+    lastProgress = now;
+    BLE_ss2kCustomCharacteristic::notify(BLE_workout);
+  }
+  return wait;
+}
+
+bool WorkoutRunner::loadFromLittleFS() {
+  int32_t size = ss2k->fileSystem->size(WORKOUT_FILENAME);
+  if (size < 0) {
+    return false;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  int32_t length = ss2k->fileSystem->read(WORKOUT_FILENAME, 0, upload, sizeof(upload));
+  // Anything longer than the largest workout can't be one
+  bool loaded = (length == size) && workout.load(upload, length);
+  xSemaphoreGive(mutex);
+  if (!loaded) {
+    SS2K_LOG(WORKOUT_LOG_TAG, "Invalid workout file");
+    return false;
+  }
+  SS2K_LOG(WORKOUT_LOG_TAG, "Loaded %d steps", (int)workout.getStepCount());
+  return true;
+}
+
+bool WorkoutRunner::control(uint8_t command) {
+  if (command == workout_load) {
+    if ((workout.getState() == Workout::Running) || (workout.getState() == Workout::Paused)) {
+      return false;
+    }
+    return this->loadFromLittleFS();
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  Workout::State state = workout.getState();
+  bool accepted        = true;
+  switch (command) {
+    case workout_start:
+      accepted = (state != Workout::Empty);
+      workout.start(millis());
+      break;
+    case workout_pause:
+      accepted = (state == Workout::Running);
+      workout.pause(millis());
+      xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+      ergLookahead.clear();
+      xSemaphoreGive(ergLookaheadMutex);
+      break;
+    case workout_resume:
+      accepted = (state == Workout::Paused);
+      workout.resume(millis());
+      break;
+    case workout_stop:
+      workout.stop();
+      xSemaphoreTake(ergLookaheadMutex, portMAX_DELAY);
+      ergLookahead.clear();
+      xSemaphoreGive(ergLookaheadMutex);
+      break;
+    default:
+      accepted = false;
+  }
+  xSemaphoreGive(mutex);
+  if (accepted) {
+    SS2K_LOG(WORKOUT_LOG_TAG, "Command %d", command);
+    xTaskNotifyGive(workoutTaskHandle);
+  }
+  return accepted;
+}
+
+bool WorkoutRunner::receive(uint16_t offset, const uint8_t *data, size_t length) {
+  if ((size_t)offset + length > sizeof(upload)) {
+    return false;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  memcpy(upload + offset, data, length);
+  xSemaphoreGive(mutex);
+  return true;
+}
+
+bool WorkoutRunner::commit(size_t length) {
+  // Replacing the workout under a rider would lose their place
+  if ((length > sizeof(upload)) || (workout.getState() == Workout::Running) || (workout.getState() == Workout::Paused)) {
+    return false;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  bool loaded = workout.load(upload, length);
+  xSemaphoreGive(mutex);
+  if (!loaded) {
+    SS2K_LOG(WORKOUT_LOG_TAG, "Rejected upload of %d bytes", (int)length);
+    return false;
+  }
+  if (!ss2k->fileSystem->write(WORKOUT_FILENAME, upload, length)) {
+    SS2K_LOG(WORKOUT_LOG_TAG, "Failed to save file");
+    return true;  // Still loaded, just not kept across a reboot
+  }
+  SS2K_LOG(WORKOUT_LOG_TAG, "Saved %d steps", (int)workout.getStepCount());
+  return true;
+}
+
+void WorkoutRunner::getProgress(uint8_t *out) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t elapsed  = workout.getElapsed(millis());
+  uint16_t seconds  = elapsed / 1000;
+  uint16_t duration = workout.getDuration() / 1000;
+  out[0]            = workout.getState();
+  out[1]            = workout.getStepAt(elapsed);
+  out[2]            = seconds & 0xff;
+  out[3]            = seconds >> 8;
+  out[4]            = duration & 0xff;
+  out[5]            = duration >> 8;
+  out[6]            = watts & 0xff;
+  out[7]            = watts >> 8;
+  xSemaphoreGive(mutex);
+}
+
+String WorkoutRunner::getProgressJSON() {
+  uint8_t progress[WORKOUT_PROGRESS_SIZE];
+  this->getProgress(progress);
+  return "{\"state\":" + String(progress[0]) + ",\"step\":" + String(progress[1]) + ",\"steps\":" + String(workout.getStepCount()) +
+         ",\"elapsed\":" + String(progress[2] | (progress[3] << 8)) + ",\"duration\":" + String(progress[4] | (progress[5] << 8)) +
+         ",\"watts\":" + String(progress[6] | (progress[7] << 8)) + "}";
+}
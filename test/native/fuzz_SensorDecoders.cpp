@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+// Fuzz entry point for the sensor decoders, compatible with libFuzzer and AFL.
+//
+// The first input byte picks the decoder (see fuzzSensorDecoder) and the rest is the packet. Build with
+// -D SS2K_FUZZ_DECODER=<n> to pin one decoder and feed it the whole input instead. For example:
+//
+//   clang -c -g -fsanitize=address lib/SS2K/src/sensors/endian.c -o endian.o
+//   clang++ -std=c++11 -g -fsanitize=fuzzer,address,undefined -Ilib/ArduinoCompat/include -Ilib/SS2K/include
+//           test/native/fuzz_SensorDecoders.cpp lib/SS2K/src/sensors/*.cpp endian.o -o fuzz_sensors
+//
+// For AFL, add -D SS2K_FUZZ_STDIN to get a main() that decodes one input from stdin.
+//
+// The unit tests also drive this with truncated and random packets, so every native test run covers it.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensors/CyclePowerData.h"
+#include "sensors/EchelonData.h"
+#include "sensors/FitnessMachineIndoorBikeData.h"
+#include "sensors/FlywheelData.h"
+#include "sensors/HeartRateData.h"
+#include "sensors/PelotonData.h"
+
+static const int FUZZ_DECODER_COUNT = 6;
+
+// Decodes one packet with a fresh decoder, then again so stateful decoders (crank revolutions) compare
+// against a previous packet. The packet is copied to a buffer of exactly its length so any read past the
+// end is caught by the address sanitizer. Returns what the second decode produced.
+SensorSample fuzzSensorDecoder(int decoder, const uint8_t *data, size_t size) {
+  CyclePowerData cyclePower;
+  EchelonData echelon;
+  FitnessMachineIndoorBikeData indoorBike;
+  FlywheelData flywheel;
+  HeartRateData heartRate;
+  PelotonData peloton;
+  SensorData *decoders[FUZZ_DECODER_COUNT] = {&cyclePower, &echelon, &indoorBike, &flywheel, &heartRate, &peloton};
+
+  uint8_t *packet = (uint8_t *)malloc(size ? size : 1);
+  memcpy(packet, data, size);
+  SensorData *sensor = decoders[decoder % FUZZ_DECODER_COUNT];
+  sensor->decode(packet, size);
+  sensor->decode(packet, size);
+  free(packet);
+  return sensor->getSample();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+#ifdef SS2K_FUZZ_DECODER
+  fuzzSensorDecoder(SS2K_FUZZ_DECODER, data, size);
+#else
+  if (size > 0) {
+    fuzzSensorDecoder(data[0], data + 1, size - 1);
+  }
+#endif
+  return 0;
+}
+
+#ifdef SS2K_FUZZ_STDIN
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+  static uint8_t input[4096];
+  size_t size = fread(input, 1, sizeof(input), stdin);
+  return LLVMFuzzerTestOneInput(input, size);
+}
+#endif  // SS2K_FUZZ_STDIN
@@ -33,6 +33,215 @@ void process() {
     TestPowerBuffer testPowerBuffer;
     RUN_TEST(testPowerBuffer.set__should_set_values__expect_values_added_to_correct_index);
   }
+
+  // Power Table Transfer
+  {
+    TestPowerTableCodec test;
+    RUN_TEST(test.encode__full_table__expect_round_trip);
+    RUN_TEST(test.encode__since_version__expect_only_changed_cells);
+    RUN_TEST(test.encode__small_chunks__expect_round_trip);
+    RUN_TEST(test.decode__malformed__expect_false);
+  }
+
+  // Power Table Persistence
+  {
+    TestPowerTableFile test;
+    RUN_TEST(test.save__then_load__expect_saved_table_shifted_to_the_knob);
+    RUN_TEST(test.load__missing_old_or_unmatched__expect_live_table_kept);
+  }
+
+  // BLE Firmware Update
+  {
+    TestOtaReceiver test;
+    RUN_TEST(test.stream__clean_link__expect_image_verified);
+    RUN_TEST(test.stream__slow_flash__expect_backpressure_without_loss);
+    RUN_TEST(test.stream__lossy_link__expect_retransmit_and_verified);
+    RUN_TEST(test.stream__disconnect__expect_resume_from_offset);
+    RUN_TEST(test.finish__wrong_crc__expect_failure);
+    RUN_TEST(test.legacy__short_write__expect_finishing);
+    RUN_TEST(test.fail__from_writer__expect_reset_on_next_packet);
+  }
+
+  // Firmware Patches
+  {
+    TestFirmwarePatch test;
+    RUN_TEST(test.apply__delta__expect_target_rebuilt);
+    RUN_TEST(test.apply__compressed__expect_target_rebuilt);
+    RUN_TEST(test.apply__wrong_source__expect_rejected_before_writing);
+    RUN_TEST(test.apply__corrupt_patch__expect_error);
+  }
+
+  // Web Assets
+  {
+    TestAssetCache test;
+    RUN_TEST(test.etagMatches__header_variants__expect_match);
+    RUN_TEST(test.acceptsGzip__header_variants__expect_parsed);
+    RUN_TEST(test.reserve__over_budget__expect_coldest_evicted);
+    RUN_TEST(test.invalidate__changed_file__expect_both_encodings_dropped);
+    RUN_TEST(test.add__table_full__expect_least_requested_replaced);
+  }
+
+  // Sensor Decoder Dispatch
+  {
+    TestSensorDataFactory test;
+    RUN_TEST(test.getSensorData__same_characteristic__expect_same_decoder);
+    RUN_TEST(test.getKey__uuid_forms__expect_same_key);
+    RUN_TEST(test.getSensorData__unknown__expect_no_data);
+    RUN_TEST(test.getSensorData__pool_full__expect_quiet_peer_reused);
+    RUN_TEST(test.dispatch__benchmark__report_cost_per_packet);
+  }
+
+  // Sensor Samples
+  {
+    TestSensorSample test;
+    RUN_TEST(test.fixed__gatt_resolutions__expect_exact);
+    RUN_TEST(test.decode__ftms_fields__expect_sample_in_one_pass);
+    RUN_TEST(test.decode__peloton_fields__expect_only_received_present);
+  }
+
+  // Sensor Decoder Robustness
+  {
+    TestSensorDecoders test;
+    RUN_TEST(test.decode__truncated_packets__expect_no_overrun);
+    RUN_TEST(test.decode__random_packets__expect_no_overrun);
+    RUN_TEST(test.decode__field_missing_from_next_packet__expect_not_reported);
+    RUN_TEST(test.decode__benchmark__report_packets_per_second);
+  }
+
+  // Sensor Fusion
+  {
+    TestSensorFusion test;
+    RUN_TEST(test.offer__power_meter_and_bike__expect_priority_and_failover);
+    RUN_TEST(test.setPreferBike__meter_bike_and_peloton__expect_bike_first_then_defaults);
+    RUN_TEST(test.offer__implausible_or_no_contact__expect_rejected);
+    RUN_TEST(test.getFresh__sources_go_quiet__expect_fields_expire);
+  }
+
+  // FTMS Indoor Bike Data
+  {
+    TestIndoorBikeData test;
+    RUN_TEST(test.decode__golden_vectors__expect_every_field);
+    RUN_TEST(test.encode__golden_vectors__expect_same_bytes);
+    RUN_TEST(test.decode__truncated__expect_whole_fields_only);
+    RUN_TEST(test.encode__out_of_range__expect_clamped_and_not_available);
+    RUN_TEST(test.encodeNext__small_mtu__expect_split_with_speed_last);
+  }
+
+  // FTMS Ride Totals
+  {
+    TestRideTotals test;
+    RUN_TEST(test.update__simulated_ride__expect_accurate_totals);
+    RUN_TEST(test.update__stops_and_dropouts__expect_not_counted);
+  }
+
+  // SIM Mode Road Model
+  {
+    TestRoadModel test;
+    RUN_TEST(test.power__grid__expect_matches_reference_model);
+    RUN_TEST(test.speed__any_power__expect_inverse_of_power);
+    RUN_TEST(test.fromFtms__golden_vectors__expect_conditions);
+  }
+
+  // SIM Mode Virtual Gearing
+  {
+    TestDrivetrain test;
+    RUN_TEST(test.configure__road_gearing__expect_sorted_ladder);
+    RUN_TEST(test.configure__new_gearing__expect_nearest_gear_kept);
+    RUN_TEST(test.speed__cadence_and_gear__expect_wheel_speed);
+    RUN_TEST(test.shift__past_either_end__expect_clamped);
+    RUN_TEST(test.configure__bad_tables__expect_rejected);
+  }
+
+  // ERG Lookahead
+  {
+    TestErgLookahead test;
+    RUN_TEST(test.schedule__out_of_order__expect_time_order);
+    RUN_TEST(test.next__boundaries_pass__expect_started_dropped);
+    RUN_TEST(test.shouldStart__hard_interval__expect_lead_covers_travel);
+  }
+
+  // ERG Control
+  {
+    TestErgControl test;
+    RUN_TEST(test.targetFromFtms__golden_vectors__expect_watts);
+    RUN_TEST(test.steps__either_side_of_ten_percent__expect_sensitivity_scaled);
+  }
+
+  // Workout Engine
+  {
+    TestWorkout test;
+    RUN_TEST(test.load__golden_file__expect_targets);
+    RUN_TEST(test.load__malformed__expect_rejected);
+    RUN_TEST(test.update__run_and_pause__expect_changes_on_time);
+    RUN_TEST(test.nextBoundary__steady_steps__expect_jump_announced);
+  }
+
+  // Stepper Position Health
+  {
+    TestPositionHealth test;
+    RUN_TEST(test.observeStatus__faults__expect_counted_once);
+    RUN_TEST(test.observeAnchor__consistent_drift__expect_rehome);
+    RUN_TEST(test.observeAnchor__disagreeing_cells__expect_no_rehome);
+    RUN_TEST(test.observeAnchor__after_fault__expect_quicker_rehome);
+  }
+
+  // Stepper Motion Planner
+  {
+    TestMotionPlanner test;
+    RUN_TEST(test.profileTime__short_and_long_moves__expect_trapezoid);
+    RUN_TEST(test.observeStepper__measured_moves__expect_fitted_eta);
+    RUN_TEST(test.reportLostSteps__one_direction__expect_backoff_and_recovery);
+  }
+
+  // Driver Thermal Model
+  {
+    TestThermalModel test;
+    RUN_TEST(test.observe__steady_current__expect_first_order_rise);
+    RUN_TEST(test.measure__sensor_readings__expect_ambient_tracked);
+    RUN_TEST(test.schedule__heating_up__expect_cheapest_fix_first);
+  }
+
+  // Shifter Input
+  {
+    TestShiftInput test;
+    RUN_TEST(test.queue__overfilled__expect_order_kept_and_drops_counted);
+    RUN_TEST(test.gestures__rapid_presses_and_noise__expect_every_press);
+    RUN_TEST(test.gestures__held__expect_one_hold);
+  }
+
+  // Hardware Fakes
+  {
+    TestHAL test;
+    RUN_TEST(test.fakeMotor__move__expect_trapezoid_and_slip);
+    RUN_TEST(test.fakeStorage__files_and_driver__expect_persisted_and_failures);
+    RUN_TEST(test.simulation__planner_on_fake_motor__expect_learned_eta);
+    RUN_TEST(test.stepperControl__loop_on_fakes__expect_limits_fault_and_rehome);
+  }
+
+  // Session Capture and Replay
+  {
+    TestSessionCapture test;
+    RUN_TEST(test.encode__each_record__expect_parsed_back);
+    RUN_TEST(test.replay__virtual_clock__expect_records_on_time);
+    RUN_TEST(test.replay__recorded_ride__expect_same_decoded_outputs);
+    RUN_TEST(test.replay__erg_ride__expect_knob_chases_target);
+  }
+
+  // Device Cache
+  {
+    TestDeviceCache test;
+    RUN_TEST(test.update__repeated_adverts__expect_smoothed_rssi_and_one_first_per_round);
+    RUN_TEST(test.update__cache_full__expect_least_recent_evicted_and_rest_found);
+    RUN_TEST(test.toJSON__named_and_unnamed__expect_settings_page_format);
+  }
+
+  // Peer Cache
+  {
+    TestPeerCache test;
+    RUN_TEST(test.remember__several_peers__expect_found_by_address_and_role);
+    RUN_TEST(test.remember__full_or_failing__expect_least_recent_evicted_and_scan_fallback);
+    RUN_TEST(test.serialize__round_trip__expect_same_peers_and_bad_files_rejected);
+  }
   UNITY_END();
 }
 
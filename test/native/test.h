@@ -26,3 +26,188 @@ class TestPowerBuffer {
  public:
   static void set__should_set_values__expect_values_added_to_correct_index(void);
 };
+
+class TestPowerTableCodec {
+ public:
+  static void encode__full_table__expect_round_trip(void);
+  static void encode__since_version__expect_only_changed_cells(void);
+  static void encode__small_chunks__expect_round_trip(void);
+  static void decode__malformed__expect_false(void);
+};
+
+class TestPowerTableFile {
+ public:
+  static void save__then_load__expect_saved_table_shifted_to_the_knob(void);
+  static void load__missing_old_or_unmatched__expect_live_table_kept(void);
+};
+
+class TestOtaReceiver {
+ public:
+  static void stream__clean_link__expect_image_verified(void);
+  static void stream__slow_flash__expect_backpressure_without_loss(void);
+  static void stream__lossy_link__expect_retransmit_and_verified(void);
+  static void stream__disconnect__expect_resume_from_offset(void);
+  static void finish__wrong_crc__expect_failure(void);
+  static void legacy__short_write__expect_finishing(void);
+  static void fail__from_writer__expect_reset_on_next_packet(void);
+};
+
+class TestFirmwarePatch {
+ public:
+  static void apply__delta__expect_target_rebuilt(void);
+  static void apply__compressed__expect_target_rebuilt(void);
+  static void apply__wrong_source__expect_rejected_before_writing(void);
+  static void apply__corrupt_patch__expect_error(void);
+};
+
+class TestAssetCache {
+ public:
+  static void etagMatches__header_variants__expect_match(void);
+  static void acceptsGzip__header_variants__expect_parsed(void);
+  static void reserve__over_budget__expect_coldest_evicted(void);
+  static void invalidate__changed_file__expect_both_encodings_dropped(void);
+  static void add__table_full__expect_least_requested_replaced(void);
+};
+
+class TestSensorDataFactory {
+ public:
+  static void getSensorData__same_characteristic__expect_same_decoder(void);
+  static void getKey__uuid_forms__expect_same_key(void);
+  static void getSensorData__unknown__expect_no_data(void);
+  static void getSensorData__pool_full__expect_quiet_peer_reused(void);
+  static void dispatch__benchmark__report_cost_per_packet(void);
+};
+
+class TestSensorSample {
+ public:
+  static void fixed__gatt_resolutions__expect_exact(void);
+  static void decode__ftms_fields__expect_sample_in_one_pass(void);
+  static void decode__peloton_fields__expect_only_received_present(void);
+};
+
+class TestSensorFusion {
+ public:
+  static void offer__power_meter_and_bike__expect_priority_and_failover(void);
+  static void setPreferBike__meter_bike_and_peloton__expect_bike_first_then_defaults(void);
+  static void offer__implausible_or_no_contact__expect_rejected(void);
+  static void getFresh__sources_go_quiet__expect_fields_expire(void);
+};
+
+class TestSensorDecoders {
+ public:
+  static void decode__truncated_packets__expect_no_overrun(void);
+  static void decode__random_packets__expect_no_overrun(void);
+  static void decode__field_missing_from_next_packet__expect_not_reported(void);
+  static void decode__benchmark__report_packets_per_second(void);
+};
+
+class TestIndoorBikeData {
+ public:
+  static void decode__golden_vectors__expect_every_field(void);
+  static void encode__golden_vectors__expect_same_bytes(void);
+  static void decode__truncated__expect_whole_fields_only(void);
+  static void encode__out_of_range__expect_clamped_and_not_available(void);
+  static void encodeNext__small_mtu__expect_split_with_speed_last(void);
+};
+
+class TestRideTotals {
+ public:
+  static void update__simulated_ride__expect_accurate_totals(void);
+  static void update__stops_and_dropouts__expect_not_counted(void);
+};
+
+class TestRoadModel {
+ public:
+  static void power__grid__expect_matches_reference_model(void);
+  static void speed__any_power__expect_inverse_of_power(void);
+  static void fromFtms__golden_vectors__expect_conditions(void);
+};
+
+class TestDrivetrain {
+ public:
+  static void configure__road_gearing__expect_sorted_ladder(void);
+  static void configure__new_gearing__expect_nearest_gear_kept(void);
+  static void speed__cadence_and_gear__expect_wheel_speed(void);
+  static void shift__past_either_end__expect_clamped(void);
+  static void configure__bad_tables__expect_rejected(void);
+};
+
+class TestErgLookahead {
+ public:
+  static void schedule__out_of_order__expect_time_order(void);
+  static void next__boundaries_pass__expect_started_dropped(void);
+  static void shouldStart__hard_interval__expect_lead_covers_travel(void);
+};
+
+class TestErgControl {
+ public:
+  static void targetFromFtms__golden_vectors__expect_watts(void);
+  static void steps__either_side_of_ten_percent__expect_sensitivity_scaled(void);
+};
+
+class TestWorkout {
+ public:
+  static void load__golden_file__expect_targets(void);
+  static void load__malformed__expect_rejected(void);
+  static void update__run_and_pause__expect_changes_on_time(void);
+  static void nextBoundary__steady_steps__expect_jump_announced(void);
+};
+
+class TestPositionHealth {
+ public:
+  static void observeStatus__faults__expect_counted_once(void);
+  static void observeAnchor__consistent_drift__expect_rehome(void);
+  static void observeAnchor__disagreeing_cells__expect_no_rehome(void);
+  static void observeAnchor__after_fault__expect_quicker_rehome(void);
+};
+
+class TestMotionPlanner {
+ public:
+  static void profileTime__short_and_long_moves__expect_trapezoid(void);
+  static void observeStepper__measured_moves__expect_fitted_eta(void);
+  static void reportLostSteps__one_direction__expect_backoff_and_recovery(void);
+};
+
+class TestHAL {
+ public:
+  static void fakeMotor__move__expect_trapezoid_and_slip(void);
+  static void fakeStorage__files_and_driver__expect_persisted_and_failures(void);
+  static void simulation__planner_on_fake_motor__expect_learned_eta(void);
+  static void stepperControl__loop_on_fakes__expect_limits_fault_and_rehome(void);
+};
+
+class TestSessionCapture {
+ public:
+  static void encode__each_record__expect_parsed_back(void);
+  static void replay__virtual_clock__expect_records_on_time(void);
+  static void replay__recorded_ride__expect_same_decoded_outputs(void);
+  static void replay__erg_ride__expect_knob_chases_target(void);
+};
+
+class TestShiftInput {
+ public:
+  static void queue__overfilled__expect_order_kept_and_drops_counted(void);
+  static void gestures__rapid_presses_and_noise__expect_every_press(void);
+  static void gestures__held__expect_one_hold(void);
+};
+
+class TestThermalModel {
+ public:
+  static void observe__steady_current__expect_first_order_rise(void);
+  static void measure__sensor_readings__expect_ambient_tracked(void);
+  static void schedule__heating_up__expect_cheapest_fix_first(void);
+};
+
+class TestDeviceCache {
+ public:
+  static void update__repeated_adverts__expect_smoothed_rssi_and_one_first_per_round(void);
+  static void update__cache_full__expect_least_recent_evicted_and_rest_found(void);
+  static void toJSON__named_and_unnamed__expect_settings_page_format(void);
+};
+
+class TestPeerCache {
+ public:
+  static void remember__several_peers__expect_found_by_address_and_role(void);
+  static void remember__full_or_failing__expect_least_recent_evicted_and_scan_fallback(void);
+  static void serialize__round_trip__expect_same_peers_and_bad_files_rejected(void);
+};
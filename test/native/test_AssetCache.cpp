@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <stdio.h>
+#include "AssetCache.h"
+#include "test.h"
+
+void TestAssetCache::etagMatches__header_variants__expect_match(void) {
+  uint32_t etag = 0x1a2b3c4d;
+  char formatted[AssetCache::ETAG_LENGTH];
+  AssetCache::formatEtag(etag, formatted);
+  TEST_ASSERT_EQUAL_STRING("\"1a2b3c4d\"", formatted);
+
+  TEST_ASSERT_TRUE(AssetCache::etagMatches("\"1a2b3c4d\"", etag));
+  TEST_ASSERT_TRUE(AssetCache::etagMatches("W/\"1a2b3c4d\"", etag));
+  TEST_ASSERT_TRUE(AssetCache::etagMatches("\"00000000\", \"1a2b3c4d\"", etag));
+  TEST_ASSERT_TRUE(AssetCache::etagMatches("*", etag));
+  TEST_ASSERT_FALSE(AssetCache::etagMatches("\"1a2b3c4e\"", etag));
+  TEST_ASSERT_FALSE(AssetCache::etagMatches("", etag));
+  TEST_ASSERT_FALSE(AssetCache::etagMatches(nullptr, etag));
+}
+
+void TestAssetCache::acceptsGzip__header_variants__expect_parsed(void) {
+  TEST_ASSERT_TRUE(AssetCache::acceptsGzip("gzip, deflate, br"));
+  TEST_ASSERT_TRUE(AssetCache::acceptsGzip("br;q=1.0, GZIP;q=0.8"));
+  TEST_ASSERT_TRUE(AssetCache::acceptsGzip("*"));
+  TEST_ASSERT_FALSE(AssetCache::acceptsGzip("gzip;q=0, deflate"));
+  TEST_ASSERT_FALSE(AssetCache::acceptsGzip("deflate, br"));
+  TEST_ASSERT_FALSE(AssetCache::acceptsGzip("x-gzip"));
+  TEST_ASSERT_FALSE(AssetCache::acceptsGzip(""));
+}
+
+void TestAssetCache::reserve__over_budget__expect_coldest_evicted(void) {
+  AssetCache cache(3000, 2000);
+  AssetCache::Entry *style = cache.add("/style.css", true, 1, 1200);
+  AssetCache::Entry *index = cache.add("/index.html", true, 2, 1000);
+  style->hits              = 5;
+  index->hits              = 2;
+  TEST_ASSERT_NOT_NULL(cache.reserve(style));
+  TEST_ASSERT_NOT_NULL(cache.reserve(index));
+  TEST_ASSERT_EQUAL_INT(2200, cache.getUsed());
+
+  // Too big to ever hold
+  AssetCache::Entry *settings = cache.add("/settings.html", true, 3, 2900);
+  settings->hits              = 100;
+  TEST_ASSERT_NULL(cache.reserve(settings));
+
+  // Less popular than everything held: not worth evicting for
+  AssetCache::Entry *shift = cache.add("/shift.html", true, 4, 1100);
+  shift->hits              = 1;
+  TEST_ASSERT_NULL(cache.reserve(shift));
+
+  // More popular than index.html, which makes way
+  shift->hits = 3;
+  TEST_ASSERT_NOT_NULL(cache.reserve(shift));
+  TEST_ASSERT_NULL(index->data);
+  TEST_ASSERT_NOT_NULL(style->data);
+  TEST_ASSERT_EQUAL_INT(2300, cache.getUsed());
+}
+
+void TestAssetCache::invalidate__changed_file__expect_both_encodings_dropped(void) {
+  AssetCache cache(8192, 4096);
+  AssetCache::Entry *gzip = cache.add("/status.html", true, 1, 500);
+  gzip->hits              = 1;
+  TEST_ASSERT_NOT_NULL(cache.reserve(gzip));
+  cache.add("/status.html", false, 2, 900);
+  cache.add("/style.css", true, 3, 400);
+
+  cache.invalidate("/status.html");
+  TEST_ASSERT_NULL(cache.find("/status.html", true));
+  TEST_ASSERT_NULL(cache.find("/status.html", false));
+  TEST_ASSERT_NOT_NULL(cache.find("/style.css", true));
+  TEST_ASSERT_EQUAL_INT(0, cache.getUsed());
+
+  // Re-adding with a new hash replaces the old one in place
+  AssetCache::Entry *style = cache.add("/style.css", true, 4, 450);
+  TEST_ASSERT_EQUAL_INT(4, style->etag);
+  TEST_ASSERT_TRUE(style == cache.find("/style.css", true));
+}
+
+void TestAssetCache::add__table_full__expect_least_requested_replaced(void) {
+  AssetCache cache(8192, 4096);
+  char path[AssetCache::MAX_PATH];
+  for (size_t i = 0; i < AssetCache::MAX_ENTRIES; i++) {
+    snprintf(path, sizeof(path), "/file%d.html", (int)i);
+    cache.add(path, true, i, 100)->hits = (i == 7) ? 0 : 10;
+  }
+  cache.add("/new.html", true, 99, 100);
+  TEST_ASSERT_NULL(cache.find("/file7.html", true));
+  TEST_ASSERT_NOT_NULL(cache.find("/file6.html", true));
+  TEST_ASSERT_NOT_NULL(cache.find("/new.html", true));
+
+  // Paths that don't fit aren't tracked
+  TEST_ASSERT_NULL(cache.add("/a/very/long/path/that/does/not/fit.html", true, 1, 1));
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <string.h>
+#include <unity.h>
+#include "DeviceCache.h"
+#include "test.h"
+
+static const uint64_t KICKR = 0xe1a2b3c4d5f6;
+static const uint64_t HRM   = 0xc00000000042;
+
+void TestDeviceCache::update__repeated_adverts__expect_smoothed_rssi_and_one_first_per_round(void) {
+  DeviceCache cache;
+  bool first;
+
+  DeviceCache::Device *device = cache.update(0, KICKR, -60, DeviceCache::FitnessMachine, first);
+  TEST_ASSERT_TRUE(first);
+  TEST_ASSERT_EQUAL_INT(-60, DeviceCache::getRssi(*device));
+  // One stray reading only moves it a quarter of the way
+  device = cache.update(100, KICKR, -80, DeviceCache::CyclingPower, first);
+  TEST_ASSERT_FALSE(first);
+  TEST_ASSERT_EQUAL_INT(-65, DeviceCache::getRssi(*device));
+  TEST_ASSERT_EQUAL_HEX8(DeviceCache::FitnessMachine | DeviceCache::CyclingPower, device->services);
+  TEST_ASSERT_EQUAL_UINT32(2, device->adverts);
+
+  cache.newRound();
+  cache.update(200, KICKR, -65, 0, first);
+  TEST_ASSERT_TRUE(first);
+  cache.update(300, KICKR, -65, 0, first);
+  TEST_ASSERT_FALSE(first);
+  TEST_ASSERT_EQUAL_INT(1, cache.size());
+  TEST_ASSERT_EQUAL_UINT32(300, cache.find(KICKR)->lastSeenMs);
+  TEST_ASSERT_NULL(cache.find(HRM));
+}
+
+void TestDeviceCache::update__cache_full__expect_least_recent_evicted_and_rest_found(void) {
+  DeviceCache cache;
+  bool first;
+
+  // 24 devices in 32 slots, so some have to probe past others
+  for (uint32_t i = 0; i < DeviceCache::MAX_DEVICES; i++) {
+    cache.update(1000 + i, 0x10000 + ((uint64_t)i << 32), -70, DeviceCache::HeartRate, first);
+  }
+  TEST_ASSERT_EQUAL_INT(DeviceCache::MAX_DEVICES, cache.size());
+  // Hearing the first one again leaves the second as the oldest
+  cache.update(2000, 0x10000, -70, DeviceCache::HeartRate, first);
+  cache.update(2001, HRM, -50, DeviceCache::HeartRate, first);
+
+  TEST_ASSERT_EQUAL_INT(DeviceCache::MAX_DEVICES, cache.size());
+  TEST_ASSERT_NULL(cache.find(0x10000 + (1ULL << 32)));
+  TEST_ASSERT_NOT_NULL(cache.find(HRM));
+  for (uint32_t i = 0; i < DeviceCache::MAX_DEVICES; i++) {
+    if (i != 1) {
+      TEST_ASSERT_NOT_NULL(cache.find(0x10000 + ((uint64_t)i << 32)));
+    }
+  }
+
+  cache.clear();
+  TEST_ASSERT_EQUAL_INT(0, cache.size());
+  TEST_ASSERT_NULL(cache.find(HRM));
+}
+
+void TestDeviceCache::toJSON__named_and_unnamed__expect_settings_page_format(void) {
+  DeviceCache cache;
+  bool first;
+  char json[512];
+
+  TEST_ASSERT_EQUAL_INT(2, cache.toJSON(0, json, sizeof(json)));
+  TEST_ASSERT_EQUAL_STRING("{}", json);
+
+  DeviceCache::Device *device = cache.update(1000, KICKR, -60, DeviceCache::CyclingPower | DeviceCache::FitnessMachine, first);
+  cache.setName(device, "KICKR \"CORE\"", 12);
+  cache.update(1500, HRM, -70, DeviceCache::HeartRate, first);
+  // Heard, but nothing we could connect to
+  cache.update(1500, 0x123456, -40, 0, first);
+
+  size_t length = cache.toJSON(2000, json, sizeof(json));
+  TEST_ASSERT_EQUAL_INT(strlen(json), length);
+  TEST_ASSERT_NOT_NULL(strstr(json, "{\"name\":\"KICKR \\\"CORE\\\" f6\",\"UUID\":\"0x1826\",\"rssi\":-60,\"ageMs\":1000}"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "{\"name\":\"c0:00:00:00:00:42\",\"UUID\":\"0x180d\",\"rssi\":-70,\"ageMs\":500}"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"device 1\""));
+  TEST_ASSERT_NULL(strstr(json, "\"device 2\""));
+
+  // Devices that don't fit are left out whole
+  length = cache.toJSON(2000, json, 100);
+  TEST_ASSERT_LESS_THAN(100, length);
+  TEST_ASSERT_EQUAL_INT('}', json[length - 1]);
+  TEST_ASSERT_NULL(strstr(json, "\"device 1\""));
+}
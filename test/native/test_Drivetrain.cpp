@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "Drivetrain.h"
+#include "test.h"
+
+void TestDrivetrain::configure__road_gearing__expect_sorted_ladder(void) {
+  Drivetrain drivetrain;
+  TEST_ASSERT_TRUE(drivetrain.configure("34, 50", "11,12,13,14,15,17,19,21,24,28", 2105));
+
+  // 20 pairings less two doubles: 34x19 is within 1% of 50x28, and 50x19 of 34x13
+  size_t count = drivetrain.getGearCount();
+  TEST_ASSERT_EQUAL_INT(18, count);
+  drivetrain.setGear(0);
+  TEST_ASSERT_EQUAL_INT(34, drivetrain.getCurrent().chainring);
+  TEST_ASSERT_EQUAL_INT(28, drivetrain.getCurrent().cog);
+  float last = 0;
+  for (size_t i = 0; i < count; i++) {
+    drivetrain.setGear(i);
+    TEST_ASSERT_TRUE(drivetrain.getCurrent().ratio > last * 1.01f);
+    last = drivetrain.getCurrent().ratio;
+  }
+  TEST_ASSERT_EQUAL_INT(50, drivetrain.getCurrent().chainring);
+  TEST_ASSERT_EQUAL_INT(11, drivetrain.getCurrent().cog);
+
+  // The same gearing again leaves the rider where they are
+  TEST_ASSERT_TRUE(drivetrain.configure("34,50", "11,12,13,14,15,17,19,21,24,28", 2105));
+  TEST_ASSERT_EQUAL_INT(50, drivetrain.getCurrent().chainring);
+  TEST_ASSERT_EQUAL_INT(11, drivetrain.getCurrent().cog);
+}
+
+void TestDrivetrain::configure__new_gearing__expect_nearest_gear_kept(void) {
+  // Starts in the gear closest to 2:1
+  Drivetrain drivetrain;
+  drivetrain.configure("34,50", "11,12,13,14,15,17,19,21,24,28", 2105);
+  TEST_ASSERT_EQUAL_INT(34, drivetrain.getCurrent().chainring);
+  TEST_ASSERT_EQUAL_INT(17, drivetrain.getCurrent().cog);
+
+  // 50x11 is 4.55, 52x11 at 4.73 is the closest the new gearing has
+  drivetrain.setGear(drivetrain.getGearCount() - 1);
+  TEST_ASSERT_TRUE(drivetrain.configure("36,52", "11,12,13,14,15,17,19,21,24,28", 2105));
+  TEST_ASSERT_EQUAL_INT(52, drivetrain.getCurrent().chainring);
+  TEST_ASSERT_EQUAL_INT(11, drivetrain.getCurrent().cog);
+
+  // A new wheel keeps the gear and changes the speed
+  size_t gear = drivetrain.getGear();
+  float speed = drivetrain.speed(90);
+  TEST_ASSERT_TRUE(drivetrain.configure("36,52", "11,12,13,14,15,17,19,21,24,28", 2200));
+  TEST_ASSERT_EQUAL_INT(gear, drivetrain.getGear());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, speed * 2200 / 2105, drivetrain.speed(90));
+}
+
+void TestDrivetrain::speed__cadence_and_gear__expect_wheel_speed(void) {
+  Drivetrain drivetrain;
+  drivetrain.configure("50", "11", 2127);
+  // 90 RPM * 50/11 * 2.127 m / 60 s
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 14.502, drivetrain.speed(90));
+  TEST_ASSERT_EQUAL_FLOAT(0, drivetrain.speed(0));
+
+  // Single speed with a 1:1 ratio is the wheel turning at cadence
+  drivetrain.configure("20", "20", 2000);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 2.0, drivetrain.speed(60));
+}
+
+void TestDrivetrain::shift__past_either_end__expect_clamped(void) {
+  Drivetrain drivetrain;
+  drivetrain.configure("40", "11,13,15,17,19", 2105);
+  TEST_ASSERT_EQUAL_INT(5, drivetrain.getGearCount());
+  TEST_ASSERT_EQUAL_INT(19, drivetrain.getCurrent().cog);  // 40/19 is closest to 2
+
+  TEST_ASSERT_EQUAL_INT(2, drivetrain.shift(2));
+  TEST_ASSERT_EQUAL_INT(15, drivetrain.getCurrent().cog);
+  TEST_ASSERT_EQUAL_INT(2, drivetrain.shift(5));
+  TEST_ASSERT_EQUAL_INT(11, drivetrain.getCurrent().cog);
+  TEST_ASSERT_EQUAL_INT(0, drivetrain.shift(1));
+  TEST_ASSERT_EQUAL_INT(-4, drivetrain.shift(-10));
+  TEST_ASSERT_EQUAL_INT(0, drivetrain.getGear());
+}
+
+void TestDrivetrain::configure__bad_tables__expect_rejected(void) {
+  Drivetrain drivetrain;
+  drivetrain.configure("40", "11,13,15,17,19", 2105);
+  const char *bad[] = {"", " ", "34,,50", "34,", ",34", "0", "256", "34;50", "34x", "-34", "a"};
+  for (const char *text : bad) {
+    TEST_ASSERT_FALSE(drivetrain.configure(text, "11,13", 2105));
+    TEST_ASSERT_FALSE(drivetrain.configure("34", text, 2105));
+  }
+  TEST_ASSERT_FALSE(drivetrain.configure("34", "11,13", 0));
+  TEST_ASSERT_FALSE(drivetrain.configure(nullptr, "11,13", 2105));
+  TEST_ASSERT_FALSE(drivetrain.configure("22,32,42,52", "11,13", 2105));                  // Too many chainrings
+  TEST_ASSERT_FALSE(drivetrain.configure("34", "10,11,12,13,14,15,16,17,18,19,20,21,22,23", 2105));  // Too many cogs
+
+  // Kept the last good one
+  TEST_ASSERT_EQUAL_INT(5, drivetrain.getGearCount());
+  TEST_ASSERT_EQUAL_INT(40, drivetrain.getCurrent().chainring);
+
+  uint8_t teeth[Drivetrain::MAX_COGS];
+  TEST_ASSERT_EQUAL_INT(12, Drivetrain::parseTeeth("10,11,12,13,14,15,17,19,21,24,28,33", teeth, Drivetrain::MAX_COGS));
+  TEST_ASSERT_EQUAL_INT(33, teeth[11]);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "ErgControl.h"
+#include "test.h"
+
+void TestErgControl::targetFromFtms__golden_vectors__expect_watts(void) {
+  int watts                = 123;
+  const uint8_t twoHund[]  = {0xc8, 0x00};
+  const uint8_t big[]      = {0x10, 0x27};  // 10000
+  const uint8_t signedHi[] = {0x00, 0x80};
+  TEST_ASSERT_FALSE(ErgControl::targetFromFtms(twoHund, 1, &watts));
+  TEST_ASSERT_EQUAL_INT(123, watts);
+  TEST_ASSERT_TRUE(ErgControl::targetFromFtms(twoHund, sizeof(twoHund), &watts));
+  TEST_ASSERT_EQUAL_INT(200, watts);
+  TEST_ASSERT_TRUE(ErgControl::targetFromFtms(big, sizeof(big), &watts));
+  TEST_ASSERT_EQUAL_INT(10000, watts);
+  TEST_ASSERT_TRUE(ErgControl::targetFromFtms(signedHi, sizeof(signedHi), &watts));
+  TEST_ASSERT_EQUAL_INT(-32768, watts);
+}
+
+void TestErgControl::steps__either_side_of_ten_percent__expect_sensitivity_scaled(void) {
+  // 25% under: full sensitivity, doubled for a new target
+  TEST_ASSERT_EQUAL_FLOAT(1250, ErgControl::inSetpoint(1000, 150, 200, 5));
+  TEST_ASSERT_EQUAL_FLOAT(1500, ErgControl::setPointChange(1000, 150, 200, 5));
+  // 5% over: half sensitivity either way
+  TEST_ASSERT_EQUAL_FLOAT(975, ErgControl::inSetpoint(1000, 210, 200, 5));
+  TEST_ASSERT_EQUAL_FLOAT(975, ErgControl::setPointChange(1000, 210, 200, 5));
+  TEST_ASSERT_EQUAL_FLOAT(1000, ErgControl::inSetpoint(1000, 200, 200, 5));
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "ErgLookahead.h"
+#include "test.h"
+
+void TestErgLookahead::schedule__out_of_order__expect_time_order(void) {
+  ErgLookahead lookahead;
+  TEST_ASSERT_TRUE(lookahead.schedule(1000, 5000, 250));
+  TEST_ASSERT_TRUE(lookahead.schedule(1000, 2000, 300));
+  TEST_ASSERT_TRUE(lookahead.schedule(1000, 8000, 150));
+  TEST_ASSERT_EQUAL_INT(3, lookahead.getCount());
+  TEST_ASSERT_EQUAL_INT(3000, lookahead.get(0).atMs);
+  TEST_ASSERT_EQUAL_INT(6000, lookahead.get(1).atMs);
+  TEST_ASSERT_EQUAL_INT(9000, lookahead.get(2).atMs);
+
+  // The app announcing the same boundary again, a little later, changes the watts rather than adding one
+  TEST_ASSERT_TRUE(lookahead.schedule(1100, 1950, 320));
+  TEST_ASSERT_EQUAL_INT(3, lookahead.getCount());
+  TEST_ASSERT_EQUAL_INT(320, lookahead.get(0).watts);
+
+  for (uint32_t i = 3; i < ErgLookahead::MAX_TARGETS; i++) {
+    TEST_ASSERT_TRUE(lookahead.schedule(1000, 10000 + i * 1000, 200));
+  }
+  TEST_ASSERT_FALSE(lookahead.schedule(1000, 60000, 200));
+  lookahead.clear();
+  TEST_ASSERT_NULL(lookahead.next(1000));
+}
+
+void TestErgLookahead::next__boundaries_pass__expect_started_dropped(void) {
+  // Across a millis() wrap
+  const uint32_t start = 0xFFFFF000;
+  ErgLookahead lookahead;
+  lookahead.schedule(start, 2000, 300);
+  lookahead.schedule(start, 6000, 100);
+
+  TEST_ASSERT_EQUAL_INT(300, lookahead.next(start)->watts);
+  TEST_ASSERT_EQUAL_INT(300, lookahead.next(start + 1999)->watts);
+  TEST_ASSERT_EQUAL_INT(100, lookahead.next(start + 2000)->watts);
+  TEST_ASSERT_EQUAL_INT(1, lookahead.getCount());
+  TEST_ASSERT_NULL(lookahead.next(start + 6000));
+  TEST_ASSERT_EQUAL_INT(0, lookahead.getCount());
+}
+
+void TestErgLookahead::shouldStart__hard_interval__expect_lead_covers_travel(void) {
+  ErgLookahead lookahead;
+  lookahead.schedule(0, 10000, 400);
+  const ErgLookahead::Target *target = lookahead.next(0);
+
+  // 3 s of travel, plus the margin
+  TEST_ASSERT_FALSE(ErgLookahead::shouldStart(6699, *target, 3000));
+  TEST_ASSERT_TRUE(ErgLookahead::shouldStart(6700, *target, 3000));
+
+  // Already there: only the margin
+  TEST_ASSERT_FALSE(ErgLookahead::shouldStart(9699, *target, 0));
+  TEST_ASSERT_TRUE(ErgLookahead::shouldStart(9700, *target, 0));
+
+  // Never more than MAX_LEAD_MS early
+  ErgLookahead::Target far = {20000, 400};
+  TEST_ASSERT_FALSE(ErgLookahead::shouldStart(9699, far, 60000));
+  TEST_ASSERT_TRUE(ErgLookahead::shouldStart(9700, far, 60000));
+}
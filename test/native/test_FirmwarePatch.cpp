@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "FirmwarePatch.h"
+#include "OtaReceiver.h"
+#include "test.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+struct PatchTarget {
+  const Bytes *source;
+  Bytes flash;
+};
+
+static bool readSource(void *context, uint32_t offset, uint8_t *data, size_t length) {
+  const Bytes *source = ((PatchTarget *)context)->source;
+  if (offset + length > source->size()) {
+    return false;
+  }
+  memcpy(data, source->data() + offset, length);
+  return true;
+}
+
+static bool writeFlash(void *context, const uint8_t *data, size_t length) {
+  Bytes &flash = ((PatchTarget *)context)->flash;
+  flash.insert(flash.end(), data, data + length);
+  return true;
+}
+
+static void putVarint(Bytes &out, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out.push_back(value ? (byte | 0x80) : byte);
+  } while (value);
+}
+
+static void put32(Bytes &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+static size_t matchLength(const Bytes &a, size_t aPos, const Bytes &b, size_t bPos) {
+  size_t length = 0;
+  while ((aPos + length < a.size()) && (bPos + length < b.size()) && (a[aPos + length] == b[bPos + length])) {
+    length++;
+  }
+  return length;
+}
+
+// Same greedy approach as firmware_patch.py, small enough for test images.
+static Bytes makePatch(const Bytes &target, const Bytes &source) {
+  const size_t block = 16;
+  std::map<std::string, size_t> sourceIndex;
+  for (size_t pos = 0; pos + block <= source.size(); pos++) {
+    sourceIndex.insert(std::make_pair(std::string(source.begin() + pos, source.begin() + pos + block), pos));
+  }
+  std::map<std::string, size_t> windowIndex;
+
+  Bytes ops, literal;
+  size_t sourceCursor = 0;
+  size_t i            = 0;
+  while (i < target.size()) {
+    uint8_t kind = 0;
+    size_t best  = 0;
+    size_t arg   = 0;
+
+    std::vector<size_t> candidates(1, sourceCursor);
+    if (i + block <= target.size()) {
+      std::map<std::string, size_t>::iterator found = sourceIndex.find(std::string(target.begin() + i, target.begin() + i + block));
+      if (found != sourceIndex.end()) {
+        candidates.push_back(found->second);
+      }
+    }
+    for (size_t c = 0; c < candidates.size(); c++) {
+      size_t length = (candidates[c] < source.size()) ? matchLength(source, candidates[c], target, i) : 0;
+      if ((length >= block) && (length > best)) {
+        kind = FirmwarePatch::OP_COPY;
+        best = length;
+        arg  = candidates[c];
+      }
+    }
+    std::string key(target.begin() + i, target.begin() + std::min(i + 4, target.size()));
+    std::map<std::string, size_t>::iterator previous = windowIndex.find(key);
+    if ((previous != windowIndex.end()) && (i - previous->second <= FirmwarePatch::WINDOW)) {
+      size_t length = matchLength(target, previous->second, target, i);
+      if ((length >= 6) && (length > best)) {
+        kind = FirmwarePatch::OP_MATCH;
+        best = length;
+        arg  = i - previous->second;
+      }
+    }
+
+    if (kind == 0) {
+      windowIndex[key] = i;
+      literal.push_back(target[i++]);
+      continue;
+    }
+    if (!literal.empty()) {
+      ops.push_back((uint8_t)FirmwarePatch::OP_LITERAL);
+      putVarint(ops, literal.size());
+      ops.insert(ops.end(), literal.begin(), literal.end());
+      literal.clear();
+    }
+    ops.push_back(kind);
+    if (kind == FirmwarePatch::OP_COPY) {
+      int32_t delta = (int32_t)arg - (int32_t)sourceCursor;
+      putVarint(ops, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+      sourceCursor = arg + best;
+    } else {
+      putVarint(ops, arg);
+    }
+    putVarint(ops, best);
+    for (size_t pos = i; pos < i + best; pos++) {
+      windowIndex[std::string(target.begin() + pos, target.begin() + std::min(pos + 4, target.size()))] = pos;
+    }
+    i += best;
+  }
+  if (!literal.empty()) {
+    ops.push_back((uint8_t)FirmwarePatch::OP_LITERAL);
+    putVarint(ops, literal.size());
+    ops.insert(ops.end(), literal.begin(), literal.end());
+  }
+
+  Bytes patch = {'S', '2', 'K', 'P', FirmwarePatch::VERSION, 0, 0, 0};
+  put32(patch, target.size());
+  put32(patch, OtaReceiver::crc32(0, target.data(), target.size()));
+  put32(patch, source.size());
+  put32(patch, source.empty() ? 0 : OtaReceiver::crc32(0, source.data(), source.size()));
+  patch.insert(patch.end(), ops.begin(), ops.end());
+  return patch;
+}
+
+// Something shaped like firmware: repeated instruction patterns, tables and a few strings.
+static Bytes makeImage(size_t size, uint32_t seed) {
+  Bytes image(1, (uint8_t)OtaReceiver::ESP_IMAGE_MAGIC);
+  const char *strings[] = {"SmartSpin2k", "Stepper position %d", "BLE_Client", "Connected to %s"};
+  while (image.size() < size) {
+    seed = seed * 1103515245 + 12345;
+    switch ((seed >> 16) % 4) {
+      case 0: {  // Function prologue and some random operands
+        const uint8_t prologue[] = {0x36, 0x41, 0x00, 0x0c, 0x02, 0x1d, 0xf0};
+        image.insert(image.end(), prologue, prologue + sizeof(prologue));
+        for (int i = 0; i < 9; i++) {
+          seed = seed * 1103515245 + 12345;
+          image.push_back((uint8_t)(seed >> 16));
+        }
+        break;
+      }
+      case 1:
+        for (int i = 0; i < 16; i++) {
+          image.push_back((uint8_t)(i * 3));
+        }
+        break;
+      case 2: {
+        const char *s = strings[(seed >> 20) % 4];
+        image.insert(image.end(), s, s + strlen(s) + 1);
+        break;
+      }
+      default:
+        for (int i = 0; i < 12; i++) {
+          seed = seed * 1103515245 + 12345;
+          image.push_back((uint8_t)(seed >> 16));
+        }
+        break;
+    }
+  }
+  image.resize(size);
+  return image;
+}
+
+static bool applyPatch(const Bytes &patch, const Bytes &source, Bytes *flash, FirmwarePatch::Error *error) {
+  PatchTarget target     = {&source, Bytes()};
+  FirmwarePatch *decoder = new FirmwarePatch(readSource, writeFlash, &target);
+  // Odd chunk sizes so ops and varints get split across writes.
+  bool ok = true;
+  for (size_t pos = 0, step = 1; ok && (pos < patch.size()); pos += step, step = (step * 7 + 3) % 601 + 1) {
+    ok = decoder->write(patch.data() + pos, std::min(step, patch.size() - pos));
+  }
+  ok     = ok && decoder->finish();
+  *flash = target.flash;
+  *error = decoder->getError();
+  delete decoder;
+  return ok;
+}
+
+void TestFirmwarePatch::apply__delta__expect_target_rebuilt(void) {
+  Bytes source = makeImage(64 * 1024, 1);
+  Bytes target = source;
+  // A new release: a function grew, a string changed, a table moved and the tail was rebuilt.
+  Bytes inserted = makeImage(700, 2);
+  target.insert(target.begin() + 5000, inserted.begin(), inserted.end());
+  target[20000] ^= 0xFF;
+  target[20001] ^= 0x55;
+  target.erase(target.begin() + 30000, target.begin() + 30500);
+  Bytes tail = makeImage(3000, 3);
+  std::copy(tail.begin(), tail.end(), target.end() - tail.size());
+
+  Bytes patch = makePatch(target, source);
+  Bytes flash;
+  FirmwarePatch::Error error;
+  TEST_ASSERT_TRUE(applyPatch(patch, source, &flash, &error));
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::PATCH_OK, error);
+  TEST_ASSERT_TRUE(flash == target);
+  // Only the changes should travel.
+  TEST_ASSERT_LESS_THAN(target.size() / 10, patch.size());
+}
+
+void TestFirmwarePatch::apply__compressed__expect_target_rebuilt(void) {
+  Bytes target = makeImage(48 * 1024, 4);
+  Bytes patch  = makePatch(target, Bytes());
+  Bytes flash;
+  FirmwarePatch::Error error;
+  TEST_ASSERT_TRUE(applyPatch(patch, Bytes(), &flash, &error));
+  TEST_ASSERT_TRUE(flash == target);
+  TEST_ASSERT_LESS_THAN(target.size(), patch.size());
+}
+
+void TestFirmwarePatch::apply__wrong_source__expect_rejected_before_writing(void) {
+  Bytes source = makeImage(16 * 1024, 5);
+  Bytes target = source;
+  target[100]  = 0;
+  Bytes patch  = makePatch(target, source);
+
+  Bytes other = source;
+  other[8000] ^= 1;
+  Bytes flash;
+  FirmwarePatch::Error error;
+  TEST_ASSERT_FALSE(applyPatch(patch, other, &flash, &error));
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::PATCH_SOURCE_MISMATCH, error);
+  TEST_ASSERT_EQUAL_INT(0, flash.size());
+}
+
+void TestFirmwarePatch::apply__corrupt_patch__expect_error(void) {
+  Bytes source = makeImage(16 * 1024, 6);
+  Bytes target = makeImage(16 * 1024, 7);
+  Bytes patch  = makePatch(target, source);
+  Bytes flash;
+  FirmwarePatch::Error error;
+
+  Bytes truncated(patch.begin(), patch.end() - 10);
+  TEST_ASSERT_FALSE(applyPatch(truncated, source, &flash, &error));
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::PATCH_INCOMPLETE, error);
+
+  Bytes badOp = patch;
+  badOp[FirmwarePatch::HEADER_SIZE] = 0x7F;
+  TEST_ASSERT_FALSE(applyPatch(badOp, source, &flash, &error));
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::PATCH_BAD_OP, error);
+
+  // Flip a literal byte: every op still parses, only the crc can catch it.
+  Bytes flipped = patch;
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::OP_LITERAL, flipped[FirmwarePatch::HEADER_SIZE]);
+  flipped[FirmwarePatch::HEADER_SIZE + 3] ^= 0x01;
+  TEST_ASSERT_FALSE(applyPatch(flipped, source, &flash, &error));
+  TEST_ASSERT_EQUAL_INT(FirmwarePatch::PATCH_CRC, error);
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "hal/Fakes.h"
+#include "MotionPlanner.h"
+#include "PositionHealth.h"
+#include "StepperControl.h"
+#include "test.h"
+
+void TestHAL::fakeMotor__move__expect_trapezoid_and_slip(void) {
+  FakeClock clock;
+  FakeMotor motor(clock, 50);
+  motor.setSpeed(1000);
+  motor.setAcceleration(1000);
+  motor.moveTo(3000);  // 1s up to speed, 2s at speed, 1s braking, after 50ms enabling
+  TEST_ASSERT_TRUE(motor.isRunning());
+  TEST_ASSERT_EQUAL_INT(3000, motor.getTargetPosition());
+  clock.advanceMs(50);
+  TEST_ASSERT_EQUAL_INT(0, motor.getCurrentPosition());
+  clock.advanceMs(1000);
+  TEST_ASSERT_INT_WITHIN(1, 500, motor.getCurrentPosition());
+  clock.advanceMs(1000);
+  TEST_ASSERT_INT_WITHIN(1, 1500, motor.getCurrentPosition());
+  clock.advanceMs(1999);
+  TEST_ASSERT_TRUE(motor.isRunning());
+  clock.advanceMs(1);
+  TEST_ASSERT_FALSE(motor.isRunning());
+  TEST_ASSERT_EQUAL_INT(3000, motor.getCurrentPosition());
+
+  // Holding keeps the outputs on, so the next move starts straight away
+  motor.setHoldEnabled(true);
+  motor.moveTo(2000);
+  clock.advanceMs(1000);
+  TEST_ASSERT_INT_WITHIN(1, 2500, motor.getCurrentPosition());
+  motor.stopMove();
+  TEST_ASSERT_FALSE(motor.isRunning());
+
+  // Lost steps only show against the real position, and re-homing puts the count back on it
+  motor.slip(-120);
+  TEST_ASSERT_EQUAL_INT(motor.getCurrentPosition() - 120, motor.getActualPosition());
+  motor.setCurrentPosition(motor.getCurrentPosition() - 120);
+  TEST_ASSERT_EQUAL_INT(motor.getCurrentPosition(), motor.getActualPosition());
+  TEST_ASSERT_EQUAL_INT(2, motor.getMoves());
+}
+
+void TestHAL::fakeStorage__files_and_driver__expect_persisted_and_failures(void) {
+  FakeFileSystem fileSystem;
+  const uint8_t data[] = {1, 2, 3, 4, 5};
+  uint8_t buffer[8];
+  TEST_ASSERT_EQUAL_INT(-1, fileSystem.size("/missing.bin"));
+  TEST_ASSERT_EQUAL_INT(-1, fileSystem.read("/missing.bin", 0, buffer, sizeof(buffer)));
+  TEST_ASSERT_TRUE(fileSystem.write("/a.bin", data, sizeof(data)));
+  TEST_ASSERT_EQUAL_INT(5, fileSystem.size("/a.bin"));
+  TEST_ASSERT_EQUAL_INT(3, fileSystem.read("/a.bin", 0, buffer, 3));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, buffer, 3);
+  TEST_ASSERT_TRUE(fileSystem.append("/a.bin", data, 2));
+  TEST_ASSERT_EQUAL_INT(3, fileSystem.read("/a.bin", 4, buffer, sizeof(buffer)));  // Stops at the end
+  TEST_ASSERT_EQUAL_INT(5, buffer[0]);
+  TEST_ASSERT_EQUAL_INT(2, buffer[2]);
+  TEST_ASSERT_EQUAL_INT(0, fileSystem.read("/a.bin", 10, buffer, sizeof(buffer)));
+
+  // Replacing a file frees its old space first
+  fileSystem.capacity = 8;
+  TEST_ASSERT_TRUE(fileSystem.write("/a.bin", data, sizeof(data)));
+  TEST_ASSERT_FALSE(fileSystem.write("/b.bin", data, sizeof(data)));
+  TEST_ASSERT_EQUAL_INT(-1, fileSystem.size("/b.bin"));
+  TEST_ASSERT_TRUE(fileSystem.remove("/a.bin"));
+  TEST_ASSERT_FALSE(fileSystem.remove("/a.bin"));
+  TEST_ASSERT_TRUE(fileSystem.write("/b.bin", data, sizeof(data)));
+  TEST_ASSERT_EQUAL_INT(4, fileSystem.writes);
+
+  FakeMotorDriver driver;
+  driver.status      = PositionHealth::OTPW;
+  driver.failedReads = 1;
+  uint32_t status    = 0;
+  TEST_ASSERT_FALSE(driver.readStatus(status));
+  TEST_ASSERT_TRUE(driver.readStatus(status));
+  TEST_ASSERT_EQUAL_HEX32(PositionHealth::OTPW, status);
+  driver.setCurrent(900, 0.5f);
+  TEST_ASSERT_EQUAL_INT(900, driver.runMa);
+  TEST_ASSERT_TRUE(driver.getCurrentScale() > 0);
+}
+
+void TestHAL::simulation__planner_on_fake_motor__expect_learned_eta(void) {
+  // Half an hour of ERG-like moves with the maintenance loop's 5ms tick, against a motor that takes 80ms to enable
+  FakeClock clock;
+  FakeMotor motor(clock, 80);
+  MotionPlanner planner(3000, 2000);
+  uint32_t seed = 12345;
+  for (uint32_t tick = 0; tick < 30 * 60 * 200; tick++) {
+    if ((tick % 2000) == 0) {
+      seed                           = seed * 1103515245 + 12345;
+      int32_t destination            = (seed >> 16) % 20000;
+      MotionPlanner::Profile profile = planner.plan(motor.getCurrentPosition(), destination);
+      motor.setSpeed(profile.speed);
+      motor.setAcceleration(profile.acceleration);
+      motor.moveTo(destination);
+    }
+    planner.observeStepper(clock.nowMs(), motor.getCurrentPosition(), motor.isRunning());
+    clock.advanceMs(5);
+  }
+  TEST_ASSERT_TRUE(planner.getMoves() > 150);
+
+  // The learned time for a move matches what the motor takes
+  motor.moveTo(0);
+  clock.advanceMs(10000);
+  uint32_t eta   = planner.eta(0, 9000);
+  uint32_t start = clock.nowMs();
+  motor.moveTo(9000);
+  while (motor.isRunning()) {
+    clock.advanceMs(1);
+  }
+  TEST_ASSERT_INT_WITHIN(15, clock.nowMs() - start, eta);
+}
+
+void TestHAL::stepperControl__loop_on_fakes__expect_limits_fault_and_rehome(void) {
+  // The stepper half of the maintenance loop: poll, move and read the driver every 5ms
+  FakeClock clock;
+  FakeMotor motor(clock, 20);
+  FakeMotorDriver driver;
+  MotionPlanner planner(3000, 2000);
+  PositionHealth health;
+  StepperControl control(planner, health);
+  uint32_t status = 0;
+
+  // Targets past the limits stop at them, and only a new destination is a new move
+  control.poll(motor, clock.nowMs());
+  TEST_ASSERT_TRUE(control.moveTo(motor, 50000, -1000, 8000));
+  TEST_ASSERT_FALSE(control.moveTo(motor, 9000, -1000, 8000));
+  TEST_ASSERT_EQUAL_INT(8000, motor.getTargetPosition());
+  TEST_ASSERT_EQUAL_INT(3000, motor.getSpeed());
+
+  // A short while moving is a fault, and tightening backs off
+  clock.advanceMs(500);
+  control.poll(motor, clock.nowMs());
+  TEST_ASSERT_TRUE(control.isRunning());
+  driver.status = PositionHealth::SHORTS;
+  TEST_ASSERT_TRUE(control.readDriverStatus(driver, status));
+  TEST_ASSERT_FALSE(health.isTrusted());
+  TEST_ASSERT_TRUE(planner.getScale(true) < 100);
+  TEST_ASSERT_EQUAL_INT(100, planner.getScale(false));
+  TEST_ASSERT_FALSE(control.readDriverStatus(driver, status));  // Already suspect
+  driver.failedReads = 1;
+  TEST_ASSERT_FALSE(control.readDriverStatus(driver, status));
+  TEST_ASSERT_EQUAL_INT(1, health.getCounters().readErrors);
+
+  // The knob fell 150 steps behind the count. The correction waits for the move to finish.
+  motor.slip(-150);
+  control.rehome(150);
+  int32_t rehomed = 0;
+  for (int tick = 0; (tick < 2000) && (rehomed == 0); tick++) {
+    rehomed = control.poll(motor, clock.nowMs());
+    TEST_ASSERT_TRUE((rehomed == 0) || !motor.isRunning());
+    control.moveTo(motor, 8000, -1000, 8000);
+    clock.advanceMs(5);
+  }
+  TEST_ASSERT_EQUAL_INT(150, rehomed);
+  TEST_ASSERT_EQUAL_INT(motor.getActualPosition(), control.getPosition());
+  TEST_ASSERT_EQUAL_INT(8000 - 150, control.getPosition());
+  TEST_ASSERT_EQUAL_INT(0, control.poll(motor, clock.nowMs()));
+}
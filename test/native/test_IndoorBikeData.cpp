@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "IndoorBikeData.h"
+#include "sensors/SensorSample.h"
+#include "test.h"
+
+// Every field, in packet order.
+static const uint8_t allFields[] = {
+    0xfe, 0x1f,        // Flags, everything but More Data
+    0xf2, 0x08,        // Speed 22.90 km/h
+    0x34, 0x08,        // Average speed 21.00 km/h
+    0xb0, 0x00,        // Cadence 88 RPM
+    0xab, 0x00,        // Average cadence 85.5 RPM
+    0x39, 0x30, 0x00,  // Distance 12345 m
+    0xfb, 0xff,        // Resistance -5
+    0xfa, 0x00,        // Power 250 W
+    0xc8, 0x00,        // Average power 200 W
+    0x41, 0x01,        // Energy 321 kcal
+    0x84, 0x03,        // 900 kcal/h
+    0x0f,              // 15 kcal/min
+    0x8e,              // Heart rate 142
+    0x55,              // 8.5 METs
+    0x10, 0x0e,        // Elapsed 3600 s
+    0x58, 0x02,        // Remaining 600 s
+};
+
+// What our own FTMS server sends: speed, cadence, resistance, power and heart rate.
+static const uint8_t serverFields[] = {0x64, 0x02, 0x91, 0x0c, 0xb0, 0x00, 0x1e, 0x00, 0x40, 0x00, 0x78};
+
+void TestIndoorBikeData::decode__golden_vectors__expect_every_field(void) {
+  IndoorBikeData::Values values;
+  TEST_ASSERT_TRUE(IndoorBikeData::decode(allFields, sizeof(allFields), &values));
+  TEST_ASSERT_EQUAL_INT((int)IndoorBikeData::MAX_LENGTH, (int)sizeof(allFields));
+  TEST_ASSERT_EQUAL_HEX16(0x7fff, values.present);
+  TEST_ASSERT_EQUAL_INT(2290, values.raw[IndoorBikeData::InstantaneousSpeed]);
+  TEST_ASSERT_EQUAL_INT(2100, values.raw[IndoorBikeData::AverageSpeed]);
+  TEST_ASSERT_EQUAL_INT(176, values.raw[IndoorBikeData::InstantaneousCadence]);
+  TEST_ASSERT_EQUAL_INT(171, values.raw[IndoorBikeData::AverageCadence]);
+  TEST_ASSERT_EQUAL_INT(12345, values.raw[IndoorBikeData::TotalDistance]);
+  TEST_ASSERT_EQUAL_INT(-5, values.raw[IndoorBikeData::ResistanceLevel]);
+  TEST_ASSERT_EQUAL_INT(250, values.raw[IndoorBikeData::InstantaneousPower]);
+  TEST_ASSERT_EQUAL_INT(200, values.raw[IndoorBikeData::AveragePower]);
+  TEST_ASSERT_EQUAL_INT(321, values.raw[IndoorBikeData::TotalEnergy]);
+  TEST_ASSERT_EQUAL_INT(900, values.raw[IndoorBikeData::EnergyPerHour]);
+  TEST_ASSERT_EQUAL_INT(15, values.raw[IndoorBikeData::EnergyPerMinute]);
+  TEST_ASSERT_EQUAL_INT(142, values.raw[IndoorBikeData::HeartRate]);
+  TEST_ASSERT_EQUAL_INT(85, values.raw[IndoorBikeData::MetabolicEquivalent]);
+  TEST_ASSERT_EQUAL_INT(3600, values.raw[IndoorBikeData::ElapsedTime]);
+  TEST_ASSERT_EQUAL_INT(600, values.raw[IndoorBikeData::RemainingTime]);
+
+  // Fixed point in real units, exactly
+  TEST_ASSERT_EQUAL_INT(SensorSample::fixed(2290, 100), values.getFixed(IndoorBikeData::InstantaneousSpeed));
+  TEST_ASSERT_EQUAL_INT(171 << (SensorSample::FRACTION_BITS - 1), values.getFixed(IndoorBikeData::AverageCadence));
+  TEST_ASSERT_EQUAL_FLOAT(8.5, SensorSample::fromFixed(values.getFixed(IndoorBikeData::MetabolicEquivalent)));
+
+  // More Data set: the second half of a split record, no speed
+  const uint8_t split[] = {0x01, 0x08, 0x10, 0x0e};
+  TEST_ASSERT_TRUE(IndoorBikeData::decode(split, sizeof(split), &values));
+  TEST_ASSERT_EQUAL_HEX16(IndoorBikeData::bit(IndoorBikeData::ElapsedTime), values.present);
+}
+
+void TestIndoorBikeData::encode__golden_vectors__expect_same_bytes(void) {
+  IndoorBikeData::Values values;
+  uint8_t out[IndoorBikeData::MAX_LENGTH];
+  IndoorBikeData::decode(allFields, sizeof(allFields), &values);
+  TEST_ASSERT_EQUAL_INT(sizeof(allFields), IndoorBikeData::encode(values, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(allFields, out, sizeof(allFields));
+
+  values.clear();
+  values.setFixed(IndoorBikeData::InstantaneousSpeed, SensorSample::toFixed(32.17));
+  values.setFixed(IndoorBikeData::InstantaneousCadence, SensorSample::toFixed(88.2));  // Nearest half RPM
+  values.set(IndoorBikeData::ResistanceLevel, 30);
+  values.set(IndoorBikeData::InstantaneousPower, 64);
+  values.set(IndoorBikeData::HeartRate, 120);
+  TEST_ASSERT_EQUAL_INT(sizeof(serverFields), IndoorBikeData::encode(values, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(serverFields, out, sizeof(serverFields));
+  TEST_ASSERT_EQUAL_INT(sizeof(serverFields), IndoorBikeData::lengthOf(values.present));
+  TEST_ASSERT_EQUAL_HEX16(0x0264, IndoorBikeData::flagsFor(values.present));
+
+  // Doesn't fit
+  TEST_ASSERT_EQUAL_INT(0, IndoorBikeData::encode(values, out, sizeof(serverFields) - 1));
+}
+
+void TestIndoorBikeData::decode__truncated__expect_whole_fields_only(void) {
+  IndoorBikeData::Values values;
+  TEST_ASSERT_FALSE(IndoorBikeData::decode(allFields, 1, &values));
+  TEST_ASSERT_EQUAL_HEX16(0, values.present);
+
+  // Cut in the middle of the distance
+  TEST_ASSERT_FALSE(IndoorBikeData::decode(allFields, 12, &values));
+  TEST_ASSERT_EQUAL_HEX16(0x000f, values.present);
+  TEST_ASSERT_EQUAL_INT(171, values.raw[IndoorBikeData::AverageCadence]);
+
+  for (size_t length = 0; length < sizeof(allFields); length++) {
+    TEST_ASSERT_FALSE(IndoorBikeData::decode(allFields, length, &values));
+  }
+}
+
+void TestIndoorBikeData::encode__out_of_range__expect_clamped_and_not_available(void) {
+  IndoorBikeData::Values values;
+  uint8_t out[IndoorBikeData::MAX_LENGTH];
+  values.clear();
+  values.set(IndoorBikeData::InstantaneousPower, 40000);
+  values.set(IndoorBikeData::InstantaneousCadence, -4);
+  values.set(IndoorBikeData::TotalEnergy, 70000);
+  size_t length = IndoorBikeData::encode(values, out, sizeof(out));
+
+  // Energy per hour and per minute go out as "not available" and come back missing
+  const uint8_t expected[] = {0x45, 0x01, 0x00, 0x00, 0xff, 0x7f, 0xfe, 0xff, 0xff, 0xff, 0xff};
+  TEST_ASSERT_EQUAL_INT(sizeof(expected), length);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, sizeof(expected));
+
+  IndoorBikeData::Values decoded;
+  TEST_ASSERT_TRUE(IndoorBikeData::decode(out, length, &decoded));
+  TEST_ASSERT_EQUAL_HEX16(IndoorBikeData::bit(IndoorBikeData::InstantaneousCadence) | IndoorBikeData::bit(IndoorBikeData::InstantaneousPower) |
+                              IndoorBikeData::bit(IndoorBikeData::TotalEnergy),
+                          decoded.present);
+  TEST_ASSERT_EQUAL_INT(32767, decoded.raw[IndoorBikeData::InstantaneousPower]);
+  TEST_ASSERT_EQUAL_INT(0xfffe, decoded.raw[IndoorBikeData::TotalEnergy]);
+}
+
+void TestIndoorBikeData::encodeNext__small_mtu__expect_split_with_speed_last(void) {
+  IndoorBikeData::Values values;
+  IndoorBikeData::decode(allFields, sizeof(allFields), &values);
+
+  // Default ATT MTU of 23 leaves 20 bytes per notification
+  uint8_t packet[20];
+  uint16_t sent = 0;
+  size_t length;
+  IndoorBikeData::Values merged;
+  merged.clear();
+  int packets = 0;
+  while ((length = IndoorBikeData::encodeNext(values, &sent, packet, sizeof(packet))) > 0) {
+    IndoorBikeData::Values part;
+    TEST_ASSERT_TRUE(length <= sizeof(packet));
+    TEST_ASSERT_TRUE(IndoorBikeData::decode(packet, length, &part));
+    packets++;
+    // More Data on all but the last, which carries the speed
+    bool last = (sent == values.present);
+    TEST_ASSERT_EQUAL_INT(last ? 0 : 1, packet[0] & 0x01);
+    TEST_ASSERT_EQUAL_INT(last, part.has(IndoorBikeData::InstantaneousSpeed));
+    for (int field = 0; field < IndoorBikeData::FIELD_COUNT; field++) {
+      if (part.has((IndoorBikeData::Field)field)) {
+        TEST_ASSERT_FALSE(merged.has((IndoorBikeData::Field)field));
+        merged.set((IndoorBikeData::Field)field, part.raw[field]);
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(2, packets);
+  TEST_ASSERT_EQUAL_HEX16(values.present, merged.present);
+  for (int field = 0; field < IndoorBikeData::FIELD_COUNT; field++) {
+    TEST_ASSERT_EQUAL_INT(values.raw[field], merged.raw[field]);
+  }
+
+  // Fits in one: the same bytes as encode()
+  uint8_t whole[IndoorBikeData::MAX_LENGTH];
+  sent = 0;
+  TEST_ASSERT_EQUAL_INT(sizeof(allFields), IndoorBikeData::encodeNext(values, &sent, whole, sizeof(whole)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(allFields, whole, sizeof(allFields));
+  TEST_ASSERT_EQUAL_INT(0, IndoorBikeData::encodeNext(values, &sent, whole, sizeof(whole)));
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "MotionPlanner.h"
+#include "test.h"
+
+void TestMotionPlanner::profileTime__short_and_long_moves__expect_trapezoid(void) {
+  MotionPlanner::Profile profile = {3500, 3000};
+  // Never reaches full speed: 2 * sqrt(d / a)
+  TEST_ASSERT_FLOAT_WITHIN(1, 365.1f, MotionPlanner::profileTime(100, profile));
+  // Full speed from 3500^2 / 3000 = 4083 steps: d / v + v / a
+  TEST_ASSERT_FLOAT_WITHIN(1, 4023.8f, MotionPlanner::profileTime(10000, profile));
+  TEST_ASSERT_EQUAL_FLOAT(0, MotionPlanner::profileTime(0, profile));
+}
+
+void TestMotionPlanner::observeStepper__measured_moves__expect_fitted_eta(void) {
+  MotionPlanner planner(3500, 3000);
+  TEST_ASSERT_EQUAL_INT(1155, planner.eta(0, 1000));  // Ideal until it has seen some moves
+
+  // This bike takes 1.2x the ideal time plus 80ms to enable the driver
+  uint32_t now     = 0;
+  int32_t position = 0;
+  const int32_t distances[] = {200, -1500, 4000, -800, 6000, -2500, 300, 1000};
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    planner.observeStepper(now, position, true);
+    MotionPlanner::Profile profile = planner.plan(position, position + distances[i]);
+    now += (uint32_t)(1.2f * MotionPlanner::profileTime(distances[i] < 0 ? -distances[i] : distances[i], profile) + 80);
+    position += distances[i];
+    planner.observeStepper(now, position, false);
+    now += 1000;
+    planner.observeStepper(now, position, false);
+  }
+  TEST_ASSERT_EQUAL_INT(8, planner.getMoves());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.2f, planner.getGain());
+  TEST_ASSERT_FLOAT_WITHIN(2, 80, planner.getLatency());
+  TEST_ASSERT_INT_WITHIN(3, 1466, planner.eta(5000, 6000));
+  TEST_ASSERT_EQUAL_INT(0, planner.eta(5000, 5000));
+}
+
+void TestMotionPlanner::reportLostSteps__one_direction__expect_backoff_and_recovery(void) {
+  MotionPlanner planner(3000, 3000);
+  for (int i = 0; i < 10; i++) {
+    planner.reportLostSteps(true);
+  }
+  TEST_ASSERT_EQUAL_INT(MotionPlanner::MIN_SCALE_PERCENT, planner.getScale(true));
+  TEST_ASSERT_EQUAL_INT(100, planner.getScale(false));  // Loosening is still at full speed
+  TEST_ASSERT_EQUAL_INT(1500, planner.plan(0, 100).speed);
+  TEST_ASSERT_EQUAL_INT(3000, planner.plan(100, 0).speed);
+
+  // Clean tightening moves earn the speed back a step at a time
+  uint32_t now = 0;
+  for (uint32_t i = 0; i < MotionPlanner::CLEAN_MOVES; i++) {
+    planner.observeStepper(now, i * 10, true);
+    planner.observeStepper(now + 20, i * 10 + 10, false);
+    now += 100;
+  }
+  TEST_ASSERT_EQUAL_INT(55, planner.getScale(true));
+}
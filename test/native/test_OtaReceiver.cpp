@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <deque>
+#include <vector>
+#include "OtaReceiver.h"
+#include "test.h"
+
+// Emulates an uploader talking to OtaReceiver over a link that can drop packets, with a writer that
+// only gets to run every few packets like a slow flash would.
+class OtaUploaderEmulator {
+ public:
+  OtaReceiver receiver;
+  std::vector<uint8_t> image;
+  std::vector<uint8_t> flash;
+  size_t payload      = 244;  // 247 byte MTU
+  size_t dropEvery    = 0;    // Drop every Nth DATA packet, 0 for a perfect link
+  size_t writerEvery  = 3;    // Packets delivered per buffer the writer gets to flush
+  size_t disconnectAt = 0;    // Drop the link once this many bytes are acked, 0 to never
+  size_t bytesSent    = 0;
+  size_t resumeOffset = 0;
+  uint8_t endStatus   = 0xFF;
+  bool busySeen       = false;
+
+  explicit OtaUploaderEmulator(size_t size) {
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      image.push_back((uint8_t)(seed >> 16));
+    }
+  }
+
+  bool run() {
+    uint32_t crc = OtaReceiver::crc32(0, image.data(), image.size());
+    begin(crc);
+    size_t delivered = 0;
+    size_t idle      = 0;
+    bool endSent     = false;
+
+    for (int step = 0; step < 100000; step++) {
+      // Fill the window
+      while (!endSent && (sendOffset < image.size()) && ((uint16_t)(nextSeq - ackedSeq - 1) < window)) {
+        std::vector<uint8_t> packet;
+        packet.push_back((uint8_t)OtaReceiver::OP_DATA);
+        packet.push_back(nextSeq & 0xFF);
+        packet.push_back(nextSeq >> 8);
+        size_t take = (image.size() - sendOffset < payload) ? image.size() - sendOffset : payload;
+        packet.insert(packet.end(), image.begin() + sendOffset, image.begin() + sendOffset + take);
+        sendOffset += take;
+        nextSeq++;
+        bytesSent += take;
+        sent++;
+        if ((dropEvery == 0) || (sent % dropEvery != 0)) {
+          link.push_back(packet);
+        }
+      }
+      if (!endSent && (ackedOffset == image.size())) {
+        link.push_back(std::vector<uint8_t>(1, (uint8_t)OtaReceiver::OP_END));
+        endSent = true;
+      }
+
+      bool progress = false;
+      if (!link.empty()) {
+        deliver(link.front());
+        link.pop_front();
+        delivered++;
+        progress = true;
+      }
+      if ((delivered % writerEvery == 0) || link.empty()) {
+        progress |= runWriter();
+      }
+      if (endStatus != 0xFF) {
+        return endStatus == OtaReceiver::STATUS_OK;
+      }
+
+      if ((disconnectAt != 0) && (ackedOffset >= disconnectAt)) {
+        disconnectAt = 0;
+        link.clear();
+        begin(crc);
+        resumeOffset = sendOffset;
+        continue;
+      }
+
+      // Nothing moving: the tail of the window was lost. Go back to the last ack.
+      idle = progress ? 0 : idle + 1;
+      if (idle > 2) {
+        sendOffset = ackedOffset;
+        nextSeq    = ackedSeq + 1;
+        endSent    = false;
+        idle       = 0;
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::deque<std::vector<uint8_t>> link;
+  size_t sendOffset  = 0;
+  size_t ackedOffset = 0;
+  uint16_t nextSeq   = 0;
+  uint16_t ackedSeq  = 0xFFFF;
+  uint8_t window   = 1;
+  size_t sent      = 0;
+  uint32_t now       = 0;
+
+  void begin(uint32_t crc) {
+    uint8_t packet[9] = {OtaReceiver::OP_BEGIN};
+    uint32_t size     = image.size();
+    for (int i = 0; i < 4; i++) {
+      packet[1 + i] = (size >> (8 * i)) & 0xFF;
+      packet[5 + i] = (crc >> (8 * i)) & 0xFF;
+    }
+    deliver(std::vector<uint8_t>(packet, packet + sizeof(packet)));
+  }
+
+  void deliver(const std::vector<uint8_t> &packet) {
+    uint8_t reply[16];
+    size_t replyLength;
+    now += 5;
+    receiver.onPacket(packet.data(), packet.size(), now, reply, &replyLength);
+    handleReply(reply, replyLength);
+  }
+
+  bool runWriter() {
+    size_t length;
+    uint32_t token;
+    const uint8_t *buffer = receiver.nextFlush(&length, &token);
+    uint8_t reply[16];
+    size_t replyLength = 0;
+    if (buffer != nullptr) {
+      flash.insert(flash.end(), buffer, buffer + length);
+      receiver.flushed(token, 1000, reply, &replyLength);
+      handleReply(reply, replyLength);
+      return true;
+    }
+    if (receiver.isDrained()) {
+      receiver.finish(reply, &replyLength);
+      handleReply(reply, replyLength);
+      return true;
+    }
+    return false;
+  }
+
+  static uint32_t get32(const uint8_t *data) { return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24); }
+
+  void handleReply(const uint8_t *reply, size_t length) {
+    if (length == 0) {
+      return;
+    }
+    switch (reply[0]) {
+      case OtaReceiver::REPLY_BEGIN:
+        sendOffset  = get32(reply + 2);
+        ackedOffset = sendOffset;
+        window      = reply[6];
+        nextSeq     = 0;
+        ackedSeq    = 0xFFFF;
+        break;
+      case OtaReceiver::REPLY_ACK:
+        ackedSeq    = reply[1] | (reply[2] << 8);
+        ackedOffset = get32(reply + 3);
+        break;
+      case OtaReceiver::REPLY_NAK:
+        busySeen |= (reply[1] == OtaReceiver::STATUS_BUSY);
+        nextSeq     = reply[2] | (reply[3] << 8);
+        sendOffset  = get32(reply + 4);
+        ackedSeq    = nextSeq - 1;
+        ackedOffset = sendOffset;
+        break;
+      case OtaReceiver::REPLY_END:
+        endStatus = reply[1];
+        break;
+    }
+  }
+};
+
+void TestOtaReceiver::stream__clean_link__expect_image_verified(void) {
+  OtaUploaderEmulator uploader(100000);
+  TEST_ASSERT_TRUE(uploader.run());
+  TEST_ASSERT_TRUE(uploader.flash == uploader.image);
+  TEST_ASSERT_EQUAL_INT(uploader.image.size(), uploader.bytesSent);
+  TEST_ASSERT_EQUAL_INT(0, uploader.receiver.getStats().naks);
+  TEST_ASSERT_EQUAL_INT((100000 + OtaReceiver::BUFFER_SIZE - 1) / OtaReceiver::BUFFER_SIZE, uploader.receiver.getStats().flushes);
+  TEST_ASSERT_TRUE(uploader.receiver.getThroughput() > 0);
+}
+
+void TestOtaReceiver::stream__slow_flash__expect_backpressure_without_loss(void) {
+  OtaUploaderEmulator uploader(50000);
+  uploader.writerEvery = 40;
+  TEST_ASSERT_TRUE(uploader.run());
+  TEST_ASSERT_TRUE(uploader.flash == uploader.image);
+  // Held acks should keep the host inside the buffers, so nothing gets refused.
+  TEST_ASSERT_FALSE(uploader.busySeen);
+  TEST_ASSERT_EQUAL_INT(uploader.image.size(), uploader.bytesSent);
+}
+
+void TestOtaReceiver::stream__lossy_link__expect_retransmit_and_verified(void) {
+  OtaUploaderEmulator uploader(60000);
+  uploader.dropEvery = 17;
+  TEST_ASSERT_TRUE(uploader.run());
+  TEST_ASSERT_TRUE(uploader.flash == uploader.image);
+  TEST_ASSERT_TRUE(uploader.bytesSent > uploader.image.size());
+  TEST_ASSERT_TRUE(uploader.receiver.getStats().naks > 0);
+}
+
+void TestOtaReceiver::stream__disconnect__expect_resume_from_offset(void) {
+  OtaUploaderEmulator uploader(80000);
+  uploader.disconnectAt = 30000;
+  TEST_ASSERT_TRUE(uploader.run());
+  TEST_ASSERT_TRUE(uploader.flash == uploader.image);
+  TEST_ASSERT_TRUE(uploader.resumeOffset >= 30000);
+  // Only the unacked window is sent twice.
+  TEST_ASSERT_TRUE(uploader.bytesSent < uploader.image.size() + OtaReceiver::WINDOW * uploader.payload);
+}
+
+void TestOtaReceiver::finish__wrong_crc__expect_failure(void) {
+  OtaReceiver receiver;
+  uint8_t reply[16];
+  size_t replyLength;
+  uint8_t begin[9] = {OtaReceiver::OP_BEGIN, 4, 0, 0, 0, 0xDE, 0xAD, 0xBE, 0xEF};
+  TEST_ASSERT_EQUAL_INT(OtaReceiver::OTA_STARTED, receiver.onPacket(begin, sizeof(begin), 0, reply, &replyLength));
+  uint8_t data[7] = {OtaReceiver::OP_DATA, 0, 0, 1, 2, 3, 4};
+  receiver.onPacket(data, sizeof(data), 0, reply, &replyLength);
+  TEST_ASSERT_EQUAL_INT(OtaReceiver::REPLY_ACK, reply[0]);
+  uint8_t end = OtaReceiver::OP_END;
+  TEST_ASSERT_TRUE(receiver.onPacket(&end, 1, 0, reply, &replyLength) & OtaReceiver::OTA_FINISHING);
+
+  size_t length;
+  uint32_t token;
+  TEST_ASSERT_NOT_NULL(receiver.nextFlush(&length, &token));
+  TEST_ASSERT_EQUAL_INT(4, length);
+  receiver.flushed(token, 10, reply, &replyLength);
+  TEST_ASSERT_TRUE(receiver.isDrained());
+  TEST_ASSERT_FALSE(receiver.finish(reply, &replyLength));
+  TEST_ASSERT_EQUAL_INT(2, replyLength);
+  TEST_ASSERT_EQUAL_INT(OtaReceiver::STATUS_CRC, reply[1]);
+}
+
+void TestOtaReceiver::legacy__short_write__expect_finishing(void) {
+  OtaReceiver receiver;
+  uint8_t reply[16];
+  size_t replyLength;
+  uint8_t chunk[OtaReceiver::LEGACY_CHUNK] = {OtaReceiver::ESP_IMAGE_MAGIC};
+  std::vector<uint8_t> flash;
+
+  uint8_t events = OtaReceiver::OTA_NONE;
+  size_t writes  = 0;
+  while (writes < 20) {
+    events = receiver.onPacket(chunk, sizeof(chunk), 0, reply, &replyLength);
+    TEST_ASSERT_EQUAL_INT(0, replyLength);
+    if (events & OtaReceiver::OTA_BUSY) {
+      // Legacy has no acks, the caller waits for the writer.
+      size_t length;
+      uint32_t token;
+      const uint8_t *buffer = receiver.nextFlush(&length, &token);
+      TEST_ASSERT_NOT_NULL(buffer);
+      flash.insert(flash.end(), buffer, buffer + length);
+      receiver.flushed(token, 10, reply, &replyLength);
+      continue;
+    }
+    writes++;
+  }
+  TEST_ASSERT_TRUE(receiver.isLegacy());
+  events = receiver.onPacket(chunk, 100, 0, reply, &replyLength);
+  TEST_ASSERT_TRUE(events & OtaReceiver::OTA_FINISHING);
+
+  size_t length;
+  uint32_t token;
+  const uint8_t *buffer;
+  while ((buffer = receiver.nextFlush(&length, &token)) != nullptr) {
+    flash.insert(flash.end(), buffer, buffer + length);
+    receiver.flushed(token, 10, reply, &replyLength);
+  }
+  TEST_ASSERT_TRUE(receiver.isDrained());
+  TEST_ASSERT_EQUAL_INT(20 * OtaReceiver::LEGACY_CHUNK + 100, flash.size());
+  TEST_ASSERT_TRUE(receiver.finish(reply, &replyLength));
+  TEST_ASSERT_EQUAL_INT(1, replyLength);
+  TEST_ASSERT_EQUAL_HEX8(OtaReceiver::LEGACY_DONE, reply[0]);
+  receiver.fail(OtaReceiver::STATUS_FLASH, reply, &replyLength);
+  TEST_ASSERT_EQUAL_INT(1, replyLength);
+  TEST_ASSERT_EQUAL_HEX8(OtaReceiver::LEGACY_FAILED, reply[0]);
+}
+
+void TestOtaReceiver::fail__from_writer__expect_reset_on_next_packet(void) {
+  OtaReceiver receiver;
+  uint8_t reply[16];
+  size_t replyLength;
+  uint8_t begin[9] = {OtaReceiver::OP_BEGIN, 0, 0x20, 0, 0, 0xDE, 0xAD, 0xBE, 0xEF};
+  receiver.onPacket(begin, sizeof(begin), 0, reply, &replyLength);
+  std::vector<uint8_t> data(3 + 200, 0x55);
+  data[0] = OtaReceiver::OP_DATA;
+  for (uint16_t seq = 0; seq < 30; seq++) {
+    data[1] = seq & 0xFF;
+    data[2] = seq >> 8;
+    receiver.onPacket(data.data(), data.size(), 0, reply, &replyLength);
+  }
+  uint32_t token = receiver.getToken();
+
+  // The writer reports the failure but leaves the session to the packet side.
+  receiver.fail(OtaReceiver::STATUS_FLASH, reply, &replyLength);
+  TEST_ASSERT_EQUAL_INT(2, replyLength);
+  TEST_ASSERT_EQUAL_HEX8(OtaReceiver::REPLY_END, reply[0]);
+  TEST_ASSERT_EQUAL_INT(OtaReceiver::STATUS_FLASH, reply[1]);
+  TEST_ASSERT_FALSE(receiver.isActive());
+  TEST_ASSERT_EQUAL_INT(token, receiver.getToken());
+  size_t length;
+  TEST_ASSERT_NULL(receiver.nextFlush(&length, &token));
+
+  TEST_ASSERT_EQUAL_INT(OtaReceiver::OTA_STARTED, receiver.onPacket(begin, sizeof(begin), 0, reply, &replyLength));
+  TEST_ASSERT_FALSE(receiver.hasFailed());
+  TEST_ASSERT_EQUAL_INT(0, receiver.getStats().bytesReceived);
+  TEST_ASSERT_EQUAL_INT(0, (int)(reply[2] | (reply[3] << 8)));
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <string.h>
+#include <unity.h>
+#include "DeviceCache.h"
+#include "PeerCache.h"
+#include "test.h"
+
+static const uint8_t POWER_SERVICES = DeviceCache::Flywheel | DeviceCache::FitnessMachine | DeviceCache::CyclingPower | DeviceCache::Echelon;
+
+static PeerCache::Peer makePeer(uint64_t address, uint8_t service, const char *name) {
+  PeerCache::Peer peer = PeerCache::Peer();
+  peer.address         = address;
+  peer.addressType     = 1;  // Random
+  peer.service         = service;
+  peer.serviceStart    = 0x0010;
+  peer.serviceEnd      = 0x001F;
+  peer.valueHandle     = 0x0012;
+  peer.interval        = 12;
+  peer.latency         = 0;
+  peer.timeout         = 200;
+  strncpy(peer.name, name, PeerCache::NAME_SIZE - 1);
+  return peer;
+}
+
+void TestPeerCache::remember__several_peers__expect_found_by_address_and_role(void) {
+  PeerCache cache;
+
+  TEST_ASSERT_TRUE(cache.remember(makePeer(0xA1, DeviceCache::FitnessMachine, "KICKR a1")));
+  TEST_ASSERT_TRUE(cache.remember(makePeer(0xB2, DeviceCache::HeartRate, "HRM b2")));
+  TEST_ASSERT_TRUE(cache.remember(makePeer(0xC3, DeviceCache::CyclingPower, "ASSIOMA c3")));
+  TEST_ASSERT_EQUAL_INT(3, cache.size());
+  TEST_ASSERT_EQUAL_INT(1, cache.find(0xB2)->addressType);
+  TEST_ASSERT_NULL(cache.find(0xD4));
+
+  // "any" is the power source used last, a saved name picks its own
+  TEST_ASSERT_EQUAL_HEX32(0xC3, (uint32_t)cache.find(POWER_SERVICES, "any")->address);
+  TEST_ASSERT_EQUAL_HEX32(0xA1, (uint32_t)cache.find(POWER_SERVICES, "KICKR a1")->address);
+  TEST_ASSERT_EQUAL_HEX32(0xB2, (uint32_t)cache.find(DeviceCache::HeartRate, "any")->address);
+  TEST_ASSERT_NULL(cache.find(DeviceCache::HeartRate, "KICKR a1"));
+  TEST_ASSERT_NULL(cache.find(DeviceCache::Hid, "any"));
+
+  // Reconnecting to the last peer unchanged needs no save, a new connection interval does
+  TEST_ASSERT_FALSE(cache.remember(makePeer(0xC3, DeviceCache::CyclingPower, "ASSIOMA c3")));
+  PeerCache::Peer faster = makePeer(0xC3, DeviceCache::CyclingPower, "ASSIOMA c3");
+  faster.interval        = 6;
+  TEST_ASSERT_TRUE(cache.remember(faster));
+  TEST_ASSERT_EQUAL_INT(6, cache.find(0xC3)->interval);
+  // Using the bike again makes it "any"
+  TEST_ASSERT_TRUE(cache.remember(makePeer(0xA1, DeviceCache::FitnessMachine, "KICKR a1")));
+  TEST_ASSERT_EQUAL_HEX32(0xA1, (uint32_t)cache.find(POWER_SERVICES, "any")->address);
+  TEST_ASSERT_EQUAL_INT(3, cache.size());
+}
+
+void TestPeerCache::remember__full_or_failing__expect_least_recent_evicted_and_scan_fallback(void) {
+  PeerCache cache;
+
+  for (uint64_t address = 1; address <= PeerCache::MAX_PEERS; address++) {
+    cache.remember(makePeer(address, DeviceCache::HeartRate, "HRM"));
+  }
+  cache.remember(makePeer(1, DeviceCache::HeartRate, "HRM"));
+  cache.remember(makePeer(0x99, DeviceCache::HeartRate, "HRM"));
+  TEST_ASSERT_EQUAL_INT(PeerCache::MAX_PEERS, cache.size());
+  TEST_ASSERT_NOT_NULL(cache.find(1));
+  TEST_ASSERT_NULL(cache.find(2));
+  TEST_ASSERT_NOT_NULL(cache.find(0x99));
+
+  for (uint8_t i = 0; i < PeerCache::MAX_DIRECT_FAILURES; i++) {
+    TEST_ASSERT_TRUE(PeerCache::canConnectDirect(*cache.find(0x99)));
+    cache.failed(0x99);
+  }
+  TEST_ASSERT_FALSE(PeerCache::canConnectDirect(*cache.find(0x99)));
+  cache.failed(0x12345);  // Unknown, ignored
+  // A scan found it and the connect worked
+  TEST_ASSERT_TRUE(cache.remember(makePeer(0x99, DeviceCache::HeartRate, "HRM")));
+  TEST_ASSERT_TRUE(PeerCache::canConnectDirect(*cache.find(0x99)));
+}
+
+void TestPeerCache::serialize__round_trip__expect_same_peers_and_bad_files_rejected(void) {
+  PeerCache cache;
+  uint8_t saved[PeerCache::SERIALIZED_SIZE];
+
+  TEST_ASSERT_EQUAL_INT(PeerCache::HEADER_SIZE, cache.serialize(saved, sizeof(saved)));
+  cache.remember(makePeer(0xE1A2B3C4D5F6ULL, DeviceCache::FitnessMachine, "KICKR CORE f6"));
+  cache.remember(makePeer(0xC00000000042ULL, DeviceCache::HeartRate, "c0:00:00:00:00:42"));
+  cache.failed(0xC00000000042ULL);
+  size_t length = cache.serialize(saved, sizeof(saved));
+  TEST_ASSERT_EQUAL_INT(PeerCache::HEADER_SIZE + 2 * PeerCache::RECORD_SIZE, length);
+  TEST_ASSERT_EQUAL_INT(0, cache.serialize(saved, length - 1));
+
+  PeerCache loaded;
+  TEST_ASSERT_TRUE(loaded.deserialize(saved, length));
+  TEST_ASSERT_EQUAL_INT(2, loaded.size());
+  const PeerCache::Peer *bike = loaded.find(0xE1A2B3C4D5F6ULL);
+  TEST_ASSERT_NOT_NULL(bike);
+  TEST_ASSERT_EQUAL_STRING("KICKR CORE f6", bike->name);
+  TEST_ASSERT_EQUAL_INT(DeviceCache::FitnessMachine, bike->service);
+  TEST_ASSERT_EQUAL_HEX32(0x0012, bike->valueHandle);
+  TEST_ASSERT_EQUAL_INT(200, bike->timeout);
+  TEST_ASSERT_EQUAL_INT(1, loaded.find(0xC00000000042ULL)->failures);
+  // Recency survives, and new connections sort after it
+  TEST_ASSERT_EQUAL_HEX32(0x00000042, (uint32_t)loaded.find(DeviceCache::FitnessMachine | DeviceCache::HeartRate, "any")->address);
+  loaded.remember(makePeer(0xE1A2B3C4D5F6ULL, DeviceCache::FitnessMachine, "KICKR CORE f6"));
+  TEST_ASSERT_EQUAL_HEX32(0xB3C4D5F6, (uint32_t)loaded.find(DeviceCache::FitnessMachine | DeviceCache::HeartRate, "any")->address);
+
+  // Cut short, another version, or not ours at all
+  TEST_ASSERT_FALSE(loaded.deserialize(saved, length - 1));
+  TEST_ASSERT_EQUAL_INT(0, loaded.size());
+  saved[4] = PeerCache::VERSION + 1;
+  TEST_ASSERT_FALSE(loaded.deserialize(saved, length));
+  TEST_ASSERT_FALSE(loaded.deserialize((const uint8_t *)"SS2C\x01\x00", 6));
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "PositionHealth.h"
+#include "test.h"
+
+void TestPositionHealth::observeStatus__faults__expect_counted_once(void) {
+  PositionHealth health;
+  health.observeStatus(PositionHealth::STST, false);
+  health.observeStatus(PositionHealth::OTPW, true);
+  health.observeStatus(PositionHealth::OTPW, true);  // Still set, not a new warning
+  TEST_ASSERT_EQUAL_INT(1, health.getCounters().overtempWarnings);
+  TEST_ASSERT_TRUE(health.isTrusted());  // A warning alone doesn't stop the motor
+
+  // Open load at standstill is just the current being off
+  health.observeStatus(PositionHealth::STST | PositionHealth::OPEN_LOAD, false);
+  TEST_ASSERT_EQUAL_INT(0, health.getCounters().openLoads);
+  TEST_ASSERT_TRUE(health.isTrusted());
+
+  health.observeStatus(PositionHealth::OT, true);
+  health.observeStatus(PositionHealth::OT | (1UL << 2), true);
+  health.observeReadError();
+  const PositionHealth::Counters &counters = health.getCounters();
+  TEST_ASSERT_EQUAL_INT(6, counters.reads);
+  TEST_ASSERT_EQUAL_INT(1, counters.readErrors);
+  TEST_ASSERT_EQUAL_INT(1, counters.overtemps);
+  TEST_ASSERT_EQUAL_INT(1, counters.shorts);
+  TEST_ASSERT_EQUAL_INT(1, counters.faultsWhileMoving);
+  TEST_ASSERT_FALSE(health.isTrusted());
+}
+
+void TestPositionHealth::observeAnchor__consistent_drift__expect_rehome(void) {
+  PositionHealth health;
+  // Noise around the table changes nothing
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(10, 150));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(11, -200));
+
+  // Four cells agreeing on ~500 lost steps
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(10, 480));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(10, 520));  // Same cell again only replaces its sample
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(11, 500));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(12, 460));
+  TEST_ASSERT_EQUAL_INT(495, health.observeAnchor(13, 500));
+  TEST_ASSERT_EQUAL_INT(1, health.getCounters().rehomes);
+  TEST_ASSERT_EQUAL_INT(495, health.getCounters().rehomedSteps);
+
+  // Starts over after a re-home
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(14, 500));
+}
+
+void TestPositionHealth::observeAnchor__disagreeing_cells__expect_no_rehome(void) {
+  PositionHealth health;
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(1, 400));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(2, -400));  // Opposite ways: the table is noisy
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(3, -700));  // Too far from -400
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(4, -650));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(5, -600));
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(6, 100));  // Back on the table
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(7, -600));
+  TEST_ASSERT_EQUAL_INT(0, health.getCounters().rehomes);
+}
+
+void TestPositionHealth::observeAnchor__after_fault__expect_quicker_rehome(void) {
+  PositionHealth health;
+  health.observeStatus(PositionHealth::OT, true);
+  TEST_ASSERT_FALSE(health.isTrusted());
+  TEST_ASSERT_EQUAL_INT(0, health.observeAnchor(20, -900));
+  TEST_ASSERT_EQUAL_INT(-850, health.observeAnchor(21, -800));
+  TEST_ASSERT_TRUE(health.isTrusted());
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "PowerTableCodec.h"
+#include "test.h"
+
+// Same shape as the firmware table: 10 cadence rows of 40 watt columns.
+static const size_t kCells = 400;
+
+static void fillTable(int16_t *cells, uint16_t *versions) {
+  for (size_t i = 0; i < kCells; i++) {
+    cells[i]    = INT16_MIN;  // empty
+    versions[i] = 1;
+  }
+  // A partially learned row at 90rpm
+  for (size_t i = 0; i < 20; i++) {
+    cells[240 + i] = (int16_t)(-2000 + (int)i * 350);
+  }
+}
+
+void TestPowerTableCodec::encode__full_table__expect_round_trip(void) {
+  int16_t cells[kCells];
+  uint16_t versions[kCells];
+  fillTable(cells, versions);
+
+  uint8_t out[512];
+  size_t cursor = 0;
+  size_t length = PowerTableCodec::encode(cells, versions, kCells, 0, &cursor, out, sizeof(out));
+  TEST_ASSERT_EQUAL_INT(kCells, cursor);
+  // 800 raw bytes should compress to well under one MTU.
+  TEST_ASSERT_LESS_THAN(100, length);
+
+  int16_t mirror[kCells] = {0};
+  TEST_ASSERT_TRUE(PowerTableCodec::decode(out, length, 0, mirror, kCells));
+  TEST_ASSERT_EQUAL_INT16_ARRAY(cells, mirror, kCells);
+}
+
+void TestPowerTableCodec::encode__since_version__expect_only_changed_cells(void) {
+  int16_t cells[kCells];
+  uint16_t versions[kCells];
+  fillTable(cells, versions);
+
+  int16_t mirror[kCells];
+  for (size_t i = 0; i < kCells; i++) {
+    mirror[i] = cells[i];
+  }
+
+  cells[245]    = 123;
+  versions[245] = 2;
+  cells[301]    = -77;
+  versions[301] = 3;
+
+  uint8_t out[512];
+  size_t cursor = 0;
+  size_t length = PowerTableCodec::encode(cells, versions, kCells, 1, &cursor, out, sizeof(out));
+  TEST_ASSERT_EQUAL_INT(kCells, cursor);
+  TEST_ASSERT_LESS_THAN(10, length);
+
+  // Poison a cell that didn't change. The delta must not touch it.
+  mirror[0] = 42;
+  TEST_ASSERT_TRUE(PowerTableCodec::decode(out, length, 0, mirror, kCells));
+  TEST_ASSERT_EQUAL_INT(123, mirror[245]);
+  TEST_ASSERT_EQUAL_INT(-77, mirror[301]);
+  TEST_ASSERT_EQUAL_INT(42, mirror[0]);
+
+  // Nothing newer than the latest version
+  cursor = 0;
+  TEST_ASSERT_EQUAL_INT(0, PowerTableCodec::encode(cells, versions, kCells, 3, &cursor, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_INT(kCells, cursor);
+}
+
+void TestPowerTableCodec::encode__small_chunks__expect_round_trip(void) {
+  int16_t cells[kCells];
+  uint16_t versions[kCells];
+  for (size_t i = 0; i < kCells; i++) {
+    cells[i]    = (int16_t)((i * 7919) % 6000 - 3000);  // Nothing repeats, worst case for the codec.
+    versions[i] = 1;
+  }
+
+  int16_t mirror[kCells] = {0};
+  uint8_t out[9];  // Smallest chunk left over with a 23 byte MTU
+  size_t cursor = 0;
+  int chunks    = 0;
+  while (cursor < kCells) {
+    size_t start  = cursor;
+    size_t length = PowerTableCodec::encode(cells, versions, kCells, 0, &cursor, out, sizeof(out));
+    TEST_ASSERT_GREATER_THAN(start, cursor);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(out), length);
+    TEST_ASSERT_TRUE(PowerTableCodec::decode(out, length, start, mirror, kCells));
+    chunks++;
+  }
+  TEST_ASSERT_GREATER_THAN(1, chunks);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(cells, mirror, kCells);
+}
+
+void TestPowerTableCodec::decode__malformed__expect_false(void) {
+  int16_t mirror[kCells] = {0};
+  const uint8_t pastEnd[]   = {0x7F, 0x7F, 0x7F, 0x7F};  // skip 512 cells
+  const uint8_t truncated[] = {0xC1, 0x02};              // literal of 2, only one value
+  const uint8_t badValue[]  = {0x80, 0xFF, 0xFF, 0xFF};  // value longer than 3 bytes
+  TEST_ASSERT_FALSE(PowerTableCodec::decode(pastEnd, sizeof(pastEnd), 0, mirror, kCells));
+  TEST_ASSERT_FALSE(PowerTableCodec::decode(truncated, sizeof(truncated), 0, mirror, kCells));
+  TEST_ASSERT_FALSE(PowerTableCodec::decode(badValue, sizeof(badValue), 0, mirror, kCells));
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "hal/Fakes.h"
+#include "PowerTableFile.h"
+#include "test.h"
+
+static const size_t ROWS    = 10;
+static const size_t COLUMNS = 40;
+static const int VERSION    = 4;
+static const char *PATH     = "/PowerTable.txt";
+
+static void clearTable(PowerTableFile::Cell *cells) {
+  for (size_t i = 0; i < ROWS * COLUMNS; i++) {
+    cells[i] = {INT16_MIN, 0};
+  }
+}
+
+void TestPowerTableFile::save__then_load__expect_saved_table_shifted_to_the_knob(void) {
+  FakeFileSystem fileSystem;
+  PowerTableFile::Cell saved[ROWS * COLUMNS];
+  clearTable(saved);
+  for (size_t j = 0; j < COLUMNS; j++) {
+    saved[3 * COLUMNS + j] = {(int16_t)(-1000 + 100 * j), 8};
+  }
+  saved[5 * COLUMNS + 2] = {-32000, 1};
+  TEST_ASSERT_TRUE(PowerTableFile::save(fileSystem, PATH, VERSION, saved, ROWS, COLUMNS, 41));
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::HEADER_SIZE + ROWS * COLUMNS * PowerTableFile::CELL_SIZE, fileSystem.size(PATH));
+  uint8_t header[8];
+  fileSystem.read(PATH, 0, header, sizeof(header));
+  TEST_ASSERT_EQUAL_UINT8(4, header[0]);
+  TEST_ASSERT_EQUAL_UINT8(41, header[4]);
+
+  // This session the knob sits 50 steps further in, measured at three cells past the unreliable low columns
+  PowerTableFile::Cell live[ROWS * COLUMNS];
+  clearTable(live);
+  live[3 * COLUMNS + 4] = {(int16_t)(-600 + 50), 5};
+  live[3 * COLUMNS + 6] = {(int16_t)(-400 + 48), 5};
+  live[3 * COLUMNS + 8] = {(int16_t)(-200 + 52), 5};
+  float offset;
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::LOADED, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 15, 3, 3, 3, &offset));
+  TEST_ASSERT_EQUAL_FLOAT(50, offset);
+  for (size_t j = 0; j < COLUMNS; j++) {
+    TEST_ASSERT_EQUAL_INT(-1000 + 100 * j + 50, live[3 * COLUMNS + j].targetPosition);
+    TEST_ASSERT_EQUAL_INT(8, live[3 * COLUMNS + j].readings);
+  }
+  TEST_ASSERT_EQUAL_INT(-32000 + 50, live[5 * COLUMNS + 2].targetPosition);
+  TEST_ASSERT_EQUAL_INT(INT16_MIN, live[0].targetPosition);
+  TEST_ASSERT_EQUAL_INT(0, live[0].readings);
+}
+
+void TestPowerTableFile::load__missing_old_or_unmatched__expect_live_table_kept(void) {
+  FakeFileSystem fileSystem;
+  PowerTableFile::Cell saved[ROWS * COLUMNS];
+  PowerTableFile::Cell live[ROWS * COLUMNS];
+  clearTable(saved);
+  clearTable(live);
+  for (size_t j = 0; j < COLUMNS; j++) {
+    saved[2 * COLUMNS + j] = {(int16_t)(100 * j), 4};
+  }
+  // Reliable, but only in the low columns that don't count
+  live[2 * COLUMNS + 0] = {10, 9};
+  live[2 * COLUMNS + 1] = {110, 9};
+  live[2 * COLUMNS + 2] = {210, 9};
+  // Matches a saved cell, but with too few readings to trust
+  live[2 * COLUMNS + 5] = {510, 3};
+  float offset;
+
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::MISSING, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 0, 3, 3, 3, &offset));
+  TEST_ASSERT_TRUE(PowerTableFile::save(fileSystem, PATH, VERSION - 1, saved, ROWS, COLUMNS, 160));
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::OLD_VERSION, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 0, 3, 3, 3, &offset));
+  TEST_ASSERT_TRUE(PowerTableFile::save(fileSystem, PATH, VERSION, saved, ROWS, COLUMNS, 160));
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::SUPERSEDED, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 161, 3, 3, 3, &offset));
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::TOO_FEW_MATCHES, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 30, 3, 3, 3, &offset));
+  TEST_ASSERT_EQUAL_INT(10, live[2 * COLUMNS].targetPosition);
+  TEST_ASSERT_EQUAL_INT(INT16_MIN, live[2 * COLUMNS + 3].targetPosition);
+
+  // A file cut short, say by a full partition, is as good as missing
+  uint8_t header[PowerTableFile::HEADER_SIZE + 30];
+  fileSystem.read(PATH, 0, header, sizeof(header));
+  fileSystem.write(PATH, header, sizeof(header));
+  TEST_ASSERT_EQUAL_INT(PowerTableFile::MISSING, PowerTableFile::load(fileSystem, PATH, VERSION, live, ROWS, COLUMNS, 0, 3, 3, 3, &offset));
+  fileSystem.capacity = 100;
+  TEST_ASSERT_FALSE(PowerTableFile::save(fileSystem, PATH, VERSION, saved, ROWS, COLUMNS, 160));
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "RideTotals.h"
+#include "sensors/SensorSample.h"
+#include "test.h"
+
+// An hour of intervals: power swings between about 100 and 300 W, speed follows it.
+static double ridePower(double seconds) { return 200.0 + 100.0 * sin(seconds / 90.0) + 30.0 * sin(seconds / 7.0); }
+static double rideSpeed(double seconds) { return 20.0 + 0.05 * (ridePower(seconds) - 200.0); }
+
+void TestRideTotals::update__simulated_ride__expect_accurate_totals(void) {
+  const double rideSeconds = 3600.0;
+
+  // Reference, in doubles with a fine step
+  double distance = 0;
+  double work     = 0;
+  for (double t = 0; t < rideSeconds; t += 0.001) {
+    distance += rideSpeed(t) / 3.6 * 0.001;
+    work += ridePower(t) * 0.001;
+  }
+
+  // The device sees a sensor packet every 250 ms
+  RideTotals totals;
+  for (uint32_t ms = 0; ms <= rideSeconds * 1000; ms += 250) {
+    totals.update(ms, SensorSample::toFixed(rideSpeed(ms / 1000.0)), (int)lround(ridePower(ms / 1000.0)));
+  }
+
+  printf("  distance  reference %.1f m  device %u m\n", distance, totals.getDistance());
+  printf("  energy    reference %.1f kcal  device %u kcal\n", work / RideTotals::WORK_PER_KCAL, totals.getEnergy());
+  TEST_ASSERT_TRUE(fabs(totals.getDistance() - distance) <= 1.0);
+  TEST_ASSERT_TRUE(fabs(totals.getEnergy() - work / RideTotals::WORK_PER_KCAL) <= 1.0);
+  TEST_ASSERT_EQUAL_INT(3600, totals.getElapsedTime());
+  TEST_ASSERT_EQUAL_INT(lround(ridePower(3600)) * 3600 / RideTotals::WORK_PER_KCAL, totals.getEnergyPerHour());
+}
+
+void TestRideTotals::update__stops_and_dropouts__expect_not_counted(void) {
+  RideTotals totals;
+  int32_t speed = SensorSample::toFixed(36.0);  // 10 m/s
+  totals.update(0, speed, 200);
+  totals.update(1000, speed, 200);
+  TEST_ASSERT_EQUAL_INT(10, totals.getDistance());
+  TEST_ASSERT_EQUAL_INT(1, totals.getElapsedTime());
+
+  // Sensor gone for 10 s: nothing is made up for the gap
+  totals.update(11000, speed, 200);
+  TEST_ASSERT_EQUAL_INT(10, totals.getDistance());
+  TEST_ASSERT_EQUAL_INT(1, totals.getElapsedTime());
+
+  // Coasting down to a stop counts, standing still doesn't
+  totals.update(12000, 0, 0);
+  TEST_ASSERT_EQUAL_INT(15, totals.getDistance());
+  TEST_ASSERT_EQUAL_INT(2, totals.getElapsedTime());
+  totals.update(14000, 0, 0);
+  TEST_ASSERT_EQUAL_INT(2, totals.getElapsedTime());
+
+  // millis() wrapping around is just another step
+  RideTotals wrapped;
+  wrapped.update(0xFFFFFE0C, speed, 100);
+  wrapped.update(500, speed, 100);
+  TEST_ASSERT_EQUAL_INT(10, wrapped.getDistance());
+
+  totals.reset();
+  TEST_ASSERT_EQUAL_INT(0, totals.getDistance());
+  TEST_ASSERT_EQUAL_INT(0, totals.getEnergy());
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <math.h>
+#include "RoadModel.h"
+#include "test.h"
+
+// Martin et al. (1998), eq. 9 without the kinetic energy and bearing terms, written out in doubles with air
+// density and CdA the way the paper has it.
+static double martinPower(double mass, double crr, double cdA, double grade, double speed, double wind) {
+  const double rho      = 1.225;
+  const double air      = speed + wind;
+  const double drag     = 0.5 * rho * cdA * air * fabs(air) * speed;
+  const double rolling  = speed * crr * mass * 9.81 * cos(atan(grade));
+  const double climbing = speed * mass * 9.81 * sin(atan(grade));
+  return (drag + rolling + climbing) / 0.976;
+}
+
+void TestRoadModel::power__grid__expect_matches_reference_model(void) {
+  // Worked by hand: 80 kg on the flat at 36 km/h, CdA 0.32. 19.6 N of drag and 3.14 N rolling.
+  RoadModel::Conditions flat = {0, 0, 0.004, 0.196, 80};
+  TEST_ASSERT_FLOAT_WITHIN(0.05, 232.98, RoadModel::power(flat, 10));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0, RoadModel::power(flat, 0));
+
+  const double cdA[]   = {0.25, 0.32, 0.40};
+  const double grade[] = {-0.12, -0.05, -0.01, 0, 0.02, 0.06, 0.10, 0.20};
+  const double wind[]  = {-5, 0, 3, 8};
+  for (double a : cdA) {
+    for (double g : grade) {
+      for (double w : wind) {
+        for (double v = 0.5; v <= 20; v += 0.5) {
+          RoadModel::Conditions road = {(float)g, (float)w, 0.005, (float)(0.5 * 1.225 * a), 75};
+          double expected            = martinPower(75, 0.005, a, g, v, w);
+          // Within 0.1% or 0.05 W, whichever is looser. The model runs in float.
+          TEST_ASSERT_FLOAT_WITHIN(fmax(0.05, fabs(expected) * 0.001), expected, RoadModel::power(road, v));
+        }
+      }
+    }
+  }
+}
+
+void TestRoadModel::speed__any_power__expect_inverse_of_power(void) {
+  const double grade[] = {-0.08, -0.03, 0, 0.04, 0.12};
+  const double wind[]  = {-4, 0, 6};
+  for (double g : grade) {
+    for (double w : wind) {
+      RoadModel::Conditions road = {(float)g, (float)w, RoadModel::DEFAULT_CRR, RoadModel::DEFAULT_CW, 85};
+      for (int watts = 50; watts <= 600; watts += 50) {
+        float v = RoadModel::speed(road, watts);
+        TEST_ASSERT_TRUE(v > 0);
+        TEST_ASSERT_FLOAT_WITHIN(0.1, watts, RoadModel::power(road, v));
+      }
+    }
+  }
+
+  // Steep descent with no pedaling: terminal velocity, where the road stops adding speed.
+  RoadModel::Conditions descent = {-0.10, 0, RoadModel::DEFAULT_CRR, RoadModel::DEFAULT_CW, 85};
+  float coasting                = RoadModel::speed(descent, 0);
+  TEST_ASSERT_FLOAT_WITHIN(0.1, 0, RoadModel::power(descent, coasting));
+  TEST_ASSERT_TRUE(coasting > 10);
+
+  // More than the cap can hold
+  RoadModel::Conditions flat = {0, 0, RoadModel::DEFAULT_CRR, RoadModel::DEFAULT_CW, 85};
+  TEST_ASSERT_EQUAL_FLOAT(20, RoadModel::speed(flat, 5000, 20));
+}
+
+void TestRoadModel::fromFtms__golden_vectors__expect_conditions(void) {
+  // Wind -1.5 m/s, grade 4.5%, Crr 0.004, Cw 0.51
+  const uint8_t packet[]     = {0x24, 0xfa, 0xc2, 0x01, 0x28, 0x33};
+  RoadModel::Conditions road = {0, 0, 0, 0, 85};
+  TEST_ASSERT_TRUE(RoadModel::fromFtms(packet, sizeof(packet), &road));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, -1.5, road.windSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.045, road.grade);
+  TEST_ASSERT_FLOAT_WITHIN(0.00001, 0.004, road.crr);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.51, road.cw);
+  TEST_ASSERT_EQUAL_FLOAT(85, road.mass);
+
+  // Downhill
+  const uint8_t descent[] = {0x00, 0x00, 0x0c, 0xfe, 0x28, 0x33};
+  TEST_ASSERT_TRUE(RoadModel::fromFtms(descent, sizeof(descent), &road));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, -0.05, road.grade);
+
+  // Some apps send grade only
+  TEST_ASSERT_FALSE(RoadModel::fromFtms(packet, 4, &road));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001, -0.05, road.grade);
+}
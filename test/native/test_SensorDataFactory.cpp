@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "Constants.h"
+#include "sensors/SensorDataFactory.h"
+#include "test.h"
+
+static uint8_t cyclePowerPacket[] = {0x20, 0x00, 0x2d, 0x00, 0x02, 0x00, 0xb8, 0x12};
+static uint8_t heartRatePacket[]  = {0x00, 0x5a};
+
+static const uint64_t POWER_METER = 0xc0ffee000001ULL;
+static const uint64_t HRM         = 0xc0ffee000002ULL;
+
+void TestSensorDataFactory::getSensorData__same_characteristic__expect_same_decoder(void) {
+  SensorDataFactory factory;
+  SensorData *power = factory.getSensorData(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER, cyclePowerPacket, sizeof(cyclePowerPacket));
+  TEST_ASSERT_TRUE(power->hasPower());
+  TEST_ASSERT_EQUAL_INT(45, power->getPower());
+  TEST_ASSERT_TRUE(power == factory.getSensorData(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER, cyclePowerPacket, sizeof(cyclePowerPacket)));
+
+  // A second power meter keeps its own crank history
+  SensorData *other = factory.getSensorData(CYCLINGPOWERMEASUREMENT_UUID, HRM, cyclePowerPacket, sizeof(cyclePowerPacket));
+  TEST_ASSERT_TRUE(power != other);
+
+  SensorData *heartRate = factory.getSensorData(HEARTCHARACTERISTIC_UUID, HRM, heartRatePacket, sizeof(heartRatePacket));
+  TEST_ASSERT_TRUE(heartRate->hasHeartRate());
+  TEST_ASSERT_EQUAL_INT(90, heartRate->getHeartRate());
+  TEST_ASSERT_TRUE(heartRate != other);
+}
+
+void TestSensorDataFactory::getKey__uuid_forms__expect_same_key(void) {
+  NimBLEUUID expanded("00002a63-0000-1000-8000-00805f9b34fb");
+  TEST_ASSERT_TRUE(SensorDataFactory::getKey(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER) == SensorDataFactory::getKey(expanded, POWER_METER));
+  TEST_ASSERT_FALSE(SensorDataFactory::getKey(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER) == SensorDataFactory::getKey(CYCLINGPOWERMEASUREMENT_UUID, HRM));
+  TEST_ASSERT_FALSE(SensorDataFactory::getKey(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER) == SensorDataFactory::getKey(HEARTCHARACTERISTIC_UUID, POWER_METER));
+}
+
+void TestSensorDataFactory::getSensorData__unknown__expect_no_data(void) {
+  SensorDataFactory factory;
+  SensorData *unknown = factory.getSensorData(BATTERYCHARACTERISTIC_UUID, HRM, heartRatePacket, sizeof(heartRatePacket));
+  TEST_ASSERT_FALSE(unknown->hasHeartRate());
+  TEST_ASSERT_FALSE(unknown->hasPower());
+}
+
+void TestSensorDataFactory::getSensorData__pool_full__expect_quiet_peer_reused(void) {
+  SensorDataFactory factory;
+  SensorData *decoders[SensorDataFactory::POOL_SIZE];
+  for (uint64_t address = 0; address < SensorDataFactory::POOL_SIZE; address++) {
+    decoders[address] = factory.getSensorData(HEARTCHARACTERISTIC_UUID, address, heartRatePacket, sizeof(heartRatePacket));
+  }
+  // Peer 0 disconnects, the rest keep sending.
+  for (uint64_t address = 1; address < SensorDataFactory::POOL_SIZE; address++) {
+    factory.getSensorData(HEARTCHARACTERISTIC_UUID, address, heartRatePacket, sizeof(heartRatePacket));
+  }
+
+  SensorData *newPeer = factory.getSensorData(HEARTCHARACTERISTIC_UUID, 0xffff, heartRatePacket, sizeof(heartRatePacket));
+  TEST_ASSERT_TRUE(newPeer == decoders[0]);
+  TEST_ASSERT_EQUAL_INT(90, newPeer->getHeartRate());
+  for (uint64_t address = 1; address < SensorDataFactory::POOL_SIZE; address++) {
+    TEST_ASSERT_TRUE(decoders[address] == factory.getSensorData(HEARTCHARACTERISTIC_UUID, address, heartRatePacket, sizeof(heartRatePacket)));
+  }
+
+  // Plenty of characteristics we can't decode don't lock out a sensor we can.
+  for (uint64_t address = 0; address < 2 * SensorDataFactory::MAP_SIZE; address++) {
+    factory.getSensorData(BATTERYCHARACTERISTIC_UUID, address, heartRatePacket, sizeof(heartRatePacket));
+  }
+  SensorData *power = factory.getSensorData(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER, cyclePowerPacket, sizeof(cyclePowerPacket));
+  TEST_ASSERT_EQUAL_INT(45, power->getPower());
+  TEST_ASSERT_TRUE(power == factory.getSensorData(CYCLINGPOWERMEASUREMENT_UUID, POWER_METER, cyclePowerPacket, sizeof(cyclePowerPacket)));
+}
+
+// Not a pass/fail test: reports what finding and running the decoder costs per packet, against the
+// linear UUID comparison the factory used to do.
+void TestSensorDataFactory::dispatch__benchmark__report_cost_per_packet(void) {
+  const int PACKETS = 200000;
+  const NimBLEUUID uuids[] = {FITNESSMACHINEINDOORBIKEDATA_UUID, FLYWHEEL_UART_SERVICE_UUID, HEARTCHARACTERISTIC_UUID, CYCLINGPOWERMEASUREMENT_UUID};
+  const uint64_t addresses[] = {1, 2, HRM, POWER_METER};
+  const int DEVICES          = sizeof(addresses) / sizeof(addresses[0]);
+  SensorDataFactory factory;
+  uint64_t keys[DEVICES];
+  SensorData *decoders[DEVICES];
+  for (int i = 0; i < DEVICES; i++) {
+    keys[i]     = SensorDataFactory::getKey(uuids[i], addresses[i]);
+    decoders[i] = factory.getSensorData(keys[i], uuids[i], cyclePowerPacket, sizeof(cyclePowerPacket));
+  }
+
+  int found = 0;
+  auto started = std::chrono::steady_clock::now();
+  for (int i = 0; i < PACKETS; i++) {
+    found += factory.getSensorData(keys[3], uuids[3], cyclePowerPacket, sizeof(cyclePowerPacket))->hasPower();
+  }
+  double keyed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / PACKETS;
+
+  started = std::chrono::steady_clock::now();
+  for (int i = 0; i < PACKETS; i++) {
+    found += factory.getSensorData(uuids[3], addresses[3], cyclePowerPacket, sizeof(cyclePowerPacket))->hasPower();
+  }
+  double hashed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / PACKETS;
+
+  started = std::chrono::steady_clock::now();
+  for (int i = 0; i < PACKETS; i++) {
+    for (int device = 0; device < DEVICES; device++) {
+      if ((uuids[device] == uuids[3]) && (addresses[device] == addresses[3])) {
+        decoders[device]->decode(cyclePowerPacket, sizeof(cyclePowerPacket));
+        found += decoders[device]->hasPower();
+        break;
+      }
+    }
+  }
+  double linear = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / PACKETS;
+
+  char message[128];
+  snprintf(message, sizeof(message), "Dispatch per packet: %.1fns with key, %.1fns hashing, %.1fns walking UUIDs", keyed, hashed, linear);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_INT(PACKETS * 3, found);
+}
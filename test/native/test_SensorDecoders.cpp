@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "sensors/CyclePowerData.h"
+#include "sensors/EchelonData.h"
+#include "sensors/FitnessMachineIndoorBikeData.h"
+#include "sensors/FlywheelData.h"
+#include "sensors/HeartRateData.h"
+#include "sensors/PelotonData.h"
+#include "test.h"
+
+SensorSample fuzzSensorDecoder(int decoder, const uint8_t *data, size_t size);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+struct SamplePacket {
+  int decoder;  // Index into the fuzz harness' decoder list
+  uint8_t data[20];
+  size_t length;
+};
+
+// One well formed packet per decoder, with every optional field turned on where the format has them.
+static const SamplePacket packets[] = {
+    {0, {0x35, 0x00, 0x2d, 0x00, 0x32, 0x10, 0x00, 0x01, 0x00, 0x00, 0x00, 0x20, 0x00, 0x02, 0x00, 0xb8, 0x12}, 17},
+    {1, {0xf0, 0xd1, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50}, 11},
+    {2, {0xfe, 0x1f, 0x91, 0x0c, 0x90, 0x0c, 0xb0, 0x00, 0xae, 0x00, 0x10, 0x00, 0x00, 0x20, 0x00, 0x40, 0x00, 0x3c, 0x00, 0x5a}, 20},
+    {3, {0xff, 0x1f, 0x0c, 0x00, 0xc8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5a, 0x00, 0x00, 0x20}, 16},
+    {4, {0x01, 0x5a, 0x00}, 3},
+    {5, {0xf1, 0x41, 0x03, 0x31, 0x35, 0x30, 0xcb}, 7},
+    {1, {0xf0, 0xd2, 0x01, 0x10}, 4},  // Echelon resistance, so a stream has both inputs to its power formula
+};
+
+// Deterministic xorshift so failures reproduce.
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Whatever the bytes, a decoder may only report known fields, and cadence and speed must fit the sample's
+// fixed point without wrapping negative. Echelon power comes from a formula and is never negative either.
+static void assertBounded(const SensorSample &sample, int decoder) {
+  TEST_ASSERT_EQUAL_UINT8(0, sample.present & ~(SensorSample::HEART_RATE | SensorSample::CADENCE | SensorSample::POWER | SensorSample::SPEED | SensorSample::RESISTANCE));
+  if (sample.has(SensorSample::CADENCE)) {
+    TEST_ASSERT_TRUE(sample.cadence >= 0);
+  }
+  if (sample.has(SensorSample::SPEED)) {
+    TEST_ASSERT_TRUE(sample.speed >= 0);
+  }
+  if ((decoder == 1) && sample.has(SensorSample::POWER)) {
+    TEST_ASSERT_TRUE(sample.power >= 0);
+  }
+}
+
+void TestSensorDecoders::decode__truncated_packets__expect_no_overrun(void) {
+  for (const SamplePacket &packet : packets) {
+    for (size_t length = 0; length <= packet.length; length++) {
+      fuzzSensorDecoder(packet.decoder, packet.data, length);
+    }
+  }
+  // Truncation drops fields instead of reading garbage
+  FitnessMachineIndoorBikeData indoorBike;
+  indoorBike.decode((uint8_t *)packets[2].data, 8);
+  TEST_ASSERT_TRUE(indoorBike.hasSpeed());
+  TEST_ASSERT_TRUE(indoorBike.hasCadence());
+  TEST_ASSERT_FALSE(indoorBike.hasPower());
+  HeartRateData heartRate;
+  heartRate.decode((uint8_t *)packets[4].data, 2);
+  TEST_ASSERT_FALSE(heartRate.hasHeartRate());
+  heartRate.decode((uint8_t *)packets[4].data, 3);
+  TEST_ASSERT_EQUAL_INT(90, heartRate.getHeartRate());
+}
+
+void TestSensorDecoders::decode__random_packets__expect_no_overrun(void) {
+  uint32_t state = 0x2ab5c0de;
+  uint8_t input[32];
+  for (int i = 0; i < 50000; i++) {
+    size_t size = nextRandom(&state) % sizeof(input);
+    for (size_t j = 0; j < size; j++) {
+      input[j] = (uint8_t)nextRandom(&state);
+    }
+    LLVMFuzzerTestOneInput(input, size);
+    if (size > 0) {
+      assertBounded(fuzzSensorDecoder(input[0], input + 1, size - 1), input[0] % 6);
+    }
+  }
+  // Mutations of valid packets reach deeper than pure noise
+  for (const SamplePacket &packet : packets) {
+    for (int i = 0; i < 5000; i++) {
+      memcpy(input, packet.data, packet.length);
+      input[nextRandom(&state) % packet.length] ^= (uint8_t)(1 << (nextRandom(&state) % 8));
+      assertBounded(fuzzSensorDecoder(packet.decoder, input, nextRandom(&state) % (packet.length + 1)), packet.decoder);
+    }
+  }
+  // One decoder fed a stream of them, so state from earlier packets (crank revolutions, the last Echelon
+  // cadence and resistance) meets every later one.
+  CyclePowerData cyclePower;
+  EchelonData echelon;
+  FitnessMachineIndoorBikeData indoorBike;
+  FlywheelData flywheel;
+  HeartRateData heartRate;
+  PelotonData peloton;
+  SensorData *decoders[] = {&cyclePower, &echelon, &indoorBike, &flywheel, &heartRate, &peloton};
+  for (const SamplePacket &packet : packets) {
+    for (int i = 0; i < 5000; i++) {
+      memcpy(input, packet.data, packet.length);
+      for (int flips = nextRandom(&state) % 4; flips >= 0; flips--) {
+        input[nextRandom(&state) % packet.length] ^= (uint8_t)(1 << (nextRandom(&state) % 8));
+      }
+      decoders[packet.decoder]->decode(input, packet.length);
+      assertBounded(decoders[packet.decoder]->getSample(), packet.decoder);
+    }
+  }
+}
+
+void TestSensorDecoders::decode__field_missing_from_next_packet__expect_not_reported(void) {
+  CyclePowerData cyclePower;
+  cyclePower.decode((uint8_t *)packets[0].data, packets[0].length);
+  TEST_ASSERT_TRUE(cyclePower.hasCadence());
+  uint8_t powerOnly[] = {0x00, 0x00, 0x2d, 0x00};
+  cyclePower.decode(powerOnly, sizeof(powerOnly));
+  TEST_ASSERT_EQUAL_INT(45, cyclePower.getPower());
+  TEST_ASSERT_FALSE(cyclePower.hasCadence());
+
+  EchelonData echelon;
+  echelon.decode((uint8_t *)packets[1].data, packets[1].length);
+  TEST_ASSERT_TRUE(echelon.hasCadence());
+  uint8_t resistance[] = {0xf0, 0xd2, 0x01, 0x10};
+  echelon.decode(resistance, sizeof(resistance));
+  TEST_ASSERT_EQUAL_INT(16, echelon.getResistance());
+  TEST_ASSERT_TRUE(echelon.hasPower());
+  TEST_ASSERT_FALSE(echelon.hasCadence());
+
+  HeartRateData heartRate;
+  heartRate.decode((uint8_t *)packets[4].data, packets[4].length);
+  TEST_ASSERT_TRUE(heartRate.hasHeartRate());
+  heartRate.decode((uint8_t *)packets[4].data, 2);
+  TEST_ASSERT_FALSE(heartRate.hasHeartRate());
+
+  PelotonData peloton;
+  peloton.decode((uint8_t *)packets[5].data, packets[5].length);
+  TEST_ASSERT_TRUE(peloton.hasCadence());
+  uint8_t power[] = {0xf1, 0x44, 0x03, 0x30, 0x35, 0x31, 0xcb};
+  peloton.decode(power, sizeof(power));
+  TEST_ASSERT_EQUAL_INT(15, peloton.getPower());
+  TEST_ASSERT_FALSE(peloton.hasCadence());
+}
+
+// Not a pass/fail test: reports how many packets per second each decoder handles.
+void TestSensorDecoders::decode__benchmark__report_packets_per_second(void) {
+  const int PACKETS = 200000;
+  CyclePowerData cyclePower;
+  EchelonData echelon;
+  FitnessMachineIndoorBikeData indoorBike;
+  FlywheelData flywheel;
+  HeartRateData heartRate;
+  PelotonData peloton;
+  SensorData *decoders[] = {&cyclePower, &echelon, &indoorBike, &flywheel, &heartRate, &peloton};
+
+  for (const SamplePacket &packet : packets) {
+    SensorData *sensor = decoders[packet.decoder];
+    uint8_t data[sizeof(packet.data)];
+    memcpy(data, packet.data, sizeof(data));
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < PACKETS; i++) {
+      // Vary a byte so the loop can't be hoisted.
+      data[packet.length - 1] = (uint8_t)i;
+      sensor->decode(data, packet.length);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    char message[96];
+    snprintf(message, sizeof(message), "%-10s %.1f M packets/s", sensor->getId(), PACKETS / seconds / 1e6);
+    TEST_MESSAGE(message);
+  }
+  TEST_ASSERT_TRUE(cyclePower.hasPower());
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "Constants.h"
+#include "sensors/SensorFusion.h"
+#include "test.h"
+
+static const uint64_t POWER_METER = 0x101;
+static const uint64_t BIKE        = 0x102;
+static const uint64_t PELOTON     = 0x103;
+static const uint64_t HRM         = 0x104;
+
+static SensorSample bikeSample(int power, float cadence, int resistance) {
+  SensorSample sample = SensorSample();
+  sample.setPower(power);
+  sample.setCadence(cadence);
+  sample.setResistance(resistance);
+  return sample;
+}
+
+void TestSensorFusion::offer__power_meter_and_bike__expect_priority_and_failover(void) {
+  SensorFusion fusion;
+  const uint8_t powerAndCadence = SensorSample::POWER | SensorSample::CADENCE;
+
+  // The bike alone supplies everything it has
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence | SensorSample::RESISTANCE, fusion.offer(0, BIKE, SensorFusion::FitnessMachine, bikeSample(180, 85, 30)));
+  // A power meter takes power and cadence over, but not resistance
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(500, POWER_METER, SensorFusion::PowerMeter, bikeSample(200, 90, 0)));
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::RESISTANCE, fusion.offer(1000, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)));
+  TEST_ASSERT_EQUAL_INT(200, fusion.getSelected(1000, SensorSample::POWER)->latest.power);
+
+  // A Peloton's resistance beats the bike's, its power doesn't beat the meter's
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::RESISTANCE, fusion.offer(1200, PELOTON, SensorFusion::Peloton, bikeSample(150, 80, 45)));
+  TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(1500, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)));
+
+  // The meter drops out: the bike takes over once it has been quiet for STALE_MS
+  uint32_t now = 500;
+  for (; now <= 500 + SensorFusion::STALE_MS; now += 500) {
+    TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(now, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)) & powerAndCadence);
+    fusion.offer(now, PELOTON, SensorFusion::Peloton, bikeSample(150, 80, 45));
+  }
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(now, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_INT(BIKE, fusion.getSelected(now, SensorSample::POWER)->key);
+  // And hands back when it returns
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(now + 100, POWER_METER, SensorFusion::PowerMeter, bikeSample(210, 91, 0)));
+  TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(now + 200, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)) & powerAndCadence);
+
+  // Configured priority wins over the defaults
+  fusion.setPriority(SensorFusion::FitnessMachine, SensorSample::POWER, 0);
+  fusion.setPriority(SensorFusion::PowerMeter, SensorSample::POWER, SensorFusion::NEVER);
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::POWER, fusion.offer(now + 300, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::CADENCE, fusion.offer(now + 400, POWER_METER, SensorFusion::PowerMeter, bikeSample(210, 91, 0)) & powerAndCadence);
+}
+
+void TestSensorFusion::setPreferBike__meter_bike_and_peloton__expect_bike_first_then_defaults(void) {
+  SensorFusion fusion;
+  const uint8_t powerAndCadence = SensorSample::POWER | SensorSample::CADENCE;
+  fusion.setPreferBike(true);
+  TEST_ASSERT_EQUAL_UINT8(0, fusion.getPriority(SensorFusion::FitnessMachine, SensorSample::POWER));
+  TEST_ASSERT_EQUAL_UINT8(0, fusion.getPriority(SensorFusion::Peloton, SensorSample::RESISTANCE));
+  TEST_ASSERT_EQUAL_UINT8(1, fusion.getPriority(SensorFusion::PowerMeter, SensorSample::SPEED));
+
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(0, POWER_METER, SensorFusion::PowerMeter, bikeSample(210, 91, 0)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(100, PELOTON, SensorFusion::Peloton, bikeSample(150, 80, 45)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(200, BIKE, SensorFusion::FitnessMachine, bikeSample(185, 86, 31)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(300, POWER_METER, SensorFusion::PowerMeter, bikeSample(210, 91, 0)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_INT(PELOTON, fusion.getSelected(300, SensorSample::RESISTANCE)->key);
+
+  // Back to the defaults, the meter wins again
+  fusion.setPreferBike(false);
+  TEST_ASSERT_EQUAL_HEX8(powerAndCadence, fusion.offer(400, POWER_METER, SensorFusion::PowerMeter, bikeSample(210, 91, 0)) & powerAndCadence);
+  TEST_ASSERT_EQUAL_INT(POWER_METER, fusion.getSelected(400, SensorSample::CADENCE)->key);
+}
+
+void TestSensorFusion::offer__implausible_or_no_contact__expect_rejected(void) {
+  SensorFusion fusion;
+  SensorSample heart = SensorSample();
+  heart.setHeartRate(140);
+  SensorSample bikeHeart = bikeSample(150, 80, 20);
+  bikeHeart.setHeartRate(138);
+
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::HEART_RATE, fusion.offer(0, HRM, SensorFusion::HeartMonitor, heart));
+  TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(100, BIKE, SensorFusion::FitnessMachine, bikeHeart) & SensorSample::HEART_RATE);
+
+  // The strap loses contact. That is no reading rather than a fault, and the bike's grips fill in.
+  heart.setHeartRate(0);
+  for (uint32_t now = 1000; now <= 1000 + SensorFusion::STALE_MS; now += 1000) {
+    TEST_ASSERT_EQUAL_HEX8(0, fusion.offer(now, HRM, SensorFusion::HeartMonitor, heart));
+    fusion.offer(now, BIKE, SensorFusion::FitnessMachine, bikeHeart);
+  }
+  TEST_ASSERT_EQUAL_INT(BIKE, fusion.getSelected(5000, SensorSample::HEART_RATE)->key);
+  TEST_ASSERT_EQUAL_INT(0, fusion.getSelected(5000, SensorSample::HEART_RATE)->rejected);
+
+  // Spikes are dropped and counted, and the last good value stays selected
+  SensorSample spike = bikeSample(5000, 300, 20);
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::RESISTANCE, fusion.offer(5100, BIKE, SensorFusion::FitnessMachine, spike) & ~SensorSample::HEART_RATE);
+  const SensorFusion::Source *bike = fusion.getSelected(5100, SensorSample::POWER);
+  TEST_ASSERT_EQUAL_INT(2, bike->rejected);
+  TEST_ASSERT_EQUAL_INT(150, bike->latest.power);
+  TEST_ASSERT_EQUAL_FLOAT(80, bike->latest.getCadence());
+}
+
+void TestSensorFusion::getFresh__sources_go_quiet__expect_fields_expire(void) {
+  SensorFusion fusion;
+  SensorSample heart = SensorSample();
+  heart.setHeartRate(120);
+  fusion.offer(0, POWER_METER, SensorFusion::PowerMeter, bikeSample(200, 90, 0));
+  fusion.offer(2000, HRM, SensorFusion::HeartMonitor, heart);
+
+  const uint8_t all = SensorSample::POWER | SensorSample::CADENCE | SensorSample::RESISTANCE | SensorSample::HEART_RATE;
+  TEST_ASSERT_EQUAL_HEX8(all, fusion.getFresh(SensorFusion::STALE_MS));
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::HEART_RATE, fusion.getFresh(SensorFusion::STALE_MS + 1));
+  TEST_ASSERT_EQUAL_HEX8(0, fusion.getFresh(2000 + SensorFusion::STALE_MS + 1));
+  TEST_ASSERT_NULL(fusion.getSelected(2000 + SensorFusion::STALE_MS + 1, SensorSample::HEART_RATE));
+
+  // Still fresh across millis() wrapping
+  SensorFusion wrapped;
+  wrapped.offer(0xFFFFFF00, HRM, SensorFusion::HeartMonitor, heart);
+  TEST_ASSERT_EQUAL_HEX8(SensorSample::HEART_RATE, wrapped.getFresh(100));
+  // More peers than slots: the quietest one makes room
+  for (uint64_t key = 1; key <= SensorFusion::MAX_SOURCES; key++) {
+    wrapped.offer(key * 10, 0x1000 + key, SensorFusion::FitnessMachine, bikeSample(100, 70, 0));
+  }
+  TEST_ASSERT_NULL(wrapped.getSelected(100, SensorSample::HEART_RATE));
+  TEST_ASSERT_EQUAL_INT(0x1000 + SensorFusion::MAX_SOURCES, wrapped.getSelected(100, SensorSample::POWER)->key);  // Took the HRM's slot, the first
+
+  TEST_ASSERT_EQUAL_INT(SensorFusion::PowerMeter, SensorFusion::getKind(CYCLINGPOWERMEASUREMENT_UUID));
+  TEST_ASSERT_EQUAL_INT(SensorFusion::HeartMonitor, SensorFusion::getKind(HEARTCHARACTERISTIC_UUID));
+  TEST_ASSERT_EQUAL_INT(SensorFusion::Peloton, SensorFusion::getKind(PELOTON_DATA_UUID));
+  TEST_ASSERT_EQUAL_INT(SensorFusion::FitnessMachine, SensorFusion::getKind(FITNESSMACHINEINDOORBIKEDATA_UUID));
+}
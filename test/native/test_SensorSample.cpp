@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "Constants.h"
+#include "sensors/SensorSample.h"
+#include "sensors/FitnessMachineIndoorBikeData.h"
+#include "sensors/PelotonData.h"
+#include "test.h"
+
+void TestSensorSample::fixed__gatt_resolutions__expect_exact(void) {
+  // 0.01 km/h steps
+  TEST_ASSERT_EQUAL_FLOAT(32.17, SensorSample::fromFixed(SensorSample::fixed(3217, 100)));
+  // 0.5 RPM steps are exact in binary
+  TEST_ASSERT_EQUAL_INT(88 << SensorSample::FRACTION_BITS, SensorSample::fixed(176, 2));
+  TEST_ASSERT_EQUAL_INT(-(3 << (SensorSample::FRACTION_BITS - 1)), SensorSample::toFixed(-1.5));
+}
+
+void TestSensorSample::decode__ftms_fields__expect_sample_in_one_pass(void) {
+  // Flags 0x0244: cadence, power, heart rate (speed is present because bit 0 is clear)
+  uint8_t data[] = {0x44, 0x02, 0x91, 0x0c, 0xb0, 0x00, 0x40, 0x00, 0x00};
+  FitnessMachineIndoorBikeData sensor;
+  sensor.decode(data, sizeof(data));
+  const SensorSample &sample = sensor.getSample();
+  TEST_ASSERT_EQUAL_INT(SensorSample::SPEED | SensorSample::CADENCE | SensorSample::POWER, sample.present);
+  TEST_ASSERT_EQUAL_INT(SensorSample::fixed(3217, 100), sample.speed);
+  TEST_ASSERT_EQUAL_FLOAT(88.0, sample.getCadence());
+  TEST_ASSERT_EQUAL_INT(64, sample.power);
+  // A zero heart rate means no monitor
+  TEST_ASSERT_FALSE(sample.has(SensorSample::HEART_RATE));
+}
+
+void TestSensorSample::decode__peloton_fields__expect_only_received_present(void) {
+  PelotonData sensor;
+  uint8_t cadence[] = {0xf1, PELOTON_CAD_ID, 0x02, 0x31, 0x35, 0x00};  // "51"
+  sensor.decode(cadence, sizeof(cadence));
+  TEST_ASSERT_TRUE(sensor.hasCadence());
+  TEST_ASSERT_EQUAL_FLOAT(51.0, sensor.getCadence());
+  TEST_ASSERT_FALSE(sensor.hasPower());
+  TEST_ASSERT_FALSE(sensor.hasResistance());
+
+  uint8_t resistance[] = {0xf1, PELOTON_RES_ID, 0x02, 0x36, 0x33, 0x00};  // "36"
+  sensor.decode(resistance, sizeof(resistance));
+  TEST_ASSERT_TRUE(sensor.hasResistance());
+  TEST_ASSERT_EQUAL_INT(36, sensor.getResistance());
+  // Cadence came in the previous packet, not this one.
+  TEST_ASSERT_FALSE(sensor.hasCadence());
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <vector>
+#include "Constants.h"
+#include "ErgControl.h"
+#include "SessionCapture.h"
+#include "hal/Fakes.h"
+#include "sensors/SensorDataFactory.h"
+#include "test.h"
+
+static const uint64_t POWER_METER = 0xc0ffee000001ULL;
+static const uint64_t HRM         = 0xc0ffee000002ULL;
+
+static void append(std::vector<uint8_t> &capture, const uint8_t *record, size_t length) { capture.insert(capture.end(), record, record + length); }
+
+static std::vector<uint8_t> newCapture() {
+  uint8_t header[SessionCapture::HEADER_SIZE];
+  std::vector<uint8_t> capture;
+  append(capture, header, SessionCapture::writeHeader(header, sizeof(header)));
+  return capture;
+}
+
+static void uuidBytes(NimBLEUUID uuid, uint8_t *out) { memcpy(out, uuid.to128().getNative()->u128.value, 16); }
+
+// What collectAndSet() keeps from a packet: the decoded values, as the device would record them in a STATE.
+static SessionCapture::State decode(SensorDataFactory &factory, const SessionCapture::Notification &notification, SessionCapture::State state) {
+  SensorData *data = factory.getSensorData(NimBLEUUID(notification.uuid, 16, false), notification.address, const_cast<uint8_t *>(notification.data), notification.length);
+  if (data->hasPower()) {
+    state.watts = data->getPower();
+  }
+  if (data->hasCadence()) {
+    state.cadence = (uint16_t)(data->getCadence() * 100);
+  }
+  if (data->hasHeartRate()) {
+    state.heartRate = data->getHeartRate();
+  }
+  return state;
+}
+
+class RecordingTarget : public SessionReplay::Target {
+ public:
+  explicit RecordingTarget(Clock &clock) : clock(clock) {}
+  void replay(const SessionCapture::Record &record) {
+    types.push_back(record.type);
+    times.push_back(clock.nowMs());
+  }
+  Clock &clock;
+  std::vector<uint8_t> types;
+  std::vector<uint32_t> times;
+};
+
+// Feeds notifications through the decoders and checks each against the STATE recorded after it.
+class DecodingTarget : public SessionReplay::Target {
+ public:
+  DecodingTarget() : mismatches(0), checked(0) { memset(&state, 0, sizeof(state)); }
+  void replay(const SessionCapture::Record &record) {
+    SessionCapture::Notification notification;
+    SessionCapture::State recorded;
+    if (SessionCapture::parseNotify(record, notification)) {
+      state = decode(factory, notification, state);
+    } else if (SessionCapture::parseState(record, recorded)) {
+      checked++;
+      if ((recorded.watts != state.watts) || (recorded.cadence != state.cadence) || (recorded.heartRate != state.heartRate)) {
+        mismatches++;
+      }
+    }
+  }
+  SensorDataFactory factory;
+  SessionCapture::State state;
+  uint32_t mismatches;
+  uint32_t checked;
+};
+
+// The maintenance loop cut down to what ERG needs: notifications through the decoders as collectAndSet() does, the
+// app's target out of control point writes as processFTMSWrite() does, and an ERG step every ERG_MODE_DELAY as
+// runERG() does. The power table has no answer yet and the knob is taken to be wherever it was last sent. Each STATE
+// is checked against the position.
+class ErgLoopTarget : public SessionReplay::Target {
+ public:
+  static const uint32_t ERG_MODE_DELAY  = 700;
+  static const uint16_t MIN_ERG_CADENCE = 30 * 100;
+  static constexpr float SENSITIVITY    = 5;
+
+  ErgLoopTarget() : newWatts(false), target(0), setPoint(0), position(0), ergTimer(0), steps(0), mismatches(0), checked(0) { memset(&state, 0, sizeof(state)); }
+  void replay(const SessionCapture::Record &record) {
+    SessionCapture::Notification notification;
+    SessionCapture::State recorded;
+    if (SessionCapture::parseNotify(record, notification)) {
+      state    = decode(factory, notification, state);
+      newWatts = true;
+    } else if (record.type == SessionCapture::CONTROL_POINT) {
+      if ((record.length > 0) && (record.payload[0] == ErgControl::SET_TARGET_POWER)) {
+        ErgControl::targetFromFtms(record.payload + 1, record.length - 1, &target);
+      }
+    } else if (SessionCapture::parseState(record, recorded)) {
+      checked++;
+      if (recorded.targetPosition != (int32_t)position) {
+        mismatches++;
+      }
+    }
+  }
+  void run(uint32_t nowMs) {
+    if ((int32_t)(nowMs - ergTimer) <= (int32_t)ERG_MODE_DELAY) {
+      return;
+    }
+    ergTimer = nowMs;
+    if ((target == 0) || (state.cadence <= MIN_ERG_CADENCE) || !newWatts) {
+      return;
+    }
+    newWatts = false;
+    if (abs(setPoint - target) > 20) {
+      position = ErgControl::setPointChange(position, state.watts, target, SENSITIVITY);
+      ergTimer += ERG_MODE_DELAY * 2;  // Wait for the power meter to see it
+    } else {
+      position = ErgControl::inSetpoint(position, state.watts, target, SENSITIVITY);
+    }
+    setPoint = target;
+    steps++;
+  }
+  SensorDataFactory factory;
+  SessionCapture::State state;
+  bool newWatts;
+  int target;
+  int setPoint;
+  float position;
+  uint32_t ergTimer;
+  uint32_t steps;
+  uint32_t mismatches;
+  uint32_t checked;
+};
+constexpr float ErgLoopTarget::SENSITIVITY;
+
+void TestSessionCapture::encode__each_record__expect_parsed_back(void) {
+  uint8_t buffer[SessionCapture::MAX_RECORD_SIZE];
+  SessionCapture::Record record;
+  TEST_ASSERT_EQUAL_INT(5, SessionCapture::writeHeader(buffer, sizeof(buffer)));
+  TEST_ASSERT_TRUE(SessionCapture::checkHeader(buffer, 5));
+  buffer[4]++;  // Newer version
+  TEST_ASSERT_FALSE(SessionCapture::checkHeader(buffer, 5));
+
+  uint8_t uuid[16];
+  uuidBytes(CYCLINGPOWERMEASUREMENT_UUID, uuid);
+  const uint8_t packet[] = {0x20, 0x00, 0x2d, 0x00, 0x02, 0x00, 0xb8, 0x12};
+  size_t length          = SessionCapture::encodeNotify(123456, POWER_METER, uuid, packet, sizeof(packet), buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(SessionCapture::RECORD_HEADER_SIZE + SessionCapture::NOTIFY_HEADER_SIZE + sizeof(packet), length);
+  TEST_ASSERT_TRUE(SessionCapture::parseRecordHeader(buffer, length, record));
+  TEST_ASSERT_EQUAL_INT(123456, record.timeMs);
+  SessionCapture::Notification notification;
+  TEST_ASSERT_TRUE(SessionCapture::parseNotify(record, notification));
+  TEST_ASSERT_TRUE(notification.address == POWER_METER);
+  TEST_ASSERT_TRUE(NimBLEUUID(notification.uuid, 16, false) == CYCLINGPOWERMEASUREMENT_UUID);
+  TEST_ASSERT_EQUAL_INT(sizeof(packet), notification.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(packet, notification.data, sizeof(packet));
+  TEST_ASSERT_EQUAL_INT(0, SessionCapture::encodeNotify(0, POWER_METER, uuid, packet, sizeof(packet), buffer, length - 1));  // Doesn't fit
+
+  const uint8_t setPower[] = {0x05, 0xc8, 0x00};
+  length                   = SessionCapture::encodeControlPoint(200, setPower, sizeof(setPower), buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(SessionCapture::parseRecordHeader(buffer, length, record));
+  TEST_ASSERT_EQUAL_INT(SessionCapture::CONTROL_POINT, record.type);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(setPower, record.payload, sizeof(setPower));
+  TEST_ASSERT_FALSE(SessionCapture::parseNotify(record, notification));
+
+  int8_t delta = 0;
+  length       = SessionCapture::encodeShift(300, -2, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(SessionCapture::parseRecordHeader(buffer, length, record));
+  TEST_ASSERT_TRUE(SessionCapture::parseShift(record, delta));
+  TEST_ASSERT_EQUAL_INT(-2, delta);
+
+  SessionCapture::State state = {-1, 9050, 140, 32, -40000, 123456};
+  SessionCapture::State parsed;
+  length = SessionCapture::encodeState(400, state, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(SessionCapture::parseRecordHeader(buffer, length, record));
+  TEST_ASSERT_TRUE(SessionCapture::parseState(record, parsed));
+  TEST_ASSERT_EQUAL_INT(-1, parsed.watts);
+  TEST_ASSERT_EQUAL_INT(9050, parsed.cadence);
+  TEST_ASSERT_EQUAL_INT(140, parsed.heartRate);
+  TEST_ASSERT_EQUAL_INT(32, parsed.resistance);
+  TEST_ASSERT_EQUAL_INT(-40000, parsed.targetPosition);
+  TEST_ASSERT_EQUAL_INT(123456, parsed.position);
+
+  buffer[0] = 0x7F;  // Unknown type
+  TEST_ASSERT_FALSE(SessionCapture::parseRecordHeader(buffer, length, record));
+}
+
+void TestSessionCapture::replay__virtual_clock__expect_records_on_time(void) {
+  uint8_t record[SessionCapture::MAX_RECORD_SIZE];
+  std::vector<uint8_t> capture = newCapture();
+  append(capture, record, SessionCapture::encodeShift(0, 1, record, sizeof(record)));
+  append(capture, record, SessionCapture::encodeShift(250, 1, record, sizeof(record)));
+  append(capture, record, SessionCapture::encodeShift(250, -1, record, sizeof(record)));
+  const uint8_t setPower[] = {0x05, 0xc8, 0x00};
+  append(capture, record, SessionCapture::encodeControlPoint(1000, setPower, sizeof(setPower), record, sizeof(record)));
+  // Power went off in the middle of the last record
+  size_t cut = SessionCapture::encodeShift(1500, 1, record, sizeof(record));
+  append(capture, record, cut - 1);
+
+  FakeClock clock;
+  clock.advanceMs(5000);  // Replays don't care when they start
+  RecordingTarget target(clock);
+  SessionReplay replay(&capture[0], capture.size());
+  TEST_ASSERT_TRUE(replay.isValid());
+  replay.start(clock.nowMs());
+  uint32_t wait;
+  while ((wait = replay.run(clock.nowMs(), target)) != SessionReplay::FINISHED) {
+    clock.advanceMs(wait);
+  }
+  TEST_ASSERT_EQUAL_INT(4, replay.getReplayed());
+  TEST_ASSERT_EQUAL_INT(5000, target.times[0]);
+  TEST_ASSERT_EQUAL_INT(5250, target.times[1]);
+  TEST_ASSERT_EQUAL_INT(5250, target.times[2]);
+  TEST_ASSERT_EQUAL_INT(6000, target.times[3]);
+  TEST_ASSERT_EQUAL_INT(SessionCapture::CONTROL_POINT, target.types[3]);
+
+  capture[0] = 'X';
+  SessionReplay corrupt(&capture[0], capture.size());
+  TEST_ASSERT_FALSE(corrupt.isValid());
+  corrupt.start(0);
+  TEST_ASSERT_EQUAL_INT(SessionReplay::FINISHED, corrupt.run(100000, target));
+}
+
+void TestSessionCapture::replay__recorded_ride__expect_same_decoded_outputs(void) {
+  // An hour of a power meter with crank data at 4Hz and a heart rate strap at 1Hz, recorded the way the device does:
+  // each notification, then the state the firmware decoded from it.
+  uint8_t powerUuid[16];
+  uint8_t heartUuid[16];
+  uuidBytes(CYCLINGPOWERMEASUREMENT_UUID, powerUuid);
+  uuidBytes(HEARTCHARACTERISTIC_UUID, heartUuid);
+  SensorDataFactory deviceFactory;
+  SessionCapture::State state;
+  memset(&state, 0, sizeof(state));
+  uint8_t record[SessionCapture::MAX_RECORD_SIZE];
+  std::vector<uint8_t> capture = newCapture();
+  SessionCapture::Notification notification;
+  SessionCapture::Record parsed;
+  for (uint32_t t = 0; t < 3600000; t += 250) {
+    uint16_t power    = 150 + (t / 1000) % 100;
+    uint16_t revs     = (uint16_t)(t * 3 / 2000);  // 90rpm
+    uint16_t lastRev  = (uint16_t)((uint64_t)revs * 2000 / 3 * 1024 / 1000);
+    uint8_t packet[8] = {0x20, 0x00, (uint8_t)power, (uint8_t)(power >> 8), (uint8_t)revs, (uint8_t)(revs >> 8), (uint8_t)lastRev, (uint8_t)(lastRev >> 8)};
+    size_t length     = SessionCapture::encodeNotify(t, POWER_METER, powerUuid, packet, sizeof(packet), record, sizeof(record));
+    append(capture, record, length);
+    SessionCapture::parseRecordHeader(record, length, parsed);
+    SessionCapture::parseNotify(parsed, notification);
+    state = decode(deviceFactory, notification, state);
+    append(capture, record, SessionCapture::encodeState(t, state, record, sizeof(record)));
+
+    if ((t % 1000) == 0) {
+      uint8_t heart[2] = {0x00, (uint8_t)(120 + (t / 60000))};
+      length           = SessionCapture::encodeNotify(t, HRM, heartUuid, heart, sizeof(heart), record, sizeof(record));
+      append(capture, record, length);
+      SessionCapture::parseRecordHeader(record, length, parsed);
+      SessionCapture::parseNotify(parsed, notification);
+      state = decode(deviceFactory, notification, state);
+      append(capture, record, SessionCapture::encodeState(t, state, record, sizeof(record)));
+    }
+  }
+  TEST_ASSERT_TRUE(state.cadence > 8900);
+
+  // Replayed on a virtual clock with the maintenance loop's 5ms tick
+  FakeClock clock;
+  DecodingTarget target;
+  SessionReplay replay(&capture[0], capture.size());
+  replay.start(clock.nowMs());
+  while (replay.run(clock.nowMs(), target) != SessionReplay::FINISHED) {
+    clock.advanceMs(5);
+  }
+  TEST_ASSERT_EQUAL_INT(18000, target.checked);
+  TEST_ASSERT_EQUAL_INT(0, target.mismatches);
+}
+
+void TestSessionCapture::replay__erg_ride__expect_knob_chases_target(void) {
+  // A power meter at 90rpm and 150w until the knob has done its work at 6s, then 200w. The app takes control and asks
+  // for 200w at 1s. STATEs record where the knob was sent by then.
+  uint8_t powerUuid[16];
+  uuidBytes(CYCLINGPOWERMEASUREMENT_UUID, powerUuid);
+  uint8_t record[SessionCapture::MAX_RECORD_SIZE];
+  std::vector<uint8_t> capture = newCapture();
+  const uint8_t requestControl[] = {0x00};
+  const uint8_t targetPower[]    = {ErgControl::SET_TARGET_POWER, 0xc8, 0x00};
+  const uint32_t stateTimes[]    = {1300, 1500, 3600, 5700, 9000};
+  const int32_t statePositions[] = {0, 500, 750, 1500, 1500};
+  size_t nextState               = 0;
+  for (uint32_t t = 0; t < 10000; t += 50) {
+    if (t == 0) {
+      append(capture, record, SessionCapture::encodeControlPoint(t, requestControl, sizeof(requestControl), record, sizeof(record)));
+    }
+    if (t == 1000) {
+      append(capture, record, SessionCapture::encodeControlPoint(t, targetPower, sizeof(targetPower), record, sizeof(record)));
+    }
+    if ((t % 250) == 0) {
+      uint16_t power    = (t < 6000) ? 150 : 200;
+      uint16_t revs     = (uint16_t)(t * 3 / 2000);
+      uint16_t lastRev  = (uint16_t)((uint64_t)revs * 2000 / 3 * 1024 / 1000);
+      uint8_t packet[8] = {0x20, 0x00, (uint8_t)power, (uint8_t)(power >> 8), (uint8_t)revs, (uint8_t)(revs >> 8), (uint8_t)lastRev, (uint8_t)(lastRev >> 8)};
+      append(capture, record, SessionCapture::encodeNotify(t, POWER_METER, powerUuid, packet, sizeof(packet), record, sizeof(record)));
+    }
+    while ((nextState < 5) && (stateTimes[nextState] <= t + 50) && (stateTimes[nextState] > t)) {
+      SessionCapture::State state;
+      memset(&state, 0, sizeof(state));
+      state.targetPosition = statePositions[nextState];
+      append(capture, record, SessionCapture::encodeState(stateTimes[nextState++], state, record, sizeof(record)));
+    }
+  }
+
+  // The loop's 5ms tick: replay what's due, then ERG
+  FakeClock clock;
+  ErgLoopTarget target;
+  SessionReplay replay(&capture[0], capture.size());
+  replay.start(clock.nowMs());
+  while (replay.run(clock.nowMs(), target) != SessionReplay::FINISHED) {
+    target.run(clock.nowMs());
+    clock.advanceMs(5);
+  }
+  TEST_ASSERT_EQUAL_INT(200, target.target);
+  TEST_ASSERT_EQUAL_INT(5, target.checked);
+  TEST_ASSERT_EQUAL_INT(0, target.mismatches);
+  TEST_ASSERT_EQUAL_FLOAT(1500, target.position);
+  // 1.41s, then every 705ms from 3.515s
+  TEST_ASSERT_EQUAL_INT(10, target.steps);
+}
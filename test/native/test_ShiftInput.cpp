@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "ShiftInput.h"
+#include "test.h"
+
+static const uint32_t DEBOUNCE_US = 20000;
+
+static void edge(ShiftGestures &gestures, uint32_t timeUs, uint8_t button, bool pressed) {
+  ShiftQueue::Event event = {timeUs, button, pressed};
+  gestures.onEdge(event);
+}
+
+static void expectGesture(ShiftGestures &gestures, ShiftGestures::Type type, uint8_t button, uint32_t timeUs) {
+  ShiftGestures::Gesture gesture;
+  TEST_ASSERT_TRUE(gestures.next(gesture));
+  TEST_ASSERT_EQUAL_INT(type, gesture.type);
+  TEST_ASSERT_EQUAL_INT(button, gesture.button);
+  TEST_ASSERT_EQUAL_INT(timeUs, gesture.timeUs);
+}
+
+void TestShiftInput::queue__overfilled__expect_order_kept_and_drops_counted(void) {
+  ShiftQueue queue;
+  ShiftQueue::Event event;
+  TEST_ASSERT_FALSE(queue.pop(event));
+  // Twice round the ring
+  for (uint32_t round = 0; round < 2; round++) {
+    for (uint32_t i = 0; i < ShiftQueue::CAPACITY + 3; i++) {
+      ShiftQueue::Event pushed = {i, ShiftGestures::UP, (i % 2) == 0};
+      TEST_ASSERT_EQUAL(i < ShiftQueue::CAPACITY, queue.push(pushed));
+    }
+    for (uint32_t i = 0; i < ShiftQueue::CAPACITY; i++) {
+      TEST_ASSERT_TRUE(queue.pop(event));
+      TEST_ASSERT_EQUAL_INT(i, event.timeUs);
+      TEST_ASSERT_EQUAL((i % 2) == 0, event.pressed);
+    }
+    TEST_ASSERT_FALSE(queue.pop(event));
+  }
+  TEST_ASSERT_EQUAL_INT(6, queue.getDropped());
+}
+
+void TestShiftInput::gestures__rapid_presses_and_noise__expect_every_press(void) {
+  ShiftGestures gestures(DEBOUNCE_US);
+  // Five quick presses, all queued before the loop gets to them, the first one bouncing
+  edge(gestures, 0, ShiftGestures::UP, true);
+  edge(gestures, 2000, ShiftGestures::UP, false);
+  edge(gestures, 3000, ShiftGestures::UP, true);
+  edge(gestures, 50000, ShiftGestures::UP, false);
+  for (uint32_t t = 100000; t < 500000; t += 100000) {
+    edge(gestures, t, ShiftGestures::UP, true);
+    edge(gestures, t + 40000, ShiftGestures::UP, false);
+  }
+  gestures.poll(1000000);
+  // Pairs of presses within DOUBLE_TAP_US are double taps
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::UP, 3000);
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::UP, 100000);
+  expectGesture(gestures, ShiftGestures::DoubleTap, ShiftGestures::UP, 100000);
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::UP, 200000);
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::UP, 300000);
+  expectGesture(gestures, ShiftGestures::DoubleTap, ShiftGestures::UP, 300000);
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::UP, 400000);
+  ShiftGestures::Gesture gesture;
+  TEST_ASSERT_FALSE(gestures.next(gesture));
+
+  // A spike shorter than the debounce is not a press
+  edge(gestures, 2000000, ShiftGestures::DOWN, true);
+  edge(gestures, 2005000, ShiftGestures::DOWN, false);
+  gestures.poll(2100000);
+  TEST_ASSERT_FALSE(gestures.next(gesture));
+  TEST_ASSERT_FALSE(gestures.isPressed(ShiftGestures::DOWN));
+  TEST_ASSERT_EQUAL_INT(5, gestures.getCounters().shifts);
+  TEST_ASSERT_EQUAL_INT(2, gestures.getCounters().bounces);
+}
+
+void TestShiftInput::gestures__held__expect_one_hold(void) {
+  ShiftGestures gestures(DEBOUNCE_US);
+  edge(gestures, 0, ShiftGestures::DOWN, true);
+  gestures.poll(10000);
+  ShiftGestures::Gesture gesture;
+  TEST_ASSERT_FALSE(gestures.next(gesture));  // Not settled yet
+  gestures.poll(1000000);
+  TEST_ASSERT_TRUE(gestures.isPressed(ShiftGestures::DOWN));
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::DOWN, 0);
+  expectGesture(gestures, ShiftGestures::Hold, ShiftGestures::DOWN, ShiftGestures::HOLD_US);
+  TEST_ASSERT_FALSE(gestures.next(gesture));  // No repeats however long it's held
+  gestures.poll(3000000);
+  TEST_ASSERT_FALSE(gestures.next(gesture));
+  edge(gestures, 3100000, ShiftGestures::DOWN, false);
+  gestures.poll(3200000);
+  TEST_ASSERT_FALSE(gestures.next(gesture));
+  TEST_ASSERT_FALSE(gestures.isPressed(ShiftGestures::DOWN));
+
+  // Released at 0.55s but seen late: too short for a hold, however late the loop notices
+  edge(gestures, 5000000, ShiftGestures::DOWN, true);
+  edge(gestures, 5550000, ShiftGestures::DOWN, false);
+  gestures.poll(7000000);
+  expectGesture(gestures, ShiftGestures::Shift, ShiftGestures::DOWN, 5000000);
+  TEST_ASSERT_FALSE(gestures.next(gesture));
+  TEST_ASSERT_EQUAL_INT(2, gestures.getCounters().shifts);
+  TEST_ASSERT_EQUAL_INT(1, gestures.getCounters().holds);
+}
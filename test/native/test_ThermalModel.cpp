@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include "ThermalModel.h"
+#include "test.h"
+
+void TestThermalModel::observe__steady_current__expect_first_order_rise(void) {
+  ThermalModel model;
+  model.measure(30);
+  // 1A RMS moving the whole time settles at RISE_PER_A2 above ambient
+  model.observe(ThermalModel::TAU_MS, 1000, 50, false, 1.0f, 1.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, ThermalModel::RISE_PER_A2 * 0.632f, model.getRise());
+  model.observe(ThermalModel::TAU_MS * 10, 1000, 50, false, 1.0f, 1.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, ThermalModel::RISE_PER_A2, model.getRise());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, model.getDuty());
+
+  // Outputs off: cools back down
+  model.observe(ThermalModel::TAU_MS * 10, 1000, 50, false, 0, 0);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 0, model.getRise());
+
+  // Holding at half current, still: a quarter of the heat
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.25f, ThermalModel::meanSquare(1000, 50, false, 0, 1.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.7f, ThermalModel::meanSquare(1000, 50, true, 1.0f, 1.0f));
+}
+
+void TestThermalModel::measure__sensor_readings__expect_ambient_tracked(void) {
+  ThermalModel model;
+  model.observe(ThermalModel::TAU_MS * 10, 1000, 50, false, 1.0f, 1.0f);
+  model.measure(70);  // 40 of that is the modelled rise
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 30, model.getAmbient());
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 70, model.getTemperature());
+  for (int i = 0; i < 200; i++) {
+    model.measure(75);  // The room warmed up
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 35, model.getAmbient());
+}
+
+void TestThermalModel::schedule__heating_up__expect_cheapest_fix_first(void) {
+  ThermalModel model;
+  model.measure(50);  // A warm enclosure with the driver cold
+  ThermalModel::Plan plan = model.schedule(90, 1300, false);
+  TEST_ASSERT_EQUAL_INT(ThermalModel::Normal, plan.level);
+  TEST_ASSERT_EQUAL_INT(ThermalModel::HOLD_PERCENT, plan.holdPercent);
+
+  // An hour of intervals with the knob moving more and more, applying each plan the way the firmware does
+  int highest = ThermalModel::Normal;
+  for (int i = 0; i < 360; i++) {
+    model.observe(10000, plan.runCurrent, plan.holdPercent, plan.stealthChop, 0.1f + 0.8f * i / 360, 1.0f);
+    plan = model.schedule(90, 1300, false);
+    TEST_ASSERT_TRUE((plan.level == highest) || (plan.level == highest + 1));  // In order, without flapping
+    highest = plan.level;
+  }
+  TEST_ASSERT_EQUAL_INT(ThermalModel::Throttled, plan.level);
+  TEST_ASSERT_EQUAL_INT(ThermalModel::LOW_HOLD_PERCENT, plan.holdPercent);
+  TEST_ASSERT_TRUE(plan.stealthChop);
+  TEST_ASSERT_TRUE((plan.runCurrent < 1300) && (plan.runCurrent > 1150));  // Trimmed, not halved
+  // Kept right at the ceiling instead of over the limit
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 85, model.predict(ThermalModel::HORIZON_MS, plan.runCurrent, plan.holdPercent, true));
+  TEST_ASSERT_TRUE(model.getTemperature() < 90);
+
+  // Resting cools it back to normal
+  for (int i = 0; i < 360; i++) {
+    model.observe(10000, plan.runCurrent, plan.holdPercent, plan.stealthChop, 0, 0);
+    plan = model.schedule(90, 1300, false);
+  }
+  TEST_ASSERT_EQUAL_INT(ThermalModel::Normal, plan.level);
+  TEST_ASSERT_EQUAL_INT(1300, plan.runCurrent);
+}
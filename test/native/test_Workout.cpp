@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020  Anthony Doud & Joel Baranick
+ * All rights reserved
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "sdkconfig.h"
+#include <unity.h>
+#include <string.h>
+#include "Workout.h"
+#include "test.h"
+
+// Ramp from 50% to 75% FTP over 5 minutes, 2 minutes at 250 W, 1 minute at 120% FTP
+static const uint8_t threeSteps[] = {
+    'W',  'K',  0x01, 0x03, 0x00, 0x00,                // header, rider's FTP
+    0x01, 0x01, 0x2c, 0x01, 0xf4, 0x01, 0xee, 0x02,    // ramp, FTP relative, 300 s, 500, 750
+    0x00, 0x00, 0x78, 0x00, 0xfa, 0x00, 0x00, 0x00,    // steady, watts, 120 s, 250
+    0x00, 0x01, 0x3c, 0x00, 0xb0, 0x04, 0x00, 0x00,    // steady, FTP relative, 60 s, 1200
+};
+
+void TestWorkout::load__golden_file__expect_targets(void) {
+  Workout workout;
+  TEST_ASSERT_TRUE(workout.load(threeSteps, sizeof(threeSteps)));
+  TEST_ASSERT_EQUAL_INT(Workout::Ready, workout.getState());
+  TEST_ASSERT_EQUAL_INT(3, workout.getStepCount());
+  TEST_ASSERT_EQUAL_INT(480000, workout.getDuration());
+
+  TEST_ASSERT_EQUAL_INT(100, workout.targetAt(0, 200));
+  TEST_ASSERT_EQUAL_INT(125, workout.targetAt(150000, 200));
+  TEST_ASSERT_EQUAL_INT(149, workout.targetAt(299999, 200));
+  TEST_ASSERT_EQUAL_INT(250, workout.targetAt(300000, 200));
+  TEST_ASSERT_EQUAL_INT(240, workout.targetAt(420000, 200));
+  TEST_ASSERT_EQUAL_INT(0, workout.targetAt(480000, 200));
+  TEST_ASSERT_EQUAL_INT(1, workout.getStepAt(419999));
+  TEST_ASSERT_EQUAL_INT(2, workout.getStepAt(420000));
+
+  // An FTP in the file wins over the rider's
+  uint8_t withFtp[sizeof(threeSteps)];
+  memcpy(withFtp, threeSteps, sizeof(threeSteps));
+  withFtp[4] = 0x2c;  // 300 W
+  withFtp[5] = 0x01;
+  TEST_ASSERT_TRUE(workout.load(withFtp, sizeof(withFtp)));
+  TEST_ASSERT_EQUAL_INT(360, workout.targetAt(420000, 200));
+}
+
+void TestWorkout::load__malformed__expect_rejected(void) {
+  Workout workout;
+  uint8_t file[sizeof(threeSteps)];
+
+  const size_t corrupt[] = {0, 2, 3, 6, 16};  // Magic, version, count, type, duration
+  const uint8_t values[] = {'X', 2, 4, 7, 0};
+  for (size_t i = 0; i < sizeof(corrupt) / sizeof(corrupt[0]); i++) {
+    memcpy(file, threeSteps, sizeof(threeSteps));
+    file[corrupt[i]] = values[i];
+    TEST_ASSERT_FALSE(workout.load(file, sizeof(file)));
+    TEST_ASSERT_EQUAL_INT(Workout::Empty, workout.getState());
+  }
+  TEST_ASSERT_FALSE(workout.load(threeSteps, sizeof(threeSteps) - 1));
+  TEST_ASSERT_FALSE(workout.load(threeSteps, 4));
+  memcpy(file, threeSteps, Workout::HEADER_SIZE);
+  file[3] = 0;
+  TEST_ASSERT_FALSE(workout.load(file, Workout::HEADER_SIZE));
+
+  // Nothing to start
+  workout.start(0);
+  TEST_ASSERT_EQUAL_INT(Workout::Empty, workout.getState());
+}
+
+void TestWorkout::update__run_and_pause__expect_changes_on_time(void) {
+  Workout workout;
+  workout.load(threeSteps, sizeof(threeSteps));
+  const uint32_t begin = 0xFFFF0000;  // Straddles a millis() wrap
+  workout.start(begin);
+
+  // Drive it the way the runner task does: sleep until nextUpdate(), then update()
+  uint32_t now     = begin;
+  uint16_t watts   = 0;
+  int changes      = 0;
+  bool paused      = false;
+  uint32_t stepTwo = 0;
+  while (true) {
+    if (workout.update(now, 200, &watts)) {
+      changes++;
+      if ((watts == 250) && (stepTwo == 0)) {
+        stepTwo = now;
+      }
+    }
+    if (workout.getState() == Workout::Finished) {
+      break;
+    }
+    // A 30 s pause in the middle of the second step
+    if (!paused && (workout.getElapsed(now) >= 360000)) {
+      workout.pause(now);
+      TEST_ASSERT_EQUAL_UINT32(1000, workout.nextUpdate(now, 200, 1000));
+      TEST_ASSERT_FALSE(workout.update(now + 30000, 200, &watts));
+      now += 30000;
+      workout.resume(now);
+      paused = true;
+      continue;
+    }
+    uint32_t wait = workout.nextUpdate(now, 200, 1000);
+    TEST_ASSERT_TRUE((wait > 0) && (wait <= 1000));
+    now += wait;
+  }
+
+  // 100 to 149 W up the ramp, step two, the resend after resuming, step three
+  TEST_ASSERT_EQUAL_INT(53, changes);
+  TEST_ASSERT_EQUAL_UINT32(begin + 300000, stepTwo);
+  TEST_ASSERT_EQUAL_UINT32(begin + 480000 + 30000, now);
+  TEST_ASSERT_EQUAL_INT(480000, workout.getElapsed(now));
+}
+
+void TestWorkout::nextBoundary__steady_steps__expect_jump_announced(void) {
+  Workout workout;
+  workout.load(threeSteps, sizeof(threeSteps));
+  uint32_t inMs;
+  uint16_t watts;
+  TEST_ASSERT_FALSE(workout.nextBoundary(0, 200, &inMs, &watts));  // Not running
+
+  workout.start(1000);
+  // The ramp ends at 150 W and the next step is 250 W, so that boundary is a jump
+  TEST_ASSERT_TRUE(workout.nextBoundary(1000 + 10000, 200, &inMs, &watts));
+  TEST_ASSERT_EQUAL_UINT32(290000, inMs);
+  TEST_ASSERT_EQUAL_INT(250, watts);
+
+  TEST_ASSERT_TRUE(workout.nextBoundary(1000 + 400000, 200, &inMs, &watts));
+  TEST_ASSERT_EQUAL_UINT32(20000, inMs);
+  TEST_ASSERT_EQUAL_INT(240, watts);
+
+  // Nothing after the last step
+  TEST_ASSERT_FALSE(workout.nextBoundary(1000 + 430000, 200, &inMs, &watts));
+}